@@ -0,0 +1,131 @@
+#include <search_kernel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+
+/* The size of the data to search */
+#define SIZE (64 * 1024 * 1024)
+
+/* How many times to search the data for each pattern */
+#define ROUNDS 4
+
+typedef ssize_t (search_func)(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length, void *ctx);
+
+struct kernel_ctx {
+	search_kernel_func *kernel;
+};
+
+static ssize_t search_with_kernel(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length, void *ctx)
+{
+	struct kernel_ctx *kctx = ctx;
+
+	return (*kctx->kernel)(data, len, pattern, length);
+}
+
+static ssize_t search_with_bmh(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length, void *ctx)
+{
+	struct search_bmh *bmh = ctx;
+
+	(void)pattern;
+	(void)length;
+
+	return search_bmh_find(bmh, data, len);
+}
+
+/* Returns the time (in seconds) it takes to search the data */
+double time_search(search_func *func, void *ctx, const unsigned char *data,
+		size_t len, const unsigned char *pattern, size_t length)
+{
+	clock_t start = clock();
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		/* The pattern is only found at the end of the data */
+		ssize_t idx = (*func)(data, len, pattern, length, ctx);
+		if (idx != (ssize_t)(len - length)) {
+			fprintf(stderr, "Wrong search result: %ld\n", (long)idx);
+			exit(1);
+		}
+	}
+
+	clock_t end = clock();
+
+	return (double) (end - start) / CLOCKS_PER_SEC / ROUNDS;
+}
+
+int main(void)
+{
+	size_t lengths[] = {1, 2, 3, 4, 8, 16, 32, 64, 128, 256};
+	size_t i;
+
+	/* 
+	 * Create text-like data (a small alphabet), where the first and last
+	 * bytes of patterns occur often.
+	 */
+	unsigned char *data = malloc(SIZE);
+	if (data == NULL)
+		return 1;
+
+	srand(0);
+	for (i = 0; i < SIZE; i++)
+		data[i] = 'a' + rand() % 16;
+
+	printf("%8s %10s %10s %10s %10s (MiB/s)\n", "length", "bmh", "scalar",
+			"sse2", "avx2");
+
+	for (i = 0; i < sizeof(lengths) / sizeof(*lengths); i++) {
+		size_t length = lengths[i];
+
+		/* 
+		 * Put a pattern that doesn't occur elsewhere at the end of the data.
+		 * Its first and last bytes are common in the data, which is the
+		 * worst case for the first/last byte filter of the kernels (and for
+		 * memchr in the scalar kernel).
+		 */
+		unsigned char *pattern = data + SIZE - length;
+		memset(pattern, 'z', length);
+		if (length > 1)
+			pattern[0] = 'a';
+		if (length > 2)
+			pattern[length - 1] = 'b';
+
+		struct search_bmh bmh;
+		search_bmh_init(&bmh, pattern, length);
+
+		double mib = (double)SIZE / (1024 * 1024);
+
+		printf("%8lu %10.0f", (unsigned long)length,
+				mib / time_search(search_with_bmh, &bmh, data, SIZE,
+					pattern, length));
+
+		enum search_kernel_impl impls[] = {SEARCH_KERNEL_SCALAR,
+			SEARCH_KERNEL_SSE2, SEARCH_KERNEL_AVX2};
+		size_t j;
+
+		for (j = 0; j < sizeof(impls) / sizeof(*impls); j++) {
+			struct kernel_ctx kctx;
+			kctx.kernel = search_kernel_get(impls[j]);
+
+			if (kctx.kernel == NULL)
+				printf(" %10s", "n/a");
+			else
+				printf(" %10.0f", mib / time_search(search_with_kernel,
+							&kctx, data, SIZE, pattern, length));
+		}
+
+		printf("\n");
+
+		/* Restore the data */
+		size_t k;
+		for (k = SIZE - length; k < SIZE; k++)
+			data[k] = 'a' + rand() % 16;
+	}
+
+	free(data);
+
+	return 0;
+}
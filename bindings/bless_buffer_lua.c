@@ -665,6 +665,20 @@ LUALIB_API int LUAOPEN_BLESS_BUFFER(LIBBLS_VERSION_MAJOR, LIBBLS_VERSION_MINOR)(
 	lua_setfield(L, -2, "UNDO_LIMIT");
 	lua_pushinteger(L, BLESS_BUF_UNDO_AFTER_SAVE);
 	lua_setfield(L, -2, "UNDO_AFTER_SAVE");
+	lua_pushinteger(L, BLESS_BUF_SEGCOL_IMPL);
+	lua_setfield(L, -2, "SEGCOL_IMPL");
+	lua_pushinteger(L, BLESS_BUF_FILE_WINDOW_SIZE);
+	lua_setfield(L, -2, "FILE_WINDOW_SIZE");
+	lua_pushinteger(L, BLESS_BUF_FILE_WINDOWS);
+	lua_setfield(L, -2, "FILE_WINDOWS");
+	lua_pushinteger(L, BLESS_BUF_FILE_BACKEND);
+	lua_setfield(L, -2, "FILE_BACKEND");
+	lua_pushinteger(L, BLESS_BUF_FIND_THREADS);
+	lua_setfield(L, -2, "FIND_THREADS");
+	lua_pushinteger(L, BLESS_BUF_SAVE_CYCLES);
+	lua_setfield(L, -2, "SAVE_CYCLES");
+	lua_pushinteger(L, BLESS_BUF_SAVE_BATCH_SIZE);
+	lua_setfield(L, -2, "SAVE_BATCH_SIZE");
 	
 	/* bless.buffer = buffer table */
 	lua_pushliteral(L, "buffer");
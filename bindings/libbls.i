@@ -8,6 +8,8 @@
 #include "segment.h"
 #include "segcol.h"
 #include "segcol_list.h"
+#include "segcol_tree.h"
+#include "segcol_btree.h"
 #include "data_object.h"
 #include "data_object_memory.h"
 #include "data_object_file.h"
@@ -21,6 +23,7 @@
 #include "util.h"
 #include "buffer_action.h"
 #include "buffer_action_edit.h"
+#include "search_kernel.h"
 %}
 
 %pointer_class (size_t, size_tp)
@@ -29,6 +32,7 @@
 %apply long long { ssize_t };
 %apply unsigned long long { size_t };
 %apply long long { off_t };
+%apply long long { int64_t };
 
 /* Don't perform any conversions on void pointers */
 %typemap(in) void *
@@ -71,6 +75,9 @@
 %apply segment_t ** { bless_buffer_t **, bless_buffer_source_t ** }
 %apply segment_t ** { priority_queue_t **, overlap_graph_t **, disjoint_set_t ** }
 %apply segment_t ** { list_t **, char **, buffer_action_t **}
+%apply segment_t ** { bless_buffer_extents_t **, const struct iovec ** }
+%apply segment_t ** { bless_pattern_set_t **, bless_regex_t ** }
+%apply segment_t ** { struct write_batch ** }
 
 
 /* Exception for void **: Append void * to return list without conversion */
@@ -153,6 +160,28 @@ void *get_read_buf_pyobj_copy(PyObject *obj, ssize_t *size)
     return data_copy;
 }
 
+/* Gets a read pointer to the first segment of raw data of a PyBuffer */
+void *get_read_buf_pyobj(PyObject *obj, ssize_t *size)
+{
+    PyTypeObject *tobj = obj->ob_type;
+
+    PyBufferProcs *procs = tobj->tp_as_buffer;
+
+    /* if object does not support the buffer interface... */
+    if (procs == NULL) {
+        *size = -1;
+        return NULL;
+    }
+
+    readbufferproc proc = procs->bf_getreadbuffer;
+
+    void *ptr;
+
+    *size = (*proc)(obj, 0, &ptr);
+
+    return ptr;
+}
+
 /* Gets a write pointer to the first segment of raw data of a PyBuffer */
 void *get_write_buf_pyobj(PyObject *obj, ssize_t *size)
 {
@@ -224,6 +253,158 @@ void *get_write_buf_pyobj(PyObject *obj, ssize_t *size)
         result = 666;
 }
 
+/* 
+ * Make the bless_buffer_find() binding accept as data input objects that
+ * support the PyBuffer interface.
+ */
+%exception bless_buffer_find
+{
+    ssize_t s;
+
+    arg4 = get_read_buf_pyobj(obj2, &s);
+
+    if (s != -1 && s >= arg5) {
+        $action
+    }
+    else
+        result = 666;
+}
+
+/* 
+ * Make the bless_buffer_rfind() binding accept as data input objects that
+ * support the PyBuffer interface.
+ */
+%exception bless_buffer_rfind
+{
+    ssize_t s;
+
+    arg4 = get_read_buf_pyobj(obj2, &s);
+
+    if (s != -1 && s >= arg5) {
+        $action
+    }
+
+/* 
+ * Make the bless_buffer_replace_all() binding accept as data input objects
+ * that support the PyBuffer interface.
+ */
+%exception bless_buffer_replace_all
+{
+    ssize_t s;
+
+    arg4 = get_read_buf_pyobj(obj3, &s);
+
+    if (s != -1 && s >= arg5) {
+        $action
+    }
+    else
+        result = 666;
+}
+    else
+        result = 666;
+}
+
+/* 
+ * Make the bless_buffer_find_masked() binding accept as data and mask input
+ * objects that support the PyBuffer interface.
+ */
+%exception bless_buffer_find_masked
+{
+    ssize_t s;
+    ssize_t ms;
+
+    arg4 = get_read_buf_pyobj(obj2, &s);
+    arg5 = get_read_buf_pyobj(obj3, &ms);
+
+    if (s != -1 && s >= arg6 && ms != -1 && ms >= arg6) {
+        $action
+    }
+    else
+        result = 666;
+}
+
+/* 
+ * Make the bless_pattern_set_add() binding accept as data input objects that
+ * support the PyBuffer interface.
+ */
+%exception bless_pattern_set_add
+{
+    ssize_t s;
+
+    arg2 = get_read_buf_pyobj(obj1, &s);
+
+    if (s != -1 && s >= arg3) {
+        $action
+    }
+    else
+        result = 666;
+}
+
+/* 
+ * Make the bless_regex_new() binding accept as pattern input objects that
+ * support the PyBuffer interface.
+ */
+%exception bless_regex_new
+{
+    ssize_t s;
+
+    arg2 = get_read_buf_pyobj(obj0, &s);
+
+    if (s != -1 && s >= arg3) {
+        $action
+    }
+    else
+        result = 666;
+}
+
+%{
+/* A bless_buffer_match_func that prints the matches to a FILE * */
+int print_match(off_t offset, off_t length, int id, void *user_data)
+{
+    fprintf((FILE *)user_data, "%lld %lld %d\n", (long long)offset,
+            (long long)length, id);
+
+    return 0;
+}
+
+/* Where print_limited_match prints to and how many matches it accepts */
+struct print_match_limit {
+    FILE *fp;
+    int left;
+};
+
+/*
+ * A bless_buffer_match_func that prints the matches to a FILE * and stops
+ * the search after a number of matches (if it is positive).
+ */
+int print_limited_match(off_t offset, off_t length, int id, void *user_data)
+{
+    struct print_match_limit *limit = user_data;
+
+    print_match(offset, length, id, limit->fp);
+
+    return limit->left > 0 && --limit->left == 0;
+}
+
+/*
+ * Copies data to a memory area that starts align bytes after a 64-byte
+ * boundary and ends at the end of an allocated block, so that reading past
+ * the data can be detected.
+ */
+static int copy_aligned(char *data, size_t len, size_t align, void **block,
+        unsigned char **p)
+{
+    int err = posix_memalign(block, 64, align + len);
+    if (err)
+        return err;
+
+    *p = (unsigned char *)*block + align;
+    memcpy(*p, data, len);
+
+    return 0;
+}
+%}
+
 /*
  * Typemaps that handle output arguments.
  */
@@ -232,6 +413,8 @@ void *get_write_buf_pyobj(PyObject *obj, ssize_t *size)
 %apply long long *OUTPUT { off_t * };
 %apply unsigned long long *OUTPUT { size_t * };
 %apply unsigned long long *OUTPUT { uint64_t * };
+%apply int *OUTPUT { data_object_file_backend * };
+%apply long long *OUTPUT { ssize_t * };
 
 /* in priority_queue_add size_t *pos is a normal pointer (not output) */
 %apply SWIGTYPE * { size_t *pos };
@@ -342,6 +525,134 @@ void print_edge_list(list_t *edges, int fd)
     fclose(fp);
 }
 
+/* 
+ * Searches a buffer for the patterns of a set and prints the matches, one
+ * per line, as "offset length id".
+ */
+int print_find_multi_matches(bless_buffer_t *buf, bless_pattern_set_t *set,
+        off_t start_offset, int fd)
+{
+    FILE *fp = fdopen(fd, "w");
+
+    int err = bless_buffer_find_multi(buf, set, start_offset, print_match, fp,
+            NULL);
+
+    fclose(fp);
+
+    return err;
+}
+
+/* 
+ * Searches a range of a buffer for the matches of a regex and prints them,
+ * one per line, as "offset length id".
+ */
+int print_find_regex_matches(bless_buffer_t *buf, bless_regex_t *regex,
+        off_t start_offset, off_t end_offset, int fd)
+{
+    FILE *fp = fdopen(fd, "w");
+
+    int err = bless_buffer_find_regex(buf, regex, start_offset, end_offset,
+            print_match, fp, NULL);
+
+    fclose(fp);
+
+    return err;
+}
+
+/* 
+ * Searches a range of a buffer for all the occurrences of some data and
+ * prints at most max_matches of them (all if max_matches is not positive), one
+ * per line, as "offset length id".
+ */
+int print_find_all_matches(bless_buffer_t *buf, off_t start_offset,
+        off_t end_offset, char *data, size_t length, int flags,
+        int max_matches, int fd)
+{
+    struct print_match_limit limit;
+    limit.fp = fdopen(fd, "w");
+    limit.left = max_matches;
+
+    int err = bless_buffer_find_all(buf, start_offset, end_offset, data,
+            length, flags, print_limited_match, &limit, NULL);
+
+    fclose(limit.fp);
+
+    return err;
+}
+
+/* 
+ * Searches data, placed align bytes after a 64-byte boundary, for a pattern
+ * with a search kernel implementation. Fails with ENOTSUP if the CPU doesn't
+ * support the implementation.
+ */
+int search_kernel_find_aligned(enum search_kernel_impl impl, size_t align,
+        char *data, size_t len, char *pattern, size_t length, ssize_t *index)
+{
+    search_kernel_func *func = search_kernel_get(impl);
+    if (func == NULL)
+        return ENOTSUP;
+
+    void *block;
+    unsigned char *p;
+    int err = copy_aligned(data, len, align, &block, &p);
+    if (err)
+        return err;
+
+    *index = (*func)(p, len, (unsigned char *)pattern, length);
+
+    free(block);
+
+    return 0;
+}
+
+/* 
+ * Searches data, placed align bytes after a 64-byte boundary, for the last
+ * match of a pattern with a reverse search kernel implementation. Fails with
+ * ENOTSUP if the CPU doesn't support the implementation.
+ */
+int search_rkernel_find_aligned(enum search_kernel_impl impl, size_t align,
+        char *data, size_t len, char *pattern, size_t length, ssize_t *index)
+{
+    search_kernel_func *func = search_rkernel_get(impl);
+    if (func == NULL)
+        return ENOTSUP;
+
+    void *block;
+    unsigned char *p;
+    int err = copy_aligned(data, len, align, &block, &p);
+    if (err)
+        return err;
+
+    *index = (*func)(p, len, (unsigned char *)pattern, length);
+
+    free(block);
+
+    return 0;
+}
+
+/* 
+ * Searches data, placed align bytes after a 64-byte boundary, for the last
+ * match of a pattern with a reverse Boyer-Moore-Horspool search.
+ */
+int search_bmh_rfind_aligned(size_t align, char *data, size_t len,
+        char *pattern, size_t length, ssize_t *index)
+{
+    void *block;
+    unsigned char *p;
+    int err = copy_aligned(data, len, align, &block, &p);
+    if (err)
+        return err;
+
+    struct search_bmh bmh;
+    search_bmh_rinit(&bmh, (unsigned char *)pattern, length);
+
+    *index = search_bmh_rfind(&bmh, p, len);
+
+    free(block);
+
+    return 0;
+}
+
 /* 
  * Prints a list of segment vertices assuming that the segment data 
  * is a PyString value.
@@ -366,6 +677,8 @@ void print_vertex_list(list_t *vertices, int fd)
 %include "../src/segment.h"
 %include "../src/segcol.h"
 %include "../src/segcol_list.h"
+%include "../src/segcol_tree.h"
+%include "../src/segcol_btree.h"
 %include "../src/data_object.h"
 %include "../src/data_object_memory.h"
 %include "../src/data_object_file.h"
@@ -380,4 +693,5 @@ void print_vertex_list(list_t *vertices, int fd)
 %include "../src/util.h"
 %include "../src/buffer_action.h"
 %include "../src/buffer_action_edit.h"
+%include "../src/search_kernel.h"
 
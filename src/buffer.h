@@ -31,6 +31,7 @@ extern "C" {
 
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 
 #include "buffer_source.h"
@@ -48,6 +49,29 @@ extern "C" {
  */
 typedef struct bless_buffer bless_buffer_t;
 
+/**
+ * Opaque data type for the extents of a range of a bless buffer.
+ *
+ * The extents are created by bless_buffer_read_extents().
+ */
+typedef struct bless_buffer_extents bless_buffer_extents_t;
+
+/**
+ * Opaque data type for a set of patterns to search for.
+ *
+ * Pattern sets are not bound to a buffer and can be used to search many
+ * buffers.
+ */
+typedef struct bless_pattern_set bless_pattern_set_t;
+
+/**
+ * Opaque data type for a compiled regular expression.
+ *
+ * Regexes are not bound to a buffer and can be used to search many
+ * buffers, but not by more than one search at a time.
+ */
+typedef struct bless_regex bless_regex_t;
+
 /** 
  * Callback function called to report the progress of long operations.
  *
@@ -62,6 +86,34 @@ typedef struct bless_buffer bless_buffer_t;
  */
 typedef int (bless_progress_func)(void *info);
 
+/**
+ * Progress info passed to the bless_progress_func of search operations.
+ */
+struct bless_buffer_find_progress_info {
+	off_t searched; /**< The number of bytes searched so far */
+	off_t total; /**< The total number of bytes to search */
+};
+
+/**
+ * Callback function called to report the matches of search operations.
+ *
+ * @param offset the offset of the match in the buffer
+ * @param length the length of the match
+ * @param id the id of the pattern that matched
+ * @param user_data user data
+ *
+ * @return 1 if the search must stop, 0 otherwise
+ */
+typedef int (bless_buffer_match_func)(off_t offset, off_t length, int id,
+		void *user_data);
+
+/**
+ * Flags for bless_buffer_find_all().
+ */
+enum {
+	BLESS_BUFFER_FIND_OVERLAPPING = 1 /**< Report overlapping matches too */
+};
+
 /** 
  * Callback function called to report a buffer event.
  *
@@ -85,6 +137,8 @@ int bless_buffer_new(bless_buffer_t **buf);
 int bless_buffer_save(bless_buffer_t *buf, int fd,
 		bless_progress_func *progress_func);
 
+int bless_buffer_get_save_spill(bless_buffer_t *buf, int fd, off_t *spill);
+
 int bless_buffer_free(bless_buffer_t *buf);
 
 /** @} */
@@ -102,16 +156,77 @@ int bless_buffer_insert(bless_buffer_t *buf, off_t offset,
 
 int bless_buffer_delete(bless_buffer_t *buf, off_t offset, off_t length);
 
+int bless_buffer_replace_all(bless_buffer_t *buf, off_t start_offset,
+		off_t end_offset, void *data, size_t length,
+		bless_buffer_source_t *src, off_t src_offset, off_t src_length,
+		off_t *count, bless_progress_func *progress_func);
+
 int bless_buffer_read(bless_buffer_t *src, off_t src_offset, void *dst,
 		size_t dst_offset, size_t length);
 
+int bless_buffer_read_extents(bless_buffer_t *buf, off_t offset, off_t length,
+		bless_buffer_extents_t **extents);
+
+int bless_buffer_extents_get_iovec(bless_buffer_extents_t *extents,
+		const struct iovec **iov, size_t *count);
+
+int bless_buffer_extents_free(bless_buffer_extents_t *extents);
+
 /* Not yet implemented
 int bless_buffer_copy(bless_buffer_t *src, off_t src_offset, bless_buffer_t *dst,
 		off_t dst_offset, off_t length);
+*/
+
+/** @} */
+/**
+ * @name Search Operations
+ *
+ * @{
+ */
 
 int bless_buffer_find(bless_buffer_t *buf, off_t *match, off_t start_offset, 
 		void *data, size_t length, bless_progress_func *progress_func);
-*/
+
+int bless_buffer_find_masked(bless_buffer_t *buf, off_t *match,
+		off_t start_offset, void *data, void *mask, size_t length,
+		bless_progress_func *progress_func);
+
+int bless_buffer_rfind(bless_buffer_t *buf, off_t *match, off_t start_offset,
+		void *data, size_t length, bless_progress_func *progress_func);
+
+int bless_buffer_find_all(bless_buffer_t *buf, off_t start_offset,
+		off_t end_offset, void *data, size_t length, int flags,
+		bless_buffer_match_func *match_func, void *user_data,
+		bless_progress_func *progress_func);
+
+int bless_buffer_find_multi(bless_buffer_t *buf, bless_pattern_set_t *set,
+		off_t start_offset, bless_buffer_match_func *match_func,
+		void *user_data, bless_progress_func *progress_func);
+
+int bless_pattern_set_new(bless_pattern_set_t **set);
+
+int bless_pattern_set_add(bless_pattern_set_t *set, void *data, size_t length,
+		int *id);
+
+int bless_pattern_set_get_count(bless_pattern_set_t *set, int *count);
+
+int bless_pattern_set_free(bless_pattern_set_t *set);
+
+int bless_buffer_find_regex(bless_buffer_t *buf, bless_regex_t *regex,
+		off_t start_offset, off_t end_offset,
+		bless_buffer_match_func *match_func, void *user_data,
+		bless_progress_func *progress_func);
+
+int bless_regex_new(bless_regex_t **regex, void *pattern, size_t length);
+
+int bless_regex_free(bless_regex_t *regex);
+
+int bless_buffer_source_index_build(bless_buffer_source_t *src,
+		bless_progress_func *progress_func);
+
+int bless_buffer_source_index_save(bless_buffer_source_t *src, int fd);
+
+int bless_buffer_source_index_load(bless_buffer_source_t *src, int fd);
 
 /** @} */
 /**
@@ -72,6 +72,14 @@ static int buffer_action_delete_to_event(buffer_action_t *action,
 		struct bless_buffer_event_info *event_info);
 static int buffer_action_delete_free(buffer_action_t *action);
 
+static int buffer_action_replace_do(buffer_action_t *action);
+static int buffer_action_replace_undo(buffer_action_t *action);
+static int buffer_action_replace_private_copy(buffer_action_t *action,
+		data_object_t *dobj);
+static int buffer_action_replace_to_event(buffer_action_t *action,
+		struct bless_buffer_event_info *event_info);
+static int buffer_action_replace_free(buffer_action_t *action);
+
 static int buffer_action_multi_do(buffer_action_t *action);
 static int buffer_action_multi_undo(buffer_action_t *action);
 static int buffer_action_multi_private_copy(buffer_action_t *action,
@@ -105,6 +113,14 @@ static struct buffer_action_funcs buffer_action_delete_funcs = {
 	.free_func = buffer_action_delete_free
 };
 
+static struct buffer_action_funcs buffer_action_replace_funcs = {
+	.do_func = buffer_action_replace_do,
+	.undo_func = buffer_action_replace_undo,
+	.private_copy_func = buffer_action_replace_private_copy,
+	.to_event_func = buffer_action_replace_to_event,
+	.free_func = buffer_action_replace_free
+};
+
 static struct buffer_action_funcs buffer_action_multi_funcs = {
 	.do_func = buffer_action_multi_do,
 	.undo_func = buffer_action_multi_undo,
@@ -132,6 +148,15 @@ struct buffer_action_delete_impl {
 	segcol_t *deleted;
 };
 
+struct buffer_action_replace_impl {
+	bless_buffer_t *buf;
+	off_t offset;
+	off_t length;
+	segcol_t *replacement;
+	off_t replacement_length;
+	segcol_t *deleted;
+};
+
 struct buffer_action_multi_impl {
 	bless_buffer_t *buf;
 	list_t *action_list;
@@ -454,6 +479,60 @@ on_error:
 	return err;
 }
 
+/** 
+ * Creates a new replace buffer_action_t.
+ *
+ * The range [offset, offset + length) of the buffer is replaced by the
+ * contents of the replacement segcol. The action takes ownership of the
+ * replacement segcol and frees it when it is freed itself.
+ *
+ * @param[out] action the created buffer_action_t
+ * @param buf the bless_buffer_t this action will act upon
+ * @param offset the offset in the buffer_t of the range to replace
+ * @param length the length in bytes of the range to replace
+ * @param replacement the segcol_t containing the new data for the range
+ * 
+ * @return the operation error code
+ */
+int buffer_action_replace_new(buffer_action_t **action, bless_buffer_t *buf,
+		off_t offset, off_t length, segcol_t *replacement)
+{
+	if (action == NULL || buf == NULL || replacement == NULL)
+		return_error(EINVAL);
+
+	off_t replacement_length;
+	int err = segcol_get_size(replacement, &replacement_length);
+	if (err)
+		return_error(err);
+
+	/* Allocate memory for implementation */
+	struct buffer_action_replace_impl *impl =
+		malloc(sizeof(struct buffer_action_replace_impl));
+	
+	if (impl == NULL)
+		return_error(EINVAL);
+
+	/* Create buffer_action_t */
+	err = buffer_action_create_impl(action, impl,
+			&buffer_action_replace_funcs);
+	if (err)
+		goto_error(err, on_error);
+
+	/* Initialize implementation */
+	impl->buf = buf;
+	impl->offset = offset;
+	impl->length = length;
+	impl->replacement = replacement;
+	impl->replacement_length = replacement_length;
+	impl->deleted = NULL;
+
+	return 0;
+
+on_error:
+	free(impl);
+	return err;
+}
+
 /** 
  * Creates a new multi buffer_action_t.
  * 
@@ -867,6 +946,140 @@ static int buffer_action_delete_free(buffer_action_t *action)
 	return 0;
 }
 
+/*********************
+ * Replace Functions *
+ *********************/
+
+static int buffer_action_replace_do(buffer_action_t *action)
+{
+	if (action == NULL)
+		return_error(EINVAL);
+
+	struct buffer_action_replace_impl *impl =
+		(struct buffer_action_replace_impl *) buffer_action_get_impl(action);
+
+	/* Remove the old data from the segcol... */
+	segcol_t *deleted;
+	int err = segcol_delete(impl->buf->segcol, &deleted, impl->offset,
+			impl->length);
+	if (err)
+		return_error(err);
+
+	/* ...and put the replacement data in its place */
+	err = segcol_add_copy(impl->buf->segcol, impl->offset, impl->replacement);
+	if (err)
+		goto_error(err, on_error_add);
+
+	/* Free previous deleted data if any */
+	if (impl->deleted != NULL) {
+		err = segcol_free(impl->deleted);
+		if (err) {
+			segcol_delete(impl->buf->segcol, NULL, impl->offset,
+					impl->replacement_length);
+			goto_error(err, on_error_add);
+		}
+	}
+
+	/* Store new deleted data */
+	impl->deleted = deleted;
+
+	return 0;
+
+on_error_add:
+	segcol_add_copy(impl->buf->segcol, impl->offset, deleted);
+	segcol_free(deleted);
+	return err;
+}
+
+static int buffer_action_replace_undo(buffer_action_t *action)
+{
+	if (action == NULL)
+		return_error(EINVAL);
+
+	struct buffer_action_replace_impl *impl =
+		(struct buffer_action_replace_impl *) buffer_action_get_impl(action);
+
+	/* Remove the replacement data... */
+	int err;
+	if (impl->replacement_length > 0) {
+		err = segcol_delete(impl->buf->segcol, NULL, impl->offset,
+				impl->replacement_length);
+		if (err)
+			return_error(err);
+	}
+
+	/* ...and add the old data back to the segcol */
+	err = segcol_add_copy(impl->buf->segcol, impl->offset, impl->deleted);
+	if (err) {
+		segcol_add_copy(impl->buf->segcol, impl->offset, impl->replacement);
+		return_error(err);
+	}
+		
+	return 0;
+}
+
+static int buffer_action_replace_private_copy(buffer_action_t *action,
+		data_object_t *cmp_dobj)
+{
+	if (action == NULL || cmp_dobj == NULL)
+		return_error(EINVAL);
+
+	struct buffer_action_replace_impl *impl =
+		(struct buffer_action_replace_impl *) buffer_action_get_impl(action);
+
+	int err = segcol_inplace_private_copy(impl->replacement, cmp_dobj);
+	if (err)
+		return_error(err);
+
+	if (impl->deleted != NULL) {
+		err = segcol_inplace_private_copy(impl->deleted, cmp_dobj);
+		if (err)
+			return_error(err);
+	}
+
+	return 0;
+}
+
+static int buffer_action_replace_to_event(buffer_action_t *action,
+		struct bless_buffer_event_info *event_info)
+{
+	if (action == NULL || event_info == NULL)
+		return_error(EINVAL);
+
+	struct buffer_action_replace_impl *impl =
+		(struct buffer_action_replace_impl *) buffer_action_get_impl(action);
+
+	event_info->action_type = BLESS_BUFFER_ACTION_REPLACE;
+	event_info->range_start = impl->offset;
+	event_info->range_length = impl->replacement_length;
+	event_info->save_fd = -1;
+
+	return 0;
+}
+
+static int buffer_action_replace_free(buffer_action_t *action)
+{
+	if (action == NULL)
+		return_error(EINVAL);
+
+	struct buffer_action_replace_impl *impl =
+		(struct buffer_action_replace_impl *) buffer_action_get_impl(action);
+
+	int err = segcol_free(impl->replacement);
+	if (err)
+		return_error(err);
+
+	if (impl->deleted != NULL) {
+		err = segcol_free(impl->deleted);
+		if (err)
+			return_error(err);
+	}
+
+	free(impl);
+
+	return 0;
+}
+
 /*******************
  * Multi Functions *
  *******************/
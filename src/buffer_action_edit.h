@@ -28,6 +28,7 @@
 #include "buffer.h"
 #include "buffer_source.h"
 #include "buffer_action.h"
+#include "segcol.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,6 +54,9 @@ int buffer_action_insert_new(buffer_action_t **action, bless_buffer_t *buf,
 int buffer_action_delete_new(buffer_action_t **action, bless_buffer_t *buf,
 		off_t offset, off_t length);
 
+int buffer_action_replace_new(buffer_action_t **action, bless_buffer_t *buf,
+		off_t offset, off_t length, segcol_t *replacement);
+
 int buffer_action_multi_new(buffer_action_t **action);
 int buffer_action_multi_add(buffer_action_t *multi_action,
 		buffer_action_t *new_action);
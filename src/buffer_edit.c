@@ -78,6 +78,301 @@ static int read_foreach_func(segcol_t *segcol, segment_t *seg,
 	return 0;
 }
 
+/**
+ * Makes sure there is space for one more iovec and hold in a
+ * bless_buffer_extents_t.
+ *
+ * @param ext the bless_buffer_extents_t
+ *
+ * @return the operation error code
+ */
+static int extents_reserve(struct bless_buffer_extents *ext)
+{
+	if (ext->count == ext->iov_capacity) {
+		size_t cap = ext->iov_capacity > 0 ? 2 * ext->iov_capacity : 16;
+		struct iovec *iov = realloc(ext->iov, cap * sizeof(*iov));
+		if (iov == NULL)
+			return_error(ENOMEM);
+
+		ext->iov = iov;
+		ext->iov_capacity = cap;
+	}
+
+	if (ext->nholds == ext->holds_capacity) {
+		size_t cap = ext->holds_capacity > 0 ? 2 * ext->holds_capacity : 16;
+		struct extent_hold *holds = realloc(ext->holds, cap * sizeof(*holds));
+		if (holds == NULL)
+			return_error(ENOMEM);
+
+		ext->holds = holds;
+		ext->holds_capacity = cap;
+	}
+
+	return 0;
+}
+
+/**
+ * A segcol_foreach_func that adds the data of a segment_t to a
+ * bless_buffer_extents_t.
+ *
+ * The data are pinned in their data object if possible, otherwise they are
+ * copied.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment to read from
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the offset in the data of the segment to start reading
+ * @param read_length the length of the data to read
+ * @param user_data the bless_buffer_extents_t
+ *
+ * @return the operation error code
+ */
+static int extents_foreach_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+	UNUSED_PARAM(mapping);
+
+	struct bless_buffer_extents *ext = user_data;
+
+	data_object_t *dobj;
+	segment_get_data(seg, (void **)&dobj);
+
+	int can_pin;
+	int err = data_object_can_pin(dobj, &can_pin);
+	if (err)
+		return_error(err);
+
+	while (read_length > 0) {
+		err = extents_reserve(ext);
+		if (err)
+			return_error(err);
+
+		struct extent_hold *hold = &ext->holds[ext->nholds];
+		void *data;
+		off_t len = read_length;
+
+		if (!can_pin) {
+			/* The data can't be pinned, make a private copy of the rest */
+			if ((uintmax_t)read_length > __MAX(size_t))
+				return_error(EOVERFLOW);
+
+			data = malloc(read_length);
+			if (data == NULL)
+				return_error(ENOMEM);
+
+			err = read_data_object(dobj, read_start, data, read_length);
+			if (err) {
+				free(data);
+				return_error(err);
+			}
+
+			hold->obj = NULL;
+			hold->copy = data;
+			len = read_length;
+		}
+		else {
+			err = data_object_get_data(dobj, &data, read_start, &len,
+					DATA_OBJECT_READ | DATA_OBJECT_PIN);
+			if (err)
+				return_error(err);
+
+			/* Keep the data object alive while its data are pinned */
+			data_object_update_usage(dobj, 1);
+			hold->obj = dobj;
+			hold->copy = NULL;
+		}
+
+		ext->nholds++;
+
+		/* Extend the previous iovec if the data are contiguous */
+		struct iovec *last = ext->count > 0 ? &ext->iov[ext->count - 1] : NULL;
+
+		if (last != NULL && (unsigned char *)last->iov_base + last->iov_len
+				== data && __MAX(size_t) - last->iov_len >= (size_t)len) {
+			last->iov_len += len;
+		}
+		else {
+			ext->iov[ext->count].iov_base = data;
+			ext->iov[ext->count].iov_len = len;
+			ext->count++;
+		}
+
+		read_start += len;
+		read_length -= len;
+	}
+
+	return 0;
+}
+
+/**
+ * The state of a bless_buffer_replace_all() operation.
+ */
+struct replace_state {
+	bless_buffer_t *buf;
+	segcol_t *replacement; /**< The new data for the replaced range */
+	segment_t *seg;        /**< The replacement data, NULL if empty */
+	off_t start;           /**< The offset of the first match */
+	off_t prev_end;        /**< The end of the last match */
+	off_t count;           /**< The number of matches so far */
+	int err;
+};
+
+/**
+ * A segcol_foreach_func that appends copies of the segments of a range
+ * to a segcol_t.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment to copy
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the start of the range in the data of the segment
+ * @param read_length the length of the range
+ * @param user_data the segcol_t to append to
+ *
+ * @return the operation error code
+ */
+static int append_copy_foreach_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+	UNUSED_PARAM(mapping);
+
+	segcol_t *dst = user_data;
+	segment_t *seg_copy;
+
+	int err = segment_copy(seg, &seg_copy);
+	if (err)
+		return_error(err);
+
+	err = segment_set_range(seg_copy, read_start, read_length);
+	if (err)
+		goto_error(err, on_error);
+
+	err = segcol_append(dst, seg_copy);
+	if (err)
+		goto_error(err, on_error);
+
+	return 0;
+
+on_error:
+	segment_free(seg_copy);
+	return err;
+}
+
+/**
+ * A bless_buffer_match_func that adds a match to the replacement data
+ * of a bless_buffer_replace_all() operation.
+ *
+ * The unmatched data between the previous match and this one is copied
+ * as is, followed by the replacement data.
+ *
+ * @param offset the offset of the match
+ * @param length the length of the match
+ * @param id unused
+ * @param user_data the struct replace_state
+ *
+ * @return 1 on error, 0 otherwise
+ */
+static int replace_match_func(off_t offset, off_t length, int id,
+		void *user_data)
+{
+	UNUSED_PARAM(id);
+
+	struct replace_state *st = user_data;
+	int err;
+
+	if (st->count == 0) {
+		st->start = offset;
+		st->prev_end = offset;
+	}
+
+	if (offset > st->prev_end) {
+		err = segcol_foreach(st->buf->segcol, st->prev_end,
+				offset - st->prev_end, append_copy_foreach_func,
+				st->replacement);
+		if (err)
+			goto_error(err, on_error);
+	}
+
+	if (st->seg != NULL) {
+		segment_t *seg_copy;
+		err = segment_copy(st->seg, &seg_copy);
+		if (err)
+			goto_error(err, on_error);
+
+		err = segcol_append(st->replacement, seg_copy);
+		if (err) {
+			segment_free(seg_copy);
+			goto_error(err, on_error);
+		}
+	}
+
+	st->prev_end = offset + length;
+	st->count++;
+
+	return 0;
+
+on_error:
+	st->err = err;
+	return 1;
+}
+
+/**
+ * A bless_buffer_match_func that stores the offset of the first match and
+ * stops the search.
+ *
+ * @param offset the offset of the match
+ * @param length unused
+ * @param id unused
+ * @param user_data the off_t to store the offset in
+ *
+ * @return 1 to stop the search
+ */
+static int first_match_func(off_t offset, off_t length, int id,
+		void *user_data)
+{
+	UNUSED_PARAM(length);
+	UNUSED_PARAM(id);
+
+	*(off_t *)user_data = offset;
+
+	return 1;
+}
+
+/**
+ * Checks that a range of a source is valid.
+ *
+ * These are the checks performed when the edit actions are created. Edits
+ * perform them before storing the data in the add buffer, so that invalid
+ * edits don't consume any of it.
+ *
+ * @param src the source of the data
+ * @param src_offset the offset of the data in the source
+ * @param length the length of the data
+ *
+ * @return the operation error code
+ */
+static int check_source_range(bless_buffer_source_t *src, off_t src_offset,
+		off_t length)
+{
+	if (src_offset < 0 || length < 0)
+		return_error(EINVAL);
+
+	/* Check if range would overflow off_t */
+	if (__MAX(off_t) - src_offset < length - 1 * (length != 0))
+		return_error(EOVERFLOW);
+
+	off_t src_size;
+	int err = data_object_get_size((data_object_t *)src, &src_size);
+	if (err)
+		return_error(err);
+
+	if (src_offset + length - 1 * (length != 0) >= src_size)
+		return_error(EINVAL);
+
+	return 0;
+}
+
 /*****************
  * API Functions *
  *****************/
@@ -101,8 +396,31 @@ int bless_buffer_append(bless_buffer_t *buf, bless_buffer_source_t *src,
 	buffer_action_t *action;
 	struct bless_buffer_event_info event_info;
 
+	/* Check the ranges before storing anything in the add buffer */
+	int err = check_source_range(src, src_offset, length);
+	if (err)
+		return_error(err);
+
+	off_t buf_size;
+	err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	if (__MAX(off_t) - buf_size < length)
+		return_error(EOVERFLOW);
+
+	/* Copy small data to the add buffer, so that it can be merged */
+	err = add_buffer_store(buf, &src, &src_offset, length);
+	if (err)
+		return_error(err);
+
+	/* Map file data using the buffer's window settings */
+	err = buffer_apply_file_options(buf, src);
+	if (err)
+		return_error(err);
+
 	/* Create an append action */
-	int err = buffer_action_append_new(&action, buf, src, src_offset, length);
+	err = buffer_action_append_new(&action, buf, src, src_offset, length);
 	if (err)
 		return_error(err);
 
@@ -192,11 +510,37 @@ int bless_buffer_insert(bless_buffer_t *buf, off_t offset,
 	if (buf == NULL || src == NULL) 
 		return_error(EINVAL);
 
+	/* Check the ranges before storing anything in the add buffer */
+	int err = check_source_range(src, src_offset, length);
+	if (err)
+		return_error(err);
+
+	off_t buf_size;
+	err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	if (__MAX(off_t) - buf_size < length)
+		return_error(EOVERFLOW);
+
+	if (offset < 0 || offset >= buf_size)
+		return_error(EINVAL);
+
+	/* Copy small data to the add buffer, so that it can be merged */
+	err = add_buffer_store(buf, &src, &src_offset, length);
+	if (err)
+		return_error(err);
+
+	/* Map file data using the buffer's window settings */
+	err = buffer_apply_file_options(buf, src);
+	if (err)
+		return_error(err);
+
 	/* Create an insert action */
 	buffer_action_t *action;
 	struct bless_buffer_event_info event_info;
 
-	int err = buffer_action_insert_new(&action, buf, offset, src, src_offset,
+	err = buffer_action_insert_new(&action, buf, offset, src, src_offset,
 			length);
 	if (err)
 		return_error(err);
@@ -361,6 +705,204 @@ on_error_do:
 	return err;
 }
 
+/**
+ * Replaces all the occurrences of some data in a bless_buffer_t.
+ *
+ * The search covers the matches that lie entirely in the range
+ * [start_offset, end_offset) and the matches don't overlap. All the
+ * matches are replaced in a single action, so a single undo restores the
+ * previous contents and a single BLESS_BUFFER_EVENT_EDIT event is emitted,
+ * covering the range from the start of the first match to the end of the
+ * last replacement.
+ *
+ * @param buf the bless_buffer_t to replace data in
+ * @param start_offset the offset to start searching at
+ * @param end_offset the offset to stop searching at
+ * @param data the data to search for
+ * @param length the length of the data to search for
+ * @param src the data source to get the replacement data from (may be
+ *            NULL if src_length is 0)
+ * @param src_offset the offset of the replacement data in src
+ * @param src_length the length of the replacement data
+ * @param[out] count the number of replaced occurrences
+ * @param progress_func the bless_progress_func to call to report the
+ *                      progress of the search (may be NULL)
+ *
+ * @return the operation error code
+ */
+int bless_buffer_replace_all(bless_buffer_t *buf, off_t start_offset,
+		off_t end_offset, void *data, size_t length,
+		bless_buffer_source_t *src, off_t src_offset, off_t src_length,
+		off_t *count, bless_progress_func *progress_func)
+{
+	if (buf == NULL || data == NULL || length == 0 || count == NULL ||
+		src_length < 0 || (src == NULL && src_length > 0))
+		return_error(EINVAL);
+
+	struct replace_state st;
+	st.buf = buf;
+	st.seg = NULL;
+	st.start = 0;
+	st.prev_end = 0;
+	st.count = 0;
+	st.err = 0;
+
+	int err;
+
+	/* Check the range before storing anything in the add buffer */
+	if (src_length > 0) {
+		err = check_source_range(src, src_offset, src_length);
+		if (err)
+			return_error(err);
+	}
+
+	/* 
+	 * Find the first match, so that nothing is stored in the add buffer if
+	 * the search range is invalid or there are no matches.
+	 */
+	off_t first = -1;
+
+	err = bless_buffer_find_all(buf, start_offset, end_offset, data, length,
+			0, first_match_func, &first, progress_func);
+	if (err)
+		return_error(err);
+
+	if (first < 0) {
+		*count = 0;
+		return 0;
+	}
+
+	/* Create a segment for the replacement data */
+	if (src_length > 0) {
+		/* Copy small data to the add buffer, so that it can be merged */
+		err = add_buffer_store(buf, &src, &src_offset, src_length);
+		if (err)
+			return_error(err);
+
+		/* Map file data using the buffer's window settings */
+		err = buffer_apply_file_options(buf, src);
+		if (err)
+			return_error(err);
+
+		data_object_t *dobj = (data_object_t *) src;
+		err = segment_new(&st.seg, dobj, src_offset, src_length,
+				data_object_update_usage);
+		if (err)
+			return_error(err);
+	}
+
+	err = segcol_new_by_name(&st.replacement, buf->options->segcol_impl);
+	if (err)
+		goto_error(err, on_error_seg);
+
+	/* Build the new contents of the range from the first to the last match */
+	err = bless_buffer_find_all(buf, first, end_offset, data, length,
+			0, replace_match_func, &st, progress_func);
+	if (err)
+		goto_error(err, on_error_segcol);
+
+	if (st.err) {
+		err = st.err;
+		goto_error(err, on_error_segcol);
+	}
+
+	if (st.seg != NULL)
+		segment_free(st.seg);
+
+	*count = st.count;
+
+	if (st.count == 0) {
+		segcol_free(st.replacement);
+		return 0;
+	}
+
+	/* Create a replace action, which takes ownership of the segcol */
+	buffer_action_t *action;
+	struct bless_buffer_event_info event_info;
+
+	err = buffer_action_replace_new(&action, buf, st.start,
+			st.prev_end - st.start, st.replacement);
+	if (err) {
+		segcol_free(st.replacement);
+		return_error(err);
+	}
+
+	/* Perform action */
+	err = buffer_action_do(action);
+	if (err)
+		goto_error(err, on_error_do);
+
+	/* 
+	 * If we are in multi action mode, just add the action to the multi
+	 * action and return.
+	 */
+	if (buf->multi_action_count) {
+		/* We may not have an action if the undo limit is 0 */
+		if (buf->multi_action != NULL) {
+			err = buffer_action_multi_add(buf->multi_action, action);
+			if (err)
+				goto_error(err, on_error_other);
+		}
+		else {
+			buf->first_rev_id = buf->next_rev_id++;
+			buffer_action_free(action);
+		}
+
+		return 0;
+	}
+
+	/* Fill in the event info structure for this action */
+	err = buffer_action_to_event(action, &event_info);
+	if (err)
+		goto_error(err, on_error_other);
+
+	/* 
+	 * Make sure that the undo list has space for one action (provided the
+	 * undo limit is > 0).
+	 */
+	err = undo_list_enforce_limit(buf, 1);
+	if (err)
+		goto_error(err, on_error_other);
+
+	/* 
+	 * If we have space in the undo list to append the action.
+	 * The only case we won't have space is when the undo limit is 0.
+	 */
+	if (buf->undo_list_size < buf->options->undo_limit) {
+		err = undo_list_append(buf, action);
+		if (err)
+			goto_error(err, on_error_other);
+	}
+	else {
+		buf->first_rev_id = buf->next_rev_id++;
+		buffer_action_free(action);
+	}
+
+	action_list_clear(buf->redo_list);
+	buf->redo_list_size = 0;
+
+	/* Call event callback if supplied by the user */
+	if (buf->event_func != NULL) {
+		event_info.event_type = BLESS_BUFFER_EVENT_EDIT;
+		(*buf->event_func)(buf, &event_info, buf->event_user_data);
+	}
+
+	return 0;
+
+on_error_other:
+	buffer_action_undo(action);
+on_error_do:
+	buffer_action_free(action);
+	return err;
+
+on_error_segcol:
+	segcol_free(st.replacement);
+on_error_seg:
+	if (st.seg != NULL)
+		segment_free(st.seg);
+	return err;
+}
+
 /**
  * Reads data from a bless_buffer_t.
  *
@@ -398,7 +940,122 @@ int bless_buffer_read(bless_buffer_t *buf, off_t src_offset, void *dst,
 	return 0;
 }
 
-/* bless_buffer_copy and bless_buffer_find are not implemented yet */
+/**
+ * Gets the extents of a range of a bless_buffer_t without copying the data.
+ *
+ * The extents point directly to the memory holding the buffer data (eg memory
+ * sources or files mapped in memory). Data that can't be referenced directly
+ * (eg files read with pread) are copied. The extents, and the data they point
+ * to, remain valid until they are freed with bless_buffer_extents_free(), even
+ * if the buffer is changed in the meantime. The data must not be altered.
+ *
+ * While extents are held, the files they point to can't stop being mapped in
+ * memory, so setting the BLESS_BUF_FILE_BACKEND option to "pread" may fail
+ * with EBUSY. Saving the buffer to one of these files would change the data
+ * under the extents, so bless_buffer_save() fails with EBUSY too. Files
+ * changed by other means (eg saving another buffer to them) invalidate the
+ * extents.
+ *
+ * @param buf the bless_buffer_t to get the extents of
+ * @param offset the offset in the bless_buffer_t of the range
+ * @param length the length of the range
+ * @param[out] extents the created bless_buffer_extents_t
+ *
+ * @return the operation error code
+ */
+int bless_buffer_read_extents(bless_buffer_t *buf, off_t offset, off_t length,
+		bless_buffer_extents_t **extents)
+{
+	if (buf == NULL || offset < 0 || length < 0 || extents == NULL)
+		return_error(EINVAL);
+
+	struct bless_buffer_extents *ext = malloc(sizeof(*ext));
+	if (ext == NULL)
+		return_error(ENOMEM);
+
+	ext->iov = NULL;
+	ext->count = 0;
+	ext->iov_capacity = 0;
+	ext->holds = NULL;
+	ext->nholds = 0;
+	ext->holds_capacity = 0;
+	ext->buf = NULL;
+
+	int err = segcol_foreach(buf->segcol, offset, length,
+			extents_foreach_func, ext);
+	if (err) {
+		bless_buffer_extents_free(ext);
+		return_error(err);
+	}
+
+	/* Keep track of the extents, so that saving can check what they hold */
+	ext->buf = buf;
+	list_insert_before(list_tail(buf->extents), &ext->ln);
+
+	*extents = ext;
+
+	return 0;
+}
+
+/**
+ * Gets the extents of a bless_buffer_extents_t as an array of struct iovec.
+ *
+ * The array can be passed directly to functions like writev().
+ *
+ * @param extents the bless_buffer_extents_t
+ * @param[out] iov the array of struct iovec (owned by extents)
+ * @param[out] count the number of elements in iov
+ *
+ * @return the operation error code
+ */
+int bless_buffer_extents_get_iovec(bless_buffer_extents_t *extents,
+		const struct iovec **iov, size_t *count)
+{
+	if (extents == NULL || iov == NULL || count == NULL)
+		return_error(EINVAL);
+
+	*iov = extents->iov;
+	*count = extents->count;
+
+	return 0;
+}
+
+/**
+ * Frees a bless_buffer_extents_t and releases the data it points to.
+ *
+ * @param extents the bless_buffer_extents_t to free
+ *
+ * @return the operation error code
+ */
+int bless_buffer_extents_free(bless_buffer_extents_t *extents)
+{
+	if (extents == NULL)
+		return_error(EINVAL);
+
+	size_t i;
+
+	for (i = 0; i < extents->nholds; i++) {
+		struct extent_hold *hold = &extents->holds[i];
+
+		if (hold->obj != NULL) {
+			data_object_unpin(hold->obj);
+			data_object_update_usage(hold->obj, -1);
+		}
+		else
+			free(hold->copy);
+	}
+
+	if (extents->buf != NULL)
+		list_delete_chain(&extents->ln, &extents->ln);
+
+	free(extents->holds);
+	free(extents->iov);
+	free(extents);
+
+	return 0;
+}
+
+/* bless_buffer_copy is not implemented yet */
 #pragma GCC visibility push(hidden)
 
 /**
@@ -424,33 +1081,6 @@ int bless_buffer_copy(bless_buffer_t *src, off_t src_offset, bless_buffer_t *dst
 	return_error(ENOSYS);
 }
 
-/**
- * Searches for data in a bless_buffer_t.
- *
- * @param buf the bless_buffer_t to search
- * @param[out] match the offset the data was found at or -1 if no match was found
- * @param start_offset the offset in the bless_buffer_t to start searching from
- * @param data a pointer to the data to search for
- * @param length the length of the data to search for
- * @param progress_func the bless_progress_cb to call to report the progress of the
- *           operation or NULL to disable reporting
- *
- * @return the offset in the bless_buffer_t where a match was found or
- *         an operation error code
- */
-int bless_buffer_find(bless_buffer_t *buf, off_t *match, off_t start_offset, 
-		void *data, size_t length, bless_progress_func *progress_func)
-{
-	UNUSED_PARAM(buf);
-	UNUSED_PARAM(match);
-	UNUSED_PARAM(start_offset);
-	UNUSED_PARAM(data);
-	UNUSED_PARAM(length);
-	UNUSED_PARAM(progress_func);
-
-	return_error(ENOSYS);
-}
-
 #pragma GCC visibility pop
 
 #pragma GCC visibility pop
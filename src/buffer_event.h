@@ -49,6 +49,7 @@ enum {
 	BLESS_BUFFER_ACTION_INSERT, /**< Insert action */
 	BLESS_BUFFER_ACTION_DELETE, /**< Delete action */
 	BLESS_BUFFER_ACTION_MULTI,  /**< Multi action */
+	BLESS_BUFFER_ACTION_REPLACE, /**< Replace action */
 };
 
 /**
@@ -25,6 +25,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
@@ -34,7 +35,6 @@
 #include "buffer.h"
 #include "buffer_options.h"
 #include "buffer_internal.h"
-#include "segcol_list.h"
 #include "data_object.h"
 #include "data_object_file.h"
 #include "overlap_graph.h"
@@ -73,6 +73,65 @@ static int is_fd_resizable(int fd, int *fd_resizable)
 	return 0;
 }
 
+/**
+ * Checks if the extents of a bless_buffer_t pin data of a file.
+ *
+ * @param buf the bless_buffer_t
+ * @param fd the fd of the file to check
+ * @param[out] pinned whether data of the file are pinned
+ *
+ * @return the operation error code
+ */
+static int extents_pin_file(bless_buffer_t *buf, int fd, int *pinned)
+{
+	struct stat fd_stat;
+	if (fstat(fd, &fd_stat) == -1)
+		return_error(errno);
+
+	*pinned = 0;
+
+	struct list_node *node;
+
+	list_for_each(list_head(buf->extents)->next, node) {
+		struct bless_buffer_extents *ext =
+			list_entry(node, struct bless_buffer_extents, ln);
+
+		size_t i;
+		for (i = 0; i < ext->nholds; i++) {
+			data_object_t *obj = ext->holds[i].obj;
+
+			/* Only pinned data are held in their data object */
+			if (obj == NULL)
+				continue;
+
+			int is_file;
+			int err = data_object_is_file(obj, &is_file);
+			if (err)
+				return_error(err);
+
+			if (!is_file)
+				continue;
+
+			int obj_fd;
+			err = data_object_file_get_fd(obj, &obj_fd);
+			if (err)
+				return_error(err);
+
+			struct stat obj_stat;
+			if (fstat(obj_fd, &obj_stat) == -1)
+				return_error(errno);
+
+			if (obj_stat.st_dev == fd_stat.st_dev &&
+				obj_stat.st_ino == fd_stat.st_ino) {
+				*pinned = 1;
+				return 0;
+			}
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Reserves disk space for writing a file.
  *
@@ -115,6 +174,8 @@ static int reserve_disk_space(int fd, off_t size)
 		bytes_left -= nwrite;
 	}
 
+	free(zero);
+
 	return 0;
 #endif
 }
@@ -126,13 +187,13 @@ static int reserve_disk_space(int fd, off_t size)
  * 
  * @param[out] g the created overlap graph
  * @param segcol the segcol_t to create the overlap graph for
- * @param fd_obj the file data_object_t pointing to the file to check
- *               for overlap with
+ * @param dev the device of the file to check for overlap with
+ * @param ino the inode of the file to check for overlap with
  * 
  * @return the operation error code
  */
 static int create_overlap_graph(overlap_graph_t **g, segcol_t *segcol,
-		data_object_t *fd_obj)
+		dev_t dev, ino_t ino)
 {
 	int err = overlap_graph_new(g, 10);
 	if (err)
@@ -161,13 +222,26 @@ static int create_overlap_graph(overlap_graph_t **g, segcol_t *segcol,
 		data_object_t *dobj;
 		segment_get_data(seg, (void *)&dobj);
 
-		int result;
-		data_object_compare(&result, fd_obj, dobj);
+		int is_file;
+		err = data_object_is_file(dobj, &is_file);
+		if (err)
+			goto_error(err, on_error);
+
+		dev_t seg_dev = 0;
+		ino_t seg_ino = 0;
+
+		if (is_file) {
+			err = data_object_file_get_id(dobj, &seg_dev, &seg_ino);
+			if (err)
+				goto_error(err, on_error);
+		}
 
-		if (result == 0) {
+		if (is_file && seg_dev == dev && seg_ino == ino) {
 			off_t mapping;
 			segcol_iter_get_mapping(iter, &mapping);
-			overlap_graph_add_segment(*g, seg, mapping);
+			err = overlap_graph_add_segment_deferred(*g, seg, mapping);
+			if (err)
+				goto_error(err, on_error);
 		}
 
 		segcol_iter_next(iter);
@@ -175,11 +249,49 @@ static int create_overlap_graph(overlap_graph_t **g, segcol_t *segcol,
 
 	segcol_iter_free(iter);
 
+	/* Find the overlaps of all the segments at once */
+	err = overlap_graph_update_edges(*g);
+	if (err) {
+		overlap_graph_free(*g);
+		return_error(err);
+	}
+
 	return 0;
 
+on_error:
+	segcol_iter_free(iter);
+	overlap_graph_free(*g);
+	return err;
+
 }
 
 
+/**
+ * Removes the cycles of an overlap graph using a named strategy.
+ *
+ * @param g the overlap graph
+ * @param strategy the strategy to use ("greedy" or "spanning_tree", see
+ *                 the BLESS_BUF_SAVE_CYCLES option)
+ *
+ * @return the operation error code
+ */
+static int remove_overlap_cycles(overlap_graph_t *g, char *strategy)
+{
+	int err;
+
+	if (!strcmp(strategy, "greedy"))
+		err = overlap_graph_remove_cycles_greedy(g);
+	else if (!strcmp(strategy, "spanning_tree"))
+		err = overlap_graph_remove_cycles(g);
+	else
+		err = EINVAL;
+
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
 /**
  * Break an edge of the overlap graph.
  *
@@ -224,14 +336,19 @@ static int break_edge(segcol_t *segcol, struct edge_entry *edge, char *tmpdir)
 /**
  * Writes the data of a segment to a file.
  *
- * @param fd the file desciptor of the file to write to
+ * The data are normally added to a write_batch, so they may be written
+ * only when the batch is flushed. Large ranges of files are copied by the
+ * kernel instead.
+ *
+ * @param batch the write_batch of the file to write to
  * @param segment the segment to write
  * @param mapping the mapping of the segment to write
  * @param overlap the overlap of the segment with itself in bytes
  *
  * @return the operation error code
  */
-static int write_segment(int fd, segment_t *segment, off_t mapping, off_t overlap)
+static int write_segment(struct write_batch *batch, segment_t *segment,
+		off_t mapping, off_t overlap)
 {
 	int err;
 
@@ -247,22 +364,24 @@ static int write_segment(int fd, segment_t *segment, off_t mapping, off_t overla
 	off_t nwrite = seg_size;
 
 	/* 
-	 * If the segment overlaps with itself and has moved to a higher address we
-	 * must write it in a safe way (starting from the end). This is necessary
-	 * in order to avoid overwriting data in the file that we need for later
-	 * parts of the segment.
+	 * If the segment overlaps with itself we must write it in a safe way
+	 * (starting from the end if it has moved to a higher address). This is
+	 * necessary in order to avoid overwriting data in the file that we need
+	 * for later parts of the segment. Writing directly from the data object
+	 * isn't safe even when the segment has moved to a lower address, because
+	 * the data may be mapped from the very pages being written.
 	 */
-	if (overlap > 0 && mapping >= seg_start) {
+	if (overlap > 0) {
 		/* if the segment has not moved at all, don't write anything */
 		if (mapping == seg_start)
 			return 0;
 
-		err = write_data_object_safe(dobj, seg_start, nwrite, fd, mapping);
+		err = write_batch_write_safe(batch, dobj, seg_start, nwrite, mapping);
 		if (err)
 			return_error(err);
 	}
 	else {
-		err = write_data_object(dobj, seg_start, nwrite, fd, mapping);
+		err = write_batch_copy(batch, dobj, seg_start, nwrite, mapping);
 		if (err)
 			return_error(err);
 	}
@@ -274,13 +393,14 @@ static int write_segment(int fd, segment_t *segment, off_t mapping, off_t overla
  * Writes the data of a segcol except those belonging to the file we are
  * trying to write to.
  *
- * @param fd the file descriptor of the file to write to
+ * @param batch the write_batch of the file to write to
  * @param segcol the segcol to write the data of
- * @param fd_obj a data_object_t pointing to fd
+ * @param fd_obj a data_object_t pointing to the file
  *
  * @return the operation error code
  */
-static int write_segcol_rest(int fd, segcol_t *segcol, data_object_t *fd_obj)
+static int write_segcol_rest(struct write_batch *batch, segcol_t *segcol,
+		data_object_t *fd_obj)
 {
 	/* Get an iterator for segcol */
 	segcol_iter_t *iter;
@@ -308,7 +428,7 @@ static int write_segcol_rest(int fd, segcol_t *segcol, data_object_t *fd_obj)
 		if (result == 1) {
 			off_t mapping;
 			segcol_iter_get_mapping(iter, &mapping);
-			err = write_segment(fd, seg, mapping, 0);
+			err = write_segment(batch, seg, mapping, 0);
 			if (err)
 				goto_error(err, out);
 		}
@@ -462,10 +582,79 @@ static int buffer_options_new(struct buffer_options **opts)
 		goto_error(err, on_error_mem_undo_after_save);
 	}
 
+	o->segcol_impl = strdup("list");
+	if (o->segcol_impl == NULL)	{
+		err = ENOMEM;
+		goto_error(err, on_error_mem_segcol_impl);
+	}
+
+	char num[32];
+
+	o->file_window_size = DATA_OBJECT_FILE_WINDOW_SIZE;
+
+	snprintf(num, sizeof(num), "%zu", o->file_window_size);
+	o->file_window_size_str = strdup(num);
+	if (o->file_window_size_str == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_mem_file_window_size_str);
+	}
+
+	o->file_windows = DATA_OBJECT_FILE_WINDOWS;
+
+	snprintf(num, sizeof(num), "%d", o->file_windows);
+	o->file_windows_str = strdup(num);
+	if (o->file_windows_str == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_mem_file_windows_str);
+	}
+
+	o->file_backend = strdup("default");
+	if (o->file_backend == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_mem_file_backend);
+	}
+
+	o->find_threads = 1;
+
+	o->find_threads_str = strdup("1");
+	if (o->find_threads_str == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_mem_find_threads_str);
+	}
+
+	o->save_cycles = strdup("spanning_tree");
+	if (o->save_cycles == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_mem_save_cycles);
+	}
+
+	o->save_batch_size = BUFFER_SAVE_BATCH_SIZE;
+
+	snprintf(num, sizeof(num), "%zu", o->save_batch_size);
+	o->save_batch_size_str = strdup(num);
+	if (o->save_batch_size_str == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_mem_save_batch_size_str);
+	}
+
 	*opts = o;
 
 	return 0;
 
+on_error_mem_save_batch_size_str:
+	free(o->save_cycles);
+on_error_mem_save_cycles:
+	free(o->find_threads_str);
+on_error_mem_find_threads_str:
+	free(o->file_backend);
+on_error_mem_file_backend:
+	free(o->file_windows_str);
+on_error_mem_file_windows_str:
+	free(o->file_window_size_str);
+on_error_mem_file_window_size_str:
+	free(o->segcol_impl);
+on_error_mem_segcol_impl:
+	free(o->undo_after_save);
 on_error_mem_undo_after_save:
 	free(o->undo_limit_str);
 on_error_mem_undo_limit_str:
@@ -487,6 +676,13 @@ static int buffer_options_free(struct buffer_options *opts)
 	free(opts->tmp_dir);
 	free(opts->undo_limit_str);
 	free(opts->undo_after_save);
+	free(opts->segcol_impl);
+	free(opts->file_window_size_str);
+	free(opts->file_windows_str);
+	free(opts->file_backend);
+	free(opts->find_threads_str);
+	free(opts->save_cycles);
+	free(opts->save_batch_size_str);
 	free(opts);
 
 	return 0;
@@ -552,13 +748,13 @@ int bless_buffer_new(bless_buffer_t **buf)
 	if (*buf == NULL)
 		return_error(ENOMEM);
 	
-	int err = segcol_list_new(&(*buf)->segcol);
+	int err = buffer_options_new(&(*buf)->options);
 	if (err)
-		goto_error(err, on_error_segcol);
+		goto_error(err, on_error_options);
 
-	err = buffer_options_new(&(*buf)->options);
+	err = segcol_new_by_name(&(*buf)->segcol, (*buf)->options->segcol_impl);
 	if (err)
-		goto_error(err, on_error_options);
+		goto_error(err, on_error_segcol);
 		
 	err = list_new(&(*buf)->undo_list, struct buffer_action_entry, ln);
 	if (err)
@@ -570,6 +766,10 @@ int bless_buffer_new(bless_buffer_t **buf)
 	if (err)
 		goto_error(err, on_error_redo);
 
+	err = list_new(&(*buf)->extents, struct bless_buffer_extents, ln);
+	if (err)
+		goto_error(err, on_error_extents);
+
 	(*buf)->redo_list_size = 0;
 	(*buf)->multi_action = NULL;
 	(*buf)->multi_action_count = 0;
@@ -578,17 +778,22 @@ int bless_buffer_new(bless_buffer_t **buf)
 	(*buf)->save_rev_id = 0;
 	(*buf)->event_func = NULL;
 	(*buf)->event_user_data = NULL;
+	(*buf)->add_buffer = NULL;
+	(*buf)->add_buffer_data = NULL;
+	(*buf)->add_buffer_used = 0;
 
 	return 0;
 
 	/* Handle errors */
+on_error_extents:
+	list_free((*buf)->redo_list);
 on_error_redo:
 	list_free((*buf)->undo_list);
 on_error_undo:
-	buffer_options_free((*buf)->options);
-on_error_options:
 	segcol_free((*buf)->segcol);
 on_error_segcol:
+	buffer_options_free((*buf)->options);
+on_error_options:
 	free(buf);
 
 	return err;
@@ -600,6 +805,9 @@ on_error_segcol:
  * The supplied @fd is not used internally after the end of this
  * function and may be manipulated freely (eg closed).
  *
+ * If extents of the buffer (see bless_buffer_read_extents()) point to data
+ * of the file, the save fails with EBUSY.
+ *
  * @param buf the bless_buffer_t whose contents to save
  * @param fd the file descriptor of the file to save the contents to
  * @param progress_func the bless_progress_func to call to report the 
@@ -615,6 +823,18 @@ int bless_buffer_save(bless_buffer_t *buf, int fd,
 	if (buf == NULL)
 		return_error(EINVAL);
 
+	/* 
+	 * Saving would change the data of the file that extents of the buffer
+	 * point to.
+	 */
+	int pinned;
+	int err = extents_pin_file(buf, fd, &pinned);
+	if (err)
+		return_error(err);
+
+	if (pinned)
+		return_error(EBUSY);
+
 	/* Make a copy of fd and use this from now on */
 	int fd_copy = dup(fd);
 	if (fd_copy == -1)
@@ -629,7 +849,7 @@ int bless_buffer_save(bless_buffer_t *buf, int fd,
 	 */
 	int fd_resizable = 0;
 
-	int err = is_fd_resizable(fd_copy, &fd_resizable);
+	err = is_fd_resizable(fd_copy, &fd_resizable);
 	if (err)
 		return_error(err);
 
@@ -660,10 +880,21 @@ int bless_buffer_save(bless_buffer_t *buf, int fd,
 	if (err)
 		return_error(err);
 
+	err = buffer_apply_file_options(buf, fd_obj);
+	if (err)
+		return_error(err);
+
 	err = data_object_update_usage(fd_obj, 1);
 	if (err)
 		return_error(err);
 
+	/* The overlap graphs are created for the segments of this file */
+	dev_t fd_dev;
+	ino_t fd_ino;
+	err = data_object_file_get_id(fd_obj, &fd_dev, &fd_ino);
+	if (err)
+		goto_error(err, on_error_1);
+
 	/* Make private copies of data in undo/redo actions. */
 	if (!strcmp(buf->options->undo_after_save, "always")) {
 		/* 
@@ -693,12 +924,12 @@ int bless_buffer_save(bless_buffer_t *buf, int fd,
 	 * Create the overlap graph and remove any cycles
 	 */
 	overlap_graph_t *g;
-	err = create_overlap_graph(&g, buf->segcol, fd_obj);
+	err = create_overlap_graph(&g, buf->segcol, fd_dev, fd_ino);
 	if (err)
 		goto_error(err, on_error_1);
 
 	/* Remove cycles from the graph */
-	err = overlap_graph_remove_cycles(g);
+	err = remove_overlap_cycles(g, buf->options->save_cycles);
 	if (err)
 		goto_error(err, on_error_2);
 
@@ -732,7 +963,7 @@ int bless_buffer_save(bless_buffer_t *buf, int fd,
 	 * existed before it was called.
 	 */
 	segcol_t *segcol_tmp;
-	err = segcol_list_new(&segcol_tmp);
+	err = segcol_new_by_name(&segcol_tmp, buf->options->segcol_impl);
 	if (err)
 		goto_error(err, on_error_1);
 
@@ -748,37 +979,55 @@ int bless_buffer_save(bless_buffer_t *buf, int fd,
 			goto_error(err, on_error_4);
 	}
 
+	/* Gather the data to write in batches of consecutive segments */
+	struct write_batch *batch;
+	err = write_batch_new(&batch, fd_copy, buf->options->save_batch_size);
+	if (err)
+		goto_error(err, on_error_4);
+
 	/* 
 	 * Create the overlap graph again and get the nodes in
 	 * topological order.
 	 */
-	err = create_overlap_graph(&g, buf->segcol, fd_obj);
+	err = create_overlap_graph(&g, buf->segcol, fd_dev, fd_ino);
 	if (err)
-		goto_error(err, on_error_4);
+		goto_error(err, on_error_5);
 
 	/* Write the file segments to file in topological order */
 	list_t *vertices;
 	err = overlap_graph_get_vertices_topo(g, &vertices);
 	if (err)
-		goto_error(err, on_error_5);
+		goto_error(err, on_error_6);
 
 	first_node =
 		list_head(vertices)->next;
 
 	list_for_each(first_node, node) {
 		struct vertex_entry *v = list_entry(node, struct vertex_entry, ln);
-		err = write_segment(fd_copy, v->segment, v->mapping, v->self_loop_weight);
+		err = write_segment(batch, v->segment, v->mapping,
+				v->self_loop_weight);
 		if (err)
-			goto_error(err, on_error_6);
+			goto_error(err, on_error_7);
 	}
 	
 	free_vertex_list(vertices);
 	overlap_graph_free(g);
 
+	/* The file segments must be in place before writing anything else */
+	err = write_batch_flush(batch);
+	if (err)
+		goto_error(err, on_error_5);
+
 	/* Write the rest of the segments */
-	err = write_segcol_rest(fd_copy, buf->segcol, fd_obj);
+	err = write_segcol_rest(batch, buf->segcol, fd_obj);
 	if (err)
-		goto_error(err, on_error_4);
+		goto_error(err, on_error_5);
+
+	err = write_batch_flush(batch);
+	if (err)
+		goto_error(err, on_error_5);
+
+	write_batch_free(batch);
 
 	/* Truncate file to final size (only if it is a resizable file) */
 	if (fd_resizable == 1) {
@@ -832,16 +1081,68 @@ on_error_1:
 
 	return err;
 
-on_error_6:
+on_error_7:
 	free_vertex_list(vertices);
-on_error_5:
+on_error_6:
 	overlap_graph_free(g);
+on_error_5:
+	write_batch_free(batch);
 on_error_4:
 	segcol_free(segcol_tmp);
 	goto on_error_1;
 
 }
 
+/**
+ * Gets the number of bytes that saving a bless_buffer_t to a file would
+ * have to copy out of the file before overwriting it.
+ *
+ * When the buffer contains data of the file it is saved to, and these data
+ * have moved, saving the buffer overwrites data that are needed later on.
+ * bless_buffer_save() copies these data to memory or temporary files first.
+ * Their size depends on the contents of the buffer and the
+ * BLESS_BUF_SAVE_CYCLES option. The buffer and the file are not changed.
+ *
+ * The spill is computed from the ranges of the segments of the buffer that
+ * point to the file alone, so the file is neither read nor mapped.
+ *
+ * @param buf the bless_buffer_t whose contents would be saved
+ * @param fd the file descriptor of the file the contents would be saved to
+ * @param[out] spill the number of bytes that would be copied
+ *
+ * @return the operation error code
+ */
+int bless_buffer_get_save_spill(bless_buffer_t *buf, int fd, off_t *spill)
+{
+	if (buf == NULL || spill == NULL)
+		return_error(EINVAL);
+
+	/* The file is identified by its device and inode */
+	struct stat fd_stat;
+	if (fstat(fd, &fd_stat) == -1)
+		return_error(errno);
+
+	/* Break the cycles of the overlap graph as a save would */
+	overlap_graph_t *g;
+	int err = create_overlap_graph(&g, buf->segcol, fd_stat.st_dev,
+			fd_stat.st_ino);
+	if (err)
+		return_error(err);
+
+	err = remove_overlap_cycles(g, buf->options->save_cycles);
+	if (err)
+		goto_error(err, on_error);
+
+	err = overlap_graph_get_removed_weight(g, spill);
+	if (err)
+		goto_error(err, on_error);
+
+on_error:
+	overlap_graph_free(g);
+
+	return err;
+}
+
 /**
  * Frees a bless_buffer_t.
  *
@@ -888,6 +1189,20 @@ int bless_buffer_free(bless_buffer_t *buf)
 
 	list_free(buf->redo_list);
 
+	/* Release the add buffer (it is freed when no segments point to it) */
+	if (buf->add_buffer != NULL)
+		data_object_update_usage(buf->add_buffer, -1);
+
+	/* Extents that are still held remain valid without the buffer */
+	list_for_each_safe(list_head(buf->extents)->next, node, tmp) {
+		struct bless_buffer_extents *ext =
+			list_entry(node, struct bless_buffer_extents, ln);
+
+		ext->buf = NULL;
+	}
+
+	list_free(buf->extents);
+
 	free(buf);
 
 	return 0;
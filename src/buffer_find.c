@@ -0,0 +1,2059 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file buffer_find.c
+ *
+ * Buffer search operations
+ *
+ * The buffer contents are searched in place: the segments in the range are
+ * walked with segcol_foreach() and their data are retrieved in chunks with
+ * data_object_get_data(), without copying them. To find matches that straddle
+ * chunk boundaries (segment, mmap window or pread buffer boundaries), the
+ * last bytes of each chunk that may be the start of a match are kept in a
+ * small staging area, along with the first bytes of the next chunk. Small
+ * chunks are gathered in the staging area and searched together.
+ *
+ * The chunks are searched with the vectorized search kernels for short
+ * patterns and with the Boyer-Moore-Horspool algorithm for long ones (see
+ * search_kernel.c).
+ *
+ * Backward searches (bless_buffer_rfind()) walk the segments with
+ * segcol_foreach_reverse() and retrieve the chunks from the end of each
+ * segment with the DATA_OBJECT_REVERSE flag, so that the data objects read
+ * ahead towards the start of the buffer. The staging area then keeps the
+ * first bytes of each chunk, that may be the end of a match, and the chunks
+ * are searched with the reverse search kernels.
+ *
+ * Masked patterns are searched for by looking for their longest unmasked
+ * run of bytes (the anchor) in the same way, and checking the masked bytes
+ * around each occurrence of the anchor.
+ *
+ * If the BLESS_BUF_FIND_THREADS option is larger than 1, large ranges are
+ * searched in parallel. The range is split in blocks that overlap by the
+ * pattern length - 1 and worker threads search the blocks in order, each
+ * through its own views of the file data objects (so that the mapping
+ * windows and pread caches are not shared). Once a match is found in a
+ * block, only the blocks before it are searched further, and the match in
+ * the lowest block is returned, so the result doesn't depend on the
+ * scheduling of the workers. Progress is reported and cancellation is
+ * checked in the calling thread.
+ *
+ * Pattern sets and regexes are searched by running their automata over the
+ * chunks of the segments as they are walked, so they need no staging area:
+ * the state of the automaton carries over from chunk to chunk.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "buffer.h"
+#include "buffer_internal.h"
+#include "buffer_util.h"
+#include "data_object.h"
+#include "data_object_file.h"
+#include "data_object_file_index.h"
+#include "segcol.h"
+#include "segment.h"
+#include "search_kernel.h"
+#include "buffer_pattern_set.h"
+#include "buffer_regex.h"
+#include "type_limits.h"
+#include "util.h"
+#include "debug.h"
+
+#pragma GCC visibility push(default)
+
+/** The minimum size of the staging area of a search */
+#define FIND_STAGE_SIZE (64 * 1024)
+
+/** The maximum pattern length for which the search kernels are used */
+#define FIND_KERNEL_MAX_LENGTH 64
+
+/** The maximum amount of data to search between progress reports */
+#define FIND_CHUNK_SIZE (16 * 1024 * 1024)
+
+/** The size of the blocks searched by the workers of parallel searches */
+#define FIND_BLOCK_SIZE (64 * 1024 * 1024)
+
+/** The minimum amount of file data to skip using the file search indexes */
+#define FIND_INDEX_MIN_SKIP (4 * 1024)
+
+struct find_worker;
+
+/**
+ * The state of a search in a bless_buffer_t.
+ */
+struct find_state {
+	/* The pattern and its mask (NULL if all the bits must match) */
+	const unsigned char *pattern;
+	const unsigned char *mask;
+	size_t length;
+
+	/* The part of the pattern searched for directly and its BMH search */
+	size_t anchor_pos;
+	size_t anchor_len;
+	struct search_bmh bmh;
+
+	/* Whether the search goes backwards (the pattern is never masked then) */
+	int reverse;
+
+	/*
+	 * The staging area, holding buffer data [stage_pos, stage_pos + stage_len)
+	 * at its start (at its end for backward searches)
+	 */
+	unsigned char *stage;
+	size_t stage_size;
+	size_t stage_len;
+	off_t stage_pos;
+
+	/*
+	 * The first offset at which a match hasn't been checked for yet (the
+	 * last one for backward searches)
+	 */
+	off_t next_start;
+
+	/* The offset of the match found or -1 */
+	off_t match;
+
+	/*
+	 * The function to report all the matches to (NULL to stop at the first
+	 * match), whether overlapping matches are reported and whether the
+	 * function stopped the search
+	 */
+	bless_buffer_match_func *match_func;
+	void *user_data;
+	int overlapping;
+	int stopped;
+
+	/* Progress reporting */
+	bless_progress_func *progress_func;
+	struct bless_buffer_find_progress_info progress;
+	off_t progress_next;
+
+	/* The worker performing the search (NULL if the search is serial) */
+	struct find_worker *worker;
+
+	/*
+	 * The n-grams of the pattern to look up in file indexes (nhashes is 0
+	 * if indexes aren't used), the last file data object searched and its
+	 * index (NULL if it has none)
+	 */
+	struct file_index_query index_query;
+	data_object_t *index_obj;
+	struct file_index *index;
+};
+
+/**
+ * A part of the searched range that is contiguous in a data object.
+ */
+struct find_extent {
+	data_object_t *obj;
+	off_t obj_offset;
+	off_t pos;
+	off_t length;
+};
+
+/**
+ * The state shared by the workers of a parallel search.
+ */
+struct find_parallel {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* The pattern */
+	const unsigned char *pattern;
+	const unsigned char *mask;
+	size_t length;
+
+	/* The extents of the searched range [start, end) */
+	struct find_extent *extents;
+	size_t nextents;
+	size_t extents_size;
+	off_t start;
+	off_t end;
+
+	/* The blocks of the range and the next one to search */
+	off_t nblocks;
+	off_t next_block;
+
+	/* The lowest block a match was found in (nblocks if none) and the match */
+	off_t match_block;
+	off_t match;
+
+	/* The amount of data searched, the running workers and their status */
+	off_t searched;
+	int running;
+	int cancel;
+	int err;
+};
+
+/**
+ * A worker of a parallel search.
+ */
+struct find_worker {
+	pthread_t thread;
+	struct find_parallel *par;
+
+	/* The block being searched */
+	off_t block;
+
+	/* The file data objects searched and the worker's views of them */
+	data_object_t **objs;
+	data_object_t **views;
+	size_t nviews;
+};
+
+/********************
+ * Helper functions *
+ ********************/
+
+/**
+ * Initializes a find_state.
+ *
+ * @param st the find_state to initialize
+ * @param pattern the pattern to search for
+ * @param mask the mask of the pattern (NULL if all the bits must match)
+ * @param length the length of the pattern
+ * @param start_offset the offset to start searching from
+ * @param reverse whether to search backwards from start_offset (the data
+ *        must then be processed from the end of start_offset + length)
+ *
+ * @return the operation error code
+ */
+static int find_state_init(struct find_state *st, const unsigned char *pattern,
+		const unsigned char *mask, size_t length, off_t start_offset,
+		int reverse)
+{
+	st->pattern = pattern;
+	st->mask = mask;
+	st->length = length;
+	st->anchor_pos = 0;
+	st->anchor_len = length;
+
+	/* Find the longest unmasked run of bytes of a masked pattern */
+	if (mask != NULL) {
+		size_t run = 0;
+		size_t i;
+
+		st->anchor_len = 0;
+
+		for (i = 0; i < length; i++) {
+			run = (mask[i] == 0xff) ? run + 1 : 0;
+
+			if (run > st->anchor_len) {
+				st->anchor_pos = i + 1 - run;
+				st->anchor_len = run;
+			}
+		}
+
+		/* A pattern without masked bits is searched for as is */
+		if (st->anchor_len == length)
+			st->mask = NULL;
+	}
+
+	if (st->anchor_len > FIND_KERNEL_MAX_LENGTH) {
+		if (reverse)
+			search_bmh_rinit(&st->bmh, pattern, length);
+		else
+			search_bmh_init(&st->bmh, pattern + st->anchor_pos,
+					st->anchor_len);
+	}
+
+	/* The staging area must fit a full chunk boundary (2 * (length - 1)) */
+	st->stage_size = FIND_STAGE_SIZE;
+	if (length > st->stage_size / 2)
+		st->stage_size = 2 * length;
+
+	st->stage = malloc(st->stage_size);
+	if (st->stage == NULL)
+		return_error(ENOMEM);
+
+	st->reverse = reverse;
+	st->stage_len = 0;
+	st->stage_pos = reverse ? start_offset + (off_t)length : start_offset;
+	st->next_start = start_offset;
+	st->match = -1;
+	st->match_func = NULL;
+	st->user_data = NULL;
+	st->overlapping = 0;
+	st->stopped = 0;
+	st->progress_func = NULL;
+	st->progress.searched = 0;
+	st->progress.total = 0;
+	st->progress_next = FIND_CHUNK_SIZE;
+	st->worker = NULL;
+
+	/* File indexes are used only for forward searches of unmasked patterns */
+	st->index_query.nhashes = 0;
+	st->index_obj = NULL;
+	st->index = NULL;
+
+	if (!reverse && st->mask == NULL)
+		file_index_query_init(&st->index_query, pattern, length);
+
+	return 0;
+}
+
+/**
+ * Frees the resources held by a find_state.
+ *
+ * @param st the find_state
+ */
+static void find_state_free(struct find_state *st)
+{
+	free(st->stage);
+
+	if (st->index != NULL)
+		file_index_unref(st->index);
+}
+
+/**
+ * Gets the search index of a data object for a search.
+ *
+ * The index of the last file data object searched is kept in the find_state,
+ * so that it isn't looked up (and checked) for every segment.
+ *
+ * @param st the find_state
+ * @param dobj the data object
+ *
+ * @return the file_index of dobj or NULL if it has none
+ */
+static struct file_index *find_state_get_index(struct find_state *st,
+		data_object_t *dobj)
+{
+	if (dobj == st->index_obj)
+		return st->index;
+
+	int is_file;
+	if (data_object_is_file(dobj, &is_file) || !is_file)
+		return NULL;
+
+	if (st->index != NULL)
+		file_index_unref(st->index);
+
+	st->index_obj = dobj;
+	st->index = NULL;
+
+	if (data_object_file_get_index(dobj, &st->index))
+		st->index = NULL;
+
+	return st->index;
+}
+
+/**
+ * Searches for the anchor of the pattern of a search in a memory area.
+ *
+ * @param st the find_state
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ *
+ * @return the index of the first match in data or -1 if there is no match
+ */
+static ssize_t find_anchor(struct find_state *st, const unsigned char *data,
+		size_t len)
+{
+	if (st->anchor_len <= FIND_KERNEL_MAX_LENGTH)
+		return search_kernel_find(data, len, st->pattern + st->anchor_pos,
+				st->anchor_len);
+	else
+		return search_bmh_find(&st->bmh, data, len);
+}
+
+/**
+ * Checks whether the masked pattern of a search matches some data.
+ *
+ * @param st the find_state
+ * @param data the data (at least st->length bytes)
+ *
+ * @return 1 if the pattern matches, 0 otherwise
+ */
+static int match_masked(struct find_state *st, const unsigned char *data)
+{
+	size_t i;
+	for (i = 0; i < st->length; i++) {
+		if ((data[i] ^ st->pattern[i]) & st->mask[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Searches for the pattern of a search in a memory area.
+ *
+ * @param st the find_state
+ * @param data the memory area to search
+ * @param len the length of the memory area (at least st->length)
+ *
+ * @return the index of the first match in data or -1 if there is no match
+ */
+static ssize_t find_in_memory(struct find_state *st, const unsigned char *data,
+		size_t len)
+{
+	if (st->mask == NULL)
+		return find_anchor(st, data, len);
+
+	/* The last index a match can start at */
+	size_t last = len - st->length;
+	size_t i = 0;
+
+	/* Without an anchor every index must be checked */
+	if (st->anchor_len == 0) {
+		for (i = 0; i <= last; i++) {
+			if (match_masked(st, data + i))
+				return i;
+		}
+
+		return -1;
+	}
+
+	/* Find the anchor and check the rest of the pattern around it */
+	while (i <= last) {
+		ssize_t idx = find_anchor(st, data + i + st->anchor_pos,
+				last - i + st->anchor_len);
+		if (idx < 0)
+			return -1;
+
+		i += idx;
+
+		if (match_masked(st, data + i))
+			return i;
+
+		i++;
+	}
+
+	return -1;
+}
+
+/**
+ * Searches for matches starting in a contiguous region of the buffer.
+ *
+ * Only matches starting at or after st->next_start are considered. Unless
+ * the search stops, st->next_start is advanced past all the match positions
+ * that could be checked in this region.
+ *
+ * If st->match_func is set, all the matches are reported to it and the
+ * search stops only if it returns non-zero.
+ *
+ * @param st the find_state
+ * @param data the data of the region
+ * @param pos the offset of the region in the buffer
+ * @param len the length of the region
+ *
+ * @return 1 if the search must stop (the last match is stored in st->match),
+ *         0 otherwise
+ */
+static int search_region(struct find_state *st, const unsigned char *data,
+		off_t pos, size_t len)
+{
+	if (len < st->length)
+		return 0;
+
+	size_t from = 0;
+	if (st->next_start > pos)
+		from = st->next_start - pos;
+
+	while (from <= len - st->length) {
+		ssize_t idx = find_in_memory(st, data + from, len - from);
+		if (idx < 0)
+			break;
+
+		st->match = pos + from + idx;
+
+		if (st->match_func == NULL)
+			return 1;
+
+		if ((*st->match_func)(st->match, st->length, 0, st->user_data)) {
+			st->stopped = 1;
+			return 1;
+		}
+
+		/* Continue after the match (or its start, if matches can overlap) */
+		st->next_start = st->match + (st->overlapping ? 1 : st->length);
+		from = st->next_start - pos;
+	}
+
+	off_t next = pos + (off_t)(len - st->length) + 1;
+	if (next > st->next_start)
+		st->next_start = next;
+
+	return 0;
+}
+
+/**
+ * Removes the data that can't be the start of a match from the staging area.
+ *
+ * @param st the find_state
+ */
+static void stage_trim(struct find_state *st)
+{
+	if (st->next_start <= st->stage_pos)
+		return;
+
+	size_t drop = st->stage_len;
+	if (st->next_start - st->stage_pos < (off_t)drop)
+		drop = st->next_start - st->stage_pos;
+
+	memmove(st->stage, st->stage + drop, st->stage_len - drop);
+	st->stage_len -= drop;
+	st->stage_pos += drop;
+}
+
+/**
+ * Appends data to the staging area (the caller must ensure there is space).
+ *
+ * @param st the find_state
+ * @param data the data to append
+ * @param len the length of the data
+ */
+static void stage_append(struct find_state *st, const unsigned char *data,
+		size_t len)
+{
+	memcpy(st->stage + st->stage_len, data, len);
+	st->stage_len += len;
+}
+
+/**
+ * Searches a chunk of the buffer data.
+ *
+ * The chunks must be processed in order, without gaps.
+ *
+ * @param st the find_state
+ * @param data the data of the chunk
+ * @param pos the offset of the chunk in the buffer
+ * @param len the length of the chunk
+ *
+ * @return 1 if the search must stop (see search_region()), 0 otherwise
+ */
+static int search_chunk(struct find_state *st, const unsigned char *data,
+		off_t pos, size_t len)
+{
+	/* Gather small chunks in the staging area */
+	if (st->stage_size - st->stage_len >= len) {
+		stage_append(st, data, len);
+		return 0;
+	}
+
+	/* 
+	 * Search the staging area and keep only the data that may be the
+	 * start of a match (less than the pattern length).
+	 */
+	if (search_region(st, st->stage, st->stage_pos, st->stage_len))
+		return 1;
+
+	stage_trim(st);
+
+	/* Search for matches that straddle the chunk boundary */
+	size_t head = st->length - 1;
+	if (head > len)
+		head = len;
+
+	stage_append(st, data, head);
+
+	if (search_region(st, st->stage, st->stage_pos, st->stage_len))
+		return 1;
+
+	stage_trim(st);
+
+	if (head == len)
+		return 0;
+
+	/* Search the chunk in place */
+	if (search_region(st, data, pos, len))
+		return 1;
+
+	/* Keep the end of the chunk that may be the start of a match */
+	st->stage_len = 0;
+	st->stage_pos = st->next_start;
+	stage_append(st, data + (st->next_start - pos),
+			len - (st->next_start - pos));
+
+	return 0;
+}
+
+/**
+ * Searches for the last match of the pattern of a backward search in a
+ * memory area.
+ *
+ * @param st the find_state
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ *
+ * @return the index of the last match in data or -1 if there is no match
+ */
+static ssize_t rfind_in_memory(struct find_state *st,
+		const unsigned char *data, size_t len)
+{
+	if (st->length <= FIND_KERNEL_MAX_LENGTH)
+		return search_kernel_rfind(data, len, st->pattern, st->length);
+	else
+		return search_bmh_rfind(&st->bmh, data, len);
+}
+
+/**
+ * Searches backwards for matches starting in a contiguous region of the
+ * buffer.
+ *
+ * Only matches starting at or before st->next_start are considered. The
+ * region must contain all the data up to the end of a match starting at
+ * st->next_start. If no match is found, st->next_start is moved before the
+ * region.
+ *
+ * @param st the find_state
+ * @param data the data of the region
+ * @param pos the offset of the region in the buffer
+ * @param len the length of the region
+ *
+ * @return 1 if a match was found (stored in st->match), 0 otherwise
+ */
+static int rsearch_region(struct find_state *st, const unsigned char *data,
+		off_t pos, size_t len)
+{
+	if (len < st->length || st->next_start < pos)
+		return 0;
+
+	/* The last index a match can start at */
+	size_t last = len - st->length;
+	if (st->next_start - pos < (off_t)last)
+		last = st->next_start - pos;
+
+	ssize_t idx = rfind_in_memory(st, data, last + st->length);
+	if (idx >= 0) {
+		st->match = pos + idx;
+		return 1;
+	}
+
+	st->next_start = pos - 1;
+
+	return 0;
+}
+
+/**
+ * Gets the data in the staging area of a backward search.
+ *
+ * @param st the find_state
+ *
+ * @return the data at st->stage_pos
+ */
+static unsigned char *rstage_data(struct find_state *st)
+{
+	return st->stage + (st->stage_size - st->stage_len);
+}
+
+/**
+ * Removes the data that can't be the end of a match from the staging area
+ * of a backward search.
+ *
+ * @param st the find_state
+ */
+static void rstage_trim(struct find_state *st)
+{
+	off_t keep = st->next_start + (off_t)st->length - st->stage_pos;
+	if (keep < 0)
+		keep = 0;
+
+	if (keep >= (off_t)st->stage_len)
+		return;
+
+	memmove(st->stage + (st->stage_size - keep), rstage_data(st), keep);
+	st->stage_len = keep;
+}
+
+/**
+ * Prepends data to the staging area of a backward search (the caller must
+ * ensure there is space).
+ *
+ * @param st the find_state
+ * @param data the data to prepend
+ * @param len the length of the data
+ */
+static void rstage_prepend(struct find_state *st, const unsigned char *data,
+		size_t len)
+{
+	st->stage_len += len;
+	st->stage_pos -= len;
+	memcpy(rstage_data(st), data, len);
+}
+
+/**
+ * Searches a chunk of the buffer data in a backward search.
+ *
+ * The chunks must be processed in reverse order, without gaps.
+ *
+ * @param st the find_state
+ * @param data the data of the chunk
+ * @param pos the offset of the chunk in the buffer
+ * @param len the length of the chunk
+ *
+ * @return 1 if a match was found (stored in st->match), 0 otherwise
+ */
+static int rsearch_chunk(struct find_state *st, const unsigned char *data,
+		off_t pos, size_t len)
+{
+	/* Gather small chunks in the staging area */
+	if (st->stage_size - st->stage_len >= len) {
+		rstage_prepend(st, data, len);
+		return 0;
+	}
+
+	/* 
+	 * Search the staging area and keep only the data that may be the
+	 * end of a match (less than the pattern length).
+	 */
+	if (rsearch_region(st, rstage_data(st), st->stage_pos, st->stage_len))
+		return 1;
+
+	rstage_trim(st);
+
+	/* Search for matches that straddle the chunk boundary */
+	size_t tail = st->length - 1;
+	if (tail > len)
+		tail = len;
+
+	rstage_prepend(st, data + (len - tail), tail);
+
+	if (rsearch_region(st, rstage_data(st), st->stage_pos, st->stage_len))
+		return 1;
+
+	rstage_trim(st);
+
+	if (tail == len)
+		return 0;
+
+	/* Search the chunk in place */
+	if (rsearch_region(st, data, pos, len))
+		return 1;
+
+	/* Keep the start of the chunk that may be the end of a match */
+	off_t keep = st->next_start + (off_t)st->length - pos;
+	if (keep < 0)
+		keep = 0;
+	if (keep > (off_t)len)
+		keep = len;
+
+	st->stage_len = 0;
+	st->stage_pos = pos + keep;
+	rstage_prepend(st, data, keep);
+
+	return 0;
+}
+
+/**
+ * Reports the progress of a parallel search and checks whether the worker
+ * should stop.
+ *
+ * @param w the find_worker
+ * @param len the amount of data searched since the last report
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled or
+ *         failed in another worker, SEGCOL_FOREACH_STOP if a match was found
+ *         in a previous block)
+ */
+static int find_worker_report(struct find_worker *w, off_t len)
+{
+	struct find_parallel *par = w->par;
+	int ret = 0;
+
+	pthread_mutex_lock(&par->mutex);
+
+	par->searched += len;
+
+	if (par->cancel || par->err)
+		ret = ECANCELED;
+	else if (par->match_block < w->block)
+		ret = SEGCOL_FOREACH_STOP;
+
+	pthread_cond_signal(&par->cond);
+	pthread_mutex_unlock(&par->mutex);
+
+	return ret;
+}
+
+/**
+ * Reports the progress of a search and checks for cancellation.
+ *
+ * @param st the find_state
+ * @param len the amount of data searched since the last report
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP if the search must stop)
+ */
+static int find_report_progress(struct find_state *st, off_t len)
+{
+	if (st->worker != NULL) {
+		int err = find_worker_report(st->worker, len);
+		if (err == SEGCOL_FOREACH_STOP)
+			return err;
+		else if (err)
+			return_error(err);
+
+		return 0;
+	}
+
+	st->progress.searched += len;
+
+	if (st->progress_func != NULL
+			&& st->progress.searched >= st->progress_next) {
+		st->progress_next = st->progress.searched + FIND_CHUNK_SIZE;
+		if ((*st->progress_func)(&st->progress))
+			return_error(ECANCELED);
+	}
+
+	return 0;
+}
+
+/**
+ * Searches a range of the data of a data object chunk by chunk.
+ *
+ * @param st the find_state
+ * @param dobj the data object
+ * @param read_start the offset in the data object to start searching
+ * @param read_length the length of the data to search
+ * @param pos the offset of the data in the buffer
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP if the search must stop, eg a match was found)
+ */
+static int find_in_object_chunks(struct find_state *st, data_object_t *dobj,
+		off_t read_start, off_t read_length, off_t pos)
+{
+	while (read_length > 0) {
+		void *data;
+		off_t len = read_length;
+		if (len > FIND_CHUNK_SIZE)
+			len = FIND_CHUNK_SIZE;
+
+		int err;
+
+		/* Backward searches get the chunks from the end of the range */
+		if (st->reverse) {
+			err = data_object_get_data(dobj, &data,
+					read_start + (read_length - len), &len,
+					DATA_OBJECT_READ | DATA_OBJECT_REVERSE);
+			if (err)
+				return_error(err);
+
+			read_length -= len;
+
+			if (rsearch_chunk(st, data, pos + read_length, len))
+				return SEGCOL_FOREACH_STOP;
+		}
+		else {
+			err = data_object_get_data(dobj, &data, read_start, &len,
+					DATA_OBJECT_READ);
+			if (err)
+				return_error(err);
+
+			if (search_chunk(st, data, pos, len))
+				return SEGCOL_FOREACH_STOP;
+
+			read_start += len;
+			read_length -= len;
+			pos += len;
+		}
+
+		err = find_report_progress(st, len);
+		if (err == SEGCOL_FOREACH_STOP)
+			return err;
+		else if (err)
+			return_error(err);
+	}
+
+	return 0;
+}
+
+/**
+ * Searches a range of the data of a file data object using its index.
+ *
+ * The parts of the range where the index shows that no match can start
+ * are skipped. Before skipping, the first bytes of the skipped part are
+ * searched (to complete the matches that start before it) and the staging
+ * area is flushed.
+ *
+ * @param st the find_state
+ * @param index the file_index of the data object
+ * @param dobj the data object
+ * @param read_start the offset in the data object to start searching
+ * @param read_length the length of the data to search
+ * @param pos the offset of the data in the buffer
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP if the search must stop, eg a match was found)
+ */
+static int find_in_indexed_object(struct find_state *st,
+		struct file_index *index, data_object_t *dobj, off_t read_start,
+		off_t read_length, off_t pos)
+{
+	off_t end = read_start + read_length;
+	off_t head = st->length - 1;
+
+	while (read_start < end) {
+		off_t cand_start;
+		off_t cand_end;
+		int err = file_index_find_candidates(index, &st->index_query,
+				read_start, end, &cand_start, &cand_end);
+		if (err)
+			return_error(err);
+
+		off_t skip = cand_start - read_start;
+
+		if (skip >= FIND_INDEX_MIN_SKIP && skip >= head) {
+			/* Complete the matches that start before the skipped data */
+			err = find_in_object_chunks(st, dobj, read_start, head, pos);
+			if (err == SEGCOL_FOREACH_STOP)
+				return err;
+			else if (err)
+				return_error(err);
+
+			if (search_region(st, st->stage, st->stage_pos, st->stage_len))
+				return SEGCOL_FOREACH_STOP;
+
+			/* Continue from the first offset a match may start at */
+			st->stage_len = 0;
+			st->stage_pos = pos + skip;
+			if (st->next_start < st->stage_pos)
+				st->next_start = st->stage_pos;
+
+			err = find_report_progress(st, skip - head);
+			if (err == SEGCOL_FOREACH_STOP)
+				return err;
+			else if (err)
+				return_error(err);
+
+			read_start = cand_start;
+			pos += skip;
+		}
+
+		/* Search the data the candidate matches may lie in */
+		off_t len = cand_end + head - read_start;
+		if (len > end - read_start)
+			len = end - read_start;
+
+		err = find_in_object_chunks(st, dobj, read_start, len, pos);
+		if (err == SEGCOL_FOREACH_STOP)
+			return err;
+		else if (err)
+			return_error(err);
+
+		read_start += len;
+		pos += len;
+	}
+
+	return 0;
+}
+
+/**
+ * Searches a range of the data of a data object.
+ *
+ * @param st the find_state
+ * @param dobj the data object
+ * @param read_start the offset in the data object to start searching
+ * @param read_length the length of the data to search
+ * @param pos the offset of the data in the buffer
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP if the search must stop, eg a match was found)
+ */
+static int find_in_object(struct find_state *st, data_object_t *dobj,
+		off_t read_start, off_t read_length, off_t pos)
+{
+	struct file_index *index = NULL;
+
+	/* Use the index of file data, if there is one */
+	if (st->index_query.nhashes > 0)
+		index = find_state_get_index(st, dobj);
+
+	if (index != NULL)
+		return find_in_indexed_object(st, index, dobj, read_start,
+				read_length, pos);
+
+	return find_in_object_chunks(st, dobj, read_start, read_length, pos);
+}
+
+/**
+ * A segcol_foreach_func that searches the data of a segment.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment to search
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the offset in the data of the segment to start searching
+ * @param read_length the length of the data to search
+ * @param user_data the find_state
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP when a match is found)
+ */
+static int find_foreach_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+
+	struct find_state *st = user_data;
+
+	data_object_t *dobj;
+	segment_get_data(seg, (void **)&dobj);
+
+	off_t start;
+	segment_get_start(seg, &start);
+
+	/* The offset in the buffer of the data to search */
+	off_t pos = mapping + (read_start - start);
+
+	return find_in_object(st, dobj, read_start, read_length, pos);
+}
+
+/**
+ * A segcol_foreach_func that gathers the extents of a parallel search.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the offset in the data of the segment of the extent
+ * @param read_length the length of the extent
+ * @param user_data the find_parallel
+ *
+ * @return the operation error code
+ */
+static int find_extents_foreach_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+
+	struct find_parallel *par = user_data;
+
+	if (par->nextents == par->extents_size) {
+		size_t size = 2 * par->extents_size;
+		if (size == 0)
+			size = 64;
+
+		if (size > __MAX(size_t) / sizeof(struct find_extent))
+			return_error(ENOMEM);
+
+		struct find_extent *extents =
+			realloc(par->extents, size * sizeof(struct find_extent));
+		if (extents == NULL)
+			return_error(ENOMEM);
+
+		par->extents = extents;
+		par->extents_size = size;
+	}
+
+	off_t start;
+	segment_get_start(seg, &start);
+
+	struct find_extent *ext = &par->extents[par->nextents++];
+
+	segment_get_data(seg, (void **)&ext->obj);
+	ext->obj_offset = read_start;
+	ext->pos = mapping + (read_start - start);
+	ext->length = read_length;
+
+	return 0;
+}
+
+/**
+ * Gets the data object a worker must use to access the data of a data object.
+ *
+ * Workers access file data objects through their own views of them (see
+ * data_object_file_new_view()). Other data objects are used directly.
+ *
+ * @param w the find_worker
+ * @param obj the data object
+ * @param[out] view the data object to use
+ *
+ * @return the operation error code
+ */
+static int find_worker_get_view(struct find_worker *w, data_object_t *obj,
+		data_object_t **view)
+{
+	int is_file;
+	int err = data_object_is_file(obj, &is_file);
+	if (err)
+		return_error(err);
+
+	if (!is_file) {
+		*view = obj;
+		return 0;
+	}
+
+	size_t i;
+	for (i = 0; i < w->nviews; i++) {
+		if (w->objs[i] == obj) {
+			*view = w->views[i];
+			return 0;
+		}
+	}
+
+	data_object_t **objs = realloc(w->objs, (w->nviews + 1) * sizeof(*objs));
+	if (objs == NULL)
+		return_error(ENOMEM);
+	w->objs = objs;
+
+	data_object_t **views = realloc(w->views, (w->nviews + 1) * sizeof(*views));
+	if (views == NULL)
+		return_error(ENOMEM);
+	w->views = views;
+
+	err = data_object_file_new_view(view, obj);
+	if (err)
+		return_error(err);
+
+	w->objs[w->nviews] = obj;
+	w->views[w->nviews] = *view;
+	w->nviews++;
+
+	return 0;
+}
+
+/**
+ * Searches a block of a parallel search.
+ *
+ * @param w the find_worker
+ * @param st the find_state of the worker
+ *
+ * @return the operation error code (SEGCOL_FOREACH_STOP if the search
+ *         must stop, eg a match was found)
+ */
+static int find_worker_search_block(struct find_worker *w,
+		struct find_state *st)
+{
+	struct find_parallel *par = w->par;
+
+	/* The block contains the matches starting in [start, start + size) */
+	off_t start = par->start + w->block * FIND_BLOCK_SIZE;
+	off_t end = par->end;
+	if (end - start > FIND_BLOCK_SIZE + (off_t)st->length - 1)
+		end = start + FIND_BLOCK_SIZE + (off_t)st->length - 1;
+
+	st->stage_len = 0;
+	st->stage_pos = start;
+	st->next_start = start;
+	st->match = -1;
+
+	/* Find the first extent of the block */
+	size_t lo = 0;
+	size_t hi = par->nextents;
+
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (par->extents[mid].pos <= start)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	size_t i;
+	for (i = lo; i < par->nextents && par->extents[i].pos < end; i++) {
+		struct find_extent *ext = &par->extents[i];
+
+		off_t from = start > ext->pos ? start : ext->pos;
+		off_t to = ext->pos + ext->length;
+		if (to > end)
+			to = end;
+
+		data_object_t *view;
+		int err = find_worker_get_view(w, ext->obj, &view);
+		if (err)
+			return_error(err);
+
+		err = find_in_object(st, view, ext->obj_offset + (from - ext->pos),
+				to - from, from);
+		if (err == SEGCOL_FOREACH_STOP)
+			return err;
+		else if (err)
+			return_error(err);
+	}
+
+	/* Search the data left in the staging area */
+	search_region(st, st->stage, st->stage_pos, st->stage_len);
+
+	return 0;
+}
+
+/**
+ * The main function of the workers of a parallel search.
+ *
+ * @param arg the find_worker
+ *
+ * @return NULL
+ */
+static void *find_worker_main(void *arg)
+{
+	struct find_worker *w = arg;
+	struct find_parallel *par = w->par;
+
+	struct find_state st;
+	int err = find_state_init(&st, par->pattern, par->mask, par->length,
+			par->start, 0);
+	int have_state = (err == 0);
+
+	st.worker = w;
+
+	/* Search the next blocks until there are none that can hold the match */
+	while (err == 0) {
+		pthread_mutex_lock(&par->mutex);
+
+		int done = par->cancel || par->err
+			|| par->next_block >= par->match_block;
+
+		if (!done)
+			w->block = par->next_block++;
+
+		pthread_mutex_unlock(&par->mutex);
+
+		if (done)
+			break;
+
+		err = find_worker_search_block(w, &st);
+		if (err == SEGCOL_FOREACH_STOP)
+			err = 0;
+
+		pthread_mutex_lock(&par->mutex);
+
+		if (err == 0 && st.match != -1 && w->block < par->match_block) {
+			par->match_block = w->block;
+			par->match = st.match;
+		}
+
+		pthread_mutex_unlock(&par->mutex);
+	}
+
+	if (have_state)
+		find_state_free(&st);
+
+	size_t i;
+	for (i = 0; i < w->nviews; i++)
+		data_object_free(w->views[i]);
+
+	free(w->objs);
+	free(w->views);
+
+	pthread_mutex_lock(&par->mutex);
+
+	if (err && !par->err)
+		par->err = err;
+
+	par->running--;
+
+	pthread_cond_signal(&par->cond);
+	pthread_mutex_unlock(&par->mutex);
+
+	return NULL;
+}
+
+/**
+ * Searches a range of a bless_buffer_t in parallel.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param[out] match the offset the data was found at or -1 if no match was found
+ * @param start_offset the offset to start searching from
+ * @param end_offset the offset to stop searching at
+ * @param data the data to search for
+ * @param mask the mask of the data (NULL if all the bits must match)
+ * @param length the length of the data to search for
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ * @param nthreads the number of worker threads to use
+ *
+ * @return the operation error code
+ */
+static int find_parallel(bless_buffer_t *buf, off_t *match, off_t start_offset,
+		off_t end_offset, const unsigned char *data, const unsigned char *mask,
+		size_t length, bless_progress_func *progress_func, int nthreads)
+{
+	struct find_parallel par;
+
+	par.pattern = data;
+	par.mask = mask;
+	par.length = length;
+	par.extents = NULL;
+	par.nextents = 0;
+	par.extents_size = 0;
+	par.start = start_offset;
+	par.end = end_offset;
+	par.nblocks = (end_offset - start_offset - 1) / FIND_BLOCK_SIZE + 1;
+	par.next_block = 0;
+	par.match_block = par.nblocks;
+	par.match = -1;
+	par.searched = 0;
+	par.running = 0;
+	par.cancel = 0;
+	par.err = 0;
+
+	if (nthreads > par.nblocks)
+		nthreads = par.nblocks;
+
+	/* Gather the extents of the range, so that workers don't use the segcol */
+	int err = segcol_foreach(buf->segcol, start_offset,
+			end_offset - start_offset, find_extents_foreach_func, &par);
+	if (err)
+		goto_error(err, on_error_extents);
+
+	struct find_worker *workers = malloc(nthreads * sizeof(*workers));
+	if (workers == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error_extents);
+	}
+
+	err = pthread_mutex_init(&par.mutex, NULL);
+	if (err)
+		goto_error(err, on_error_mutex);
+
+	err = pthread_cond_init(&par.cond, NULL);
+	if (err)
+		goto_error(err, on_error_cond);
+
+	/* Start the workers */
+	pthread_mutex_lock(&par.mutex);
+
+	int i;
+	for (i = 0; i < nthreads; i++) {
+		workers[i].par = &par;
+		workers[i].block = 0;
+		workers[i].objs = NULL;
+		workers[i].views = NULL;
+		workers[i].nviews = 0;
+
+		err = pthread_create(&workers[i].thread, NULL, find_worker_main,
+				&workers[i]);
+		if (err) {
+			par.err = err;
+			break;
+		}
+
+		par.running++;
+	}
+
+	nthreads = i;
+
+	/* Report the progress until all workers have finished */
+	struct bless_buffer_find_progress_info progress;
+	progress.searched = 0;
+	progress.total = end_offset - start_offset;
+	off_t progress_next = FIND_CHUNK_SIZE;
+
+	while (par.running > 0) {
+		pthread_cond_wait(&par.cond, &par.mutex);
+
+		if (progress_func == NULL || par.cancel || par.err
+				|| par.searched < progress_next)
+			continue;
+
+		/* Don't count the data searched twice at the ends of blocks */
+		progress.searched = par.searched;
+		if (progress.searched > progress.total)
+			progress.searched = progress.total;
+
+		progress_next = par.searched + FIND_CHUNK_SIZE;
+
+		pthread_mutex_unlock(&par.mutex);
+		int cancel = (*progress_func)(&progress);
+		pthread_mutex_lock(&par.mutex);
+
+		if (cancel)
+			par.cancel = 1;
+	}
+
+	pthread_mutex_unlock(&par.mutex);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	if (par.cancel)
+		err = ECANCELED;
+	else
+		err = par.err;
+
+	*match = par.match;
+
+	pthread_cond_destroy(&par.cond);
+on_error_cond:
+	pthread_mutex_destroy(&par.mutex);
+on_error_mutex:
+	free(workers);
+on_error_extents:
+	free(par.extents);
+	return err;
+}
+
+/**
+ * Searches for a (possibly masked) pattern in a bless_buffer_t.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param[out] match the offset the data was found at or -1 if no match was found
+ * @param start_offset the offset in the bless_buffer_t to start searching from
+ * @param data the data to search for
+ * @param mask the mask of the data (NULL if all the bits must match)
+ * @param length the length of the data to search for
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+static int find_pattern(bless_buffer_t *buf, off_t *match, off_t start_offset,
+		const unsigned char *data, const unsigned char *mask, size_t length,
+		bless_progress_func *progress_func)
+{
+	if (buf == NULL || match == NULL || start_offset < 0 || length == 0)
+		return_error(EINVAL);
+
+	off_t buf_size;
+	int err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	*match = -1;
+
+	if (start_offset >= buf_size || (uintmax_t)(buf_size - start_offset) < length)
+		return 0;
+
+	if (buf->options->find_threads > 1
+			&& buf_size - start_offset > FIND_BLOCK_SIZE) {
+		err = find_parallel(buf, match, start_offset, buf_size, data, mask,
+				length, progress_func, buf->options->find_threads);
+		if (err)
+			return_error(err);
+
+		return 0;
+	}
+
+	struct find_state st;
+
+	err = find_state_init(&st, data, mask, length, start_offset, 0);
+	if (err)
+		return_error(err);
+
+	st.progress_func = progress_func;
+	st.progress.total = buf_size - start_offset;
+
+	err = segcol_foreach(buf->segcol, start_offset, buf_size - start_offset,
+			find_foreach_func, &st);
+
+	/* Search the data left in the staging area */
+	if (err == 0 && st.match == -1)
+		search_region(&st, st.stage, st.stage_pos, st.stage_len);
+
+	find_state_free(&st);
+
+	if (err)
+		return_error(err);
+
+	*match = st.match;
+
+	return 0;
+}
+
+/**
+ * The state of a multi-pattern search in a bless_buffer_t.
+ */
+struct find_multi_state {
+	bless_pattern_set_t *set;
+	uint32_t state;
+
+	bless_buffer_match_func *match_func;
+	void *user_data;
+
+	/* Progress reporting */
+	bless_progress_func *progress_func;
+	struct bless_buffer_find_progress_info progress;
+	off_t progress_next;
+};
+
+/**
+ * A segcol_foreach_func that scans the data of a segment with the automaton
+ * of a pattern set.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment to search
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the offset in the data of the segment to start searching
+ * @param read_length the length of the data to search
+ * @param user_data the find_multi_state
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP if the match function stopped the search)
+ */
+static int find_multi_foreach_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+
+	struct find_multi_state *st = user_data;
+
+	data_object_t *dobj;
+	segment_get_data(seg, (void **)&dobj);
+
+	off_t start;
+	segment_get_start(seg, &start);
+
+	/* The offset in the buffer of the data to search */
+	off_t pos = mapping + (read_start - start);
+
+	while (read_length > 0) {
+		void *data;
+		off_t len = read_length;
+		if (len > FIND_CHUNK_SIZE)
+			len = FIND_CHUNK_SIZE;
+
+		int err = data_object_get_data(dobj, &data, read_start, &len,
+				DATA_OBJECT_READ);
+		if (err)
+			return_error(err);
+
+		int stop;
+		err = pattern_set_scan(st->set, &st->state, data, len, pos,
+				st->match_func, st->user_data, &stop);
+		if (err)
+			return_error(err);
+
+		if (stop)
+			return SEGCOL_FOREACH_STOP;
+
+		read_start += len;
+		read_length -= len;
+		pos += len;
+
+		/* Report progress and check for cancellation */
+		st->progress.searched += len;
+
+		if (st->progress_func != NULL
+				&& st->progress.searched >= st->progress_next) {
+			st->progress_next = st->progress.searched + FIND_CHUNK_SIZE;
+			if ((*st->progress_func)(&st->progress))
+				return_error(ECANCELED);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * The state of a regex search in a bless_buffer_t.
+ */
+struct find_regex_state {
+	bless_regex_t *regex;
+	struct regex_run run;
+
+	/* Progress reporting (for the scans for the ends of the matches) */
+	bless_progress_func *progress_func;
+	struct bless_buffer_find_progress_info progress;
+	off_t progress_next;
+	off_t start_offset;
+};
+
+/**
+ * A segcol_foreach_func that runs an automaton of a regex over the data of
+ * a segment.
+ *
+ * The data are retrieved from the end of the segment if the automaton runs
+ * backwards.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment to search
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the offset in the data of the segment to start searching
+ * @param read_length the length of the data to search
+ * @param user_data the find_regex_state
+ *
+ * @return the operation error code (ECANCELED if the search was cancelled,
+ *         SEGCOL_FOREACH_STOP if the run is over)
+ */
+static int find_regex_foreach_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+
+	struct find_regex_state *st = user_data;
+	int reverse = (st->run.dfa == REGEX_DFA_REVERSE);
+
+	data_object_t *dobj;
+	segment_get_data(seg, (void **)&dobj);
+
+	off_t start;
+	segment_get_start(seg, &start);
+
+	/* The offset in the buffer of the data to search */
+	off_t pos = mapping + (read_start - start);
+
+	while (read_length > 0) {
+		void *data;
+		off_t len = read_length;
+		if (len > FIND_CHUNK_SIZE)
+			len = FIND_CHUNK_SIZE;
+
+		int err;
+
+		if (reverse) {
+			err = data_object_get_data(dobj, &data,
+					read_start + (read_length - len), &len,
+					DATA_OBJECT_READ | DATA_OBJECT_REVERSE);
+			if (err)
+				return_error(err);
+
+			read_length -= len;
+
+			err = regex_run_scan(st->regex, &st->run, data, len,
+					pos + read_length);
+			if (err)
+				return_error(err);
+		}
+		else {
+			err = data_object_get_data(dobj, &data, read_start, &len,
+					DATA_OBJECT_READ);
+			if (err)
+				return_error(err);
+
+			err = regex_run_scan(st->regex, &st->run, data, len, pos);
+			if (err)
+				return_error(err);
+
+			read_start += len;
+			read_length -= len;
+			pos += len;
+		}
+
+		if (st->run.done)
+			return SEGCOL_FOREACH_STOP;
+
+		/* Report progress and check for cancellation */
+		if (st->run.dfa == REGEX_DFA_SEARCH && st->progress_func != NULL) {
+			st->progress.searched = pos - st->start_offset;
+
+			if (st->progress.searched >= st->progress_next) {
+				st->progress_next = st->progress.searched + FIND_CHUNK_SIZE;
+				if ((*st->progress_func)(&st->progress))
+					return_error(ECANCELED);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*****************
+ * API Functions *
+ *****************/
+
+/**
+ * Searches for data in a bless_buffer_t.
+ *
+ * The progress_func, if not NULL, is called periodically with a pointer to a
+ * struct bless_buffer_find_progress_info. If it returns a non-zero value the
+ * search is cancelled and ECANCELED is returned.
+ *
+ * Large buffers are searched in parallel if the BLESS_BUF_FIND_THREADS option
+ * is larger than 1. The result is the same as that of a serial search and
+ * progress_func is still called from the calling thread.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param[out] match the offset the data was found at or -1 if no match was found
+ * @param start_offset the offset in the bless_buffer_t to start searching from
+ * @param data a pointer to the data to search for
+ * @param length the length of the data to search for
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+int bless_buffer_find(bless_buffer_t *buf, off_t *match, off_t start_offset, 
+		void *data, size_t length, bless_progress_func *progress_func)
+{
+	if (data == NULL)
+		return_error(EINVAL);
+
+	int err = find_pattern(buf, match, start_offset, data, NULL, length,
+			progress_func);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Searches for data with masked bits in a bless_buffer_t.
+ *
+ * A byte of the buffer matches byte i of the data if all the bits that are
+ * set in byte i of the mask are the same in both. So, a mask byte of 0xff
+ * requires an exact match and a mask byte of 0x00 matches any byte (a
+ * wildcard).
+ *
+ * The search is performed like in bless_buffer_find(). The longest run of
+ * unmasked (0xff) bytes is searched for first, so patterns with long
+ * unmasked runs are found faster.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param[out] match the offset the data was found at or -1 if no match was found
+ * @param start_offset the offset in the bless_buffer_t to start searching from
+ * @param data a pointer to the data to search for
+ * @param mask a pointer to the mask of the data (length bytes)
+ * @param length the length of the data to search for
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+int bless_buffer_find_masked(bless_buffer_t *buf, off_t *match,
+		off_t start_offset, void *data, void *mask, size_t length,
+		bless_progress_func *progress_func)
+{
+	if (data == NULL || mask == NULL)
+		return_error(EINVAL);
+
+	int err = find_pattern(buf, match, start_offset, data, mask, length,
+			progress_func);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Searches backwards for data in a bless_buffer_t.
+ *
+ * The last occurrence of the data that starts at or before start_offset is
+ * found. The buffer is searched from high to low offsets, so occurrences
+ * near start_offset are found without reading the data before them. If
+ * start_offset is beyond the last offset the data can start at, the search
+ * starts from the end of the buffer. Backward searches are always performed
+ * by the calling thread.
+ *
+ * The progress_func, if not NULL, is called periodically with a pointer to a
+ * struct bless_buffer_find_progress_info. If it returns a non-zero value the
+ * search is cancelled and ECANCELED is returned.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param[out] match the offset the data was found at or -1 if no match was found
+ * @param start_offset the offset in the bless_buffer_t to start searching
+ *                     backwards from
+ * @param data a pointer to the data to search for
+ * @param length the length of the data to search for
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+int bless_buffer_rfind(bless_buffer_t *buf, off_t *match, off_t start_offset,
+		void *data, size_t length, bless_progress_func *progress_func)
+{
+	if (buf == NULL || match == NULL || start_offset < 0 || data == NULL
+			|| length == 0)
+		return_error(EINVAL);
+
+	off_t buf_size;
+	int err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	*match = -1;
+
+	if ((uintmax_t)buf_size < length)
+		return 0;
+
+	if (start_offset > buf_size - (off_t)length)
+		start_offset = buf_size - length;
+
+	struct find_state st;
+
+	err = find_state_init(&st, data, NULL, length, start_offset, 1);
+	if (err)
+		return_error(err);
+
+	/* The range holding the matches that start at or before start_offset */
+	off_t range_length = start_offset + length;
+
+	st.progress_func = progress_func;
+	st.progress.total = range_length;
+
+	err = segcol_foreach_reverse(buf->segcol, 0, range_length,
+			find_foreach_func, &st);
+
+	/* Search the data left in the staging area */
+	if (err == 0 && st.match == -1)
+		rsearch_region(&st, rstage_data(&st), st.stage_pos, st.stage_len);
+
+	find_state_free(&st);
+
+	if (err)
+		return_error(err);
+
+	*match = st.match;
+
+	return 0;
+}
+
+/**
+ * Searches for all the occurrences of data in a range of a bless_buffer_t.
+ *
+ * The occurrences that lie completely in [start_offset, end_offset) are
+ * reported in order by calling match_func (with 0 as the pattern id) as
+ * they are found, so the memory used doesn't depend on the number of
+ * matches. By default the search continues after the end of each match, so
+ * matches don't overlap. If BLESS_BUFFER_FIND_OVERLAPPING is set in flags,
+ * the search continues after the start of each match instead. If
+ * match_func returns a non-zero value the search stops (this is not an
+ * error).
+ *
+ * The search is performed by the calling thread. The progress_func, if not
+ * NULL, is called periodically with a pointer to a struct
+ * bless_buffer_find_progress_info. If it returns a non-zero value the
+ * search is cancelled and ECANCELED is returned.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param start_offset the start of the range to search
+ * @param end_offset the end of the range to search (exclusive, it is limited
+ *                   to the size of the buffer)
+ * @param data a pointer to the data to search for
+ * @param length the length of the data to search for
+ * @param flags the search flags (0 or BLESS_BUFFER_FIND_OVERLAPPING)
+ * @param match_func the function to call for each match
+ * @param user_data the user data to pass to match_func
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+int bless_buffer_find_all(bless_buffer_t *buf, off_t start_offset,
+		off_t end_offset, void *data, size_t length, int flags,
+		bless_buffer_match_func *match_func, void *user_data,
+		bless_progress_func *progress_func)
+{
+	if (buf == NULL || start_offset < 0 || end_offset < start_offset
+			|| data == NULL || length == 0 || match_func == NULL
+			|| (flags & ~BLESS_BUFFER_FIND_OVERLAPPING))
+		return_error(EINVAL);
+
+	off_t buf_size;
+	int err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	if (end_offset > buf_size)
+		end_offset = buf_size;
+
+	if (start_offset >= end_offset
+			|| (uintmax_t)(end_offset - start_offset) < length)
+		return 0;
+
+	struct find_state st;
+
+	err = find_state_init(&st, data, NULL, length, start_offset, 0);
+	if (err)
+		return_error(err);
+
+	st.match_func = match_func;
+	st.user_data = user_data;
+	st.overlapping = (flags & BLESS_BUFFER_FIND_OVERLAPPING) != 0;
+	st.progress_func = progress_func;
+	st.progress.total = end_offset - start_offset;
+
+	err = segcol_foreach(buf->segcol, start_offset, end_offset - start_offset,
+			find_foreach_func, &st);
+
+	/* Search the data left in the staging area */
+	if (err == 0 && !st.stopped)
+		search_region(&st, st.stage, st.stage_pos, st.stage_len);
+
+	find_state_free(&st);
+
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Searches for many patterns at once in a bless_buffer_t.
+ *
+ * All the occurrences of all the patterns of the set that start at or after
+ * start_offset are reported by calling match_func, in a single pass over the
+ * buffer data. Matches are reported in order of their end offset and, for
+ * matches ending at the same offset, from the longest to the shortest. If
+ * match_func returns a non-zero value the search stops (this is not an
+ * error).
+ *
+ * The pattern set is compiled the first time it is used and the compiled
+ * form is reused by later searches, in this or any other buffer, until
+ * patterns are added to it.
+ *
+ * The progress_func, if not NULL, is called periodically with a pointer to a
+ * struct bless_buffer_find_progress_info. If it returns a non-zero value the
+ * search is cancelled and ECANCELED is returned.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param set the patterns to search for
+ * @param start_offset the offset in the bless_buffer_t to start searching from
+ * @param match_func the function to call for each match
+ * @param user_data the user data to pass to match_func
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+int bless_buffer_find_multi(bless_buffer_t *buf, bless_pattern_set_t *set,
+		off_t start_offset, bless_buffer_match_func *match_func,
+		void *user_data, bless_progress_func *progress_func)
+{
+	if (buf == NULL || set == NULL || start_offset < 0 || match_func == NULL)
+		return_error(EINVAL);
+
+	off_t buf_size;
+	int err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	if (start_offset >= buf_size)
+		return 0;
+
+	err = pattern_set_compile(set);
+	if (err)
+		return_error(err);
+
+	struct find_multi_state st;
+
+	st.set = set;
+	st.state = 0;
+	st.match_func = match_func;
+	st.user_data = user_data;
+	st.progress_func = progress_func;
+	st.progress.searched = 0;
+	st.progress.total = buf_size - start_offset;
+	st.progress_next = FIND_CHUNK_SIZE;
+
+	err = segcol_foreach(buf->segcol, start_offset, buf_size - start_offset,
+			find_multi_foreach_func, &st);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Searches for the matches of a regular expression in a range of a
+ * bless_buffer_t.
+ *
+ * The matches that lie completely in [start_offset, end_offset) are reported
+ * in order by calling match_func (with 0 as the pattern id), as they are
+ * found. Matches don't overlap: the search continues after the end of each
+ * match. The match reported is the one that ends first, extended to start
+ * as early and end as late as possible (for most regexes this is the
+ * leftmost-longest match). If match_func returns a non-zero value the
+ * search stops (this is not an error).
+ *
+ * The buffer data are scanned in place, chunk by chunk, and the automata of
+ * the regex use a fixed amount of memory, so searching large buffers
+ * doesn't need more memory than searching small ones.
+ *
+ * The search is performed by the calling thread. The progress_func, if not
+ * NULL, is called periodically with a pointer to a struct
+ * bless_buffer_find_progress_info. If it returns a non-zero value the
+ * search is cancelled and ECANCELED is returned.
+ *
+ * @param buf the bless_buffer_t to search
+ * @param regex the regex to search for (see bless_regex_new())
+ * @param start_offset the start of the range to search
+ * @param end_offset the end of the range to search (exclusive, it is limited
+ *                   to the size of the buffer)
+ * @param match_func the function to call for each match
+ * @param user_data the user data to pass to match_func
+ * @param progress_func the bless_progress_cb to call to report the progress of the
+ *           operation or NULL to disable reporting
+ *
+ * @return the operation error code
+ */
+int bless_buffer_find_regex(bless_buffer_t *buf, bless_regex_t *regex,
+		off_t start_offset, off_t end_offset,
+		bless_buffer_match_func *match_func, void *user_data,
+		bless_progress_func *progress_func)
+{
+	if (buf == NULL || regex == NULL || start_offset < 0
+			|| end_offset < start_offset || match_func == NULL)
+		return_error(EINVAL);
+
+	off_t buf_size;
+	int err = segcol_get_size(buf->segcol, &buf_size);
+	if (err)
+		return_error(err);
+
+	if (end_offset > buf_size)
+		end_offset = buf_size;
+
+	struct find_regex_state st;
+
+	st.regex = regex;
+	st.progress_func = progress_func;
+	st.progress.searched = 0;
+	st.progress.total = end_offset - start_offset;
+	st.progress_next = FIND_CHUNK_SIZE;
+	st.start_offset = start_offset;
+
+	off_t pos = start_offset;
+
+	while (pos < end_offset) {
+		/* Find the end of the first match */
+		err = regex_run_init(regex, &st.run, REGEX_DFA_SEARCH, 1);
+		if (err)
+			return_error(err);
+
+		err = segcol_foreach(buf->segcol, pos, end_offset - pos,
+				find_regex_foreach_func, &st);
+		if (err)
+			return_error(err);
+
+		if (st.run.match == -1)
+			break;
+
+		off_t match_end = st.run.match;
+
+		/* Find the leftmost start of the matches ending there */
+		err = regex_run_init(regex, &st.run, REGEX_DFA_REVERSE, 0);
+		if (err)
+			return_error(err);
+
+		err = segcol_foreach_reverse(buf->segcol, pos, match_end - pos,
+				find_regex_foreach_func, &st);
+		if (err)
+			return_error(err);
+
+		off_t match_start = st.run.match;
+
+		/* Find the longest match from that start */
+		err = regex_run_init(regex, &st.run, REGEX_DFA_FORWARD, 0);
+		if (err)
+			return_error(err);
+
+		err = segcol_foreach(buf->segcol, match_start,
+				end_offset - match_start, find_regex_foreach_func, &st);
+		if (err)
+			return_error(err);
+
+		match_end = st.run.match;
+
+		if ((*match_func)(match_start, match_end - match_start, 0, user_data))
+			break;
+
+		pos = match_end;
+	}
+
+	return 0;
+}
+
+#pragma GCC visibility pop
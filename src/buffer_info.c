@@ -251,6 +251,207 @@ int bless_buffer_set_option(bless_buffer_t *buf, bless_buffer_option_t opt,
 				buf->options->undo_after_save = dup;
 			}
 			break;
+
+		case BLESS_BUF_SEGCOL_IMPL:
+			if (val == NULL)
+				return_error(EINVAL);
+			else {
+				/* 
+				 * Create an empty segcol of the requested implementation (this
+				 * also checks that the name is valid) and move the current
+				 * buffer contents to it. The logical contents of the buffer
+				 * don't change, so the undo/redo history remains valid.
+				 */
+				segcol_t *segcol;
+				int err = segcol_new_by_name(&segcol, val);
+				if (err)
+					return_error(err);
+
+				err = segcol_add_copy(segcol, 0, buf->segcol);
+				if (err) {
+					segcol_free(segcol);
+					return_error(err);
+				}
+
+				char *dup = strdup(val);
+				if (dup == NULL) {
+					segcol_free(segcol);
+					return_error(ENOMEM);
+				}
+
+				/* Free old values and set new ones */
+				segcol_free(buf->segcol);
+				buf->segcol = segcol;
+
+				if (buf->options->segcol_impl != NULL)
+					free(buf->options->segcol_impl);
+				buf->options->segcol_impl = dup;
+			}
+			break;
+
+		case BLESS_BUF_FILE_WINDOW_SIZE:
+			if (val == NULL)
+				return_error(EINVAL);
+			else {
+				char *endptr;
+				errno = 0;
+				unsigned long size = strtoul(val, &endptr, 10);
+				if (*val == '\0' || *endptr != '\0' || *val == '-'
+						|| errno != 0 || size == 0 || size > __MAX(size_t))
+					return_error(EINVAL);
+
+				char *dup = strdup(val);
+				if (dup == NULL)
+					return_error(ENOMEM);
+
+				/* Set the new value and apply it to the files in the buffer */
+				char *old_str = buf->options->file_window_size_str;
+				size_t old_size = buf->options->file_window_size;
+
+				buf->options->file_window_size_str = dup;
+				buf->options->file_window_size = size;
+
+				int err = segcol_apply_file_options(buf, buf->segcol);
+				if (err) {
+					/* Keep the old value, which the files still use */
+					buf->options->file_window_size_str = old_str;
+					buf->options->file_window_size = old_size;
+					free(dup);
+					return_error(err);
+				}
+
+				if (old_str != NULL)
+					free(old_str);
+			}
+			break;
+
+		case BLESS_BUF_FILE_WINDOWS:
+			if (val == NULL)
+				return_error(EINVAL);
+			else {
+				char *endptr;
+				errno = 0;
+				long n = strtol(val, &endptr, 10);
+				if (*val == '\0' || *endptr != '\0' || errno != 0
+						|| n <= 0 || n > __MAX(int))
+					return_error(EINVAL);
+
+				char *dup = strdup(val);
+				if (dup == NULL)
+					return_error(ENOMEM);
+
+				/* Set the new value and apply it to the files in the buffer */
+				char *old_str = buf->options->file_windows_str;
+				int old_n = buf->options->file_windows;
+
+				buf->options->file_windows_str = dup;
+				buf->options->file_windows = n;
+
+				int err = segcol_apply_file_options(buf, buf->segcol);
+				if (err) {
+					/* Keep the old value, which the files still use */
+					buf->options->file_windows_str = old_str;
+					buf->options->file_windows = old_n;
+					free(dup);
+					return_error(err);
+				}
+
+				if (old_str != NULL)
+					free(old_str);
+			}
+			break;
+
+		case BLESS_BUF_FILE_BACKEND:
+			if (val == NULL || (strcmp(val, "default") && strcmp(val, "mmap")
+					&& strcmp(val, "pread")))
+				return_error(EINVAL);
+			else {
+				char *dup = strdup(val);
+				if (dup == NULL)
+					return_error(ENOMEM);
+
+				/* Set the new value and apply it to the files in the buffer */
+				char *old_backend = buf->options->file_backend;
+
+				buf->options->file_backend = dup;
+
+				int err = segcol_apply_file_options(buf, buf->segcol);
+				if (err) {
+					/* Keep the old value, which the files still use */
+					buf->options->file_backend = old_backend;
+					free(dup);
+					return_error(err);
+				}
+
+				if (old_backend != NULL)
+					free(old_backend);
+			}
+			break;
+
+		case BLESS_BUF_FIND_THREADS:
+			if (val == NULL)
+				return_error(EINVAL);
+			else {
+				char *endptr;
+				errno = 0;
+				long n = strtol(val, &endptr, 10);
+				if (*val == '\0' || *endptr != '\0' || errno != 0
+						|| n <= 0 || n > __MAX(int))
+					return_error(EINVAL);
+
+				char *dup = strdup(val);
+				if (dup == NULL)
+					return_error(ENOMEM);
+
+				/* Free old value and set new one */
+				if (buf->options->find_threads_str != NULL)
+					free(buf->options->find_threads_str);
+
+				buf->options->find_threads_str = dup;
+				buf->options->find_threads = n;
+			}
+			break;
+
+		case BLESS_BUF_SAVE_CYCLES:
+			if (val == NULL || (strcmp(val, "greedy")
+					&& strcmp(val, "spanning_tree")))
+				return_error(EINVAL);
+			else {
+				char *dup = strdup(val);
+				if (dup == NULL)
+					return_error(ENOMEM);
+
+				/* Free old value and set new one */
+				if (buf->options->save_cycles != NULL)
+					free(buf->options->save_cycles);
+				buf->options->save_cycles = dup;
+			}
+			break;
+
+		case BLESS_BUF_SAVE_BATCH_SIZE:
+			if (val == NULL)
+				return_error(EINVAL);
+			else {
+				char *endptr;
+				errno = 0;
+				unsigned long size = strtoul(val, &endptr, 10);
+				if (*val == '\0' || *endptr != '\0' || *val == '-'
+						|| errno != 0 || size == 0 || size > __MAX(size_t))
+					return_error(EINVAL);
+
+				char *dup = strdup(val);
+				if (dup == NULL)
+					return_error(ENOMEM);
+
+				/* Free old value and set new one */
+				if (buf->options->save_batch_size_str != NULL)
+					free(buf->options->save_batch_size_str);
+
+				buf->options->save_batch_size_str = dup;
+				buf->options->save_batch_size = size;
+			}
+			break;
+
 		default:
 			break;
 	}
@@ -289,6 +490,34 @@ int bless_buffer_get_option(bless_buffer_t *buf, char **val,
 			*val = buf->options->undo_after_save;
 			break;
 
+		case BLESS_BUF_SEGCOL_IMPL:
+			*val = buf->options->segcol_impl;
+			break;
+
+		case BLESS_BUF_FILE_WINDOW_SIZE:
+			*val = buf->options->file_window_size_str;
+			break;
+
+		case BLESS_BUF_FILE_WINDOWS:
+			*val = buf->options->file_windows_str;
+			break;
+
+		case BLESS_BUF_FILE_BACKEND:
+			*val = buf->options->file_backend;
+			break;
+
+		case BLESS_BUF_FIND_THREADS:
+			*val = buf->options->find_threads_str;
+			break;
+
+		case BLESS_BUF_SAVE_CYCLES:
+			*val = buf->options->save_cycles;
+			break;
+
+		case BLESS_BUF_SAVE_BATCH_SIZE:
+			*val = buf->options->save_batch_size_str;
+			break;
+
 		default:
 			*val = NULL;
 			break;
@@ -29,6 +29,7 @@ extern "C" {
 #endif
 
 #include "segcol.h"
+#include "data_object.h"
 #include "list.h"
 #include "buffer_action.h"
 #include "buffer.h"
@@ -52,6 +53,52 @@ struct buffer_options {
 	char *undo_limit_str;
 
 	char *undo_after_save;
+
+	char *segcol_impl;
+
+	size_t file_window_size;
+	char *file_window_size_str;
+
+	int file_windows;
+	char *file_windows_str;
+
+	char *file_backend;
+
+	int find_threads;
+	char *find_threads_str;
+
+	char *save_cycles;
+
+	size_t save_batch_size;
+	char *save_batch_size_str;
+};
+
+/** 
+ * A reference to data held by a bless_buffer_extents_t.
+ *
+ * If obj is not NULL the data is pinned in obj, otherwise copy points to a
+ * private copy of the data.
+ */
+struct extent_hold {
+	data_object_t *obj;
+	void *copy;
+};
+
+/**
+ * The extents of a range of a bless_buffer_t.
+ */
+struct bless_buffer_extents {
+	struct iovec *iov;
+	size_t count;
+	size_t iov_capacity;
+
+	struct extent_hold *holds;
+	size_t nholds;
+	size_t holds_capacity;
+
+	/* The buffer holding the extents, NULL if it has been freed */
+	bless_buffer_t *buf;
+	struct list_node ln;
 };
 
 /**
@@ -72,6 +119,14 @@ struct bless_buffer {
 	
 	bless_buffer_event_func_t *event_func;
 	void *event_user_data;
+
+	/* The chunk of the add buffer that is being filled (see buffer_util.c) */
+	data_object_t *add_buffer;
+	unsigned char *add_buffer_data;
+	size_t add_buffer_used;
+
+	/* The extents of the buffer that have not been freed yet */
+	list_t *extents;
 };
 
 #ifdef __cplusplus
@@ -34,6 +34,13 @@ typedef enum {
 	BLESS_BUF_TMP_DIR,    /**< The directory to use for saving temporary files */
 	BLESS_BUF_UNDO_LIMIT, /**< The maximum number of actions that can be undone */
 	BLESS_BUF_UNDO_AFTER_SAVE, /**< Whether to support undo after having saved */
+	BLESS_BUF_SEGCOL_IMPL, /**< The segment collection implementation to use */
+	BLESS_BUF_FILE_WINDOW_SIZE, /**< The size of the mapped windows of files */
+	BLESS_BUF_FILE_WINDOWS, /**< The number of mapped windows per file */
+	BLESS_BUF_FILE_BACKEND, /**< How to access the data of files */
+	BLESS_BUF_FIND_THREADS, /**< The number of threads to use for searching */
+	BLESS_BUF_SAVE_CYCLES, /**< How to break overlap cycles when saving */
+	BLESS_BUF_SAVE_BATCH_SIZE, /**< The maximum size of data written at once when saving */
 	BLESS_BUF_SENTINEL
 } bless_buffer_option_t;
 
@@ -0,0 +1,497 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file buffer_pattern_set.c
+ *
+ * Pattern set implementation
+ *
+ * A pattern set is compiled into an Aho-Corasick automaton, which finds all
+ * the occurrences of all the patterns in a single pass over the data. The
+ * automaton is stored as a full DFA (the failure transitions are resolved at
+ * compile time), so scanning costs one table lookup per byte. To keep the
+ * table small the bytes are mapped to classes: each byte that appears in
+ * the patterns gets its own class and all other bytes share a single class.
+ *
+ * The automaton is compiled the first time the set is used in a search and
+ * is reused by later searches (in any buffer) until the set is changed.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "buffer_pattern_set.h"
+#include "type_limits.h"
+#include "debug.h"
+
+#pragma GCC visibility push(default)
+
+/**
+ * A set of patterns to search for.
+ */
+struct bless_pattern_set {
+	/* The patterns (copies of the user data) */
+	unsigned char **patterns;
+	size_t *lengths;
+	int npatterns;
+	int patterns_size;
+
+	/* Whether the automaton is up to date */
+	int compiled;
+
+	/* The byte classes */
+	uint8_t classes[256];
+	size_t nclasses;
+
+	/* The transitions of the states (nstates * nclasses) */
+	uint32_t *delta;
+	uint32_t nstates;
+
+	/*
+	 * The first pattern ending at each state (or -1), the next pattern
+	 * ending at the same state as each pattern (or -1), the closest state
+	 * reachable by failure links that has patterns ending at it (or 0)
+	 * and whether any pattern ends at each state or at its suffixes.
+	 */
+	int *term;
+	int *term_next;
+	uint32_t *dict;
+	unsigned char *output;
+};
+
+/********************
+ * Helper functions *
+ ********************/
+
+/**
+ * Frees the automaton of a pattern set.
+ *
+ * @param set the bless_pattern_set_t
+ */
+static void free_automaton(bless_pattern_set_t *set)
+{
+	free(set->delta);
+	free(set->term);
+	free(set->term_next);
+	free(set->dict);
+	free(set->output);
+
+	set->delta = NULL;
+	set->term = NULL;
+	set->term_next = NULL;
+	set->dict = NULL;
+	set->output = NULL;
+	set->nstates = 0;
+	set->compiled = 0;
+}
+
+/**
+ * Computes the byte classes of a pattern set.
+ *
+ * @param set the bless_pattern_set_t
+ */
+static void compute_classes(bless_pattern_set_t *set)
+{
+	int used[256];
+	memset(used, 0, sizeof(used));
+
+	int i;
+	for (i = 0; i < set->npatterns; i++) {
+		size_t j;
+		for (j = 0; j < set->lengths[i]; j++)
+			used[set->patterns[i][j]] = 1;
+	}
+
+	/* 
+	 * Bytes that are not used share class 0. If all the bytes are used,
+	 * class 0 is given to the last one.
+	 */
+	memset(set->classes, 0, sizeof(set->classes));
+	set->nclasses = 1;
+
+	int c;
+	for (c = 0; c < 256; c++) {
+		if (used[c] && set->nclasses < 256)
+			set->classes[c] = set->nclasses++;
+	}
+}
+
+/**
+ * Builds the trie of the patterns of a pattern set.
+ *
+ * @param set the bless_pattern_set_t
+ */
+static void build_trie(bless_pattern_set_t *set)
+{
+	set->nstates = 1;
+
+	/* Insert the patterns in reverse order, so that lists are in id order */
+	int i;
+	for (i = set->npatterns - 1; i >= 0; i--) {
+		uint32_t s = 0;
+		size_t j;
+
+		for (j = 0; j < set->lengths[i]; j++) {
+			uint32_t *t = &set->delta[(size_t)s * set->nclasses +
+				set->classes[set->patterns[i][j]]];
+
+			/* The root is never a child, so 0 means no child */
+			if (*t == 0)
+				*t = set->nstates++;
+
+			s = *t;
+		}
+
+		set->term_next[i] = set->term[s];
+		set->term[s] = i;
+	}
+}
+
+/**
+ * Resolves the failure transitions of the trie of a pattern set, turning
+ * it into a DFA.
+ *
+ * @param set the bless_pattern_set_t
+ * @param fail scratch space for the failure links (nstates entries)
+ * @param queue scratch space for the BFS queue (nstates entries)
+ */
+static void build_dfa(bless_pattern_set_t *set, uint32_t *fail,
+		uint32_t *queue)
+{
+	size_t nclasses = set->nclasses;
+	uint32_t head = 0;
+	uint32_t tail = 0;
+
+	fail[0] = 0;
+	set->dict[0] = 0;
+	set->output[0] = 0;
+	queue[tail++] = 0;
+
+	/*
+	 * Process the states in BFS order. When a state is processed its row
+	 * holds only its trie children, while the rows of all the states with
+	 * smaller depth (including its failure state) are complete.
+	 */
+	while (head < tail) {
+		uint32_t s = queue[head++];
+		uint32_t *row = &set->delta[(size_t)s * nclasses];
+		uint32_t *fail_row = &set->delta[(size_t)fail[s] * nclasses];
+		size_t c;
+
+		for (c = 0; c < nclasses; c++) {
+			uint32_t t = row[c];
+
+			if (t == 0) {
+				row[c] = (s == 0) ? 0 : fail_row[c];
+				continue;
+			}
+
+			fail[t] = (s == 0) ? 0 : fail_row[c];
+
+			uint32_t f = fail[t];
+			set->dict[t] = (set->term[f] != -1) ? f : set->dict[f];
+			set->output[t] = (set->term[t] != -1 || set->dict[t] != 0);
+
+			queue[tail++] = t;
+		}
+	}
+}
+
+/**********************
+ * Internal functions *
+ **********************/
+
+/**
+ * Compiles the automaton of a pattern set, if it is not up to date.
+ *
+ * @param set the bless_pattern_set_t
+ *
+ * @return the operation error code
+ */
+int pattern_set_compile(bless_pattern_set_t *set)
+{
+	if (set == NULL)
+		return_error(EINVAL);
+
+	if (set->compiled)
+		return 0;
+
+	free_automaton(set);
+
+	compute_classes(set);
+
+	/* There is at most one state per pattern byte, plus the root */
+	size_t max_states = 1;
+	int i;
+	for (i = 0; i < set->npatterns; i++) {
+		if (set->lengths[i] > UINT32_MAX - max_states)
+			return_error(EOVERFLOW);
+		max_states += set->lengths[i];
+	}
+
+	if (max_states > __MAX(size_t) / sizeof(uint32_t) / set->nclasses)
+		return_error(ENOMEM);
+
+	set->delta = calloc(max_states * set->nclasses, sizeof(uint32_t));
+	set->term = malloc(max_states * sizeof(int));
+	set->term_next = malloc((set->npatterns + 1) * sizeof(int));
+	set->dict = malloc(max_states * sizeof(uint32_t));
+	set->output = malloc(max_states);
+
+	uint32_t *fail = malloc(max_states * sizeof(uint32_t));
+	uint32_t *queue = malloc(max_states * sizeof(uint32_t));
+
+	int err = 0;
+
+	if (set->delta == NULL || set->term == NULL || set->term_next == NULL
+			|| set->dict == NULL || set->output == NULL || fail == NULL
+			|| queue == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error);
+	}
+
+	size_t s;
+	for (s = 0; s < max_states; s++)
+		set->term[s] = -1;
+
+	build_trie(set);
+	build_dfa(set, fail, queue);
+
+	set->compiled = 1;
+
+on_error:
+	free(fail);
+	free(queue);
+
+	if (err)
+		free_automaton(set);
+
+	return err;
+}
+
+/**
+ * Scans data with the automaton of a pattern set, reporting the matches.
+ *
+ * The data can be scanned in consecutive pieces, by passing the state
+ * returned by one call to the next. The initial state is 0. Matches are
+ * reported in order of their end offset and, for the same end offset, from
+ * the longest to the shortest pattern.
+ *
+ * @param set the compiled bless_pattern_set_t
+ * @param[in,out] state the state of the automaton
+ * @param data the data to scan
+ * @param len the length of the data
+ * @param pos the offset of the data in the buffer
+ * @param match_func the function to report the matches to
+ * @param user_data the user data to pass to match_func
+ * @param[out] stop 1 if match_func requested the search to stop, 0 otherwise
+ *
+ * @return the operation error code
+ */
+int pattern_set_scan(bless_pattern_set_t *set, uint32_t *state,
+		const unsigned char *data, size_t len, off_t pos,
+		bless_buffer_match_func *match_func, void *user_data, int *stop)
+{
+	if (set == NULL || state == NULL || data == NULL || stop == NULL
+			|| !set->compiled)
+		return_error(EINVAL);
+
+	const uint32_t *delta = set->delta;
+	const uint8_t *classes = set->classes;
+	const unsigned char *output = set->output;
+	size_t nclasses = set->nclasses;
+
+	uint32_t s = *state;
+	size_t i;
+
+	*stop = 0;
+
+	for (i = 0; i < len; i++) {
+		s = delta[(size_t)s * nclasses + classes[data[i]]];
+
+		if (!output[s])
+			continue;
+
+		/* Report the patterns ending at this state and at its suffixes */
+		off_t end = pos + (off_t)i + 1;
+		uint32_t t = s;
+
+		while (t != 0) {
+			int id;
+			for (id = set->term[t]; id != -1; id = set->term_next[id]) {
+				off_t length = set->lengths[id];
+				if (match_func != NULL &&
+						(*match_func)(end - length, length, id, user_data)) {
+					*stop = 1;
+					*state = s;
+					return 0;
+				}
+			}
+
+			t = set->dict[t];
+		}
+	}
+
+	*state = s;
+
+	return 0;
+}
+
+/*****************
+ * API Functions *
+ *****************/
+
+/**
+ * Creates a new, empty pattern set.
+ *
+ * @param[out] set the created bless_pattern_set_t
+ *
+ * @return the operation error code
+ */
+int bless_pattern_set_new(bless_pattern_set_t **set)
+{
+	if (set == NULL)
+		return_error(EINVAL);
+
+	bless_pattern_set_t *ps = malloc(sizeof(*ps));
+	if (ps == NULL)
+		return_error(ENOMEM);
+
+	ps->patterns = NULL;
+	ps->lengths = NULL;
+	ps->npatterns = 0;
+	ps->patterns_size = 0;
+	ps->compiled = 0;
+	ps->nclasses = 0;
+	ps->delta = NULL;
+	ps->nstates = 0;
+	ps->term = NULL;
+	ps->term_next = NULL;
+	ps->dict = NULL;
+	ps->output = NULL;
+
+	*set = ps;
+
+	return 0;
+}
+
+/**
+ * Adds a pattern to a pattern set.
+ *
+ * The pattern data are copied, so they can be freed after this call. The
+ * patterns are identified by their index in the set, in the order they were
+ * added (starting from 0).
+ *
+ * @param set the bless_pattern_set_t to add the pattern to
+ * @param data the data of the pattern
+ * @param length the length of the pattern (must be > 0)
+ * @param[out] id the id of the added pattern
+ *
+ * @return the operation error code
+ */
+int bless_pattern_set_add(bless_pattern_set_t *set, void *data, size_t length,
+		int *id)
+{
+	if (set == NULL || data == NULL || length == 0 || id == NULL)
+		return_error(EINVAL);
+
+	if (set->npatterns == __MAX(int))
+		return_error(ENOMEM);
+
+	if (set->npatterns == set->patterns_size) {
+		int size = set->patterns_size * 2;
+		if (size <= set->patterns_size)
+			size = set->patterns_size < 16 ? 16 : __MAX(int);
+
+		unsigned char **patterns =
+			realloc(set->patterns, size * sizeof(*patterns));
+		if (patterns == NULL)
+			return_error(ENOMEM);
+		set->patterns = patterns;
+
+		size_t *lengths = realloc(set->lengths, size * sizeof(*lengths));
+		if (lengths == NULL)
+			return_error(ENOMEM);
+		set->lengths = lengths;
+
+		set->patterns_size = size;
+	}
+
+	unsigned char *copy = malloc(length);
+	if (copy == NULL)
+		return_error(ENOMEM);
+
+	memcpy(copy, data, length);
+
+	set->patterns[set->npatterns] = copy;
+	set->lengths[set->npatterns] = length;
+	*id = set->npatterns++;
+
+	/* The automaton must be compiled again */
+	free_automaton(set);
+
+	return 0;
+}
+
+/**
+ * Gets the number of patterns in a pattern set.
+ *
+ * @param set the bless_pattern_set_t
+ * @param[out] count the number of patterns
+ *
+ * @return the operation error code
+ */
+int bless_pattern_set_get_count(bless_pattern_set_t *set, int *count)
+{
+	if (set == NULL || count == NULL)
+		return_error(EINVAL);
+
+	*count = set->npatterns;
+
+	return 0;
+}
+
+/**
+ * Frees a pattern set.
+ *
+ * @param set the bless_pattern_set_t to free
+ *
+ * @return the operation error code
+ */
+int bless_pattern_set_free(bless_pattern_set_t *set)
+{
+	if (set == NULL)
+		return_error(EINVAL);
+
+	free_automaton(set);
+
+	int i;
+	for (i = 0; i < set->npatterns; i++)
+		free(set->patterns[i]);
+
+	free(set->patterns);
+	free(set->lengths);
+	free(set);
+
+	return 0;
+}
+
+#pragma GCC visibility pop
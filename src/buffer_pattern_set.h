@@ -0,0 +1,37 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file buffer_pattern_set.h
+ *
+ * Internal pattern set functions
+ */
+#ifndef _BUFFER_PATTERN_SET_H
+#define _BUFFER_PATTERN_SET_H
+
+#include <stdint.h>
+#include "buffer.h"
+
+int pattern_set_compile(bless_pattern_set_t *set);
+
+int pattern_set_scan(bless_pattern_set_t *set, uint32_t *state,
+		const unsigned char *data, size_t len, off_t pos,
+		bless_buffer_match_func *match_func, void *user_data, int *stop);
+
+#endif /* _BUFFER_PATTERN_SET_H */
@@ -0,0 +1,1588 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file buffer_regex.c
+ *
+ * Regular expression implementation
+ *
+ * A regex is parsed into a syntax tree, which is compiled into two Thompson
+ * NFAs: one for the regex and one for the regex reversed. The NFAs are run
+ * as lazy DFAs: the DFA states (sets of NFA states) and their transitions are
+ * computed the first time a search needs them and are kept in a cache. The
+ * cache of each automaton has a fixed memory budget (REGEX_DFA_CACHE_SIZE).
+ * When it is full it is flushed and the states are computed again as they
+ * are needed, so the memory used doesn't depend on the data searched. As in
+ * pattern sets, the bytes are mapped to classes (bytes that no part of the
+ * regex tells apart share a class) to keep the transition tables small.
+ *
+ * Three automata are run (see bless_buffer_find_regex()): the forward NFA
+ * with an implicit ".*" prefix, to find where the first match ends, the
+ * reverse NFA, to find the leftmost start of the matches ending there, and
+ * the forward NFA again, to find the longest match from that start.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "buffer_regex.h"
+#include "debug.h"
+
+#pragma GCC visibility push(default)
+
+/** The number of buckets of the hash table of the states of a DFA */
+#define REGEX_DFA_HASH_SIZE 4096
+
+/** The transition of a DFA state that hasn't been computed yet */
+#define REGEX_DFA_UNKNOWN (-1)
+
+/** The DFA state without NFA states (no match is possible from it) */
+#define REGEX_DFA_DEAD 0
+
+/**
+ * The types of the nodes of a regex syntax tree.
+ */
+enum regex_node_type {
+	REGEX_NODE_BYTES, /**< A single byte out of a set */
+	REGEX_NODE_CAT, /**< The concatenation of the children (may be empty) */
+	REGEX_NODE_ALT, /**< An alternation of the children */
+	REGEX_NODE_REPEAT /**< A repetition of the child */
+};
+
+/**
+ * A node of a regex syntax tree.
+ */
+struct regex_node {
+	int type;
+	int depth;
+
+	/* The first and last children and the siblings (-1 if none) */
+	int child;
+	int last;
+	int prev;
+	int next;
+
+	/* The repetition counts (max is -1 for unbounded repetitions) */
+	int min;
+	int max;
+
+	uint32_t bytes[8];
+};
+
+/**
+ * The state of the parser of a regex.
+ */
+struct regex_parser {
+	const unsigned char *p;
+	const unsigned char *end;
+	int depth;
+
+	struct regex_node *nodes;
+	int nnodes;
+	int nodes_size;
+};
+
+/**
+ * The types of the states of an NFA.
+ */
+enum regex_nfa_state_type {
+	REGEX_NFA_BYTES, /**< Consumes a byte out of a set and goes to out */
+	REGEX_NFA_SPLIT, /**< Goes to both out and out1 without consuming bytes */
+	REGEX_NFA_MATCH /**< A match has been found */
+};
+
+/**
+ * A state of an NFA.
+ */
+struct regex_nfa_state {
+	int type;
+	int32_t out;
+	int32_t out1;
+	uint32_t bytes[8];
+};
+
+/**
+ * A Thompson NFA.
+ */
+struct regex_nfa {
+	struct regex_nfa_state *states;
+	int32_t nstates;
+	int32_t states_size;
+};
+
+/**
+ * A lazy DFA run from an NFA.
+ */
+struct regex_dfa {
+	struct regex_nfa *nfa;
+	int32_t nfa_start;
+
+	/* The start state (-1 if it is not in the cache) */
+	int32_t start;
+
+	/*
+	 * The transitions of the states (nstates * nclasses), the location of
+	 * the sets of NFA states of the states in the pool, the hashes of the
+	 * sets, the next state in the same hash bucket and whether the states
+	 * contain a match state.
+	 */
+	int32_t *delta;
+	uint32_t *set_start;
+	uint32_t *set_length;
+	uint32_t *hash;
+	int32_t *hash_next;
+	unsigned char *accept;
+	int32_t nstates;
+	int32_t states_size;
+
+	/* The sets of NFA states of the DFA states */
+	uint32_t *pool;
+	size_t pool_length;
+	size_t pool_size;
+
+	int32_t buckets[REGEX_DFA_HASH_SIZE];
+
+	/* The memory used by the states in the cache */
+	size_t cache_used;
+};
+
+/**
+ * A compiled regular expression.
+ */
+struct bless_regex {
+	/* The byte classes and a byte of each class */
+	uint8_t classes[256];
+	unsigned char class_bytes[256];
+	size_t nclasses;
+
+	struct regex_nfa forward;
+	struct regex_nfa reverse;
+
+	struct regex_dfa dfas[REGEX_DFA_COUNT];
+
+	/*
+	 * Scratch space for computing sets of NFA states: the generation each
+	 * NFA state was last added in, the stack of the states to visit and
+	 * the set being computed.
+	 */
+	uint32_t *mark;
+	uint32_t mark_gen;
+	int32_t *stack;
+	uint32_t *set;
+	size_t set_length;
+};
+
+/********************
+ * Helper functions *
+ ********************/
+
+static inline void byte_set_add(uint32_t *set, int b)
+{
+	set[b >> 5] |= (uint32_t)1 << (b & 31);
+}
+
+static inline int byte_set_has(const uint32_t *set, int b)
+{
+	return (set[b >> 5] >> (b & 31)) & 1;
+}
+
+static void byte_set_add_range(uint32_t *set, int lo, int hi)
+{
+	int b;
+	for (b = lo; b <= hi; b++)
+		byte_set_add(set, b);
+}
+
+static void byte_set_invert(uint32_t *set)
+{
+	int i;
+	for (i = 0; i < 8; i++)
+		set[i] = ~set[i];
+}
+
+/**
+ * Adds a new node to the syntax tree of a regex.
+ *
+ * @param ps the regex_parser
+ * @param type the type of the node
+ * @param[out] node the index of the new node
+ *
+ * @return the operation error code
+ */
+static int parser_new_node(struct regex_parser *ps, int type, int *node)
+{
+	if (ps->nnodes == ps->nodes_size) {
+		int size = ps->nodes_size < 16 ? 16 : ps->nodes_size * 2;
+		if (size <= ps->nodes_size)
+			return_error(ENOMEM);
+
+		struct regex_node *nodes = realloc(ps->nodes, size * sizeof(*nodes));
+		if (nodes == NULL)
+			return_error(ENOMEM);
+
+		ps->nodes = nodes;
+		ps->nodes_size = size;
+	}
+
+	struct regex_node *n = &ps->nodes[ps->nnodes];
+
+	n->type = type;
+	n->depth = 1;
+	n->child = -1;
+	n->last = -1;
+	n->prev = -1;
+	n->next = -1;
+	n->min = 0;
+	n->max = 0;
+	memset(n->bytes, 0, sizeof(n->bytes));
+
+	*node = ps->nnodes++;
+
+	return 0;
+}
+
+/**
+ * Appends a child to a node of the syntax tree of a regex.
+ *
+ * @param ps the regex_parser
+ * @param parent the node to append the child to
+ * @param child the child node
+ *
+ * @return the operation error code (EINVAL if the tree gets too deep)
+ */
+static int parser_add_child(struct regex_parser *ps, int parent, int child)
+{
+	struct regex_node *p = &ps->nodes[parent];
+	struct regex_node *c = &ps->nodes[child];
+
+	c->prev = p->last;
+	c->next = -1;
+
+	if (p->last == -1)
+		p->child = child;
+	else
+		ps->nodes[p->last].next = child;
+
+	p->last = child;
+
+	if (c->depth + 1 > p->depth)
+		p->depth = c->depth + 1;
+
+	if (p->depth > REGEX_MAX_DEPTH)
+		return_error(EINVAL);
+
+	return 0;
+}
+
+/**
+ * Parses an escape sequence (after the backslash).
+ *
+ * @param ps the regex_parser
+ * @param[out] set the bytes matched by the escape sequence
+ * @param[out] byte the byte of the escape sequence or -1 if it matches
+ *                  a class of bytes (eg "\d")
+ *
+ * @return the operation error code
+ */
+static int parse_escape(struct regex_parser *ps, uint32_t *set, int *byte)
+{
+	if (ps->p == ps->end)
+		return_error(EINVAL);
+
+	int c = *ps->p++;
+	int b = -1;
+	int invert = 0;
+
+	memset(set, 0, 8 * sizeof(*set));
+
+	switch (c) {
+		case 'x': {
+			int i;
+			b = 0;
+			for (i = 0; i < 2; i++) {
+				if (ps->p == ps->end)
+					return_error(EINVAL);
+
+				int h = *ps->p++;
+				if (h >= '0' && h <= '9')
+					b = b * 16 + (h - '0');
+				else if (h >= 'a' && h <= 'f')
+					b = b * 16 + (h - 'a' + 10);
+				else if (h >= 'A' && h <= 'F')
+					b = b * 16 + (h - 'A' + 10);
+				else
+					return_error(EINVAL);
+			}
+			break;
+		}
+		case 'n': b = '\n'; break;
+		case 'r': b = '\r'; break;
+		case 't': b = '\t'; break;
+		case 'f': b = '\f'; break;
+		case 'v': b = '\v'; break;
+		case '0': b = 0; break;
+		case 'D': invert = 1; /* Fall through */
+		case 'd':
+			byte_set_add_range(set, '0', '9');
+			break;
+		case 'W': invert = 1; /* Fall through */
+		case 'w':
+			byte_set_add_range(set, '0', '9');
+			byte_set_add_range(set, 'A', 'Z');
+			byte_set_add_range(set, 'a', 'z');
+			byte_set_add(set, '_');
+			break;
+		case 'S': invert = 1; /* Fall through */
+		case 's':
+			byte_set_add_range(set, '\t', '\r');
+			byte_set_add(set, ' ');
+			break;
+		default:
+			/* Other letters and digits are reserved */
+			if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z')
+					|| (c >= 'a' && c <= 'z'))
+				return_error(EINVAL);
+			b = c;
+			break;
+	}
+
+	if (b != -1)
+		byte_set_add(set, b);
+	else if (invert)
+		byte_set_invert(set);
+
+	*byte = b;
+
+	return 0;
+}
+
+/**
+ * Parses a bracket expression (after the opening bracket).
+ *
+ * @param ps the regex_parser
+ * @param[out] set the bytes matched by the bracket expression
+ *
+ * @return the operation error code
+ */
+static int parse_bracket(struct regex_parser *ps, uint32_t *set)
+{
+	int negate = 0;
+	int first = 1;
+
+	memset(set, 0, 8 * sizeof(*set));
+
+	if (ps->p < ps->end && *ps->p == '^') {
+		negate = 1;
+		ps->p++;
+	}
+
+	for (;;) {
+		if (ps->p == ps->end)
+			return_error(EINVAL);
+
+		/* A ']' right after the opening bracket is a literal */
+		if (*ps->p == ']' && !first) {
+			ps->p++;
+			break;
+		}
+
+		first = 0;
+
+		uint32_t eset[8];
+		int lo;
+		int err;
+
+		if (*ps->p == '\\') {
+			ps->p++;
+			err = parse_escape(ps, eset, &lo);
+			if (err)
+				return_error(err);
+
+			/* Classes of bytes can't be range endpoints */
+			if (lo == -1) {
+				int i;
+				for (i = 0; i < 8; i++)
+					set[i] |= eset[i];
+				continue;
+			}
+		}
+		else
+			lo = *ps->p++;
+
+		/* A '-' before the closing bracket is a literal */
+		if (ps->end - ps->p >= 2 && ps->p[0] == '-' && ps->p[1] != ']') {
+			int hi;
+
+			ps->p++;
+			if (*ps->p == '\\') {
+				ps->p++;
+				err = parse_escape(ps, eset, &hi);
+				if (err)
+					return_error(err);
+
+				if (hi == -1)
+					return_error(EINVAL);
+			}
+			else
+				hi = *ps->p++;
+
+			if (hi < lo)
+				return_error(EINVAL);
+
+			byte_set_add_range(set, lo, hi);
+		}
+		else
+			byte_set_add(set, lo);
+	}
+
+	if (negate)
+		byte_set_invert(set);
+
+	return 0;
+}
+
+/**
+ * Parses a repetition count.
+ *
+ * @param ps the regex_parser
+ * @param[out] count the parsed count
+ *
+ * @return the operation error code
+ */
+static int parse_count(struct regex_parser *ps, int *count)
+{
+	int n = 0;
+	int digits = 0;
+
+	while (ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9') {
+		n = n * 10 + (*ps->p++ - '0');
+		if (n > REGEX_MAX_REPEAT)
+			return_error(EINVAL);
+		digits++;
+	}
+
+	if (digits == 0)
+		return_error(EINVAL);
+
+	*count = n;
+
+	return 0;
+}
+
+/**
+ * Parses a quantifier, if there is one.
+ *
+ * @param ps the regex_parser
+ * @param[out] min the minimum repetition count
+ * @param[out] max the maximum repetition count (-1 for unbounded)
+ * @param[out] found whether a quantifier was found
+ *
+ * @return the operation error code
+ */
+static int parse_quantifier(struct regex_parser *ps, int *min, int *max,
+		int *found)
+{
+	*found = 0;
+
+	if (ps->p == ps->end)
+		return 0;
+
+	switch (*ps->p) {
+		case '*': *min = 0; *max = -1; break;
+		case '+': *min = 1; *max = -1; break;
+		case '?': *min = 0; *max = 1; break;
+		case '{': {
+			ps->p++;
+
+			int err = parse_count(ps, min);
+			if (err)
+				return_error(err);
+
+			*max = *min;
+
+			if (ps->p < ps->end && *ps->p == ',') {
+				ps->p++;
+				if (ps->p < ps->end && *ps->p == '}') {
+					*max = -1;
+				}
+				else {
+					err = parse_count(ps, max);
+					if (err)
+						return_error(err);
+
+					if (*max < *min)
+						return_error(EINVAL);
+				}
+			}
+
+			if (ps->p == ps->end || *ps->p != '}')
+				return_error(EINVAL);
+			break;
+		}
+		default:
+			return 0;
+	}
+
+	ps->p++;
+	*found = 1;
+
+	return 0;
+}
+
+static int parse_alternation(struct regex_parser *ps, int *node);
+
+/**
+ * Parses an atom (a byte, a bracket expression or a group).
+ *
+ * @param ps the regex_parser
+ * @param[out] node the node of the atom
+ *
+ * @return the operation error code
+ */
+static int parse_atom(struct regex_parser *ps, int *node)
+{
+	int c = *ps->p++;
+	int err;
+
+	if (c == '(') {
+		if (++ps->depth > REGEX_MAX_DEPTH)
+			return_error(EINVAL);
+
+		err = parse_alternation(ps, node);
+		if (err)
+			return_error(err);
+
+		if (ps->p == ps->end || *ps->p != ')')
+			return_error(EINVAL);
+
+		ps->p++;
+		ps->depth--;
+
+		return 0;
+	}
+
+	/* Quantifiers without an atom and anchors (not supported) */
+	if (c == '*' || c == '+' || c == '?' || c == '{' || c == '^' || c == '$')
+		return_error(EINVAL);
+
+	err = parser_new_node(ps, REGEX_NODE_BYTES, node);
+	if (err)
+		return_error(err);
+
+	uint32_t *set = ps->nodes[*node].bytes;
+
+	if (c == '[') {
+		err = parse_bracket(ps, set);
+		if (err)
+			return_error(err);
+	}
+	else if (c == '\\') {
+		int b;
+		err = parse_escape(ps, set, &b);
+		if (err)
+			return_error(err);
+	}
+	else if (c == '.')
+		byte_set_add_range(set, 0, 255);
+	else
+		byte_set_add(set, c);
+
+	return 0;
+}
+
+/**
+ * Parses a concatenation of (possibly repeated) atoms.
+ *
+ * @param ps the regex_parser
+ * @param[out] node the node of the concatenation
+ *
+ * @return the operation error code
+ */
+static int parse_concatenation(struct regex_parser *ps, int *node)
+{
+	int cat;
+	int err = parser_new_node(ps, REGEX_NODE_CAT, &cat);
+	if (err)
+		return_error(err);
+
+	while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+		int atom;
+		err = parse_atom(ps, &atom);
+		if (err)
+			return_error(err);
+
+		int min;
+		int max;
+		int found;
+
+		for (;;) {
+			err = parse_quantifier(ps, &min, &max, &found);
+			if (err)
+				return_error(err);
+
+			if (!found)
+				break;
+
+			int rep;
+			err = parser_new_node(ps, REGEX_NODE_REPEAT, &rep);
+			if (err)
+				return_error(err);
+
+			ps->nodes[rep].min = min;
+			ps->nodes[rep].max = max;
+
+			err = parser_add_child(ps, rep, atom);
+			if (err)
+				return_error(err);
+
+			atom = rep;
+		}
+
+		err = parser_add_child(ps, cat, atom);
+		if (err)
+			return_error(err);
+	}
+
+	*node = cat;
+
+	return 0;
+}
+
+/**
+ * Parses an alternation of concatenations.
+ *
+ * @param ps the regex_parser
+ * @param[out] node the node of the alternation
+ *
+ * @return the operation error code
+ */
+static int parse_alternation(struct regex_parser *ps, int *node)
+{
+	int cat;
+	int err = parse_concatenation(ps, &cat);
+	if (err)
+		return_error(err);
+
+	if (ps->p == ps->end || *ps->p != '|') {
+		*node = cat;
+		return 0;
+	}
+
+	int alt;
+	err = parser_new_node(ps, REGEX_NODE_ALT, &alt);
+	if (err)
+		return_error(err);
+
+	err = parser_add_child(ps, alt, cat);
+	if (err)
+		return_error(err);
+
+	while (ps->p < ps->end && *ps->p == '|') {
+		ps->p++;
+
+		err = parse_concatenation(ps, &cat);
+		if (err)
+			return_error(err);
+
+		err = parser_add_child(ps, alt, cat);
+		if (err)
+			return_error(err);
+	}
+
+	*node = alt;
+
+	return 0;
+}
+
+/**
+ * Adds a state to an NFA.
+ *
+ * @param nfa the regex_nfa
+ * @param type the type of the state
+ * @param out the state to go to
+ * @param out1 the other state to go to (for REGEX_NFA_SPLIT states)
+ * @param bytes the bytes consumed (for REGEX_NFA_BYTES states) or NULL
+ * @param[out] id the id of the new state
+ *
+ * @return the operation error code (EINVAL if the NFA gets too large)
+ */
+static int nfa_add_state(struct regex_nfa *nfa, int type, int32_t out,
+		int32_t out1, const uint32_t *bytes, int32_t *id)
+{
+	if (nfa->nstates == REGEX_MAX_NFA_STATES)
+		return_error(EINVAL);
+
+	if (nfa->nstates == nfa->states_size) {
+		int32_t size = nfa->states_size < 64 ? 64 : nfa->states_size * 2;
+		if (size > REGEX_MAX_NFA_STATES)
+			size = REGEX_MAX_NFA_STATES;
+
+		struct regex_nfa_state *states =
+			realloc(nfa->states, size * sizeof(*states));
+		if (states == NULL)
+			return_error(ENOMEM);
+
+		nfa->states = states;
+		nfa->states_size = size;
+	}
+
+	struct regex_nfa_state *st = &nfa->states[nfa->nstates];
+
+	st->type = type;
+	st->out = out;
+	st->out1 = out1;
+
+	if (bytes != NULL)
+		memcpy(st->bytes, bytes, sizeof(st->bytes));
+	else
+		memset(st->bytes, 0, sizeof(st->bytes));
+
+	*id = nfa->nstates++;
+
+	return 0;
+}
+
+/**
+ * Compiles a node of a syntax tree into NFA states.
+ *
+ * The NFA is built backwards: the states of the node are built to continue
+ * to an existing state.
+ *
+ * @param nodes the nodes of the syntax tree
+ * @param n the node to compile
+ * @param nfa the regex_nfa to add the states to
+ * @param reverse whether to compile the reversed regex
+ * @param next the state to continue to after the node has matched
+ * @param[out] start the first state of the node
+ *
+ * @return the operation error code
+ */
+static int nfa_compile(struct regex_node *nodes, int n, struct regex_nfa *nfa,
+		int reverse, int32_t next, int32_t *start)
+{
+	struct regex_node *node = &nodes[n];
+	int32_t s = next;
+	int err = 0;
+	int c;
+
+	switch (node->type) {
+		case REGEX_NODE_BYTES:
+			err = nfa_add_state(nfa, REGEX_NFA_BYTES, next, -1, node->bytes,
+					&s);
+			break;
+
+		case REGEX_NODE_CAT:
+			/* Build the children from the last one (the first if reversed) */
+			c = reverse ? node->child : node->last;
+			while (c != -1 && !err) {
+				err = nfa_compile(nodes, c, nfa, reverse, s, &s);
+				c = reverse ? nodes[c].next : nodes[c].prev;
+			}
+			break;
+
+		case REGEX_NODE_ALT:
+			s = -1;
+			for (c = node->child; c != -1 && !err; c = nodes[c].next) {
+				int32_t cs;
+				err = nfa_compile(nodes, c, nfa, reverse, next, &cs);
+				if (!err && s != -1)
+					err = nfa_add_state(nfa, REGEX_NFA_SPLIT, cs, s, NULL, &cs);
+				s = cs;
+			}
+			break;
+
+		case REGEX_NODE_REPEAT: {
+			int copies = node->min;
+
+			if (node->max == -1) {
+				/* The last mandatory copy (or an optional one) loops */
+				int32_t loop;
+				err = nfa_add_state(nfa, REGEX_NFA_SPLIT, -1, next, NULL,
+						&loop);
+				if (err)
+					break;
+
+				int32_t body;
+				err = nfa_compile(nodes, node->child, nfa, reverse, loop, &body);
+				if (err)
+					break;
+
+				nfa->states[loop].out = body;
+
+				if (copies > 0) {
+					s = body;
+					copies--;
+				}
+				else
+					s = loop;
+			}
+			else {
+				/* The optional copies, nested: (x(x)?)? */
+				int i;
+				for (i = node->min; i < node->max && !err; i++) {
+					int32_t body;
+					err = nfa_compile(nodes, node->child, nfa, reverse, s, &body);
+					if (!err)
+						err = nfa_add_state(nfa, REGEX_NFA_SPLIT, body, next,
+								NULL, &s);
+				}
+			}
+
+			while (copies-- > 0 && !err)
+				err = nfa_compile(nodes, node->child, nfa, reverse, s, &s);
+
+			break;
+		}
+	}
+
+	if (err)
+		return_error(err);
+
+	*start = s;
+
+	return 0;
+}
+
+/**
+ * Computes the byte classes of a regex.
+ *
+ * Consecutive bytes are put in the same class, unless some byte set of the
+ * NFA contains only one of them.
+ *
+ * @param regex the bless_regex_t
+ */
+static void compute_classes(bless_regex_t *regex)
+{
+	unsigned char split[256];
+	memset(split, 0, sizeof(split));
+
+	int32_t i;
+	for (i = 0; i < regex->forward.nstates; i++) {
+		struct regex_nfa_state *st = &regex->forward.states[i];
+		if (st->type != REGEX_NFA_BYTES)
+			continue;
+
+		int b;
+		for (b = 1; b < 256; b++) {
+			if (byte_set_has(st->bytes, b) != byte_set_has(st->bytes, b - 1))
+				split[b] = 1;
+		}
+	}
+
+	int cls = 0;
+	int b;
+
+	regex->classes[0] = 0;
+	regex->class_bytes[0] = 0;
+
+	for (b = 1; b < 256; b++) {
+		if (split[b])
+			regex->class_bytes[++cls] = b;
+		regex->classes[b] = cls;
+	}
+
+	regex->nclasses = cls + 1;
+}
+
+/**
+ * Starts computing a new set of NFA states.
+ *
+ * @param regex the bless_regex_t
+ */
+static void closure_begin(bless_regex_t *regex)
+{
+	regex->set_length = 0;
+
+	if (++regex->mark_gen == 0) {
+		int32_t n = regex->forward.nstates;
+		if (regex->reverse.nstates > n)
+			n = regex->reverse.nstates;
+
+		memset(regex->mark, 0, n * sizeof(*regex->mark));
+		regex->mark_gen = 1;
+	}
+}
+
+/**
+ * Adds an NFA state and the states reachable from it without consuming
+ * bytes to the set being computed.
+ *
+ * Only the states that consume bytes and the match state are kept in the
+ * set, as the others don't affect the transitions.
+ *
+ * @param regex the bless_regex_t
+ * @param nfa the regex_nfa
+ * @param id the state to add
+ */
+static void closure_add(bless_regex_t *regex, struct regex_nfa *nfa,
+		int32_t id)
+{
+	uint32_t *mark = regex->mark;
+	uint32_t gen = regex->mark_gen;
+	int32_t *stack = regex->stack;
+	size_t top = 0;
+
+	if (mark[id] == gen)
+		return;
+
+	mark[id] = gen;
+	stack[top++] = id;
+
+	while (top > 0) {
+		struct regex_nfa_state *st = &nfa->states[stack[--top]];
+
+		if (st->type == REGEX_NFA_SPLIT) {
+			if (mark[st->out] != gen) {
+				mark[st->out] = gen;
+				stack[top++] = st->out;
+			}
+			if (mark[st->out1] != gen) {
+				mark[st->out1] = gen;
+				stack[top++] = st->out1;
+			}
+		}
+		else
+			regex->set[regex->set_length++] = st - nfa->states;
+	}
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Empties the state cache of a DFA.
+ *
+ * Only the dead state is kept.
+ *
+ * @param regex the bless_regex_t
+ * @param dfa the regex_dfa
+ */
+static void dfa_flush(bless_regex_t *regex, struct regex_dfa *dfa)
+{
+	int i;
+	for (i = 0; i < REGEX_DFA_HASH_SIZE; i++)
+		dfa->buckets[i] = -1;
+
+	dfa->nstates = 1;
+	dfa->pool_length = 0;
+	dfa->start = -1;
+	dfa->cache_used = regex->nclasses * sizeof(*dfa->delta);
+
+	/* The dead state goes to itself and isn't in the hash table */
+	memset(dfa->delta, 0, regex->nclasses * sizeof(*dfa->delta));
+	dfa->set_start[REGEX_DFA_DEAD] = 0;
+	dfa->set_length[REGEX_DFA_DEAD] = 0;
+	dfa->hash[REGEX_DFA_DEAD] = 0;
+	dfa->hash_next[REGEX_DFA_DEAD] = -1;
+	dfa->accept[REGEX_DFA_DEAD] = 0;
+}
+
+/**
+ * Makes room for another state in the arrays of a DFA.
+ *
+ * @param regex the bless_regex_t
+ * @param dfa the regex_dfa
+ * @param set_length the length of the set of the new state
+ *
+ * @return the operation error code
+ */
+static int dfa_grow(bless_regex_t *regex, struct regex_dfa *dfa,
+		size_t set_length)
+{
+	if (dfa->nstates == dfa->states_size) {
+		int32_t size = dfa->states_size * 2;
+		if (size <= dfa->states_size)
+			return_error(ENOMEM);
+
+		int32_t *delta = realloc(dfa->delta,
+				(size_t)size * regex->nclasses * sizeof(*delta));
+		if (delta == NULL)
+			return_error(ENOMEM);
+		dfa->delta = delta;
+
+		uint32_t *set_start = realloc(dfa->set_start, size * sizeof(*set_start));
+		if (set_start == NULL)
+			return_error(ENOMEM);
+		dfa->set_start = set_start;
+
+		uint32_t *set_length = realloc(dfa->set_length,
+				size * sizeof(*set_length));
+		if (set_length == NULL)
+			return_error(ENOMEM);
+		dfa->set_length = set_length;
+
+		uint32_t *hash = realloc(dfa->hash, size * sizeof(*hash));
+		if (hash == NULL)
+			return_error(ENOMEM);
+		dfa->hash = hash;
+
+		int32_t *hash_next = realloc(dfa->hash_next, size * sizeof(*hash_next));
+		if (hash_next == NULL)
+			return_error(ENOMEM);
+		dfa->hash_next = hash_next;
+
+		unsigned char *accept = realloc(dfa->accept, size * sizeof(*accept));
+		if (accept == NULL)
+			return_error(ENOMEM);
+		dfa->accept = accept;
+
+		dfa->states_size = size;
+	}
+
+	if (dfa->pool_length + set_length > dfa->pool_size) {
+		size_t size = dfa->pool_size * 2;
+		if (size < dfa->pool_length + set_length)
+			size = dfa->pool_length + set_length;
+
+		uint32_t *pool = realloc(dfa->pool, size * sizeof(*pool));
+		if (pool == NULL)
+			return_error(ENOMEM);
+
+		dfa->pool = pool;
+		dfa->pool_size = size;
+	}
+
+	return 0;
+}
+
+/**
+ * Gets the DFA state of the set of NFA states computed last, adding it to
+ * the cache if it isn't there.
+ *
+ * If the cache is full it is flushed first, so the ids of all the other
+ * states become invalid.
+ *
+ * @param regex the bless_regex_t
+ * @param dfa the regex_dfa
+ * @param[out] state the DFA state
+ * @param[out] flushed whether the cache was flushed
+ *
+ * @return the operation error code
+ */
+static int dfa_get_state(bless_regex_t *regex, struct regex_dfa *dfa,
+		int32_t *state, int *flushed)
+{
+	uint32_t *set = regex->set;
+	size_t len = regex->set_length;
+
+	*flushed = 0;
+
+	if (len == 0) {
+		*state = REGEX_DFA_DEAD;
+		return 0;
+	}
+
+	qsort(set, len, sizeof(*set), compare_ids);
+
+	uint32_t hash = 2166136261U;
+	int accept = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ set[i]) * 16777619U;
+		if (dfa->nfa->states[set[i]].type == REGEX_NFA_MATCH)
+			accept = 1;
+	}
+
+	int32_t s;
+	for (s = dfa->buckets[hash % REGEX_DFA_HASH_SIZE]; s != -1;
+			s = dfa->hash_next[s]) {
+		if (dfa->hash[s] == hash && dfa->set_length[s] == len
+				&& !memcmp(dfa->pool + dfa->set_start[s], set,
+					len * sizeof(*set))) {
+			*state = s;
+			return 0;
+		}
+	}
+
+	/* Add a new state, flushing the cache if it is full */
+	size_t cost = regex->nclasses * sizeof(*dfa->delta)
+		+ 4 * sizeof(uint32_t) + sizeof(unsigned char) + len * sizeof(*set);
+
+	if (dfa->cache_used + cost > REGEX_DFA_CACHE_SIZE && dfa->nstates > 1) {
+		dfa_flush(regex, dfa);
+		*flushed = 1;
+	}
+
+	int err = dfa_grow(regex, dfa, len);
+	if (err)
+		return_error(err);
+
+	s = dfa->nstates++;
+
+	int32_t *row = dfa->delta + (size_t)s * regex->nclasses;
+	for (i = 0; i < regex->nclasses; i++)
+		row[i] = REGEX_DFA_UNKNOWN;
+
+	memcpy(dfa->pool + dfa->pool_length, set, len * sizeof(*set));
+	dfa->set_start[s] = dfa->pool_length;
+	dfa->set_length[s] = len;
+	dfa->pool_length += len;
+
+	dfa->accept[s] = accept;
+	dfa->hash[s] = hash;
+	dfa->hash_next[s] = dfa->buckets[hash % REGEX_DFA_HASH_SIZE];
+	dfa->buckets[hash % REGEX_DFA_HASH_SIZE] = s;
+
+	dfa->cache_used += cost;
+
+	*state = s;
+
+	return 0;
+}
+
+/**
+ * Gets the start state of a DFA.
+ *
+ * @param regex the bless_regex_t
+ * @param dfa the regex_dfa
+ * @param[out] state the start state
+ *
+ * @return the operation error code
+ */
+static int dfa_get_start(bless_regex_t *regex, struct regex_dfa *dfa,
+		int32_t *state)
+{
+	if (dfa->start == -1) {
+		closure_begin(regex);
+		closure_add(regex, dfa->nfa, dfa->nfa_start);
+
+		int32_t s;
+		int flushed;
+		int err = dfa_get_state(regex, dfa, &s, &flushed);
+		if (err)
+			return_error(err);
+
+		dfa->start = s;
+	}
+
+	*state = dfa->start;
+
+	return 0;
+}
+
+/**
+ * Computes a transition of a DFA.
+ *
+ * @param regex the bless_regex_t
+ * @param dfa the regex_dfa
+ * @param s the state to compute the transition of
+ * @param cls the byte class of the transition
+ * @param[out] next the state the transition leads to
+ *
+ * @return the operation error code
+ */
+static int dfa_compute(bless_regex_t *regex, struct regex_dfa *dfa,
+		int32_t s, int cls, int32_t *next)
+{
+	struct regex_nfa *nfa = dfa->nfa;
+	int b = regex->class_bytes[cls];
+
+	closure_begin(regex);
+
+	const uint32_t *set = dfa->pool + dfa->set_start[s];
+	size_t len = dfa->set_length[s];
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		struct regex_nfa_state *st = &nfa->states[set[i]];
+		if (st->type == REGEX_NFA_BYTES && byte_set_has(st->bytes, b))
+			closure_add(regex, nfa, st->out);
+	}
+
+	int32_t t;
+	int flushed;
+	int err = dfa_get_state(regex, dfa, &t, &flushed);
+	if (err)
+		return_error(err);
+
+	/* If the cache was flushed, s is no longer valid */
+	if (!flushed)
+		dfa->delta[(size_t)s * regex->nclasses + cls] = t;
+
+	*next = t;
+
+	return 0;
+}
+
+/**
+ * Initializes a DFA.
+ *
+ * @param regex the bless_regex_t
+ * @param dfa the regex_dfa
+ * @param nfa the NFA to run
+ * @param start the start state of the NFA
+ *
+ * @return the operation error code
+ */
+static int dfa_init(bless_regex_t *regex, struct regex_dfa *dfa,
+		struct regex_nfa *nfa, int32_t start)
+{
+	dfa->nfa = nfa;
+	dfa->nfa_start = start;
+	dfa->states_size = 64;
+	dfa->pool_size = 256;
+
+	dfa->delta = malloc((size_t)dfa->states_size * regex->nclasses *
+			sizeof(*dfa->delta));
+	dfa->set_start = malloc(dfa->states_size * sizeof(*dfa->set_start));
+	dfa->set_length = malloc(dfa->states_size * sizeof(*dfa->set_length));
+	dfa->hash = malloc(dfa->states_size * sizeof(*dfa->hash));
+	dfa->hash_next = malloc(dfa->states_size * sizeof(*dfa->hash_next));
+	dfa->accept = malloc(dfa->states_size * sizeof(*dfa->accept));
+	dfa->pool = malloc(dfa->pool_size * sizeof(*dfa->pool));
+
+	if (dfa->delta == NULL || dfa->set_start == NULL
+			|| dfa->set_length == NULL || dfa->hash == NULL
+			|| dfa->hash_next == NULL || dfa->accept == NULL
+			|| dfa->pool == NULL)
+		return_error(ENOMEM);
+
+	dfa_flush(regex, dfa);
+
+	return 0;
+}
+
+/**
+ * Frees the resources of a regex.
+ *
+ * @param regex the bless_regex_t
+ */
+static void regex_free(bless_regex_t *regex)
+{
+	int i;
+	for (i = 0; i < REGEX_DFA_COUNT; i++) {
+		struct regex_dfa *dfa = &regex->dfas[i];
+		free(dfa->delta);
+		free(dfa->set_start);
+		free(dfa->set_length);
+		free(dfa->hash);
+		free(dfa->hash_next);
+		free(dfa->accept);
+		free(dfa->pool);
+	}
+
+	free(regex->forward.states);
+	free(regex->reverse.states);
+	free(regex->mark);
+	free(regex->stack);
+	free(regex->set);
+	free(regex);
+}
+
+/**
+ * Compiles the NFAs of a regex.
+ *
+ * @param regex the bless_regex_t
+ * @param pattern the regex
+ * @param length the length of the regex
+ * @param[out] starts the start states of the automata
+ *
+ * @return the operation error code
+ */
+static int regex_compile(bless_regex_t *regex, const unsigned char *pattern,
+		size_t length, int32_t *starts)
+{
+	struct regex_parser ps;
+
+	ps.p = pattern;
+	ps.end = pattern + length;
+	ps.depth = 0;
+	ps.nodes = NULL;
+	ps.nnodes = 0;
+	ps.nodes_size = 0;
+
+	int root;
+	int err = parse_alternation(&ps, &root);
+	if (err)
+		goto_error(err, on_error);
+
+	/* An unmatched ')' */
+	if (ps.p != ps.end) {
+		err = EINVAL;
+		goto_error(err, on_error);
+	}
+
+	int32_t match;
+	err = nfa_add_state(&regex->forward, REGEX_NFA_MATCH, -1, -1, NULL, &match);
+	if (err)
+		goto_error(err, on_error);
+
+	err = nfa_compile(ps.nodes, root, &regex->forward, 0, match,
+			&starts[REGEX_DFA_FORWARD]);
+	if (err)
+		goto_error(err, on_error);
+
+	/* The search automaton skips any bytes before a match: ".*" */
+	int32_t loop;
+	err = nfa_add_state(&regex->forward, REGEX_NFA_SPLIT,
+			starts[REGEX_DFA_FORWARD], -1, NULL, &loop);
+	if (err)
+		goto_error(err, on_error);
+
+	uint32_t any[8];
+	memset(any, 0xff, sizeof(any));
+
+	int32_t skip;
+	err = nfa_add_state(&regex->forward, REGEX_NFA_BYTES, loop, -1, any, &skip);
+	if (err)
+		goto_error(err, on_error);
+
+	regex->forward.states[loop].out1 = skip;
+	starts[REGEX_DFA_SEARCH] = loop;
+
+	err = nfa_add_state(&regex->reverse, REGEX_NFA_MATCH, -1, -1, NULL, &match);
+	if (err)
+		goto_error(err, on_error);
+
+	err = nfa_compile(ps.nodes, root, &regex->reverse, 1, match,
+			&starts[REGEX_DFA_REVERSE]);
+	if (err)
+		goto_error(err, on_error);
+
+	free(ps.nodes);
+
+	return 0;
+
+on_error:
+	free(ps.nodes);
+	return err;
+}
+
+/**********************
+ * Internal functions *
+ **********************/
+
+/**
+ * Starts a run of an automaton of a regex.
+ *
+ * @param regex the bless_regex_t
+ * @param run the regex_run to initialize
+ * @param dfa the automaton to run (one of enum regex_dfa_kind)
+ * @param stop_at_match whether to stop at the first match found
+ *
+ * @return the operation error code
+ */
+int regex_run_init(bless_regex_t *regex, struct regex_run *run, int dfa,
+		int stop_at_match)
+{
+	if (regex == NULL || run == NULL || dfa < 0 || dfa >= REGEX_DFA_COUNT)
+		return_error(EINVAL);
+
+	int32_t start;
+	int err = dfa_get_start(regex, &regex->dfas[dfa], &start);
+	if (err)
+		return_error(err);
+
+	run->dfa = dfa;
+	run->state = start;
+	run->stop_at_match = stop_at_match;
+	run->match = -1;
+	run->done = 0;
+
+	return 0;
+}
+
+/**
+ * Runs an automaton of a regex over some data.
+ *
+ * The data are scanned from the start for forward automata and from the
+ * end for REGEX_DFA_REVERSE. The match field of the run is updated every
+ * time a match is found (for the forward automata it is set to the offset
+ * after the last byte of the match, for REGEX_DFA_REVERSE to the offset of
+ * the first byte). The done field is set when no more matches can be found
+ * or, if stop_at_match was set, when a match has been found. Data passed
+ * after that are ignored.
+ *
+ * @param regex the bless_regex_t
+ * @param run the regex_run
+ * @param data the data to scan
+ * @param len the length of the data
+ * @param pos the offset of the data in the buffer
+ *
+ * @return the operation error code
+ */
+int regex_run_scan(bless_regex_t *regex, struct regex_run *run,
+		const unsigned char *data, size_t len, off_t pos)
+{
+	if (regex == NULL || run == NULL || data == NULL)
+		return_error(EINVAL);
+
+	if (run->done)
+		return 0;
+
+	struct regex_dfa *dfa = &regex->dfas[run->dfa];
+	const uint8_t *classes = regex->classes;
+	size_t nclasses = regex->nclasses;
+	const int32_t *delta = dfa->delta;
+	const unsigned char *accept = dfa->accept;
+	int reverse = (run->dfa == REGEX_DFA_REVERSE);
+
+	int32_t s = run->state;
+	int err = 0;
+	size_t n;
+
+	for (n = 0; n < len; n++) {
+		size_t i = reverse ? len - 1 - n : n;
+		int cls = classes[data[i]];
+		int32_t t = delta[(size_t)s * nclasses + cls];
+
+		if (t == REGEX_DFA_UNKNOWN) {
+			err = dfa_compute(regex, dfa, s, cls, &t);
+			if (err)
+				break;
+
+			delta = dfa->delta;
+			accept = dfa->accept;
+		}
+
+		s = t;
+
+		if (accept[s]) {
+			run->match = pos + (off_t)i + !reverse;
+			if (run->stop_at_match) {
+				run->done = 1;
+				break;
+			}
+		}
+		else if (s == REGEX_DFA_DEAD) {
+			run->done = 1;
+			break;
+		}
+	}
+
+	run->state = s;
+
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/*****************
+ * API Functions *
+ *****************/
+
+/**
+ * Compiles a regular expression.
+ *
+ * The regex is matched against bytes. It may contain any bytes (including
+ * NUL) and supports the following syntax: literal bytes, "." (any byte),
+ * bracket expressions ("[a-z]", "[^\x00-\x1f]"), groups ("(...)"),
+ * alternation ("|"), the quantifiers "*", "+", "?", "{n}", "{n,}" and
+ * "{n,m}" (n, m <= 1000) and the escapes "\xHH", "\n", "\r", "\t", "\f",
+ * "\v", "\0", "\d", "\w", "\s" (and "\D", "\W", "\S"). A backslash before
+ * any other punctuation character matches that character. Anchors are not
+ * supported.
+ *
+ * Regexes that match the empty data are not allowed.
+ *
+ * @param[out] regex the compiled bless_regex_t
+ * @param pattern the regex
+ * @param length the length of the regex
+ *
+ * @return the operation error code (EINVAL if the regex is not valid or is
+ *         too complex)
+ */
+int bless_regex_new(bless_regex_t **regex, void *pattern, size_t length)
+{
+	if (regex == NULL || pattern == NULL || length == 0)
+		return_error(EINVAL);
+
+	bless_regex_t *re = calloc(1, sizeof(*re));
+	if (re == NULL)
+		return_error(ENOMEM);
+
+	int32_t starts[REGEX_DFA_COUNT];
+
+	int err = regex_compile(re, pattern, length, starts);
+	if (err)
+		goto_error(err, on_error);
+
+	compute_classes(re);
+
+	int32_t n = re->forward.nstates;
+	if (re->reverse.nstates > n)
+		n = re->reverse.nstates;
+
+	re->mark = calloc(n, sizeof(*re->mark));
+	re->stack = malloc(n * sizeof(*re->stack));
+	re->set = malloc(n * sizeof(*re->set));
+	re->mark_gen = 0;
+
+	if (re->mark == NULL || re->stack == NULL || re->set == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error);
+	}
+
+	int i;
+	for (i = 0; i < REGEX_DFA_COUNT; i++) {
+		struct regex_nfa *nfa =
+			(i == REGEX_DFA_REVERSE) ? &re->reverse : &re->forward;
+
+		err = dfa_init(re, &re->dfas[i], nfa, starts[i]);
+		if (err)
+			goto_error(err, on_error);
+	}
+
+	/* Check whether the regex matches the empty data */
+	int32_t start;
+	err = dfa_get_start(re, &re->dfas[REGEX_DFA_FORWARD], &start);
+	if (err)
+		goto_error(err, on_error);
+
+	if (re->dfas[REGEX_DFA_FORWARD].accept[start]) {
+		err = EINVAL;
+		goto_error(err, on_error);
+	}
+
+	*regex = re;
+
+	return 0;
+
+on_error:
+	regex_free(re);
+	return err;
+}
+
+/**
+ * Frees a compiled regular expression.
+ *
+ * @param regex the bless_regex_t to free
+ *
+ * @return the operation error code
+ */
+int bless_regex_free(bless_regex_t *regex)
+{
+	if (regex == NULL)
+		return_error(EINVAL);
+
+	regex_free(regex);
+
+	return 0;
+}
+
+#pragma GCC visibility pop
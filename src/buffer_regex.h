@@ -0,0 +1,81 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file buffer_regex.h
+ *
+ * Internal regular expression functions
+ */
+#ifndef _BUFFER_REGEX_H
+#define _BUFFER_REGEX_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include "buffer.h"
+
+/** The maximum memory used by the state cache of each automaton of a regex */
+#define REGEX_DFA_CACHE_SIZE (2 * 1024 * 1024)
+
+/** The maximum number of states of the NFA of a regex */
+#define REGEX_MAX_NFA_STATES 10000
+
+/** The maximum nesting depth of groups and repetitions in a regex */
+#define REGEX_MAX_DEPTH 256
+
+/** The maximum count of a bounded repetition ("{n,m}") in a regex */
+#define REGEX_MAX_REPEAT 1000
+
+/**
+ * The automata of a regex.
+ */
+enum regex_dfa_kind {
+	REGEX_DFA_SEARCH = 0, /**< Forward, finds the end of the first match */
+	REGEX_DFA_FORWARD, /**< Forward, anchored at the start of a match */
+	REGEX_DFA_REVERSE, /**< Backward, anchored at the end of a match */
+	REGEX_DFA_COUNT
+};
+
+/**
+ * A run of an automaton of a regex over a range of data.
+ *
+ * The data of the range are passed to regex_run_scan() in order (from the
+ * end to the start for REGEX_DFA_REVERSE), in as many calls as needed.
+ */
+struct regex_run {
+	int dfa;
+	int32_t state;
+	int stop_at_match;
+
+	/*
+	 * The end (or the start, for REGEX_DFA_REVERSE) of the last match found
+	 * so far, or -1 if no match was found.
+	 */
+	off_t match;
+
+	/* Whether no more matches can be found */
+	int done;
+};
+
+int regex_run_init(bless_regex_t *regex, struct regex_run *run, int dfa,
+		int stop_at_match);
+
+int regex_run_scan(bless_regex_t *regex, struct regex_run *run,
+		const unsigned char *data, size_t len, off_t pos);
+
+#endif /* _BUFFER_REGEX_H */
@@ -23,6 +23,7 @@
  * Buffer source implementation
  */
 
+#include "buffer.h"
 #include "buffer_source.h"
 #include "data_object.h"
 #include "data_object_memory.h"
@@ -130,6 +131,39 @@ on_error:
 	return err;
 }
 
+/**
+ * Creates a file source for bless_buffer_t that reads the file with pread().
+ *
+ * Normal file sources map the file in memory. This source reads the file
+ * with large pread() calls instead, adapting the amount of data read to the
+ * access pattern. It is useful for files that can't be mapped or for which
+ * mapping is slow (eg some network file systems).
+ *
+ * If the data_free function is NULL the file won't be closed
+ * when this source object is freed.
+ *
+ * @param[out] src the created bless_buffer_source_t.
+ * @param fd the file descriptor associated with this source object 
+ * @param file_close the function to call to close the file
+ *
+ * @return the operation error code
+ */
+int bless_buffer_source_file_pread(bless_buffer_source_t **src, int fd, 
+		bless_file_close_func *file_close)
+{
+	int err = bless_buffer_source_file(src, fd, file_close);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_set_backend(*src, DATA_OBJECT_FILE_PREAD);
+	if (err) {
+		bless_buffer_source_unref(*src);
+		return_error(err);
+	}
+
+	return 0;
+}
+
 /**
  * Decreases the usage count of a source object.
  *
@@ -155,5 +189,118 @@ int bless_buffer_source_unref(bless_buffer_source_t *src)
 	return 0;
 }
 
+/**
+ * Checks that a source object is a file source.
+ *
+ * @param src the source object
+ *
+ * @return the operation error code (EINVAL if src is not a file source)
+ */
+static int check_file_source(bless_buffer_source_t *src)
+{
+	if (src == NULL)
+		return_error(EINVAL);
+
+	int is_file;
+	int err = data_object_is_file((data_object_t *) src, &is_file);
+	if (err)
+		return_error(err);
+
+	if (!is_file)
+		return_error(EINVAL);
+
+	return 0;
+}
+
+/**
+ * Builds the search index of a file source object.
+ *
+ * The index holds the 3-byte sequences found in each 64KiB block of the
+ * file. Searches in buffers (eg bless_buffer_find()) use it to skip the
+ * parts of the file that can't contain the searched data, and search the
+ * rest of the buffer (eg memory sources, data around segment boundaries)
+ * normally. Since the index describes the file itself, edits of the buffers
+ * using the source don't affect it.
+ *
+ * The file is read independently of the rest of the library, so this
+ * function can be called from another thread to build the index in the
+ * background while the source is in use. The index is used by the searches
+ * that start after it has been built.
+ *
+ * The index is ignored if the size or modification time of the file change.
+ *
+ * The progress is reported with a struct bless_buffer_find_progress_info,
+ * whose searched field holds the number of bytes indexed so far.
+ *
+ * @param src the file source object
+ * @param progress_func the bless_progress_func to call to report the
+ *                      progress of the operation (may be NULL)
+ *
+ * @return the operation error code
+ */
+int bless_buffer_source_index_build(bless_buffer_source_t *src,
+		bless_progress_func *progress_func)
+{
+	int err = check_file_source(src);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_build_index((data_object_t *) src, progress_func);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Saves the search index of a file source object to a file.
+ *
+ * The index is written at the current offset of fd and can be loaded
+ * later with bless_buffer_source_index_load() (eg from a file next to the
+ * indexed one).
+ *
+ * @param src the file source object
+ * @param fd the file to save the index to
+ *
+ * @return the operation error code (ENOENT if the source has no index)
+ */
+int bless_buffer_source_index_save(bless_buffer_source_t *src, int fd)
+{
+	int err = check_file_source(src);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_save_index((data_object_t *) src, fd);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Loads the search index of a file source object from a file.
+ *
+ * The index is read from the current offset of fd.
+ *
+ * @param src the file source object
+ * @param fd the file to load the index from
+ *
+ * @return the operation error code (EINVAL if fd doesn't contain a valid
+ *         index, ESTALE if the index doesn't match the current contents of
+ *         the file of the source)
+ */
+int bless_buffer_source_index_load(bless_buffer_source_t *src, int fd)
+{
+	int err = check_file_source(src);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_load_index((data_object_t *) src, fd);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
 #pragma GCC visibility pop
 
@@ -62,6 +62,9 @@ int bless_buffer_source_memory(bless_buffer_source_t **src, void *data,
 int bless_buffer_source_file(bless_buffer_source_t **src, int fd,
 		bless_file_close_func *file_close);
 
+int bless_buffer_source_file_pread(bless_buffer_source_t **src, int fd,
+		bless_file_close_func *file_close);
+
 int bless_buffer_source_unref(bless_buffer_source_t *src);
 
 /** @} */
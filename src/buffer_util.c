@@ -23,8 +23,16 @@
  * Implementation of utility function used by bless_buffer_t
  */
 
+/* For pwritev() and copy_file_range() */
+#define _GNU_SOURCE
+
 #include <sys/types.h>
+#include <sys/uio.h>
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -34,6 +42,9 @@
 #include "buffer_internal.h"
 #include "buffer_action.h"
 #include "segcol.h"
+#include "segcol_list.h"
+#include "segcol_tree.h"
+#include "segcol_btree.h"
 #include "segment.h"
 #include "data_object.h"
 #include "data_object_memory.h"
@@ -43,6 +54,45 @@
 
 #include "type_limits.h"
 
+/** The maximum number of iovecs written with a single call */
+#ifdef IOV_MAX
+#define WRITE_BATCH_MAX_IOV IOV_MAX
+#else
+#define WRITE_BATCH_MAX_IOV 16
+#endif
+
+/**
+ * A batch of data to be written to consecutive offsets of a file.
+ *
+ * The data are pinned in their data objects if possible, otherwise they are
+ * copied to a private buffer of at most max_size bytes.
+ */
+struct write_batch {
+	int fd;
+
+	/* The offset in the file to write the batch to */
+	off_t file_offset;
+
+	/* The size of the data in the batch and its limit */
+	size_t size;
+	size_t max_size;
+
+	struct iovec iov[WRITE_BATCH_MAX_IOV];
+	int iovcnt;
+
+	/* The data objects that data of the batch are pinned in */
+	data_object_t *pinned[WRITE_BATCH_MAX_IOV];
+	int npinned;
+
+	/* The private buffer for data that can't be pinned */
+	unsigned char *copy;
+	size_t copy_size;
+
+	/* Whether the kernel has been found not to support each way of copying */
+	int no_copy_file_range;
+	int no_sendfile;
+};
+
 
 /**
  * Reads data from a data object to memory.
@@ -109,10 +159,6 @@ int read_data_object(data_object_t *dobj, off_t offset, void *mem, off_t length)
 int write_data_object(data_object_t *dobj, off_t offset, off_t length,
 		int fd, off_t file_offset)
 {
-	off_t s = lseek(fd, file_offset, SEEK_SET);
-	if (s != file_offset)
-		return_error(errno);
-
 	while (length > 0) {
 		void *data;
 		off_t nbytes = length;
@@ -125,19 +171,98 @@ int write_data_object(data_object_t *dobj, off_t offset, off_t length,
 		 * Note that the length of data returned by data_object_get_data is
 		 * guaranteed to fit in a ssize_t, hence the casts are safe.
 		 */
-		ssize_t nwritten = write(fd, data, (ssize_t)nbytes);
+		ssize_t nwritten = pwrite(fd, data, (ssize_t)nbytes, file_offset);
 		if (nwritten < (ssize_t)nbytes)
 			return_error(errno);
 
 		/* See read_data_object() about this check */
 		if (__MAX(off_t) - offset >= nbytes)
 			offset += nbytes;
+		if (__MAX(off_t) - file_offset >= nbytes)
+			file_offset += nbytes;
 		length -= nbytes;
 	}
 
 	return 0;
 }
 
+/**
+ * Copies data from a data object to a file in a safe way, in chunks.
+ *
+ * See write_data_object_safe().
+ *
+ * @param dobj the data object to read from
+ * @param offset the offset in the data object to read from
+ * @param length the number of bytes to read
+ * @param fd the file descriptor to write the data to
+ * @param file_offset the offset in the file to write the data
+ * @param data the buffer to copy the chunks through
+ * @param chunk_size the size of data (at most __MAX(ssize_t))
+ *
+ * @return the operation error code
+ */
+static int copy_data_object_safe(data_object_t *dobj, off_t offset,
+		off_t length, int fd, off_t file_offset, void *data,
+		size_t chunk_size)
+{
+	int err = 0;
+
+	off_t nread = 0;
+
+	/* Moving to a higher offset: copy the chunks from the end backwards */
+	int backwards = file_offset > offset;
+
+	off_t start_offset = offset;
+
+	/* Try to start at the last multiple of chunk_size contained in the range */
+	if (backwards) {
+		start_offset = offset + length - (offset + length) % chunk_size;
+
+		if (start_offset < offset)
+			start_offset = offset;
+	}
+
+	while (nread < length) {
+		off_t nbytes;
+		if (backwards)
+			nbytes = (offset + length) - nread - start_offset;
+		else
+			nbytes = length - nread;
+
+		if ((uintmax_t)nbytes > chunk_size)
+			nbytes = chunk_size;
+
+		/* Read a chunk from the data object */
+		err = read_data_object(dobj, start_offset, data, nbytes);
+		if (err)
+			return_error(err);
+
+		/* Write the chunk to the final position in the file */
+		ssize_t nwritten = pwrite(fd, data, (ssize_t)nbytes,
+				file_offset + start_offset - offset);
+		if (nwritten < (ssize_t)nbytes)
+			return_error(errno);
+
+		if (backwards) {
+			/* Move backwards */
+			if (start_offset - offset > (off_t)chunk_size)
+				start_offset -= chunk_size;
+			else
+				start_offset = offset;
+		}
+		else {
+			/* Move forwards */
+			start_offset += nbytes;
+		}
+
+		/* See read_data_object() about this check */
+		if (__MAX(off_t) - nread >= nbytes)
+			nread += nbytes;
+	}
+
+	return err;
+}
+
 /**
  * Writes data from a data object to a file in a safe way.
  *
@@ -146,6 +271,10 @@ int write_data_object(data_object_t *dobj, off_t offset, off_t length,
  * overlap between the original data object range and the range we are
  * writing it to.
  *
+ * The data are copied through a private buffer in chunks, starting from
+ * the end of the range if it moves to a higher offset and from its start
+ * otherwise, so that no chunk overwrites data needed for later chunks.
+ *
  * @param dobj the data object to read from
  * @param offset the offset in the data object to read from
  * @param length the number of bytes to read
@@ -157,58 +286,430 @@ int write_data_object(data_object_t *dobj, off_t offset, off_t length,
 int write_data_object_safe(data_object_t *dobj, off_t offset, off_t length,
 		int fd, off_t file_offset)
 {
-	int err = 0;
 	void *data = malloc(4096);
 	if (data == NULL)
 		return_error(ENOMEM);
 
-	off_t nread = 0;
+	int err = copy_data_object_safe(dobj, offset, length, fd, file_offset,
+			data, 4096);
 
-	/* Try to start at the last multiple of 4096 contained in the range */
-	off_t start_offset = offset + length - (offset + length) % 4096;
+	free(data);
 
-	if (start_offset < offset)
-		start_offset = offset;
+	return err;
+}
 
-	while (nread < length) {
-		off_t nbytes = (offset + length) - nread - start_offset;
-		if (nbytes > 4096)
-			nbytes = 4096;
+/**
+ * Creates a write_batch.
+ *
+ * Data added to the batch are written to the file only when the batch is
+ * flushed, with as few system calls as possible. Data that can't be pinned
+ * in their data objects are copied to a private buffer first, so max_size
+ * also bounds the memory used by the batch.
+ *
+ * @param[out] batch the created write_batch
+ * @param fd the file descriptor to write the data to
+ * @param max_size the maximum size of the data in the batch
+ *
+ * @return the operation error code
+ */
+int write_batch_new(struct write_batch **batch, int fd, size_t max_size)
+{
+	if (batch == NULL || max_size == 0)
+		return_error(EINVAL);
 
-		/* Read a chunk from the data object */
-		int err = read_data_object(dobj, start_offset, data, nbytes);
+	/* The size of the data written at once must fit in an ssize_t */
+	if (max_size > __MAX(ssize_t))
+		max_size = __MAX(ssize_t);
+
+	struct write_batch *b = malloc(sizeof(*b));
+	if (b == NULL)
+		return_error(ENOMEM);
+
+	b->fd = fd;
+	b->file_offset = 0;
+	b->size = 0;
+	b->max_size = max_size;
+	b->iovcnt = 0;
+	b->npinned = 0;
+	b->copy = NULL;
+	b->copy_size = 0;
+	b->no_copy_file_range = 0;
+	b->no_sendfile = 0;
+
+	*batch = b;
+
+	return 0;
+}
+
+/**
+ * Adds data from a data object to a write_batch.
+ *
+ * If the data don't immediately follow the data already in the batch, or
+ * the batch is full, the batch is flushed first. Note that the data are
+ * read from the data object either now or when the batch is flushed.
+ *
+ * @param batch the write_batch to add the data to
+ * @param dobj the data object to read from
+ * @param offset the offset in the data object to read from
+ * @param length the number of bytes to read
+ * @param file_offset the offset in the file to write the data
+ *
+ * @return the operation error code
+ */
+int write_batch_add(struct write_batch *batch, data_object_t *dobj,
+		off_t offset, off_t length, off_t file_offset)
+{
+	if (batch == NULL || dobj == NULL || offset < 0 || length < 0
+			|| file_offset < 0)
+		return_error(EINVAL);
+
+	/* Data that can't be pinned are copied to the private buffer */
+	int can_pin;
+	int err = data_object_can_pin(dobj, &can_pin);
+	if (err)
+		return_error(err);
+
+	/* Data that don't follow the batch must be written separately */
+	if (batch->size > 0 && file_offset != batch->file_offset
+			+ (off_t)batch->size) {
+		err = write_batch_flush(batch);
 		if (err)
-			goto_error(err, out);
+			return_error(err);
+	}
 
-		/* Write the chunk to the final position in the file */
-		off_t s = lseek(fd, file_offset + start_offset - offset, SEEK_SET);
-		if (s != file_offset + start_offset - offset) {
-			err = errno;
-			goto_error(err, out);
+	while (length > 0) {
+		if (batch->size == batch->max_size
+				|| batch->iovcnt == WRITE_BATCH_MAX_IOV
+				|| batch->npinned == WRITE_BATCH_MAX_IOV) {
+			err = write_batch_flush(batch);
+			if (err)
+				return_error(err);
 		}
-		
-		ssize_t nwritten = write(fd, data, (ssize_t)nbytes);
-		if (nwritten < (ssize_t)nbytes) {
-			err = errno;
-			goto_error(err, out);
+
+		if (batch->size == 0)
+			batch->file_offset = file_offset;
+
+		void *data;
+		off_t nbytes = length;
+		if ((uintmax_t)nbytes > batch->max_size - batch->size)
+			nbytes = batch->max_size - batch->size;
+
+		if (!can_pin) {
+			if (batch->copy == NULL) {
+				batch->copy = malloc(batch->max_size);
+				if (batch->copy == NULL)
+					return_error(ENOMEM);
+			}
+
+			data = batch->copy + batch->copy_size;
+
+			err = read_data_object(dobj, offset, data, nbytes);
+			if (err)
+				return_error(err);
+
+			batch->copy_size += nbytes;
+		}
+		else {
+			err = data_object_get_data(dobj, &data, offset, &nbytes,
+					DATA_OBJECT_READ | DATA_OBJECT_PIN);
+			if (err)
+				return_error(err);
+
+			batch->pinned[batch->npinned++] = dobj;
 		}
 
-		/* Move backwards */
-		start_offset -= 4096;
+		/* Extend the previous iovec if the data are contiguous */
+		struct iovec *last = batch->iovcnt > 0 ?
+			&batch->iov[batch->iovcnt - 1] : NULL;
+
+		if (last != NULL && (unsigned char *)last->iov_base
+				+ last->iov_len == data) {
+			last->iov_len += nbytes;
+		}
+		else {
+			batch->iov[batch->iovcnt].iov_base = data;
+			batch->iov[batch->iovcnt].iov_len = nbytes;
+			batch->iovcnt++;
+		}
+
+		batch->size += nbytes;
+
 		/* See read_data_object() about this check */
-		if (__MAX(off_t) - nread >= nbytes)
-			nread += nbytes;
+		if (__MAX(off_t) - offset >= nbytes)
+			offset += nbytes;
+		if (__MAX(off_t) - file_offset >= nbytes)
+			file_offset += nbytes;
+		length -= nbytes;
+	}
 
-		if (start_offset < offset)
-			start_offset = offset;
+	return 0;
+}
+
+/**
+ * Checks whether an error from a kernel copy means that the kernel can't copy
+ * the data this way, so they must be copied in another way.
+ *
+ * @param err the error
+ *
+ * @return 1 if the data must be copied in another way, 0 otherwise
+ */
+static int kernel_copy_unsupported(int err)
+{
+	return err == ENOSYS || err == EXDEV || err == EINVAL
+		|| err == EOPNOTSUPP || err == ENOTSUP;
+}
+
+/**
+ * Copies data from a file to the file of a write_batch in the kernel.
+ *
+ * The data are copied with copy_file_range() or else sendfile(). If the
+ * kernel can't copy (some of) the data, the range is updated to contain the
+ * data that have not been copied.
+ *
+ * @param batch the write_batch whose file to write the data to
+ * @param in_fd the file descriptor of the file to read from
+ * @param[in,out] offset the offset in in_fd to read from
+ * @param[in,out] length the number of bytes to read
+ * @param[in,out] file_offset the offset in the file to write the data
+ *
+ * @return the operation error code
+ */
+static int copy_in_kernel(struct write_batch *batch, int in_fd, off_t *offset,
+		off_t *length, off_t *file_offset)
+{
+	while (*length > 0) {
+		ssize_t ncopied = -1;
+
+		/* Stay well within the limits of a single call */
+		size_t count = *length;
+		if (*length > (off_t)1 << 30)
+			count = (size_t)1 << 30;
+
+#ifdef HAVE_COPY_FILE_RANGE
+		if (!batch->no_copy_file_range) {
+			loff_t in_offset = *offset;
+			loff_t out_offset = *file_offset;
+
+			ncopied = copy_file_range(in_fd, &in_offset, batch->fd,
+					&out_offset, count, 0);
+
+			if (ncopied == -1 && !kernel_copy_unsupported(errno))
+				return_error(errno);
+
+			if (ncopied == -1 && errno == ENOSYS)
+				batch->no_copy_file_range = 1;
+		}
+#endif
+
+#ifdef HAVE_SENDFILE
+		/* sendfile() writes at the current offset of the file */
+		if (ncopied == -1 && !batch->no_sendfile) {
+			if (lseek(batch->fd, *file_offset, SEEK_SET) != *file_offset)
+				return_error(errno);
+
+			off_t in_offset = *offset;
+
+			ncopied = sendfile(batch->fd, in_fd, &in_offset, count);
+
+			if (ncopied == -1 && !kernel_copy_unsupported(errno))
+				return_error(errno);
+
+			if (ncopied == -1 && errno == ENOSYS)
+				batch->no_sendfile = 1;
+		}
+#endif
+
+		/* The kernel can't copy the rest of the data */
+		if (ncopied <= 0)
+			break;
+
+		*offset += ncopied;
+		*file_offset += ncopied;
+		*length -= ncopied;
+	}
+
+	return 0;
+}
+
+/**
+ * Writes data from a data object to the file of a write_batch, letting the
+ * kernel copy them if they come from a file.
+ *
+ * Large ranges of file data objects are copied by the kernel after flushing
+ * the batch. This avoids passing the data through user space and lets file
+ * systems share or copy the data on their side. Other data, and data that the
+ * kernel can't copy, are added to the batch as with write_batch_add().
+ *
+ * The range in the data object must not overlap with the range it is written
+ * to, if they are in the same file.
+ *
+ * @param batch the write_batch to write the data with
+ * @param dobj the data object to read from
+ * @param offset the offset in the data object to read from
+ * @param length the number of bytes to read
+ * @param file_offset the offset in the file to write the data
+ *
+ * @return the operation error code
+ */
+int write_batch_copy(struct write_batch *batch, data_object_t *dobj,
+		off_t offset, off_t length, off_t file_offset)
+{
+	if (batch == NULL || dobj == NULL || offset < 0 || length < 0
+			|| file_offset < 0)
+		return_error(EINVAL);
+
+	int is_file;
+	int err = data_object_is_file(dobj, &is_file);
+	if (err)
+		return_error(err);
+
+	if (is_file && length >= BUFFER_SAVE_KERNEL_COPY_MIN
+			&& !(batch->no_copy_file_range && batch->no_sendfile)) {
+		int in_fd;
+		err = data_object_file_get_fd(dobj, &in_fd);
+		if (err)
+			return_error(err);
+
+		/* Data before these must be written first */
+		err = write_batch_flush(batch);
+		if (err)
+			return_error(err);
+
+		err = copy_in_kernel(batch, in_fd, &offset, &length, &file_offset);
+		if (err)
+			return_error(err);
+	}
+
+	if (length > 0) {
+		err = write_batch_add(batch, dobj, offset, length, file_offset);
+		if (err)
+			return_error(err);
+	}
+
+	return 0;
+}
+
+/**
+ * Writes data from a data object to the file of a write_batch in a safe way.
+ *
+ * See write_data_object_safe(). The batch is flushed first and the data are
+ * written immediately, copied through the private buffer of the batch.
+ *
+ * @param batch the write_batch to write the data with
+ * @param dobj the data object to read from
+ * @param offset the offset in the data object to read from
+ * @param length the number of bytes to read
+ * @param file_offset the offset in the file to write the data
+ *
+ * @return the operation error code
+ */
+int write_batch_write_safe(struct write_batch *batch, data_object_t *dobj,
+		off_t offset, off_t length, off_t file_offset)
+{
+	if (batch == NULL || dobj == NULL || offset < 0 || length < 0
+			|| file_offset < 0)
+		return_error(EINVAL);
+
+	/* Data before these must be written first */
+	int err = write_batch_flush(batch);
+	if (err)
+		return_error(err);
+
+	if (batch->copy == NULL) {
+		batch->copy = malloc(batch->max_size);
+		if (batch->copy == NULL)
+			return_error(ENOMEM);
+	}
+
+	err = copy_data_object_safe(dobj, offset, length, batch->fd, file_offset,
+			batch->copy, batch->max_size);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Writes the data of a write_batch to the file and empties the batch.
+ *
+ * The batch is emptied even if writing fails.
+ *
+ * @param batch the write_batch to flush
+ *
+ * @return the operation error code
+ */
+int write_batch_flush(struct write_batch *batch)
+{
+	if (batch == NULL)
+		return_error(EINVAL);
+
+	int err = 0;
+
+	struct iovec *iov = batch->iov;
+	int iovcnt = batch->iovcnt;
+	off_t file_offset = batch->file_offset;
+
+	while (iovcnt > 0) {
+#ifdef HAVE_PWRITEV
+		ssize_t nwritten = pwritev(batch->fd, iov, iovcnt, file_offset);
+#else
+		ssize_t nwritten = pwrite(batch->fd, iov->iov_base, iov->iov_len,
+				file_offset);
+#endif
+		if (nwritten <= 0) {
+			err = nwritten == 0 ? EIO : errno;
+			goto_error(err, out);
+		}
+
+		file_offset += nwritten;
+
+		/* Skip the data that have been written */
+		while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+			nwritten -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (unsigned char *)iov->iov_base + nwritten;
+			iov->iov_len -= nwritten;
+		}
 	}
 
 out:
-	free(data);
+	while (batch->npinned > 0)
+		data_object_unpin(batch->pinned[--batch->npinned]);
+
+	batch->size = 0;
+	batch->iovcnt = 0;
+	batch->copy_size = 0;
 
 	return err;
 }
 
+/**
+ * Frees a write_batch.
+ *
+ * Any data in the batch that have not been flushed are discarded.
+ *
+ * @param batch the write_batch to free
+ *
+ * @return the operation error code
+ */
+int write_batch_free(struct write_batch *batch)
+{
+	if (batch == NULL)
+		return_error(EINVAL);
+
+	while (batch->npinned > 0)
+		data_object_unpin(batch->pinned[--batch->npinned]);
+
+	free(batch->copy);
+	free(batch);
+
+	return 0;
+}
+
 /**
  * Gets from an iterator the read limits.
  *
@@ -257,43 +758,139 @@ static int get_data_from_iter(segcol_iter_t *iter, segment_t **segment,
 	if (__MAX(off_t) - offset < length - 1 * (length != 0))
 		return_error(EOVERFLOW);
 
-	/* The index of the end of the logical range in the segment range */
-	off_t end_index = (offset + length - 1 * (length != 0)) - *mapping;
+	/* The index of the end of the logical range in the segment range */
+	off_t end_index = (offset + length - 1 * (length != 0)) - *mapping;
+
+	/* 
+	 * If the end of the logical range is outside the segment range,
+	 * clip the logical range to the end of the segment range.
+	 */
+	if (end_index >= seg_size)
+		end_index = seg_size - 1;
+
+	if (__MAX(off_t) - seg_start < start_index)
+		return_error(EOVERFLOW);
+
+	/* Calculate the read range for the data object */
+	*read_start = seg_start + start_index;
+
+	/* 
+	 * read_length cannot overflow because 
+	 * end_index - start_index <= length - 1 <= MAX_OFF_T - 1
+	 */
+	*read_length = end_index - start_index + 1;
+
+	return 0;
+}
+
+/**
+ * Calls a function for each segment in the specified range of a segcol_t.
+ *
+ * If func returns SEGCOL_FOREACH_STOP the iteration stops early and
+ * segcol_foreach() returns successfully.
+ *
+ * @param segcol the segcol_t to search in
+ * @param offset the offset in the segcol_t to start from
+ * @param length the length of the range
+ * @param func the function to call for each segment
+ * @param user_data user specified data to pass to func
+ *
+ * @return the operation error code
+ */
+int segcol_foreach(segcol_t *segcol, off_t offset, off_t length,
+		segcol_foreach_func *func, void *user_data)
+{
+	if (segcol == NULL || offset < 0 || length < 0 || func == NULL)
+		return_error(EINVAL);
+
+	/* Check for overflow */
+	if (__MAX(off_t) - offset < length - 1 * (length != 0))
+		return_error(EOVERFLOW);
+
+	/* Make sure that the range is valid */
+	off_t segcol_size;
+	segcol_get_size(segcol, &segcol_size);
+
+	if (offset + length - 1 * (length != 0) >= segcol_size)
+		return_error(EINVAL);
+
+	/* Get iterator to offset */
+	segcol_iter_t *iter;
+	int err = segcol_find(segcol, &iter, offset);
+	if (err)
+		return_error(err);
+
+	off_t cur_offset = offset;
+
+	/* How many bytes we still have to read */
+	off_t bytes_left = length;
+
+	int iter_valid;
+
+	/* 
+	 * Iterate over the given range 
+	 */
+	while (!(err = segcol_iter_is_valid(iter, &iter_valid)) && iter_valid) {
+		/* Get necessary data from the iterator */
+		segment_t *segment;
+		off_t mapping;
+		off_t read_start = 0; /* assign just to silence warnings */
+		off_t read_length;
+
+		err = get_data_from_iter(iter, &segment, &mapping, &read_start, 
+				&read_length, cur_offset, bytes_left);
+		if (err)
+			goto_error(err, out);
+
+		/* Call user provided function */
+		err = (*func)(segcol, segment, mapping, read_start, read_length,
+				user_data);
+		if (err == SEGCOL_FOREACH_STOP) {
+			err = 0;
+			break;
+		}
+		if (err)
+			goto_error(err, out);
+
+		bytes_left -= read_length;
 
-	/* 
-	 * If the end of the logical range is outside the segment range,
-	 * clip the logical range to the end of the segment range.
-	 */
-	if (end_index >= seg_size)
-		end_index = seg_size - 1;
+		/* Don't allow signed overflow. See read_data_object() for more. */
+		if (__MAX(off_t) - cur_offset >= read_length)
+			cur_offset += read_length;
 
-	if (__MAX(off_t) - seg_start < start_index)
-		return_error(EOVERFLOW);
+		if (bytes_left == 0)
+			break;
 
-	/* Calculate the read range for the data object */
-	*read_start = seg_start + start_index;
+		/* Move to next segment */
+		err = segcol_iter_next(iter);
+		if (err)
+			goto_error(err, out);
+	}
 
-	/* 
-	 * read_length cannot overflow because 
-	 * end_index - start_index <= length - 1 <= MAX_OFF_T - 1
-	 */
-	*read_length = end_index - start_index + 1;
+out:
+	segcol_iter_free(iter);
 
-	return 0;
+	return err;
 }
 
 /**
- * Calls a function for each segment in the specified range of a segcol_t.
+ * Calls a function for each segment in the specified range of a segcol_t,
+ * starting from the end of the range and moving towards its start.
+ *
+ * The arguments passed to func are the same as in segcol_foreach(), but
+ * segments are visited from high to low offsets. If func returns
+ * SEGCOL_FOREACH_STOP the iteration stops early and segcol_foreach_reverse()
+ * returns successfully. For an empty range func is not called at all.
  *
  * @param segcol the segcol_t to search in
- * @param offset the offset in the segcol_t to start from
+ * @param offset the offset in the segcol_t where the range starts
  * @param length the length of the range
  * @param func the function to call for each segment
  * @param user_data user specified data to pass to func
  *
  * @return the operation error code
  */
-int segcol_foreach(segcol_t *segcol, off_t offset, off_t length,
+int segcol_foreach_reverse(segcol_t *segcol, off_t offset, off_t length,
 		segcol_foreach_func *func, void *user_data)
 {
 	if (segcol == NULL || offset < 0 || length < 0 || func == NULL)
@@ -310,51 +907,57 @@ int segcol_foreach(segcol_t *segcol, off_t offset, off_t length,
 	if (offset + length - 1 * (length != 0) >= segcol_size)
 		return_error(EINVAL);
 
-	/* Get iterator to offset */
+	if (length == 0)
+		return 0;
+
+	off_t end_offset = offset + length - 1;
+
+	/* Get iterator to the last byte of the range */
 	segcol_iter_t *iter;
-	int err = segcol_find(segcol, &iter, offset);
+	int err = segcol_find(segcol, &iter, end_offset);
 	if (err)
 		return_error(err);
 
-	off_t cur_offset = offset;
-
-	/* How many bytes we still have to read */
-	off_t bytes_left = length;
-
 	int iter_valid;
 
 	/* 
-	 * Iterate over the given range 
+	 * Iterate backwards over the given range 
 	 */
 	while (!(err = segcol_iter_is_valid(iter, &iter_valid)) && iter_valid) {
-		/* Get necessary data from the iterator */
-		segment_t *segment;
 		off_t mapping;
+		err = segcol_iter_get_mapping(iter, &mapping);
+		if (err)
+			goto_error(err, out);
+
+		/* The part of the range that falls in this segment */
+		off_t cur_offset = mapping > offset ? mapping : offset;
+
+		segment_t *segment;
 		off_t read_start = 0; /* assign just to silence warnings */
 		off_t read_length;
 
 		err = get_data_from_iter(iter, &segment, &mapping, &read_start, 
-				&read_length, cur_offset, bytes_left);
+				&read_length, cur_offset, end_offset - cur_offset + 1);
 		if (err)
 			goto_error(err, out);
 
 		/* Call user provided function */
 		err = (*func)(segcol, segment, mapping, read_start, read_length,
 				user_data);
+		if (err == SEGCOL_FOREACH_STOP) {
+			err = 0;
+			break;
+		}
 		if (err)
 			goto_error(err, out);
 
-		bytes_left -= read_length;
-
-		/* Don't allow signed overflow. See read_data_object() for more. */
-		if (__MAX(off_t) - cur_offset >= read_length)
-			cur_offset += read_length;
-
-		if (bytes_left == 0)
+		if (cur_offset == offset)
 			break;
 
-		/* Move to next segment */
-		err = segcol_iter_next(iter);
+		end_offset = cur_offset - 1;
+
+		/* Move to previous segment */
+		err = segcol_iter_prev(iter);
 		if (err)
 			goto_error(err, out);
 	}
@@ -480,6 +1083,14 @@ on_error_foreach:
 	return err;
 }
 
+/**
+ * A file that data are stored in by store_segment_func().
+ */
+struct store_file {
+	int fd;
+	off_t offset; /**< The offset to write the next data to */
+};
+
 /**
  * A segcol_foreach_func that writes data from a segment_t into a file.
  *
@@ -488,7 +1099,7 @@ on_error_foreach:
  * @param mapping the mapping of the segment in segcol
  * @param read_start the offset in the data of the segment to start reading
  * @param read_length the length of the data to read
- * @param user_data a int * pointer pointing to the fd to write to
+ * @param user_data a struct store_file pointer describing the file to write to
  *
  * @return the operation error code
  */
@@ -501,15 +1112,15 @@ static int store_segment_func(segcol_t *segcol, segment_t *seg,
 	data_object_t *dobj;
 	segment_get_data(seg, (void **)&dobj);
 
-	/* user_data is actually a pointer to a file descriptor */
-	int fd = *(int *)user_data;
-
-	off_t cur_off = lseek(fd, 0, SEEK_CUR);
+	struct store_file *sf = user_data;
 
-	int err = write_data_object(dobj, read_start, read_length, fd, cur_off);
+	int err = write_data_object(dobj, read_start, read_length, sf->fd,
+			sf->offset);
 	if (err)
 		return_error(err);
 
+	sf->offset += read_length;
+
 	return 0;
 }
 
@@ -545,10 +1156,9 @@ int segcol_store_in_file(segcol_t *segcol, off_t offset, off_t length,
 		goto_error(err, on_error_tmp);
 	}
 
-	int *fd_ptr = &fd;
+	struct store_file sf = { .fd = fd, .offset = 0 };
 
-	err = segcol_foreach(segcol, offset, length, store_segment_func,
-			fd_ptr);
+	err = segcol_foreach(segcol, offset, length, store_segment_func, &sf);
 	if (err)
 		goto_error(err, on_error_foreach);
 
@@ -703,6 +1313,39 @@ on_error_free:
 	return err;
 }
 
+/** 
+ * Creates a new empty segcol_t using the implementation specified by name.
+ *
+ * The valid implementation names are "list", "tree" and "btree" (see
+ * segcol_list_new(), segcol_tree_new() and segcol_btree_new()).
+ * 
+ * @param[out] segcol the created segcol_t
+ * @param impl_name the name of the implementation to use
+ * 
+ * @return the operation error code
+ */
+int segcol_new_by_name(segcol_t **segcol, char *impl_name)
+{
+	if (segcol == NULL || impl_name == NULL)
+		return_error(EINVAL);
+
+	int err;
+
+	if (!strcmp(impl_name, "list"))
+		err = segcol_list_new(segcol);
+	else if (!strcmp(impl_name, "tree"))
+		err = segcol_tree_new(segcol);
+	else if (!strcmp(impl_name, "btree"))
+		err = segcol_btree_new(segcol);
+	else
+		err = EINVAL;
+
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
 /**
  * Enforces the undo limit on the undo list.
  *
@@ -831,3 +1474,301 @@ int undo_list_append(bless_buffer_t *buf, buffer_action_t *action)
 
 	return 0;
 }
+
+/**
+ * Starts a new chunk in the add buffer of a bless_buffer_t.
+ *
+ * @param buf the bless_buffer_t
+ *
+ * @return the operation error code
+ */
+static int add_buffer_new_chunk(bless_buffer_t *buf)
+{
+	unsigned char *data = malloc(BUFFER_ADD_BUFFER_CHUNK_SIZE);
+	if (data == NULL)
+		return_error(ENOMEM);
+
+	data_object_t *dobj;
+	int err = data_object_memory_new(&dobj, data, BUFFER_ADD_BUFFER_CHUNK_SIZE);
+	if (err)
+		goto_error(err, on_error_new);
+
+	err = data_object_memory_set_free_func(dobj, free);
+	if (err)
+		goto_error(err, on_error_set_free_func);
+
+	/* 
+	 * The bless_buffer_t holds a reference to the chunk it is filling.
+	 * Older chunks live on as long as segments point to them.
+	 */
+	err = data_object_update_usage(dobj, 1);
+	if (err)
+		goto_error(err, on_error_set_free_func);
+
+	if (buf->add_buffer != NULL)
+		data_object_update_usage(buf->add_buffer, -1);
+
+	buf->add_buffer = dobj;
+	buf->add_buffer_data = data;
+	buf->add_buffer_used = 0;
+
+	return 0;
+
+on_error_set_free_func:
+	data_object_memory_set_free_func(dobj, NULL);
+	data_object_free(dobj);
+on_error_new:
+	free(data);
+	return err;
+}
+
+/**
+ * Stores small data in the add buffer of a bless_buffer_t.
+ *
+ * The add buffer is an append-only memory data object, allocated in chunks
+ * of BUFFER_ADD_BUFFER_CHUNK_SIZE bytes, that holds copies of the data of
+ * small edits. The data of consecutive edits is stored contiguously, so the
+ * segments pointing to it can be merged in the segcol_t instead of each
+ * edit keeping its own segment and data object.
+ *
+ * If length is 0 or greater than BUFFER_ADD_BUFFER_MAX_STORE, the data is
+ * not stored and src and src_offset are left unchanged.
+ *
+ * @param buf the bless_buffer_t
+ * @param[in,out] src the source of the data and, on return, the source to
+ *                    use to access the data
+ * @param[in,out] src_offset the offset of the data in the source and, on
+ *                           return, the offset to use to access the data
+ * @param length the length of the data
+ *
+ * @return the operation error code
+ */
+int add_buffer_store(bless_buffer_t *buf, bless_buffer_source_t **src,
+		off_t *src_offset, off_t length)
+{
+	if (buf == NULL || src == NULL || *src == NULL || src_offset == NULL)
+		return_error(EINVAL);
+
+	if (length <= 0 || length > BUFFER_ADD_BUFFER_MAX_STORE)
+		return 0;
+
+	/* Start a new chunk if the data doesn't fit in the current one */
+	if (buf->add_buffer == NULL ||
+		BUFFER_ADD_BUFFER_CHUNK_SIZE - buf->add_buffer_used < (size_t)length) {
+		int err = add_buffer_new_chunk(buf);
+		if (err)
+			return_error(err);
+	}
+
+	/* 
+	 * Copy the data. The used size is updated only on success, so the
+	 * add buffer is unaffected by failures.
+	 */
+	int err = read_data_object((data_object_t *)*src, *src_offset,
+			buf->add_buffer_data + buf->add_buffer_used, length);
+	if (err)
+		return_error(err);
+
+	*src = buf->add_buffer;
+	*src_offset = buf->add_buffer_used;
+
+	buf->add_buffer_used += length;
+
+	return 0;
+}
+
+/**
+ * Applies the file related options of a bless_buffer_t to a data object.
+ *
+ * If the data object is not a file data object, nothing is done.
+ *
+ * @param buf the bless_buffer_t
+ * @param obj the data object
+ *
+ * @return the operation error code
+ */
+int buffer_apply_file_options(bless_buffer_t *buf, data_object_t *obj)
+{
+	if (buf == NULL || obj == NULL)
+		return_error(EINVAL);
+
+	int is_file;
+	int err = data_object_is_file(obj, &is_file);
+	if (err)
+		return_error(err);
+
+	if (!is_file)
+		return 0;
+
+	err = data_object_file_set_window_cache(obj,
+			buf->options->file_window_size, buf->options->file_windows);
+	if (err)
+		return_error(err);
+
+	/* With "default" each file keeps the backend it was created with */
+	if (!strcmp(buf->options->file_backend, "mmap"))
+		err = data_object_file_set_backend(obj, DATA_OBJECT_FILE_MMAP);
+	else if (!strcmp(buf->options->file_backend, "pread"))
+		err = data_object_file_set_backend(obj, DATA_OBJECT_FILE_PREAD);
+
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * The settings of a file data object, saved so that they can be restored.
+ */
+struct file_settings {
+	data_object_t *obj;
+	size_t window_size;
+	int nwindows;
+	data_object_file_backend backend;
+};
+
+/**
+ * The saved settings of the file data objects of a segcol_t.
+ */
+struct file_settings_list {
+	struct file_settings *files;
+	size_t count;
+	size_t capacity;
+};
+
+/**
+ * A segcol_foreach_func that saves the settings of the data object of a
+ * segment, if it is a file data object.
+ *
+ * @param segcol the segcol_t containing the segment
+ * @param seg the segment
+ * @param mapping the mapping of the segment in segcol
+ * @param read_start the offset in the data of the segment
+ * @param read_length the length of the data
+ * @param user_data the struct file_settings_list to save the settings in
+ *
+ * @return the operation error code
+ */
+static int save_file_settings_func(segcol_t *segcol, segment_t *seg,
+		off_t mapping, off_t read_start, off_t read_length, void *user_data)
+{
+	UNUSED_PARAM(segcol);
+	UNUSED_PARAM(mapping);
+	UNUSED_PARAM(read_start);
+	UNUSED_PARAM(read_length);
+
+	struct file_settings_list *list = user_data;
+
+	data_object_t *dobj;
+	int err = segment_get_data(seg, (void **)&dobj);
+	if (err)
+		return_error(err);
+
+	int is_file;
+	err = data_object_is_file(dobj, &is_file);
+	if (err)
+		return_error(err);
+
+	if (!is_file)
+		return 0;
+
+	/* Consecutive segments often belong to the same file */
+	if (list->count > 0 && list->files[list->count - 1].obj == dobj)
+		return 0;
+
+	if (list->count == list->capacity) {
+		size_t capacity = list->capacity > 0 ? 2 * list->capacity : 16;
+
+		if (capacity > __MAX(size_t) / sizeof(struct file_settings))
+			return_error(ENOMEM);
+
+		struct file_settings *files =
+			realloc(list->files, capacity * sizeof(struct file_settings));
+		if (files == NULL)
+			return_error(ENOMEM);
+
+		list->files = files;
+		list->capacity = capacity;
+	}
+
+	struct file_settings *fs = &list->files[list->count];
+	fs->obj = dobj;
+
+	err = data_object_file_get_window_cache(dobj, &fs->window_size,
+			&fs->nwindows);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_get_backend(dobj, &fs->backend);
+	if (err)
+		return_error(err);
+
+	list->count++;
+
+	return 0;
+}
+
+/**
+ * Applies the file related options of a bless_buffer_t to all the data
+ * objects in a segcol_t.
+ *
+ * If the options can't be applied to some data object, the settings of
+ * all the data objects are restored, so that a failed change of the
+ * options doesn't leave the files of the buffer using a mix of old and new
+ * settings.
+ *
+ * @param buf the bless_buffer_t
+ * @param segcol the segcol_t
+ *
+ * @return the operation error code
+ */
+int segcol_apply_file_options(bless_buffer_t *buf, segcol_t *segcol)
+{
+	if (buf == NULL || segcol == NULL)
+		return_error(EINVAL);
+
+	off_t segcol_size;
+	int err = segcol_get_size(segcol, &segcol_size);
+	if (err)
+		return_error(err);
+
+	if (segcol_size == 0)
+		return 0;
+
+	/* Save the current settings of the files before changing any of them */
+	struct file_settings_list list = { NULL, 0, 0 };
+
+	err = segcol_foreach(segcol, 0, segcol_size, save_file_settings_func,
+			&list);
+	if (err)
+		goto_error(err, out);
+
+	size_t i;
+	for (i = 0; i < list.count; i++) {
+		err = buffer_apply_file_options(buf, list.files[i].obj);
+		if (err)
+			break;
+	}
+
+	/* 
+	 * Restore the settings of the files changed so far (including the
+	 * failed one, which may have been changed partially). The settings are
+	 * restored on a best effort basis: the old settings were in use, so
+	 * failures are unlikely.
+	 */
+	if (err) {
+		size_t j;
+		for (j = 0; j <= i && j < list.count; j++) {
+			struct file_settings *fs = &list.files[j];
+			data_object_file_set_window_cache(fs->obj, fs->window_size,
+					fs->nwindows);
+			data_object_file_set_backend(fs->obj, fs->backend);
+		}
+
+		goto_error(err, out);
+	}
+
+out:
+	free(list.files);
+	return err;
+}
@@ -37,6 +37,26 @@ extern "C" {
 #include "data_object.h"
 #include "list.h"
 
+/** The size of the chunks the add buffer of a bless_buffer_t is made of */
+#define BUFFER_ADD_BUFFER_CHUNK_SIZE (64 * 1024)
+
+/** The maximum length of the data of an edit stored in the add buffer */
+#define BUFFER_ADD_BUFFER_MAX_STORE 1024
+
+/** The default maximum size of the data written at once when saving */
+#define BUFFER_SAVE_BATCH_SIZE (4 * 1024 * 1024)
+
+/** The minimum size of the file data that the kernel copies when saving */
+#define BUFFER_SAVE_KERNEL_COPY_MIN (64 * 1024)
+
+/** Value returned by a segcol_foreach_func to stop the iteration */
+#define SEGCOL_FOREACH_STOP (-1)
+
+/**
+ * A batch of data to be written to consecutive offsets of a file.
+ */
+struct write_batch;
+
 typedef int (segcol_foreach_func)(segcol_t *segcol, segment_t *seg,
 		off_t mapping, off_t read_start, off_t read_length, void *user_data);
 
@@ -48,9 +68,27 @@ int write_data_object(data_object_t *dobj, off_t offset, off_t length,
 int write_data_object_safe(data_object_t *dobj, off_t offset, off_t length,
 		int fd, off_t file_offset);
 
+int write_batch_new(struct write_batch **batch, int fd, size_t max_size);
+
+int write_batch_add(struct write_batch *batch, data_object_t *dobj,
+		off_t offset, off_t length, off_t file_offset);
+
+int write_batch_copy(struct write_batch *batch, data_object_t *dobj,
+		off_t offset, off_t length, off_t file_offset);
+
+int write_batch_write_safe(struct write_batch *batch, data_object_t *dobj,
+		off_t offset, off_t length, off_t file_offset);
+
+int write_batch_flush(struct write_batch *batch);
+
+int write_batch_free(struct write_batch *batch);
+
 int segcol_foreach(segcol_t *segcol, off_t offset, off_t length,
 		segcol_foreach_func *func, void *user_data);
 
+int segcol_foreach_reverse(segcol_t *segcol, off_t offset, off_t length,
+		segcol_foreach_func *func, void *user_data);
+
 int segcol_store_in_memory(segcol_t *segcol, off_t offset, off_t length);
 
 int segcol_store_in_file(segcol_t *segcol, off_t offset, off_t length,
@@ -58,12 +96,21 @@ int segcol_store_in_file(segcol_t *segcol, off_t offset, off_t length,
 
 int segcol_add_copy(segcol_t *dst, off_t offset, segcol_t *src);
 
+int segcol_new_by_name(segcol_t **segcol, char *impl_name);
+
 int undo_list_enforce_limit(bless_buffer_t *buf, int ensure_vacancy);
 
 int action_list_clear(list_t *action_list);
 
 int undo_list_append(bless_buffer_t *buf, buffer_action_t *action);
 
+int add_buffer_store(bless_buffer_t *buf, bless_buffer_source_t **src,
+		off_t *src_offset, off_t length);
+
+int buffer_apply_file_options(bless_buffer_t *buf, data_object_t *obj);
+
+int segcol_apply_file_options(bless_buffer_t *buf, segcol_t *segcol);
+
 #ifdef __cplusplus
 }
 #endif
@@ -78,6 +78,17 @@ void *data_object_get_impl(data_object_t *obj)
 	return obj->impl;
 }
 
+/**
+ * Gets the implementation functions of a data_object_t.
+ *
+ * This can be used by an implementation to check whether a data_object_t
+ * is one of its own.
+ */
+struct data_object_funcs *data_object_get_funcs(data_object_t *obj)
+{
+	return obj->funcs;
+}
+
 /***************** 
  * API functions *
  *****************/
@@ -94,6 +105,12 @@ void *data_object_get_impl(data_object_t *obj)
  * Furthermore, the pointer returned is valid only as long as no other access
  * is made to the data object (watch out for concurrency issues!).
  *
+ * If DATA_OBJECT_REVERSE is set in flags, the data are going to be accessed
+ * backwards: if only some of the requested data are retrieved, they are the
+ * data at the end of the range, that is, buf points to the data at offset
+ * + (requested length - returned length). Data objects may use this to read
+ * ahead in the right direction.
+ *
  * @param obj the obj to get the data from
  * @param[out] buf the location that will contain the data
  * @param offset the offset in the data object to get data from
@@ -111,6 +128,57 @@ int data_object_get_data(data_object_t *obj, void **buf, off_t offset,
 	return (*obj->funcs->get_data)(obj, buf, offset, length, flags);
 }
 
+/**
+ * Releases data pinned by data_object_get_data().
+ *
+ * When data_object_get_data() is called with the DATA_OBJECT_PIN flag, the
+ * returned data remain valid until a matching call to this function, instead
+ * of only until the next data_object_get_data() call. Data objects that can't
+ * pin their data return ENOTSUP from data_object_get_data() in that case
+ * (use data_object_can_pin() to check beforehand).
+ *
+ * @param obj the data object
+ *
+ * @return the operation error code
+ */
+int data_object_unpin(data_object_t *obj)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	/* Data objects whose data are always valid don't track pins */
+	if (obj->funcs->unpin == NULL)
+		return 0;
+
+	return (*obj->funcs->unpin)(obj);
+}
+
+/**
+ * Checks whether the data of a data object can be pinned.
+ *
+ * Not being able to pin data is a normal condition (the caller usually
+ * copies the data instead), so this should be used to choose between
+ * pinning and copying, rather than trying to pin and handling ENOTSUP.
+ *
+ * @param obj the data object
+ * @param[out] can_pin whether data_object_get_data() can pin data
+ *
+ * @return the operation error code
+ */
+int data_object_can_pin(data_object_t *obj, int *can_pin)
+{
+	if (obj == NULL || can_pin == NULL)
+		return_error(EINVAL);
+
+	/* Data objects whose data are always valid don't track pins */
+	if (obj->funcs->can_pin == NULL) {
+		*can_pin = 1;
+		return 0;
+	}
+
+	return (*obj->funcs->can_pin)(obj, can_pin);
+}
+
 /**
  * Frees the data object and its resources.
  *
@@ -58,12 +58,18 @@ typedef struct data_object data_object_t;
 typedef enum { 
 	DATA_OBJECT_READ = 1, /**< Data will be used just for reading */
 	DATA_OBJECT_WRITE = 2, /**< Data will be used just for writing */
-	DATA_OBJECT_RW = 3 /**< Data will be used for both reading and writing */
+	DATA_OBJECT_RW = 3, /**< Data will be used for both reading and writing */
+	DATA_OBJECT_PIN = 4, /**< Data must remain valid until data_object_unpin() */
+	DATA_OBJECT_REVERSE = 8 /**< Data are accessed backwards (see data_object_get_data()) */
 } data_object_flags;
 
 int data_object_get_data(data_object_t *obj, void **buf, off_t offset,
 		off_t *length, data_object_flags flags);
 
+int data_object_unpin(data_object_t *obj);
+
+int data_object_can_pin(data_object_t *obj, int *can_pin);
+
 int data_object_free(data_object_t *obj);
 
 int data_object_update_usage(void *obj, int change);
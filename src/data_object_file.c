@@ -30,14 +30,31 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "data_object.h"
 #include "data_object_internal.h"
 #include "data_object_file.h"
+#include "data_object_file_pread.h"
+#include "data_object_file_index.h"
 #include "type_limits.h"
 #include "debug.h"
 #include "util.h"
 
+/*
+ * Whether to map whole files by default. This is only done when the address
+ * space is large enough (64-bit hosts), so that mapping big files doesn't
+ * exhaust it.
+ */
+#if SIZE_MAX > 0xffffffffUL
+#define DATA_OBJECT_FILE_MAP_WHOLE 1
+#else
+#define DATA_OBJECT_FILE_MAP_WHOLE 0
+#endif
+
+/** The size of the hugepages we ask the kernel to use for large windows */
+#define DATA_OBJECT_FILE_HUGEPAGE_SIZE (2 * 1024 * 1024)
 
 /* forward declarations */
 static int data_object_file_get_size(data_object_t *obj, off_t *size);
@@ -46,13 +63,25 @@ static int data_object_file_get_data(data_object_t *obj, void **buf,
 		off_t offset, off_t *length, data_object_flags flags);
 static int data_object_file_compare(int *result, data_object_t *obj1,
 		data_object_t *obj2);
+static int data_object_file_unpin(data_object_t *obj);
+static int data_object_file_can_pin(data_object_t *obj, int *can_pin);
 
 /* Function pointers for the file implementation of data_object_t */
 static struct data_object_funcs data_object_file_funcs = {
 	.get_data = data_object_file_get_data,
 	.free = data_object_file_free,
 	.get_size = data_object_file_get_size,
-	.compare = data_object_file_compare
+	.compare = data_object_file_compare,
+	.unpin = data_object_file_unpin,
+	.can_pin = data_object_file_can_pin
+};
+
+/** A window of the file that is mapped in memory */
+struct data_object_file_window {
+	void *data;
+	off_t offset;
+	size_t size;
+	unsigned long last_used;
 };
 
 /* Private data for the file implementation of data_object_t */
@@ -60,8 +89,18 @@ struct data_object_file_impl {
 	int fd;
 	off_t size;
 
-	void *page_data;
-	off_t page_offset;
+	/* The pread cache (NULL if the mmap backend is used) */
+	struct pread_cache *pread;
+
+	/* The mapping of the whole file (NULL if windows are used) */
+	void *file_data;
+	int pins;
+
+	/* The mapped windows of the file (an LRU cache) */
+	struct data_object_file_window *windows;
+	int nwindows;
+	size_t window_size;
+	unsigned long window_clock;
 	long page_size;	
 
 	/* Device and inode of fd. Used in data object comparisons. */
@@ -72,6 +111,13 @@ struct data_object_file_impl {
 
 	/* The path of the file (only used in tempfile data objects */
 	char *path;
+
+	/* 
+	 * The search index of the file (NULL if there is none). It may be
+	 * set by other threads, so it is protected by index_mutex.
+	 */
+	struct file_index *index;
+	pthread_mutex_t index_mutex;
 };
 
 /**
@@ -109,35 +155,68 @@ int data_object_file_new(data_object_t **obj, int fd)
 
 	impl->fd = fd;
 
+	/* Nothing is mapped yet, so that errors can be handled in one place */
+	impl->windows = NULL;
+	impl->nwindows = 0;
+	impl->window_size = 0;
+	impl->window_clock = 0;
+	impl->file_data = NULL;
+	impl->pins = 0;
+	impl->pread = NULL;
+
+	/* We don't own the file by default */
+	impl->file_close = NULL;
+	
+	impl->path = NULL;
+	impl->index = NULL;
+
 	/* Get file info */
 	struct stat st;
-	err = fstat(fd, &st);
-	if (err)
-		goto_error(errno, on_error_other);
+	if (fstat(fd, &st) == -1) {
+		err = errno;
+		goto_error(err, on_error_data);
+	}
 
 	impl->dev = st.st_dev;
 	impl->inode = st.st_ino;
 
 	/* Get size of file */
 	impl->size = lseek(fd, 0, SEEK_END);
-	if (impl->size == -1)
-		goto_error(errno, on_error_other);
+	if (impl->size == -1) {
+		err = errno;
+		goto_error(err, on_error_data);
+	}
 
 	impl->page_size = sysconf(_SC_PAGESIZE);
-	if (impl->page_size == -1)
-		goto_error(errno, on_error_other);
+	if (impl->page_size == -1) {
+		err = errno;
+		goto_error(err, on_error_data);
+	}
 
-	impl->page_data = NULL;
+	err = data_object_file_set_window_cache(*obj,
+			DATA_OBJECT_FILE_WINDOW_SIZE, DATA_OBJECT_FILE_WINDOWS);
+	if (err)
+		goto_error(err, on_error_data);
 
-	/* We don't own the file by default */
-	impl->file_close = NULL;
-	
-	impl->path = NULL;
+	/* 
+	 * Try to map the whole file. If this fails (eg for some devices) we
+	 * fall back to using the windows.
+	 */
+	if (DATA_OBJECT_FILE_MAP_WHOLE)
+		data_object_file_set_whole_mapping(*obj, 1);
+
+	err = pthread_mutex_init(&impl->index_mutex, NULL);
+	if (err)
+		goto_error(err, on_error_data);
 
 	return 0;
 
-on_error_other:
-	free(obj);
+on_error_data:
+	/* Windows are only mapped when data are accessed */
+	if (impl->file_data != NULL)
+		munmap(impl->file_data, impl->size);
+	free(impl->windows);
+	free(*obj);
 on_error_object:
 	free(impl);
 	return err;
@@ -182,6 +261,101 @@ int data_object_tempfile_new(data_object_t **obj, int fd, char *path)
 
 	return 0;
 }
+/**
+ * Creates a new view of a file data object.
+ *
+ * A view is a file data object that accesses the same file as the original
+ * one, with the same backend, mapping parameters and search index, but keeps
+ * its own mappings and cached data. Views can therefore be used concurrently
+ * with the original data object and with each other (eg by different
+ * threads).
+ *
+ * The view never owns the file, so it can be freed independently of the
+ * original data object. It must be freed before the original data object,
+ * though, as the file may be closed when the latter is freed.
+ *
+ * @param[out] view the created view
+ * @param obj the file data object to create a view of
+ *
+ * @return the operation error code
+ */
+int data_object_file_new_view(data_object_t **view, data_object_t *obj)
+{
+	if (view == NULL || obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *orig =
+		data_object_get_impl(obj);
+
+	/* Allocate memory for implementation */
+	struct data_object_file_impl *impl =
+		malloc (sizeof(struct data_object_file_impl));
+
+	if (impl == NULL)
+		return_error(ENOMEM);
+
+	int err = data_object_create_impl(view, impl, &data_object_file_funcs);
+	if (err)
+		goto_error(err, on_error_object);
+
+	/* 
+	 * Share the file information with the original data object. This also
+	 * avoids touching the file offset of the shared file descriptor.
+	 */
+	impl->fd = orig->fd;
+	impl->size = orig->size;
+	impl->dev = orig->dev;
+	impl->inode = orig->inode;
+	impl->page_size = orig->page_size;
+
+	impl->windows = NULL;
+	impl->nwindows = 0;
+	impl->window_size = 0;
+	impl->window_clock = 0;
+	impl->file_data = NULL;
+	impl->pins = 0;
+	impl->pread = NULL;
+	impl->file_close = NULL;
+	impl->path = NULL;
+
+	impl->index = NULL;
+	err = pthread_mutex_init(&impl->index_mutex, NULL);
+	if (err)
+		goto_error(err, on_error_data);
+
+	/* Share the search index of the original */
+	pthread_mutex_lock(&orig->index_mutex);
+	impl->index = orig->index;
+	if (impl->index != NULL)
+		file_index_ref(impl->index);
+	pthread_mutex_unlock(&orig->index_mutex);
+
+	/* Use the same backend and mapping parameters as the original */
+	err = data_object_file_set_window_cache(*view, orig->window_size,
+			orig->nwindows);
+	if (err)
+		goto_error(err, on_error_view);
+
+	if (orig->pread != NULL)
+		err = data_object_file_set_backend(*view, DATA_OBJECT_FILE_PREAD);
+	else if (orig->file_data != NULL)
+		err = data_object_file_set_whole_mapping(*view, 1);
+
+	if (err)
+		goto_error(err, on_error_view);
+
+	return 0;
+
+on_error_view:
+	data_object_free(*view);
+	return err;
+on_error_data:
+	free(*view);
+on_error_object:
+	free(impl);
+	return err;
+}
+
 /**
  * Sets the function used to close the file associated with the data object.
  *
@@ -208,22 +382,578 @@ int data_object_file_set_close_func(data_object_t *obj,
 	return 0;
 }
 
+/**
+ * Unmaps all the mapped windows of a file data object.
+ *
+ * @param impl the data_object_file_impl
+ *
+ * @return the operation error code
+ */
+static int unmap_windows(struct data_object_file_impl *impl)
+{
+	int i;
+
+	for (i = 0; i < impl->nwindows; i++) {
+		struct data_object_file_window *win = &impl->windows[i];
+
+		if (win->data == NULL)
+			continue;
+
+		if (munmap(win->data, win->size) == -1)
+			return_error(errno);
+
+		win->data = NULL;
+	}
+
+	return 0;
+}
+
+/**
+ * Sets the parameters of the cache of mapped windows of a file data object.
+ *
+ * The data of a file data object are accessed through at most nwindows
+ * windows of window_size bytes each, that are mapped in memory. When a
+ * window that is not mapped is needed, the least recently used window is
+ * replaced.
+ *
+ * @param obj the data object
+ * @param window_size the size of each window (it is rounded up to a multiple
+ *                    of the page size)
+ * @param nwindows the maximum number of mapped windows
+ *
+ * @return the operation error code
+ */
+int data_object_file_set_window_cache(data_object_t *obj, size_t window_size,
+		int nwindows)
+{
+	if (obj == NULL || window_size == 0 || nwindows <= 0)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	/* Round the window size up to a multiple of the page size */
+	size_t page_size = (size_t) impl->page_size;
+
+	if (__MAX(size_t) - window_size < page_size - 1)
+		return_error(EOVERFLOW);
+
+	window_size = ((window_size + page_size - 1) / page_size) * page_size;
+
+	if (window_size == impl->window_size && nwindows == impl->nwindows)
+		return 0;
+
+	struct data_object_file_window *windows =
+		malloc(nwindows * sizeof(struct data_object_file_window));
+	if (windows == NULL)
+		return_error(ENOMEM);
+
+	int err = unmap_windows(impl);
+	if (err) {
+		free(windows);
+		return_error(err);
+	}
+
+	int i;
+	for (i = 0; i < nwindows; i++) {
+		windows[i].data = NULL;
+		windows[i].offset = 0;
+		windows[i].size = 0;
+		windows[i].last_used = 0;
+	}
+
+	free(impl->windows);
+
+	impl->windows = windows;
+	impl->nwindows = nwindows;
+	impl->window_size = window_size;
+
+	return 0;
+}
+
+/**
+ * Gets the parameters of the cache of mapped windows of a file data object.
+ *
+ * @param obj the data object
+ * @param[out] window_size the size of each window
+ * @param[out] nwindows the maximum number of mapped windows
+ *
+ * @return the operation error code
+ */
+int data_object_file_get_window_cache(data_object_t *obj, size_t *window_size,
+		int *nwindows)
+{
+	if (obj == NULL || window_size == NULL || nwindows == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	*window_size = impl->window_size;
+	*nwindows = impl->nwindows;
+
+	return 0;
+}
+
+/**
+ * Sets whether a file data object maps the whole file in memory.
+ *
+ * When the whole file is mapped, data_object_get_data() always returns the
+ * whole requested range and no more mapping operations are needed. Otherwise
+ * the data is accessed through the window cache (see
+ * data_object_file_set_window_cache()).
+ *
+ * By default file data objects map the whole file on 64-bit hosts.
+ *
+ * @param obj the data object
+ * @param enable whether to map the whole file
+ *
+ * @return the operation error code (if the file cannot be mapped the data
+ *         object keeps using the window cache, EBUSY if disabling while
+ *         data are pinned)
+ */
+int data_object_file_set_whole_mapping(data_object_t *obj, int enable)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	/* Unmap the whole file */
+	if (!enable) {
+		/* Pinned data must remain valid */
+		if (impl->pins > 0)
+			return_error(EBUSY);
+
+		if (impl->file_data != NULL) {
+			if (munmap(impl->file_data, impl->size) == -1)
+				return_error(errno);
+
+			impl->file_data = NULL;
+		}
+
+		return 0;
+	}
+
+	if (impl->file_data != NULL)
+		return 0;
+
+	/* Whole mapping is only supported by the mmap backend */
+	if (impl->pread != NULL)
+		return_error(EINVAL);
+
+	/* Empty files can't be mapped, but they can't be read either */
+	if (impl->size == 0 || (uintmax_t)impl->size > SIZE_MAX)
+		return_error(EINVAL);
+
+	void *mmap_addr = mmap(NULL, impl->size, PROT_READ, MAP_PRIVATE,
+			impl->fd, 0);
+
+	if (mmap_addr == MAP_FAILED)
+		return_error(errno);
+
+	/* The windows are not needed anymore */
+	int err = unmap_windows(impl);
+	if (err) {
+		munmap(mmap_addr, impl->size);
+		return_error(err);
+	}
+
+	impl->file_data = mmap_addr;
+
+	return 0;
+}
+
+/**
+ * Gets whether a file data object maps the whole file in memory.
+ *
+ * @param obj the data object
+ * @param[out] enabled whether the whole file is mapped
+ *
+ * @return the operation error code
+ */
+int data_object_file_get_whole_mapping(data_object_t *obj, int *enabled)
+{
+	if (obj == NULL || enabled == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	*enabled = (impl->file_data != NULL);
+
+	return 0;
+}
+
+/**
+ * Sets the backend used to access the data of a file data object.
+ *
+ * The DATA_OBJECT_FILE_MMAP backend maps the file in memory (whole or
+ * through the window cache). The DATA_OBJECT_FILE_PREAD backend reads the
+ * data with pread() into a buffer, growing the amount of data read when the
+ * file is accessed sequentially. The latter is useful for files that can't
+ * be mapped or for which mapping is slow (eg some network file systems).
+ *
+ * Both backends are of the same data object type, so file data objects for
+ * the same file compare equal regardless of their backend.
+ *
+ * @param obj the data object
+ * @param backend the backend to use
+ *
+ * @return the operation error code
+ */
+int data_object_file_set_backend(data_object_t *obj,
+		data_object_file_backend backend)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	int err;
+
+	switch (backend) {
+		case DATA_OBJECT_FILE_MMAP:
+			if (impl->pread == NULL)
+				break;
+
+			err = pread_cache_free(impl->pread);
+			if (err)
+				return_error(err);
+
+			impl->pread = NULL;
+
+			if (DATA_OBJECT_FILE_MAP_WHOLE)
+				data_object_file_set_whole_mapping(obj, 1);
+			break;
+
+		case DATA_OBJECT_FILE_PREAD:
+			if (impl->pread != NULL)
+				break;
+
+			struct pread_cache *cache;
+			err = pread_cache_new(&cache, impl->fd, impl->size);
+			if (err)
+				return_error(err);
+
+			/* Release the mappings of the mmap backend */
+			err = data_object_file_set_whole_mapping(obj, 0);
+			if (err == 0)
+				err = unmap_windows(impl);
+
+			if (err) {
+				pread_cache_free(cache);
+				return_error(err);
+			}
+
+			impl->pread = cache;
+			break;
+
+		default:
+			return_error(EINVAL);
+	}
+
+	return 0;
+}
+
+/**
+ * Gets the backend used to access the data of a file data object.
+ *
+ * @param obj the data object
+ * @param[out] backend the backend in use
+ *
+ * @return the operation error code
+ */
+int data_object_file_get_backend(data_object_t *obj,
+		data_object_file_backend *backend)
+{
+	if (obj == NULL || backend == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	if (impl->pread != NULL)
+		*backend = DATA_OBJECT_FILE_PREAD;
+	else
+		*backend = DATA_OBJECT_FILE_MMAP;
+
+	return 0;
+}
+
+/**
+ * Builds the search index of a file data object.
+ *
+ * The index holds the n-grams of each block of the file and lets searches
+ * skip the parts of the file that can't contain the searched data (see
+ * data_object_file_index.c). Any previous index is replaced.
+ *
+ * The file is read without touching the data object mappings or caches, so
+ * the index can be built by another thread while the data object is used.
+ *
+ * @param obj the data object
+ * @param progress_func the bless_progress_func to call to report the
+ *                      progress of the operation (may be NULL)
+ *
+ * @return the operation error code (ECANCELED if the operation was cancelled)
+ */
+int data_object_file_build_index(data_object_t *obj,
+		bless_progress_func *progress_func)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	struct file_index *index;
+	int err = file_index_build(&index, impl->fd, impl->size, progress_func);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_set_index(obj, index);
+	if (err) {
+		file_index_unref(index);
+		return_error(err);
+	}
+
+	return 0;
+}
+
+/**
+ * Loads the search index of a file data object from a file.
+ *
+ * @param obj the data object
+ * @param index_fd the file to load the index from (saved with
+ *                 data_object_file_save_index())
+ *
+ * @return the operation error code (EINVAL if the saved index is invalid,
+ *         ESTALE if it doesn't match the current contents of the file)
+ */
+int data_object_file_load_index(data_object_t *obj, int index_fd)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	struct file_index *index;
+	int err = file_index_load(&index, index_fd, impl->fd, impl->size);
+	if (err)
+		return_error(err);
+
+	err = data_object_file_set_index(obj, index);
+	if (err) {
+		file_index_unref(index);
+		return_error(err);
+	}
+
+	return 0;
+}
+
+/**
+ * Saves the search index of a file data object to a file.
+ *
+ * @param obj the data object
+ * @param index_fd the file to save the index to
+ *
+ * @return the operation error code (ENOENT if the data object has no index)
+ */
+int data_object_file_save_index(data_object_t *obj, int index_fd)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct file_index *index;
+	int err = data_object_file_get_index(obj, &index);
+	if (err)
+		return_error(err);
+
+	if (index == NULL)
+		return_error(ENOENT);
+
+	err = file_index_save(index, index_fd);
+	file_index_unref(index);
+
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Sets the search index of a file data object.
+ *
+ * The data object takes over the caller's reference to the index. Any
+ * previous index is released.
+ *
+ * @param obj the data object
+ * @param index the file_index (NULL to remove the index)
+ *
+ * @return the operation error code
+ */
+int data_object_file_set_index(data_object_t *obj, struct file_index *index)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	pthread_mutex_lock(&impl->index_mutex);
+	struct file_index *prev = impl->index;
+	impl->index = index;
+	pthread_mutex_unlock(&impl->index_mutex);
+
+	if (prev != NULL)
+		file_index_unref(prev);
+
+	return 0;
+}
+
+/**
+ * Gets the search index of a file data object.
+ *
+ * Only an index that matches the current contents of the file is returned.
+ * The caller gets a reference to the index and must release it with
+ * file_index_unref() when done.
+ *
+ * @param obj the data object
+ * @param[out] index the file_index (NULL if there is no current index)
+ *
+ * @return the operation error code
+ */
+int data_object_file_get_index(data_object_t *obj, struct file_index **index)
+{
+	if (obj == NULL || index == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	pthread_mutex_lock(&impl->index_mutex);
+	struct file_index *idx = impl->index;
+	if (idx != NULL)
+		file_index_ref(idx);
+	pthread_mutex_unlock(&impl->index_mutex);
+
+	*index = NULL;
+
+	if (idx == NULL)
+		return 0;
+
+	int current;
+	int err = file_index_is_current(idx, impl->fd, impl->size, &current);
+	if (err || !current) {
+		file_index_unref(idx);
+		if (err)
+			return_error(err);
+		return 0;
+	}
+
+	*index = idx;
+
+	return 0;
+}
+
+/**
+ * Checks whether a data object is a file data object.
+ *
+ * @param obj the data object
+ * @param[out] is_file 1 if the data object is a file data object, 0 otherwise
+ *
+ * @return the operation error code
+ */
+int data_object_is_file(data_object_t *obj, int *is_file)
+{
+	if (obj == NULL || is_file == NULL)
+		return_error(EINVAL);
+
+	*is_file = (data_object_get_funcs(obj) == &data_object_file_funcs);
+
+	return 0;
+}
+
+/**
+ * Gets the file descriptor of the file of a file data object.
+ *
+ * The file descriptor is still owned by the data object.
+ *
+ * @param obj the file data object
+ * @param[out] fd the file descriptor
+ *
+ * @return the operation error code
+ */
+int data_object_file_get_fd(data_object_t *obj, int *fd)
+{
+	if (obj == NULL || fd == NULL
+			|| data_object_get_funcs(obj) != &data_object_file_funcs)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	*fd = impl->fd;
+
+	return 0;
+}
+
+/**
+ * Gets the device and inode of the file of a file data object.
+ *
+ * These identify the file, so file data objects with the same device and
+ * inode are equal (see data_object_compare()).
+ *
+ * @param obj the file data object
+ * @param[out] dev the device of the file
+ * @param[out] ino the inode of the file
+ *
+ * @return the operation error code
+ */
+int data_object_file_get_id(data_object_t *obj, dev_t *dev, ino_t *ino)
+{
+	if (obj == NULL || dev == NULL || ino == NULL
+			|| data_object_get_funcs(obj) != &data_object_file_funcs)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	*dev = impl->dev;
+	*ino = impl->inode;
+
+	return 0;
+}
+
 /*
- * The file data object provides access to a file's data by partially mapping a
- * page of it in memory. When a caller requests a data range we check if a part
- * of the range is already loaded in memory. If it is, we return a pointer to
+ * If the pread backend is used the data are served from the pread cache.
+ *
+ * If the whole file is mapped in memory we just return a pointer to the
+ * requested range.
+ *
+ * Otherwise, the file data object provides access to a file's data by mapping
+ * windows of it in memory. When a caller requests a data range we check if the start of
+ * the range is in one of the mapped windows. If it is, we return a pointer to
  * that memory area. If the whole range was not returned it is up to the caller
  * to call the function again (perhaps multiple times) to retrieve the data.
  *
- * If the data range requested is not in memory we first unmap the previous
- * mapped file page (if any). We then map a new page that contains a part from
- * the start of requested range (perhaps all of it).
+ * If the start of the range is not in a mapped window we unmap the least
+ * recently used window (if all windows are in use) and map a new window that
+ * contains the start of the range. Windows start at multiples of the window
+ * size, so that large windows are aligned in the file (and hugepages can be
+ * used where supported).
+ *
+ * For backward access (DATA_OBJECT_REVERSE) the window containing the end of
+ * the range is used instead, and the part of the range in that window is
+ * returned. Since the kernel reads ahead only forwards when faulting in
+ * mapped pages, we ask it to read the whole window when mapping it.
  */
 static int data_object_file_get_data(data_object_t *obj, void **buf, 
 		off_t offset, off_t *length, data_object_flags flags)
 {
-	UNUSED_PARAM(flags);
-
 	if (obj == NULL || buf == NULL || length == NULL || offset < 0)
 		return_error(EINVAL);
 
@@ -240,42 +970,128 @@ static int data_object_file_get_data(data_object_t *obj, void **buf,
 	if (offset + len - 1 * (len != 0) >= impl->size)
 		return_error(EINVAL);
 
-	/* If requested data is not loaded in memory, load it... */
-	if (impl->page_data == NULL || offset < impl->page_offset
-			|| offset >= impl->page_offset + impl->page_size)
-	{
+	/* Backward access only matters if the range may be split */
+	int reverse = (flags & DATA_OBJECT_REVERSE) && len > 0;
+
+	if (impl->pread != NULL) {
+		if (flags & DATA_OBJECT_PIN)
+			return_error(ENOTSUP);
+
 		int err;
+		if (reverse)
+			err = pread_cache_get_reverse(impl->pread, buf, offset, length);
+		else
+			err = pread_cache_get(impl->pread, buf, offset, length);
+		if (err)
+			return_error(err);
 
-		/* Unload previous page */
-		if (impl->page_data != NULL) {
-			err = munmap(impl->page_data, impl->page_size);
-			if (err)
+		return 0;
+	}
+
+	if (impl->file_data != NULL) {
+		if (flags & DATA_OBJECT_PIN)
+			impl->pins++;
+
+		/* Read ahead backwards (best effort, ignore failures) */
+		if (reverse) {
+			off_t page_start = (offset / impl->page_size) * impl->page_size;
+			posix_madvise((unsigned char *)impl->file_data + page_start,
+					offset + len - page_start, POSIX_MADV_WILLNEED);
+		}
+
+		*buf = (unsigned char *)impl->file_data + offset;
+		return 0;
+	}
+
+	/* Windows and the pread cache are reused, so data can't be pinned */
+	if (flags & DATA_OBJECT_PIN)
+		return_error(ENOTSUP);
+
+	/* The offset that must be in the window */
+	off_t needed = reverse ? offset + len - 1 : offset;
+
+	/* Look for a mapped window containing it and for a replacement */
+	struct data_object_file_window *win = NULL;
+	struct data_object_file_window *victim = &impl->windows[0];
+	int i;
+
+	for (i = 0; i < impl->nwindows; i++) {
+		struct data_object_file_window *w = &impl->windows[i];
+
+		if (w->data != NULL && needed >= w->offset
+				&& needed - w->offset < (off_t)w->size) {
+			win = w;
+			break;
+		}
+
+		/* Prefer empty windows, then the least recently used one */
+		if (victim->data != NULL && (w->data == NULL ||
+				w->last_used < victim->last_used))
+			victim = w;
+	}
+
+	/* If requested data is not loaded in memory, load it... */
+	if (win == NULL) {
+		win = victim;
+
+		/* Unload the replaced window */
+		if (win->data != NULL) {
+			if (munmap(win->data, win->size) == -1)
 				return_error(errno);
 
-			impl->page_data = NULL;
+			win->data = NULL;
 		}
 
-		/* Load new page */
-		off_t page_offset = (offset / impl->page_size) * impl->page_size;
+		/* Load the window containing it (but not past the file end) */
+		off_t win_offset = (needed / impl->window_size) * impl->window_size;
+		size_t win_size = impl->window_size;
 
-		void *mmap_addr = mmap(NULL, impl->page_size, PROT_READ, MAP_PRIVATE,
-				impl->fd, page_offset);
+		if (impl->size - win_offset < (off_t)win_size)
+			win_size = impl->size - win_offset;
+
+		void *mmap_addr = mmap(NULL, win_size, PROT_READ, MAP_PRIVATE,
+				impl->fd, win_offset);
 
 		if (mmap_addr == MAP_FAILED)
 			return_error(errno);
 
-		impl->page_data = mmap_addr;
-		impl->page_offset = page_offset;
+#ifdef MADV_HUGEPAGE
+		/* Best effort, ignore failures */
+		if (win_size >= DATA_OBJECT_FILE_HUGEPAGE_SIZE)
+			madvise(mmap_addr, win_size, MADV_HUGEPAGE);
+#endif
+
+		/* Read ahead backwards (best effort, ignore failures) */
+		if (reverse)
+			posix_madvise(mmap_addr, win_size, POSIX_MADV_WILLNEED);
+
+		win->data = mmap_addr;
+		win->offset = win_offset;
+		win->size = win_size;
+	}
+
+	win->last_used = ++impl->window_clock;
+
+	if (reverse) {
+		/* Return the part of the range that is in the window */
+		off_t start = offset;
+		if (start < win->offset)
+			start = win->offset;
+
+		*length = offset + len - start;
+		*buf = (unsigned char *)win->data + (start - win->offset);
+
+		return 0;
 	}
 
 	/* Find out if we have loaded more or less than we needed */
-	off_t loaded_length = impl->page_size - (offset - impl->page_offset);
+	off_t loaded_length = win->size - (offset - win->offset);
 	if (loaded_length > len)
 		*length = len;
 	else
 		*length = loaded_length;
 
-	*buf = (unsigned char *)impl->page_data + offset - impl->page_offset;
+	*buf = (unsigned char *)win->data + (offset - win->offset);
 
 	return 0;
 }
@@ -288,13 +1104,23 @@ static int data_object_file_free(data_object_t *obj)
 	struct data_object_file_impl *impl =
 		data_object_get_impl(obj);
 
-	/* If we have mapped data, unmap them */
-	if (impl->page_data != NULL) {
-		int err = munmap(impl->page_data, impl->page_size);
-		if (err == -1)
-			return_error(errno);
+	/* If we have cached or mapped data, release them */
+	if (impl->pread != NULL) {
+		int err = pread_cache_free(impl->pread);
+		if (err)
+			return_error(err);
 	}
 
+	int err = data_object_file_set_whole_mapping(obj, 0);
+	if (err)
+		return_error(err);
+
+	err = unmap_windows(impl);
+	if (err)
+		return_error(err);
+
+	free(impl->windows);
+
 	/* Free the data (close the file) */
     data_object_file_close_func *file_close = impl->file_close;
 
@@ -310,11 +1136,46 @@ static int data_object_file_free(data_object_t *obj)
 		free(impl->path);
 	}
 
+	if (impl->index != NULL)
+		file_index_unref(impl->index);
+
+	pthread_mutex_destroy(&impl->index_mutex);
+
 	free(impl);
 
 	return 0;
 }
 
+static int data_object_file_unpin(data_object_t *obj)
+{
+	if (obj == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	if (impl->pins <= 0)
+		return_error(EINVAL);
+
+	impl->pins--;
+
+	return 0;
+}
+
+static int data_object_file_can_pin(data_object_t *obj, int *can_pin)
+{
+	if (obj == NULL || can_pin == NULL)
+		return_error(EINVAL);
+
+	struct data_object_file_impl *impl =
+		data_object_get_impl(obj);
+
+	/* Only data of a whole mapped file remain valid after other accesses */
+	*can_pin = impl->pread == NULL && impl->file_data != NULL;
+
+	return 0;
+}
+
 static int data_object_file_get_size(data_object_t *obj, off_t *size)
 {
 	if (obj == NULL || size == NULL)
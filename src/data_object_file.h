@@ -30,8 +30,11 @@ extern "C" {
 #endif
 
 #include "data_object.h"
+#include "buffer.h"
 #include <sys/types.h>
 
+struct file_index;
+
 /**
  * @addtogroup data_object
  * @{
@@ -42,6 +45,20 @@ extern "C" {
  */
 typedef int (data_object_file_close_func)(int fd);
 
+/**
+ * The backends used to access the data of a file data_object_t.
+ */
+typedef enum {
+	DATA_OBJECT_FILE_MMAP, /**< Map the file in memory */
+	DATA_OBJECT_FILE_PREAD /**< Read the file with pread() */
+} data_object_file_backend;
+
+/** The default size of the mapped windows of a file data_object_t */
+#define DATA_OBJECT_FILE_WINDOW_SIZE (4 * 1024 * 1024)
+
+/** The default number of mapped windows of a file data_object_t */
+#define DATA_OBJECT_FILE_WINDOWS 4
+
 /**
  * @name Constructors
  * @{
@@ -54,6 +71,55 @@ int data_object_tempfile_new(data_object_t **obj, int fd, char *path);
 int data_object_file_set_close_func(data_object_t *obj,
         data_object_file_close_func *file_close);
 
+int data_object_file_new_view(data_object_t **view, data_object_t *obj);
+
+/** @} */
+
+/**
+ * @name Mapping
+ * @{
+ */
+
+int data_object_file_set_window_cache(data_object_t *obj, size_t window_size,
+		int nwindows);
+
+int data_object_file_get_window_cache(data_object_t *obj, size_t *window_size,
+		int *nwindows);
+
+int data_object_file_set_whole_mapping(data_object_t *obj, int enable);
+
+int data_object_file_get_whole_mapping(data_object_t *obj, int *enabled);
+
+int data_object_file_set_backend(data_object_t *obj,
+		data_object_file_backend backend);
+
+int data_object_file_get_backend(data_object_t *obj,
+		data_object_file_backend *backend);
+
+int data_object_is_file(data_object_t *obj, int *is_file);
+
+int data_object_file_get_fd(data_object_t *obj, int *fd);
+
+int data_object_file_get_id(data_object_t *obj, dev_t *dev, ino_t *ino);
+
+/** @} */
+
+/**
+ * @name Search index
+ * @{
+ */
+
+int data_object_file_build_index(data_object_t *obj,
+		bless_progress_func *progress_func);
+
+int data_object_file_load_index(data_object_t *obj, int index_fd);
+
+int data_object_file_save_index(data_object_t *obj, int index_fd);
+
+int data_object_file_set_index(data_object_t *obj, struct file_index *index);
+
+int data_object_file_get_index(data_object_t *obj, struct file_index **index);
+
 /** @} */
 /** @} */
 
@@ -0,0 +1,676 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file data_object_file_index.c
+ *
+ * Implementation of the n-gram search index of file data objects.
+ *
+ * The file is split in blocks of FILE_INDEX_BLOCK_SIZE bytes and for each
+ * block the index holds a bitmap of the (hashed) n-grams that lie completely
+ * in the block. A match of a pattern that lies completely in a block can only
+ * exist if all the n-grams of the pattern are in the bitmap of the block, so
+ * searches can skip the blocks that miss any of them. Matches that straddle
+ * block boundaries are never ruled out.
+ *
+ * The index can be saved to and loaded from a file. Saved indexes record the
+ * size and modification time of the indexed file, so that stale indexes are
+ * detected.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "data_object_file_index.h"
+#include "type_limits.h"
+#include "debug.h"
+
+/** The number of 64-bit words of the bitmap of each block */
+#define FILE_INDEX_BLOCK_WORDS ((1 << FILE_INDEX_HASH_BITS) / 64)
+
+/** The amount of data read at a time when building an index */
+#define FILE_INDEX_READ_SIZE (16 * FILE_INDEX_BLOCK_SIZE)
+
+/** The magic string at the start of saved indexes */
+#define FILE_INDEX_MAGIC "BLSINDEX"
+
+/** The version of the format of saved indexes */
+#define FILE_INDEX_VERSION 1
+
+/**
+ * An n-gram index of the contents of a file.
+ */
+struct file_index {
+	/* The size and modification time of the indexed file */
+	off_t size;
+	time_t mtime;
+
+	/* The n-gram bitmaps of the blocks of the file */
+	uint64_t *bitmaps;
+	off_t nblocks;
+
+	/* Indexes are shared between data objects and searches */
+	pthread_mutex_t mutex;
+	int refs;
+};
+
+/**
+ * The header of a saved index.
+ */
+struct file_index_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t version;
+	uint32_t gram_length;
+	uint32_t hash_bits;
+	uint32_t block_size;
+	uint32_t reserved;
+	int64_t file_size;
+	int64_t mtime;
+	uint64_t nblocks;
+};
+
+/********************
+ * Helper functions *
+ ********************/
+
+/**
+ * Hashes an n-gram.
+ *
+ * @param gram the n-gram (the bytes in the low FILE_INDEX_GRAM_LENGTH bytes)
+ *
+ * @return the hash of the n-gram
+ */
+static inline uint32_t gram_hash(uint32_t gram)
+{
+	return (gram * 2654435761U) >> (32 - FILE_INDEX_HASH_BITS);
+}
+
+/**
+ * Creates a new empty file_index.
+ *
+ * @param[out] index the created file_index
+ * @param size the size of the indexed file
+ * @param mtime the modification time of the indexed file
+ *
+ * @return the operation error code
+ */
+static int file_index_new(struct file_index **index, off_t size, time_t mtime)
+{
+	off_t nblocks = (size + FILE_INDEX_BLOCK_SIZE - 1) / FILE_INDEX_BLOCK_SIZE;
+
+	if ((uintmax_t)nblocks > __MAX(size_t) / (FILE_INDEX_BLOCK_WORDS * 8))
+		return_error(EOVERFLOW);
+
+	struct file_index *idx = malloc(sizeof(struct file_index));
+	if (idx == NULL)
+		return_error(ENOMEM);
+
+	idx->bitmaps = calloc(nblocks * FILE_INDEX_BLOCK_WORDS + 1,
+			sizeof(uint64_t));
+	if (idx->bitmaps == NULL) {
+		free(idx);
+		return_error(ENOMEM);
+	}
+
+	int err = pthread_mutex_init(&idx->mutex, NULL);
+	if (err) {
+		free(idx->bitmaps);
+		free(idx);
+		return_error(err);
+	}
+
+	idx->size = size;
+	idx->mtime = mtime;
+	idx->nblocks = nblocks;
+	idx->refs = 1;
+
+	*index = idx;
+
+	return 0;
+}
+
+/**
+ * Adds the n-grams of a block to a file_index.
+ *
+ * @param index the file_index
+ * @param block the block
+ * @param data the data of the block
+ * @param len the length of the data
+ */
+static void index_block(struct file_index *index, off_t block,
+		const unsigned char *data, size_t len)
+{
+	uint64_t *bitmap = index->bitmaps + block * FILE_INDEX_BLOCK_WORDS;
+
+	if (len < FILE_INDEX_GRAM_LENGTH)
+		return;
+
+	uint32_t gram = data[0] | (data[1] << 8);
+	size_t i;
+
+	for (i = FILE_INDEX_GRAM_LENGTH - 1; i < len; i++) {
+		gram = (gram | ((uint32_t)data[i] << 16)) & 0xffffff;
+
+		uint32_t h = gram_hash(gram);
+		bitmap[h / 64] |= (uint64_t)1 << (h % 64);
+
+		gram >>= 8;
+	}
+}
+
+/**
+ * Checks whether a block of a file_index may contain a pattern.
+ *
+ * @param index the file_index
+ * @param query the file_index_query of the pattern
+ * @param block the block
+ *
+ * @return 1 if the block may contain the pattern, 0 otherwise
+ */
+static int block_may_match(struct file_index *index,
+		struct file_index_query *query, off_t block)
+{
+	uint64_t *bitmap = index->bitmaps + block * FILE_INDEX_BLOCK_WORDS;
+	size_t i;
+
+	for (i = 0; i < query->nhashes; i++) {
+		uint32_t h = query->hashes[i];
+		if (!(bitmap[h / 64] & ((uint64_t)1 << (h % 64))))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Reads exactly a number of bytes from a file.
+ *
+ * @param fd the file to read from
+ * @param buf the buffer to read into
+ * @param size the number of bytes to read
+ *
+ * @return the operation error code (EINVAL if the file ends too early)
+ */
+static int read_all(int fd, void *buf, size_t size)
+{
+	size_t nread = 0;
+
+	while (nread < size) {
+		ssize_t n = read(fd, (unsigned char *)buf + nread, size - nread);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n == -1)
+			return_error(errno);
+
+		if (n == 0)
+			return_error(EINVAL);
+
+		nread += n;
+	}
+
+	return 0;
+}
+
+/**
+ * Writes exactly a number of bytes to a file.
+ *
+ * @param fd the file to write to
+ * @param buf the data to write
+ * @param size the number of bytes to write
+ *
+ * @return the operation error code
+ */
+static int write_all(int fd, const void *buf, size_t size)
+{
+	size_t nwritten = 0;
+
+	while (nwritten < size) {
+		ssize_t n = write(fd, (const unsigned char *)buf + nwritten,
+				size - nwritten);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n == -1)
+			return_error(errno);
+
+		nwritten += n;
+	}
+
+	return 0;
+}
+
+/*****************
+ * API functions *
+ *****************/
+
+/**
+ * Builds the n-gram index of a file.
+ *
+ * The file is read with pread(), so its file offset is not used and the
+ * index can be built in a separate thread.
+ *
+ * The progress is reported with a struct bless_buffer_find_progress_info,
+ * whose searched field holds the number of bytes indexed so far.
+ *
+ * @param[out] index the created file_index
+ * @param fd the file to index
+ * @param size the size of the file
+ * @param progress_func the bless_progress_func to call to report the
+ *                      progress of the operation (may be NULL)
+ *
+ * @return the operation error code (ECANCELED if the operation was cancelled)
+ */
+int file_index_build(struct file_index **index, int fd, off_t size,
+		bless_progress_func *progress_func)
+{
+	if (index == NULL || size < 0)
+		return_error(EINVAL);
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return_error(errno);
+
+	struct file_index *idx;
+	int err = file_index_new(&idx, size, st.st_mtime);
+	if (err)
+		return_error(err);
+
+	unsigned char *data = malloc(FILE_INDEX_READ_SIZE);
+	if (data == NULL) {
+		err = ENOMEM;
+		goto_error(err, on_error);
+	}
+
+	struct bless_buffer_find_progress_info progress;
+	progress.searched = 0;
+	progress.total = size;
+
+	off_t offset = 0;
+
+	while (offset < size) {
+		size_t len = FILE_INDEX_READ_SIZE;
+		if (size - offset < (off_t)len)
+			len = size - offset;
+
+		size_t nread = 0;
+
+		while (nread < len) {
+			ssize_t n = pread(fd, data + nread, len - nread, offset + nread);
+
+			if (n == -1 && errno == EINTR)
+				continue;
+
+			if (n == -1) {
+				err = errno;
+				goto_error(err, on_error_data);
+			}
+
+			/* The file was truncated after we got its size */
+			if (n == 0) {
+				err = EIO;
+				goto_error(err, on_error_data);
+			}
+
+			nread += n;
+		}
+
+		/* Index the blocks read (offset is a multiple of the block size) */
+		size_t i;
+		for (i = 0; i < len; i += FILE_INDEX_BLOCK_SIZE) {
+			size_t block_len = FILE_INDEX_BLOCK_SIZE;
+			if (len - i < block_len)
+				block_len = len - i;
+
+			index_block(idx, (offset + i) / FILE_INDEX_BLOCK_SIZE, data + i,
+					block_len);
+		}
+
+		offset += len;
+
+		progress.searched = offset;
+
+		if (progress_func != NULL && (*progress_func)(&progress)) {
+			err = ECANCELED;
+			goto_error(err, on_error_data);
+		}
+	}
+
+	free(data);
+
+	*index = idx;
+
+	return 0;
+
+on_error_data:
+	free(data);
+on_error:
+	file_index_unref(idx);
+	return err;
+}
+
+/**
+ * Loads an n-gram index saved with file_index_save().
+ *
+ * The index is read from the current offset of index_fd.
+ *
+ * @param[out] index the loaded file_index
+ * @param index_fd the file to load the index from
+ * @param fd the indexed file
+ * @param size the size of the indexed file
+ *
+ * @return the operation error code (EINVAL if the index is invalid, ESTALE
+ *         if it doesn't match the current contents of fd)
+ */
+int file_index_load(struct file_index **index, int index_fd, int fd,
+		off_t size)
+{
+	if (index == NULL)
+		return_error(EINVAL);
+
+	struct file_index_header hdr;
+	int err = read_all(index_fd, &hdr, sizeof(hdr));
+	if (err)
+		return_error(err);
+
+	if (memcmp(hdr.magic, FILE_INDEX_MAGIC, sizeof(hdr.magic))
+			|| hdr.byte_order != 0x01020304
+			|| hdr.version != FILE_INDEX_VERSION
+			|| hdr.gram_length != FILE_INDEX_GRAM_LENGTH
+			|| hdr.hash_bits != FILE_INDEX_HASH_BITS
+			|| hdr.block_size != FILE_INDEX_BLOCK_SIZE)
+		return_error(EINVAL);
+
+	/* Check the size before allocating memory for the bitmaps */
+	if (hdr.file_size != size)
+		return_error(ESTALE);
+
+	struct file_index *idx;
+	err = file_index_new(&idx, hdr.file_size, hdr.mtime);
+	if (err)
+		return_error(err);
+
+	if ((uint64_t)idx->nblocks != hdr.nblocks) {
+		err = EINVAL;
+		goto_error(err, on_error);
+	}
+
+	err = read_all(index_fd, idx->bitmaps,
+			idx->nblocks * FILE_INDEX_BLOCK_WORDS * sizeof(uint64_t));
+	if (err)
+		goto_error(err, on_error);
+
+	int current;
+	err = file_index_is_current(idx, fd, size, &current);
+	if (err)
+		goto_error(err, on_error);
+
+	if (!current) {
+		err = ESTALE;
+		goto_error(err, on_error);
+	}
+
+	*index = idx;
+
+	return 0;
+
+on_error:
+	file_index_unref(idx);
+	return err;
+}
+
+/**
+ * Saves an n-gram index to a file.
+ *
+ * The index is written at the current offset of index_fd.
+ *
+ * @param index the file_index to save
+ * @param index_fd the file to save the index to
+ *
+ * @return the operation error code
+ */
+int file_index_save(struct file_index *index, int index_fd)
+{
+	if (index == NULL)
+		return_error(EINVAL);
+
+	struct file_index_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, FILE_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = 0x01020304;
+	hdr.version = FILE_INDEX_VERSION;
+	hdr.gram_length = FILE_INDEX_GRAM_LENGTH;
+	hdr.hash_bits = FILE_INDEX_HASH_BITS;
+	hdr.block_size = FILE_INDEX_BLOCK_SIZE;
+	hdr.file_size = index->size;
+	hdr.mtime = index->mtime;
+	hdr.nblocks = index->nblocks;
+
+	int err = write_all(index_fd, &hdr, sizeof(hdr));
+	if (err)
+		return_error(err);
+
+	err = write_all(index_fd, index->bitmaps,
+			index->nblocks * FILE_INDEX_BLOCK_WORDS * sizeof(uint64_t));
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/**
+ * Increases the reference count of a file_index.
+ *
+ * @param index the file_index
+ *
+ * @return the operation error code
+ */
+int file_index_ref(struct file_index *index)
+{
+	if (index == NULL)
+		return_error(EINVAL);
+
+	pthread_mutex_lock(&index->mutex);
+	index->refs++;
+	pthread_mutex_unlock(&index->mutex);
+
+	return 0;
+}
+
+/**
+ * Decreases the reference count of a file_index, freeing it when it drops
+ * to zero.
+ *
+ * @param index the file_index
+ *
+ * @return the operation error code
+ */
+int file_index_unref(struct file_index *index)
+{
+	if (index == NULL)
+		return_error(EINVAL);
+
+	pthread_mutex_lock(&index->mutex);
+	int refs = --index->refs;
+	pthread_mutex_unlock(&index->mutex);
+
+	if (refs == 0) {
+		pthread_mutex_destroy(&index->mutex);
+		free(index->bitmaps);
+		free(index);
+	}
+
+	return 0;
+}
+
+/**
+ * Checks whether an n-gram index matches the current contents of a file.
+ *
+ * The size and modification time of the file are compared with the ones
+ * recorded when the index was built.
+ *
+ * @param index the file_index
+ * @param fd the indexed file
+ * @param size the size of the indexed file
+ * @param[out] current 1 if the index is current, 0 otherwise
+ *
+ * @return the operation error code
+ */
+int file_index_is_current(struct file_index *index, int fd, off_t size,
+		int *current)
+{
+	if (index == NULL || current == NULL)
+		return_error(EINVAL);
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return_error(errno);
+
+	*current = index->size == size && index->mtime == st.st_mtime
+		&& (!S_ISREG(st.st_mode) || st.st_size == size);
+
+	return 0;
+}
+
+/**
+ * Initializes a file_index_query for a pattern.
+ *
+ * Patterns shorter than FILE_INDEX_GRAM_LENGTH have no n-grams and can't be
+ * looked up (query->nhashes is 0).
+ *
+ * @param query the file_index_query to initialize
+ * @param pattern the pattern
+ * @param length the length of the pattern
+ *
+ * @return the operation error code
+ */
+int file_index_query_init(struct file_index_query *query,
+		const unsigned char *pattern, size_t length)
+{
+	if (query == NULL || pattern == NULL)
+		return_error(EINVAL);
+
+	query->nhashes = 0;
+	query->length = length;
+
+	size_t i;
+	for (i = 0; i + FILE_INDEX_GRAM_LENGTH <= length; i++) {
+		uint32_t gram = pattern[i] | (pattern[i + 1] << 8)
+			| ((uint32_t)pattern[i + 2] << 16);
+		uint32_t h = gram_hash(gram);
+
+		/* Look up each hash once */
+		size_t j;
+		for (j = 0; j < query->nhashes; j++) {
+			if (query->hashes[j] == h)
+				break;
+		}
+
+		if (j == query->nhashes) {
+			query->hashes[query->nhashes++] = h;
+			if (query->nhashes == FILE_INDEX_QUERY_MAX)
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Finds the next range of a file where matches of a pattern may start.
+ *
+ * Only the matches that lie completely in [offset, end) are considered.
+ * Upon return, no match starts in [offset, cand_start) and matches may start
+ * anywhere in [cand_start, cand_end). If no match can start in the rest of
+ * the range, cand_start and cand_end are set to the first offset at which a
+ * match would extend past end.
+ *
+ * @param index the file_index of the file
+ * @param query the file_index_query of the pattern
+ * @param offset the start of the range
+ * @param end the end of the range
+ * @param[out] cand_start the start of the candidate range
+ * @param[out] cand_end the end of the candidate range
+ *
+ * @return the operation error code
+ */
+int file_index_find_candidates(struct file_index *index,
+		struct file_index_query *query, off_t offset, off_t end,
+		off_t *cand_start, off_t *cand_end)
+{
+	if (index == NULL || query == NULL || cand_start == NULL
+			|| cand_end == NULL || offset < 0 || end > index->size)
+		return_error(EINVAL);
+
+	off_t length = query->length;
+
+	/* The first offset at which a match would extend past end */
+	off_t last = end - length + 1;
+	if (last < offset)
+		last = offset;
+
+	/* Skip the blocks that can't contain a match */
+	off_t pos = offset;
+
+	while (pos < last) {
+		off_t block = pos / FILE_INDEX_BLOCK_SIZE;
+		off_t block_end = (block + 1) * FILE_INDEX_BLOCK_SIZE;
+		if (block_end > index->size)
+			block_end = index->size;
+
+		/* Matches straddling the block boundary are always candidates */
+		if (pos + length > block_end || block_may_match(index, query, block))
+			break;
+
+		pos = block_end - length + 1;
+	}
+
+	if (pos > last)
+		pos = last;
+
+	*cand_start = pos;
+
+	/* Extend the candidate range up to the next block that can be skipped */
+	while (pos < last) {
+		off_t block = pos / FILE_INDEX_BLOCK_SIZE;
+		off_t block_end = (block + 1) * FILE_INDEX_BLOCK_SIZE;
+		if (block_end > index->size)
+			block_end = index->size;
+
+		if (pos + length <= block_end && !block_may_match(index, query, block))
+			break;
+
+		pos = block_end;
+	}
+
+	if (pos > last)
+		pos = last;
+
+	*cand_end = pos;
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file data_object_file_index.h
+ *
+ * Definitions for the n-gram search index of file data objects.
+ */
+#ifndef _DATA_OBJECT_FILE_INDEX_H
+#define _DATA_OBJECT_FILE_INDEX_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "buffer.h"
+
+/** The length of the n-grams that are indexed */
+#define FILE_INDEX_GRAM_LENGTH 3
+
+/** The size of the blocks of the file that are indexed separately */
+#define FILE_INDEX_BLOCK_SIZE (64 * 1024)
+
+/** The number of bits of the n-gram hashes (log2 of the bits per block) */
+#define FILE_INDEX_HASH_BITS 15
+
+/** The maximum number of n-gram hashes of a pattern that are looked up */
+#define FILE_INDEX_QUERY_MAX 32
+
+/**
+ * An n-gram index of the contents of a file.
+ */
+struct file_index;
+
+/**
+ * The n-grams of a pattern to look up in file indexes.
+ */
+struct file_index_query {
+	uint32_t hashes[FILE_INDEX_QUERY_MAX];
+	size_t nhashes;
+	size_t length;
+};
+
+int file_index_build(struct file_index **index, int fd, off_t size,
+		bless_progress_func *progress_func);
+
+int file_index_load(struct file_index **index, int index_fd, int fd,
+		off_t size);
+
+int file_index_save(struct file_index *index, int index_fd);
+
+int file_index_ref(struct file_index *index);
+
+int file_index_unref(struct file_index *index);
+
+int file_index_is_current(struct file_index *index, int fd, off_t size,
+		int *current);
+
+int file_index_query_init(struct file_index_query *query,
+		const unsigned char *pattern, size_t length);
+
+int file_index_find_candidates(struct file_index *index,
+		struct file_index_query *query, off_t offset, off_t end,
+		off_t *cand_start, off_t *cand_end);
+
+#endif /* _DATA_OBJECT_FILE_INDEX_H */
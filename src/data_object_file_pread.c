@@ -0,0 +1,295 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file data_object_file_pread.c
+ *
+ * Implementation of the pread backend of the file data_object_t.
+ *
+ * The pread backend is used for files that can't be mapped in memory, or
+ * for which mapping is slow (eg some network file systems). The data are
+ * read with large pread() calls into a buffer and served from there.
+ *
+ * The amount of data read (the readahead) adapts to the access pattern:
+ * every time a miss occurs right after the previously accessed range the
+ * readahead is doubled (up to PREAD_CACHE_MAX_READAHEAD), whereas a miss at
+ * any other offset resets it to PREAD_CACHE_MIN_READAHEAD. Backward access
+ * (pread_cache_get_reverse()) is handled in the same way, but the data are
+ * read ahead towards the start of the file.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "data_object_file_pread.h"
+#include "type_limits.h"
+#include "debug.h"
+
+/**
+ * A cache of file data that is filled with pread() calls.
+ */
+struct pread_cache {
+	int fd;
+	off_t file_size;
+
+	/* The buffer and the range of the file it holds */
+	unsigned char *data;
+	size_t capacity;
+	off_t offset;
+	size_t length;
+
+	/* The last accessed range [prev_offset, next_offset), to detect
+	 * sequential (forward or backward) access */
+	off_t prev_offset;
+	off_t next_offset;
+	size_t readahead;
+};
+
+/**
+ * Creates a new pread_cache.
+ *
+ * @param[out] cache the created pread_cache
+ * @param fd the file to read from
+ * @param file_size the size of the file
+ *
+ * @return the operation error code
+ */
+int pread_cache_new(struct pread_cache **cache, int fd, off_t file_size)
+{
+	if (cache == NULL || file_size < 0)
+		return_error(EINVAL);
+
+	struct pread_cache *c = malloc(sizeof(struct pread_cache));
+	if (c == NULL)
+		return_error(ENOMEM);
+
+	c->fd = fd;
+	c->file_size = file_size;
+	c->data = NULL;
+	c->capacity = 0;
+	c->offset = 0;
+	c->length = 0;
+	c->prev_offset = -1;
+	c->next_offset = -1;
+	c->readahead = PREAD_CACHE_MIN_READAHEAD;
+
+	*cache = c;
+
+	return 0;
+}
+
+/**
+ * Frees a pread_cache.
+ *
+ * @param cache the pread_cache to free
+ *
+ * @return the operation error code
+ */
+int pread_cache_free(struct pread_cache *cache)
+{
+	if (cache == NULL)
+		return_error(EINVAL);
+
+	free(cache->data);
+	free(cache);
+
+	return 0;
+}
+
+/**
+ * Fills the cache with data starting at offset.
+ *
+ * @param cache the pread_cache
+ * @param offset the offset in the file to read from
+ * @param size the number of bytes to read
+ *
+ * @return the operation error code
+ */
+static int pread_cache_fill(struct pread_cache *cache, off_t offset,
+		size_t size)
+{
+	/* Make sure we have enough space (we never shrink the buffer) */
+	if (cache->capacity < size) {
+		unsigned char *data = realloc(cache->data, size);
+		if (data == NULL)
+			return_error(ENOMEM);
+
+		cache->data = data;
+		cache->capacity = size;
+	}
+
+	/* Invalidate the cache contents in case of error */
+	cache->length = 0;
+
+	size_t nread = 0;
+
+	while (nread < size) {
+		ssize_t n = pread(cache->fd, cache->data + nread, size - nread,
+				offset + nread);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n == -1)
+			return_error(errno);
+
+		/* The file was truncated after we got its size */
+		if (n == 0)
+			break;
+
+		nread += n;
+	}
+
+	if (nread == 0)
+		return_error(EIO);
+
+	cache->offset = offset;
+	cache->length = nread;
+
+	return 0;
+}
+
+/**
+ * Gets a pointer to file data from a pread_cache.
+ *
+ * The returned pointer is valid until the next call to pread_cache_get().
+ * Fewer bytes than requested may be returned; it is up to the caller to call
+ * the function again to get the rest.
+ *
+ * @param cache the pread_cache
+ * @param[out] buf the pointer to the data
+ * @param offset the offset in the file
+ * @param[in,out] length the requested length (in), the returned length (out)
+ *
+ * @return the operation error code
+ */
+int pread_cache_get(struct pread_cache *cache, void **buf, off_t offset,
+		off_t *length)
+{
+	if (cache == NULL || buf == NULL || length == NULL || offset < 0
+			|| offset >= cache->file_size)
+		return_error(EINVAL);
+
+	off_t len = *length;
+
+	/* If the data is not in the cache, read it... */
+	if (offset < cache->offset || offset - cache->offset >= (off_t)cache->length)
+	{
+		/* Grow the readahead for sequential access, reset it otherwise */
+		if (offset == cache->next_offset) {
+			if (cache->readahead <= PREAD_CACHE_MAX_READAHEAD / 2)
+				cache->readahead *= 2;
+		}
+		else
+			cache->readahead = PREAD_CACHE_MIN_READAHEAD;
+
+		/* Read at least the readahead, and the whole range if possible */
+		off_t size = cache->readahead;
+		if (len > size)
+			size = len < PREAD_CACHE_MAX_READAHEAD ?
+				len : PREAD_CACHE_MAX_READAHEAD;
+
+		if (cache->file_size - offset < size)
+			size = cache->file_size - offset;
+
+		int err = pread_cache_fill(cache, offset, size);
+		if (err)
+			return_error(err);
+	}
+
+	off_t avail = cache->length - (offset - cache->offset);
+	if (avail < len)
+		len = avail;
+
+	*buf = cache->data + (offset - cache->offset);
+	*length = len;
+
+	cache->prev_offset = offset;
+	cache->next_offset = offset + len;
+
+	return 0;
+}
+
+/**
+ * Gets a pointer to file data from a pread_cache, for backward access.
+ *
+ * This works like pread_cache_get(), but if fewer bytes than requested are
+ * returned, they are the bytes at the end of the requested range, and on
+ * misses the data before the range are read ahead.
+ *
+ * @param cache the pread_cache
+ * @param[out] buf the pointer to the data
+ * @param offset the offset in the file
+ * @param[in,out] length the requested length (in), the returned length (out)
+ *
+ * @return the operation error code
+ */
+int pread_cache_get_reverse(struct pread_cache *cache, void **buf,
+		off_t offset, off_t *length)
+{
+	if (cache == NULL || buf == NULL || length == NULL || offset < 0
+			|| *length <= 0 || cache->file_size - offset < *length)
+		return_error(EINVAL);
+
+	off_t end = offset + *length;
+
+	/* If the last byte is not in the cache, read it and the data before it */
+	if (end <= cache->offset || end - cache->offset > (off_t)cache->length)
+	{
+		/* Grow the readahead for sequential access, reset it otherwise */
+		if (end == cache->prev_offset) {
+			if (cache->readahead <= PREAD_CACHE_MAX_READAHEAD / 2)
+				cache->readahead *= 2;
+		}
+		else
+			cache->readahead = PREAD_CACHE_MIN_READAHEAD;
+
+		/* Read at least the readahead, and the whole range if possible */
+		off_t size = cache->readahead;
+		if (*length > size)
+			size = *length < PREAD_CACHE_MAX_READAHEAD ?
+				*length : PREAD_CACHE_MAX_READAHEAD;
+
+		if (end < size)
+			size = end;
+
+		int err = pread_cache_fill(cache, end - size, size);
+		if (err)
+			return_error(err);
+
+		/* The file was truncated after we got its size */
+		if (cache->length < (size_t)size)
+			return_error(EIO);
+	}
+
+	off_t start = offset;
+	if (start < cache->offset)
+		start = cache->offset;
+
+	*buf = cache->data + (start - cache->offset);
+	*length = end - start;
+
+	cache->prev_offset = start;
+	cache->next_offset = end;
+
+	return 0;
+}
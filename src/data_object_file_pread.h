@@ -0,0 +1,52 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file data_object_file_pread.h
+ *
+ * Definitions for the pread backend of the file data_object_t.
+ */
+#ifndef _DATA_OBJECT_FILE_PREAD_H
+#define _DATA_OBJECT_FILE_PREAD_H
+
+#include <sys/types.h>
+
+/** The initial (and minimum) readahead of a pread_cache */
+#define PREAD_CACHE_MIN_READAHEAD (64 * 1024)
+
+/** The maximum readahead of a pread_cache */
+#define PREAD_CACHE_MAX_READAHEAD (8 * 1024 * 1024)
+
+/**
+ * A cache of file data that is filled with pread() calls.
+ */
+struct pread_cache;
+
+int pread_cache_new(struct pread_cache **cache, int fd, off_t file_size);
+
+int pread_cache_free(struct pread_cache *cache);
+
+int pread_cache_get(struct pread_cache *cache, void **buf, off_t offset,
+		off_t *length);
+
+int pread_cache_get_reverse(struct pread_cache *cache, void **buf,
+		off_t offset, off_t *length);
+
+#endif /* _DATA_OBJECT_FILE_PREAD_H */
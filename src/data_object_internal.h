@@ -41,6 +41,8 @@ struct data_object_funcs {
 	int (*free)(data_object_t *obj);
 	int (*get_size)(data_object_t *obj, off_t *size);
 	int (*compare)(int *result, data_object_t *obj1, data_object_t *obj2);
+	int (*unpin)(data_object_t *obj);
+	int (*can_pin)(data_object_t *obj, int *can_pin);
 };
 
 int data_object_create_impl(data_object_t **obj, void *impl,
@@ -48,6 +50,8 @@ int data_object_create_impl(data_object_t **obj, void *impl,
 
 void *data_object_get_impl(data_object_t *obj);
 
+struct data_object_funcs *data_object_get_funcs(data_object_t *obj);
+
 #ifdef __cplusplus
 }
 #endif
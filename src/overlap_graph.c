@@ -27,6 +27,7 @@
 #include "priority_queue.h"
 #include "list.h"
 #include "debug.h"
+#include "type_limits.h"
 
 #include <errno.h>
 #include <sys/types.h>
@@ -66,9 +67,41 @@ struct overlap_graph {
 	struct vertex *vertices; /**< the vertices of the graph */
 	size_t capacity; /**< the vertex capacity of the graph */
 	size_t size; /**< the actual number of vertices in the graph */
+	size_t linked; /**< the number of vertices whose edges have been added */
 	struct edge tail; /**< a tail edge used in edge lists */
 };
 
+/**
+ * An event of the sweep that finds the overlapping ranges.
+ */
+struct sweep_event {
+	off_t pos; /**< the position of the event */
+	int start; /**< whether a range starts (1) or ends (0) at pos */
+	int buffer; /**< whether the range is in the buffer (1) or the file (0) */
+	size_t id; /**< the vertex the range belongs to */
+};
+
+/**
+ * The state of a vertex while removing cycles with
+ * overlap_graph_remove_cycles_greedy().
+ */
+struct fas_vertex {
+	size_t index; /**< the discovery index of the vertex (Tarjan) */
+	size_t low; /**< the lowest index reachable from the vertex (Tarjan) */
+	size_t comp; /**< the strongly connected component of the vertex */
+	int on_stack; /**< whether the vertex is on the component stack */
+	struct edge *next_edge; /**< the next outgoing edge to follow */
+	struct edge **in_edges; /**< the incoming edges inside the component */
+	size_t nin_edges; /**< the number of incoming edges inside the component */
+	size_t in; /**< the number of incoming edges from unplaced vertices */
+	size_t out; /**< the number of outgoing edges to unplaced vertices */
+	off_t delta; /**< the weight of the out edges minus that of the in edges */
+	int placed; /**< whether the vertex has been placed in the sequence */
+	int in_pq; /**< whether the vertex is in the priority queue */
+	size_t pq_pos; /**< the position of the vertex in the priority queue */
+	size_t order; /**< the position of the vertex in the sequence */
+};
+
 /********************/
 /* Helper functions */
 /********************/
@@ -111,6 +144,37 @@ static off_t calculate_overlap(off_t start1, off_t size1, off_t start2,
 	return overlap;
 }
 
+/** 
+ * Inserts a new edge in the edge list of its source vertex.
+ *
+ * The weight of the edge is not set.
+ * 
+ * @param g the overlap graph 
+ * @param prev the edge of the list to insert the new edge after
+ * @param src_id the id of the source of the edge
+ * @param dst_id the id of the destination of the edges 
+ * 
+ * @return the operation error code
+ */
+static int overlap_graph_insert_edge(overlap_graph_t *g, struct edge *prev,
+		size_t src_id, size_t dst_id)
+{
+	struct edge *edst = malloc (sizeof *edst);
+	if (edst == NULL)
+		return_error(ENOMEM);
+
+	g->vertices[dst_id].in_degree += 1;
+
+	edst->src_id = src_id;
+	edst->dst_id = dst_id;
+	edst->removed = 0;
+
+	edst->next = prev->next;
+	prev->next = edst;
+
+	return 0;
+}
+
 /** 
  * Adds an edge to the overlap graph. 
  * 
@@ -136,22 +200,92 @@ static int overlap_graph_add_edge(overlap_graph_t *g, size_t src_id, size_t dst_
 
 	/* if we didn't find an edge from src to dst, add it */
 	if (e->next == &g->tail) {
-		struct edge *edst = malloc (sizeof *edst);
-		if (edst == NULL)
+		int err = overlap_graph_insert_edge(g, e, src_id, dst_id);
+		if (err)
+			return_error(err);
+	}
+
+	/* Update weight */
+	e->next->weight = weight;
+
+	return 0;
+}
+
+/** 
+ * Compares two sweep events by position.
+ *
+ * At the same position the ends of ranges come before the starts, because
+ * the ranges are half-open.
+ */
+static int compare_sweep_events(const void *a, const void *b)
+{
+	const struct sweep_event *e1 = a;
+	const struct sweep_event *e2 = b;
+
+	if (e1->pos != e2->pos)
+		return e1->pos < e2->pos ? -1 : 1;
+
+	if (e1->start != e2->start)
+		return e1->start - e2->start;
+
+	if (e1->buffer != e2->buffer)
+		return e1->buffer - e2->buffer;
+
+	return (e1->id > e2->id) - (e1->id < e2->id);
+}
+
+/** 
+ * Adds a vertex for a segment to an overlap graph, without adding its
+ * edges.
+ * 
+ * @param g the overlap graph to add the segment to 
+ * @param seg the segment to add
+ * @param mapping the mapping of the segment in its buffer
+ * 
+ * @return the operation error code 
+ */
+static int overlap_graph_add_vertex(overlap_graph_t *g, segment_t *seg,
+		off_t mapping)
+{
+	/* Check if we have enough memory */
+	if (g->size >= g->capacity) {
+		size_t new_capacity = ((5 * g->capacity) / 4) + 1;
+		struct vertex *t = realloc(g->vertices, new_capacity * sizeof *t);
+		if (t == NULL)
 			return_error(ENOMEM);
 
-		g->vertices[dst_id].in_degree += 1;
+		g->vertices = t;
+		g->capacity = new_capacity;
+	}
+
+	struct vertex *v = &g->vertices[g->size];
 
-		edst->src_id = src_id;
-		edst->dst_id = dst_id;
-		edst->removed = 0;
+	int err = segment_copy(seg, &v->segment);
+	if (err)
+		return_error(err);
 
-		edst->next = e->next;
-		e->next = edst;
+	v->mapping = mapping;
+	v->self_loop_weight = 0;
+	v->in_degree = 0;
+	v->out_degree = 0;
+	v->visited = 0;
+	v->head = malloc(sizeof *v->head);
+	if (v->head == NULL) {
+		segment_free(v->segment);
+		return_error(ENOMEM);
 	}
+	v->head->next = &g->tail;
 
-	/* Update weight */
-	e->next->weight = weight;
+	off_t seg_size;
+	segment_get_size(seg, &seg_size);
+	off_t seg_start;
+	segment_get_start(seg, &seg_start);
+
+	/* Check if segment overlaps with itself */
+	v->self_loop_weight = calculate_overlap(seg_start, seg_size, mapping,
+			seg_size);
+
+	g->size++;
 
 	return 0;
 }
@@ -208,6 +342,89 @@ static int topo_visit(overlap_graph_t *g, size_t n, list_t *list)
 	return 0;
 }
 
+/**
+ * Finds the strongly connected components of an overlap graph.
+ *
+ * This is Tarjan's algorithm, using explicit stacks instead of recursion so
+ * that graphs with many vertices can't overflow the call stack. Only edges
+ * inside a strongly connected component can be part of a cycle.
+ *
+ * @param g the overlap graph
+ * @param fv per-vertex state, whose comp field is set to the component
+ *           of each vertex
+ * @param stack scratch space for g->size vertex ids
+ * @param call_stack scratch space for g->size vertex ids
+ */
+static void find_strong_components(overlap_graph_t *g, struct fas_vertex *fv,
+		size_t *stack, size_t *call_stack)
+{
+	size_t unvisited = __MAX(size_t);
+	size_t counter = 0;
+	size_t ncomp = 0;
+	size_t sp = 0;
+	size_t csp = 0;
+
+	size_t i;
+	for (i = 0; i < g->size; i++) {
+		fv[i].index = unvisited;
+		fv[i].on_stack = 0;
+	}
+
+	for (i = 0; i < g->size; i++) {
+		if (fv[i].index != unvisited)
+			continue;
+
+		/* Visit the root */
+		fv[i].index = fv[i].low = counter++;
+		fv[i].next_edge = g->vertices[i].head->next;
+		fv[i].on_stack = 1;
+		stack[sp++] = i;
+		call_stack[csp++] = i;
+
+		while (csp > 0) {
+			size_t v = call_stack[csp - 1];
+			struct edge *e = fv[v].next_edge;
+
+			if (e != &g->tail) {
+				fv[v].next_edge = e->next;
+				size_t w = e->dst_id;
+
+				if (fv[w].index == unvisited) {
+					/* Descend into w */
+					fv[w].index = fv[w].low = counter++;
+					fv[w].next_edge = g->vertices[w].head->next;
+					fv[w].on_stack = 1;
+					stack[sp++] = w;
+					call_stack[csp++] = w;
+				}
+				else if (fv[w].on_stack && fv[w].index < fv[v].low)
+					fv[v].low = fv[w].index;
+
+				continue;
+			}
+
+			/* All the edges of v are done, return to its parent */
+			csp--;
+			if (csp > 0) {
+				size_t u = call_stack[csp - 1];
+				if (fv[v].low < fv[u].low)
+					fv[u].low = fv[v].low;
+			}
+
+			/* If v is the root of a component, pop the component */
+			if (fv[v].low == fv[v].index) {
+				size_t w;
+				do {
+					w = stack[--sp];
+					fv[w].on_stack = 0;
+					fv[w].comp = ncomp;
+				} while (w != v);
+				ncomp++;
+			}
+		}
+	}
+}
+
 /*****************/
 /* API functions */
 /*****************/
@@ -239,6 +456,7 @@ int overlap_graph_new(overlap_graph_t **g, size_t capacity)
 
 	p->capacity = capacity;
 	p->size = 0;
+	p->linked = 0;
 	p->tail.next = &p->tail;
 
 	*g = p;
@@ -294,36 +512,16 @@ int overlap_graph_add_segment(overlap_graph_t *g, segment_t *seg,
 	if (g == NULL || seg == NULL || mapping < 0)
 		return_error(EINVAL);
 
-	/* Check if we have enough memory */
-	if (g->size >= g->capacity) {
-		size_t new_capacity = ((5 * g->capacity) / 4) + 1;
-		struct vertex *t = realloc(g->vertices, new_capacity * sizeof *t);
-		if (t == NULL)
-			return_error(ENOMEM);
-
-		g->vertices = t;
-		g->capacity = new_capacity;
-	}
+	/* Add the edges of any deferred segments first */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
 
 	/* Add the new segment */
-	struct vertex *v = &g->vertices[g->size++];
-
-	int err = segment_copy(seg, &v->segment);
+	err = overlap_graph_add_vertex(g, seg, mapping);
 	if (err)
 		return_error(err);
 
-	v->mapping = mapping;
-	v->self_loop_weight = 0;
-	v->in_degree = 0;
-	v->out_degree = 0;
-	v->visited = 0;
-	v->head = malloc(sizeof *v->head);
-	if (v->head == NULL) {
-		segment_free(v->segment);
-		return_error(ENOMEM);
-	}
-	v->head->next = &g->tail;
-
 	off_t seg_size;
 	segment_get_size(seg, &seg_size);
 	off_t seg_start;
@@ -331,9 +529,9 @@ int overlap_graph_add_segment(overlap_graph_t *g, segment_t *seg,
 
 	/* 
 	 * Find all segments in the graph (excluding the new segment) that 
-	 * "overlap" with the new segment and add edges to them. We handle 
-	 * self-overlaps separately later because they are marked differently
-	 * in the graph (as information at the node, not as a separate edge).
+	 * "overlap" with the new segment and add edges to them. Self-overlaps
+	 * are handled separately because they are marked differently in the
+	 * graph (as information at the node, not as a separate edge).
 	 */
 	size_t i;
 	for (i = 0; i < g->size - 1; i++) {
@@ -356,13 +554,182 @@ int overlap_graph_add_segment(overlap_graph_t *g, segment_t *seg,
 			overlap_graph_add_edge(g, g->size - 1, i, overlap2);
 	}
 
-	/* Check if segment overlaps with itself */
-	v->self_loop_weight = calculate_overlap(seg_start, seg_size, mapping,
-			seg_size);
+	g->linked = g->size;
 
 	return 0;
 }
 
+/** 
+ * Adds a segment to an overlap graph without finding its overlaps.
+ *
+ * The edges of the segments added with this function are added by
+ * overlap_graph_update_edges(), which finds the overlaps of many segments
+ * at once much faster than overlap_graph_add_segment() does. It is called
+ * automatically by the functions that need the edges.
+ * 
+ * @param g the overlap graph to add the segment to 
+ * @param seg the segment to add
+ * @param mapping the mapping of the segment in its buffer
+ * 
+ * @return the operation error code 
+ */
+int overlap_graph_add_segment_deferred(overlap_graph_t *g, segment_t *seg,
+		off_t mapping)
+{
+	if (g == NULL || seg == NULL || mapping < 0)
+		return_error(EINVAL);
+
+	int err = overlap_graph_add_vertex(g, seg, mapping);
+	if (err)
+		return_error(err);
+
+	return 0;
+}
+
+/** 
+ * Adds the edges of the segments added with
+ * overlap_graph_add_segment_deferred().
+ *
+ * The ranges of the segments in the file and in the buffer are sorted and
+ * swept in order, keeping the ranges that contain the current position in
+ * two lists (one for the file ranges and one for the buffer ranges). When a
+ * range starts it overlaps exactly the ranges of the other kind in the
+ * lists, so only the overlapping pairs are visited and the edges are found
+ * in O(n log n + e) time (n vertices, e edges).
+ * 
+ * @param g the overlap graph
+ * 
+ * @return the operation error code 
+ */
+int overlap_graph_update_edges(overlap_graph_t *g)
+{
+	if (g == NULL)
+		return_error(EINVAL);
+
+	size_t first_new = g->linked;
+	size_t n = g->size;
+
+	if (first_new == n)
+		return 0;
+
+	int err = 0;
+
+	struct sweep_event *events = malloc(4 * n * sizeof(*events));
+	/*
+	 * The lists of the active file (0) and buffer (1) ranges, doubly linked
+	 * through the vertex ids, with n as the head.
+	 */
+	size_t *next[2] = { NULL, NULL };
+	size_t *prev[2] = { NULL, NULL };
+	int k;
+
+	for (k = 0; k < 2; k++) {
+		next[k] = malloc((n + 1) * sizeof(size_t));
+		prev[k] = malloc((n + 1) * sizeof(size_t));
+		if (next[k] == NULL || prev[k] == NULL)
+			break;
+
+		next[k][n] = n;
+		prev[k][n] = n;
+	}
+
+	if (events == NULL || k < 2) {
+		err = ENOMEM;
+		goto_error(err, out);
+	}
+
+	/* Create the events of the ranges (empty ranges overlap nothing) */
+	size_t nevents = 0;
+	size_t i;
+	for (i = 0; i < n; i++) {
+		struct vertex *v = &g->vertices[i];
+		off_t start;
+		segment_get_start(v->segment, &start);
+		off_t size;
+		segment_get_size(v->segment, &size);
+
+		if (size == 0)
+			continue;
+
+		for (k = 0; k < 2; k++) {
+			off_t range_start = k ? v->mapping : start;
+
+			events[nevents].pos = range_start;
+			events[nevents].start = 1;
+			events[nevents].buffer = k;
+			events[nevents].id = i;
+			nevents++;
+
+			events[nevents].pos = range_start + size;
+			events[nevents].start = 0;
+			events[nevents].buffer = k;
+			events[nevents].id = i;
+			nevents++;
+		}
+	}
+
+	qsort(events, nevents, sizeof(*events), compare_sweep_events);
+
+	for (i = 0; i < nevents; i++) {
+		struct sweep_event *ev = &events[i];
+		size_t id = ev->id;
+		k = ev->buffer;
+
+		if (!ev->start) {
+			next[k][prev[k][id]] = next[k][id];
+			prev[k][next[k][id]] = prev[k][id];
+			continue;
+		}
+
+		/* 
+		 * Edges go from the segments whose range in the file overlaps the
+		 * range of other segments in the buffer to those segments.
+		 */
+		size_t j;
+		for (j = next[!k][n]; j != n; j = next[!k][j]) {
+			size_t src_id = k ? j : id;
+			size_t dst_id = k ? id : j;
+
+			if (src_id == dst_id || (src_id < first_new && dst_id < first_new))
+				continue;
+
+			struct vertex *src = &g->vertices[src_id];
+			struct vertex *dst = &g->vertices[dst_id];
+
+			off_t src_start;
+			segment_get_start(src->segment, &src_start);
+			off_t src_size;
+			segment_get_size(src->segment, &src_size);
+			off_t dst_size;
+			segment_get_size(dst->segment, &dst_size);
+
+			err = overlap_graph_insert_edge(g, src->head, src_id, dst_id);
+			if (err)
+				goto_error(err, out);
+
+			src->out_degree += 1;
+			src->head->next->weight = calculate_overlap(src_start, src_size,
+					dst->mapping, dst_size);
+		}
+
+		/* Add the range to the active list */
+		next[k][id] = next[k][n];
+		prev[k][id] = n;
+		prev[k][next[k][n]] = id;
+		next[k][n] = id;
+	}
+
+	g->linked = n;
+
+out:
+	for (k = 0; k < 2; k++) {
+		free(next[k]);
+		free(prev[k]);
+	}
+	free(events);
+
+	return err;
+}
 
 /**
  * Removes cycles from the graph.
@@ -379,13 +746,18 @@ int overlap_graph_remove_cycles(overlap_graph_t *g)
 	if (g == NULL)
 		return_error(EINVAL);
 
+	/* Add the edges of any deferred segments */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
+
 	/* 
 	 * Create a disjoint-set to hold the vertices of the graph. This is used
 	 * below to efficiently check whether two nodes are connected. Initially
 	 * all nodes are disconnected.
 	 */
 	disjoint_set_t *ds = NULL;
-	int err = disjoint_set_new(&ds, g->size);
+	err = disjoint_set_new(&ds, g->size);
 	if (err)
 		return_error(err);
 
@@ -407,13 +779,18 @@ int overlap_graph_remove_cycles(overlap_graph_t *g)
 		while (e != &g->tail) {
 			/* mark all edges as not included in the graph */
 			e->removed = 1;
-			err = priority_queue_add(pq, e, e->weight, NULL);
+			err = priority_queue_add_deferred(pq, e, e->weight, NULL);
 			if (err)
 				goto_error(err, out);
 			e = e->next;
 		}
 	}
 
+	/* Build the heap of the edges at once */
+	err = priority_queue_heapify(pq);
+	if (err)
+		goto_error(err, out);
+
 	/* 
 	 * Process the edges in non-increasing order of weight using the priority 
 	 * queue (remember this a *maximum* spanning tree algorithm).
@@ -478,6 +855,274 @@ out:
 	return err;
 }
 
+/**
+ * Removes cycles from the graph, trying to minimize the total weight
+ * of the removed edges.
+ *
+ * This is a weighted version of the Eades-Lin-Smyth heuristic, applied to
+ * the edges inside each strongly connected component (the other edges can't
+ * be part of a cycle, so they are always kept). The vertices are arranged in
+ * a sequence by repeatedly moving sinks to the end of the sequence, sources to
+ * its start and, when there are neither, the vertex with the largest
+ * difference between the weights of its outgoing and incoming edges to its
+ * start. The edges that point backwards in the sequence are removed.
+ *
+ * Like overlap_graph_remove_cycles(), this algorithm doesn't change the graph
+ * apart from marking the edges as included or not in the graph.
+ *
+ * @param g the graph to remove the cycles of
+ *
+ * @return the operation error code
+ */
+int overlap_graph_remove_cycles_greedy(overlap_graph_t *g)
+{
+	if (g == NULL)
+		return_error(EINVAL);
+
+	/* Add the edges of any deferred segments */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
+
+	size_t n = g->size;
+	if (n == 0)
+		return 0;
+
+	struct fas_vertex *fv = NULL;
+	size_t *scratch = NULL;
+	struct edge **in_edges = NULL;
+	priority_queue_t *pq = NULL;
+
+	fv = malloc(n * sizeof *fv);
+	scratch = malloc(2 * n * sizeof *scratch);
+	if (fv == NULL || scratch == NULL) {
+		err = ENOMEM;
+		goto_error(err, out);
+	}
+
+	find_strong_components(g, fv, scratch, scratch + n);
+
+	/* 
+	 * Gather the edges inside components, counting the edges of each vertex
+	 * and the difference of the weights of its outgoing and incoming edges.
+	 */
+	size_t i;
+	for (i = 0; i < n; i++) {
+		fv[i].in = 0;
+		fv[i].out = 0;
+		fv[i].delta = 0;
+		fv[i].placed = 0;
+		fv[i].in_pq = 0;
+	}
+
+	size_t nedges = 0;
+	for (i = 0; i < n; i++) {
+		struct edge *e = g->vertices[i].head->next;
+		while (e != &g->tail) {
+			if (fv[e->dst_id].comp == fv[i].comp) {
+				fv[i].out++;
+				fv[i].delta += e->weight;
+				fv[e->dst_id].in++;
+				fv[e->dst_id].delta -= e->weight;
+				nedges++;
+			}
+			e = e->next;
+		}
+	}
+
+	/* Create the lists of incoming edges of the vertices */
+	in_edges = malloc((nedges + 1) * sizeof *in_edges);
+	if (in_edges == NULL) {
+		err = ENOMEM;
+		goto_error(err, out);
+	}
+
+	size_t first = 0;
+	for (i = 0; i < n; i++) {
+		fv[i].in_edges = in_edges + first;
+		fv[i].nin_edges = fv[i].in;
+		first += fv[i].in;
+		fv[i].in = 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct edge *e = g->vertices[i].head->next;
+		while (e != &g->tail) {
+			if (fv[e->dst_id].comp == fv[i].comp) {
+				struct fas_vertex *d = &fv[e->dst_id];
+				d->in_edges[d->in++] = e;
+			}
+			e = e->next;
+		}
+	}
+
+	/* 
+	 * Sinks and sources are kept in a work list, the rest of the vertices in
+	 * a priority queue keyed on their weight difference. Each vertex enters
+	 * the work list at most twice: initially or when it becomes a source
+	 * and when it becomes a sink.
+	 */
+	err = priority_queue_new(&pq, n);
+	if (err)
+		goto_error(err, out);
+
+	size_t *work = scratch;
+	size_t nwork = 0;
+
+	for (i = 0; i < n; i++) {
+		if (fv[i].in == 0 || fv[i].out == 0) {
+			work[nwork++] = i;
+		}
+		else {
+			err = priority_queue_add_deferred(pq, &fv[i], fv[i].delta,
+					&fv[i].pq_pos);
+			if (err)
+				goto_error(err, out);
+			fv[i].in_pq = 1;
+		}
+	}
+
+	err = priority_queue_heapify(pq);
+	if (err)
+		goto_error(err, out);
+
+	/* Arrange the vertices in a sequence */
+	size_t left = 0;
+	size_t right = n;
+	size_t placed = 0;
+
+	while (placed < n) {
+		size_t v;
+
+		if (nwork > 0) {
+			v = work[--nwork];
+			if (fv[v].placed)
+				continue;
+
+			if (fv[v].out == 0)
+				fv[v].order = --right;
+			else
+				fv[v].order = left++;
+		}
+		else {
+			struct fas_vertex *max;
+			err = priority_queue_remove_max(pq, (void **)&max);
+			if (err)
+				goto_error(err, out);
+
+			v = max - fv;
+			fv[v].in_pq = 0;
+			if (fv[v].placed)
+				continue;
+
+			fv[v].order = left++;
+		}
+
+		fv[v].placed = 1;
+		placed++;
+
+		/* Remove the edges of v from the rest of the component */
+		struct edge *e = g->vertices[v].head->next;
+		while (e != &g->tail) {
+			struct fas_vertex *w = &fv[e->dst_id];
+			if (w->comp == fv[v].comp && !w->placed) {
+				w->in--;
+				w->delta += e->weight;
+				if (w->in == 0)
+					work[nwork++] = e->dst_id;
+				else if (w->in_pq)
+					priority_queue_change_key(pq, w->pq_pos, w->delta);
+			}
+			e = e->next;
+		}
+
+		size_t k;
+		for (k = 0; k < fv[v].nin_edges; k++) {
+			e = fv[v].in_edges[k];
+			struct fas_vertex *u = &fv[e->src_id];
+			if (!u->placed) {
+				u->out--;
+				u->delta -= e->weight;
+				if (u->out == 0)
+					work[nwork++] = e->src_id;
+				else if (u->in_pq)
+					priority_queue_change_key(pq, u->pq_pos, u->delta);
+			}
+		}
+	}
+
+	/* 
+	 * Remove the edges inside components that point backwards in the
+	 * sequence and update the degrees to count only the remaining edges.
+	 */
+	for (i = 0; i < n; i++) {
+		g->vertices[i].in_degree = 0;
+		g->vertices[i].out_degree = 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct edge *e = g->vertices[i].head->next;
+		while (e != &g->tail) {
+			size_t d = e->dst_id;
+			if (fv[d].comp == fv[i].comp && fv[d].order < fv[i].order) {
+				e->removed = 1;
+			}
+			else {
+				e->removed = 0;
+				g->vertices[i].out_degree += 1;
+				g->vertices[d].in_degree += 1;
+			}
+			e = e->next;
+		}
+	}
+
+out:
+	if (pq != NULL) priority_queue_free(pq);
+	free(in_edges);
+	free(scratch);
+	free(fv);
+
+	return err;
+}
+
+/**
+ * Gets the total weight of the edges removed from the graph.
+ *
+ * This is the number of bytes that have to be copied out of the file
+ * to break the removed edges (see overlap_graph_get_removed_edges()).
+ *
+ * @param g the overlap graph
+ * @param[out] weight the total weight of the removed edges
+ *
+ * @return the operation error code
+ */
+int overlap_graph_get_removed_weight(overlap_graph_t *g, off_t *weight)
+{
+	if (g == NULL || weight == NULL)
+		return_error(EINVAL);
+
+	/* Add the edges of any deferred segments */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
+
+	off_t total = 0;
+
+	size_t i;
+	for (i = 0; i < g->size; i++) {
+		struct edge *e = g->vertices[i].head->next;
+		while (e != &g->tail) {
+			if (e->removed == 1)
+				total += e->weight;
+			e = e->next;
+		}
+	}
+
+	*weight = total;
+
+	return 0;
+}
+
 /**
  * Exports an overlap graph to the dot format.
  *
@@ -491,6 +1136,11 @@ int overlap_graph_export_dot(overlap_graph_t *g, int fd)
 	if (g == NULL)
 		return_error(EINVAL);
 
+	/* Add the edges of any deferred segments */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
+
 	FILE *fp = fdopen(fd, "w");
 	if (fp == NULL)
 		return_error(EINVAL);
@@ -546,7 +1196,12 @@ int overlap_graph_get_removed_edges(overlap_graph_t *g, list_t **edges)
 	if (g == NULL || edges == NULL)
 		return_error(EINVAL);
 
-	int err = list_new(edges, struct edge_entry, ln);
+	/* Add the edges of any deferred segments */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
+
+	err = list_new(edges, struct edge_entry, ln);
 	if (err)
 		return_error(err);
 
@@ -620,8 +1275,13 @@ int overlap_graph_get_vertices_topo(overlap_graph_t *g, list_t **vertices)
 	if (g == NULL || vertices == NULL)
 		return_error(EINVAL);
 
+	/* Add the edges of any deferred segments */
+	int err = overlap_graph_update_edges(g);
+	if (err)
+		return_error(err);
+
 	/* Create the list to hold the vertex entries */
-	int err = list_new(vertices, struct vertex_entry, ln);
+	err = list_new(vertices, struct vertex_entry, ln);
 	if (err)
 		return_error(err);
 
@@ -71,8 +71,17 @@ int overlap_graph_free(overlap_graph_t *g);
 
 int overlap_graph_add_segment(overlap_graph_t *g, segment_t *seg, off_t mapping); 
 
+int overlap_graph_add_segment_deferred(overlap_graph_t *g, segment_t *seg,
+		off_t mapping);
+
+int overlap_graph_update_edges(overlap_graph_t *g);
+
 int overlap_graph_remove_cycles(overlap_graph_t *g);
 
+int overlap_graph_remove_cycles_greedy(overlap_graph_t *g);
+
+int overlap_graph_get_removed_weight(overlap_graph_t *g, off_t *weight);
+
 int overlap_graph_get_removed_edges(overlap_graph_t *g, list_t **edges);
 
 int overlap_graph_get_vertices_topo(overlap_graph_t *g, list_t **vertices);
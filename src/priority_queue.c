@@ -37,7 +37,7 @@
  */
 struct element {
 	void *data; /**< The data this element holds */
-	int key; /**< The priority key of this element */
+	int64_t key; /**< The priority key of this element */
 	size_t *pos; /**< Place to store the current position in the heap */ 
 };
 
@@ -45,8 +45,17 @@ struct priority_queue {
 	struct element *heap;
 	size_t capacity;
 	size_t size;
+	int deferred; /**< Whether elements were added without fixing the heap */
 };
 
+/** 
+ * The number of children of each element of the heap.
+ *
+ * A 4-ary heap is shallower than a binary one and the children of an element
+ * are next to each other in memory, which makes it more cache friendly.
+ */
+#define PRIORITY_QUEUE_ARITY 4
+
 /* Forward declarations */
 static int upheap(priority_queue_t *pq, size_t n);
 static int downheap(priority_queue_t *pq, size_t n);
@@ -55,6 +64,21 @@ static int downheap(priority_queue_t *pq, size_t n);
 /* Helper functions */
 /********************/
 
+/*
+ * The heap is stored starting at index 1, with a sentinel at index 0. The
+ * parent of the element at index i is at index (i + ARITY - 2) / ARITY and
+ * its children start at index ARITY * (i - 1) + 2.
+ */
+static inline size_t heap_parent(size_t i)
+{
+	return (i + PRIORITY_QUEUE_ARITY - 2) / PRIORITY_QUEUE_ARITY;
+}
+
+static inline size_t heap_first_child(size_t i)
+{
+	return PRIORITY_QUEUE_ARITY * (i - 1) + 2;
+}
+
 static inline void place_element(struct element *h, size_t pos,
         struct element e)
 {
@@ -74,7 +98,7 @@ static inline void place_element(struct element *h, size_t pos,
 static int upheap(priority_queue_t *pq, size_t n)
 {
 	struct element *h = pq->heap;
-	int i = n;
+	size_t i = n;
 
 	/* Store the Element */
 	struct element k = h[n];
@@ -87,9 +111,9 @@ static int upheap(priority_queue_t *pq, size_t n)
 	 * We have a sentinel at h[0] so there is no need
 	 * to check for i > 1.
 	 */
-	while (k.key > h[i / 2].key) {
-		place_element(h, i, h[i / 2]);
-		i = i / 2;
+	while (k.key > h[heap_parent(i)].key) {
+		place_element(h, i, h[heap_parent(i)]);
+		i = heap_parent(i);
 	}
 
 	/* Place the Element at its proper place */
@@ -118,14 +142,19 @@ static int downheap(priority_queue_t *pq, size_t n)
 
 
 	/* While the current element has at least one child */
-	while (2 * i <= pq_size) { 
-		size_t j = 2 * i;
+	while (heap_first_child(i) <= pq_size) { 
+		size_t j = heap_first_child(i);
+
+		size_t last = j + PRIORITY_QUEUE_ARITY - 1;
+		if (last > pq_size)
+			last = pq_size;
 
-		/* 
-		 * If there is a right child (j < pq_size) and the right 
-		 * child (j + 1) is larger than the left (j), use it.
-		 */
-		if (j < pq_size && h[j].key < h[j + 1].key) j++;
+		/* Use the largest of the children */
+		size_t c;
+		for (c = j + 1; c <= last; c++) {
+			if (h[c].key > h[j].key)
+				j = c;
+		}
 
 		/* if the Element is larger than its children, stop the descent. */
 		if (k.key > h[j].key) break;
@@ -143,6 +172,42 @@ static int downheap(priority_queue_t *pq, size_t n)
 	return 0;
 }
 
+/** 
+ * Appends an element to the heap array without fixing the heap property.
+ * 
+ * @param pq the priority queue
+ * @param data the element to be added 
+ * @param key the priority key of the element to be added
+ * @param pos where to store the current position of the element in the heap
+ * 
+ * @return the operation error code
+ */
+static int append_element(priority_queue_t *pq, void *data, int64_t key,
+		size_t *pos)
+{
+	/* Allocate more space if needed */
+	if (pq->size >= pq->capacity) {
+		/* Increase by about 20%. Make sure that we increase at least 1! */
+		size_t new_size = ((5 * pq->capacity) / 4) + 1;
+		struct element *t = realloc(pq->heap, (new_size + 1) * sizeof *t);
+		if (t == NULL)
+			return_error(ENOMEM);
+
+		pq->heap = t;
+		pq->capacity = new_size;
+	}
+	
+	/* Place the new element at the end of the heap */
+	struct element e;
+	e.data = data;
+	e.key = key;
+	e.pos = pos;
+
+	place_element(pq->heap, ++pq->size, e);
+
+	return 0;
+}
+
 /*****************/
 /* API functions */
 /*****************/
@@ -179,10 +244,12 @@ int priority_queue_new(priority_queue_t **pq, size_t capacity)
 
 	p->capacity = capacity;
 	p->size = 0;
+	p->deferred = 0;
 
 	/* Create sentinel element at index 0 */
-	p->heap[0].key = __MAX(int);
+	p->heap[0].key = __MAX(int64_t);
 	p->heap[0].data = NULL;
+	p->heap[0].pos = NULL;
 
 	*pq = p;
 
@@ -239,30 +306,77 @@ int priority_queue_get_size(priority_queue_t *pq, size_t *size)
  * 
  * @return the operation error code
  */
-int priority_queue_add(priority_queue_t *pq, void *data, int key, size_t *pos)
+int priority_queue_add(priority_queue_t *pq, void *data, int64_t key,
+		size_t *pos)
 {
 	if (pq == NULL)
 		return_error(EINVAL);
 
-	/* Allocate more space if needed */
-	if (pq->size >= pq->capacity) {
-		/* Increase by about 20%. Make sure that we increase at least 1! */
-		size_t new_size = ((5 * pq->capacity) / 4) + 1;
-		struct element *t = realloc(pq->heap, (new_size + 1) * sizeof *t);
-		if (t == NULL)
-			return_error(ENOMEM);
+	int err = append_element(pq, data, key, pos);
+	if (err)
+		return_error(err);
 
-		pq->heap = t;
-		pq->capacity = new_size;
-	}
-	
-	/* Place the new element at the end of the heap */
-	pq->heap[++pq->size].data = data;
-	pq->heap[pq->size].key = key;
-	pq->heap[pq->size].pos = pos;
+	/* Fix the heap property (unless it will be fixed later anyway) */
+	if (!pq->deferred)
+		upheap(pq, pq->size);
 
-	/* Fix the heap property */
-	upheap(pq, pq->size);
+	return 0;
+}
+
+/** 
+ * Adds an element to the priority queue without fixing the heap.
+ *
+ * This is more efficient than priority_queue_add() when adding many elements
+ * at once. The heap is fixed for all the deferred elements at once in O(n)
+ * time by priority_queue_heapify() or, implicitly, the next time an element
+ * is removed from the queue.
+ * 
+ * @param pq the priority queue to add the element to
+ * @param data the element to be added 
+ * @param key the priority key of the element to be added
+ * @param pos where to store the current position of the element in the heap
+ * 
+ * @return the operation error code
+ */
+int priority_queue_add_deferred(priority_queue_t *pq, void *data, int64_t key,
+		size_t *pos)
+{
+	if (pq == NULL)
+		return_error(EINVAL);
+
+	int err = append_element(pq, data, key, pos);
+	if (err)
+		return_error(err);
+
+	pq->deferred = 1;
+
+	return 0;
+}
+
+/** 
+ * Fixes the heap of a priority queue after elements have been added to it
+ * with priority_queue_add_deferred().
+ *
+ * This works bottom-up, moving each element that has children downwards
+ * (Floyd's method), which takes O(n) time in total.
+ * 
+ * @param pq the priority queue
+ * 
+ * @return the operation error code
+ */
+int priority_queue_heapify(priority_queue_t *pq)
+{
+	if (pq == NULL)
+		return_error(EINVAL);
+
+	if (!pq->deferred)
+		return 0;
+
+	size_t i;
+	for (i = heap_parent(pq->size); i > 0; i--)
+		downheap(pq, i);
+
+	pq->deferred = 0;
 
 	return 0;
 }
@@ -281,6 +395,11 @@ int priority_queue_remove_max(priority_queue_t *pq, void **data)
 	if (pq == NULL || data == NULL)
 		return_error(EINVAL);
 
+	/* Fix the heap if elements have been added without fixing it */
+	int err = priority_queue_heapify(pq);
+	if (err)
+		return_error(err);
+
 	/* Store the maximum element */
 	struct element k = pq->heap[1];
 	
@@ -306,16 +425,20 @@ int priority_queue_remove_max(priority_queue_t *pq, void **data)
  * 
  * @return 
  */
-int priority_queue_change_key(priority_queue_t *pq, size_t pos, int key)
+int priority_queue_change_key(priority_queue_t *pq, size_t pos, int64_t key)
 {
 	if (pq == NULL || pos > pq->size)
 		return_error(EINVAL);
 
 	struct element *e = &pq->heap[pos];
-	int old_key = e->key;
+	int64_t old_key = e->key;
 
 	e->key = key;
 
+	/* The heap will be fixed later anyway */
+	if (pq->deferred)
+		return 0;
+
 	if (key < old_key)
 		downheap(pq, pos);
 	else if (key > old_key)
@@ -27,11 +27,12 @@
 #define _BLESS_PRIORITY_QUEUE_H
 
 #include <sys/types.h>
+#include <stdint.h>
 
 /**
  * @defgroup priority_queue Priority Queue
  *
- * A max-priority queue.
+ * A max-priority queue with 64-bit keys.
  *
  * @{
  */
@@ -45,11 +46,17 @@ int priority_queue_new(priority_queue_t **pq, size_t size);
 
 int priority_queue_free(priority_queue_t *pq);
 
-int priority_queue_add(priority_queue_t *pq, void *data, int key, size_t *pos);
+int priority_queue_add(priority_queue_t *pq, void *data, int64_t key,
+		size_t *pos);
+
+int priority_queue_add_deferred(priority_queue_t *pq, void *data, int64_t key,
+		size_t *pos);
+
+int priority_queue_heapify(priority_queue_t *pq);
 
 int priority_queue_remove_max(priority_queue_t *pq, void **data);
 
-int priority_queue_change_key(priority_queue_t *pq, size_t pos, int key);
+int priority_queue_change_key(priority_queue_t *pq, size_t pos, int64_t key);
 
 int priority_queue_get_size(priority_queue_t *pq, size_t *size);
 
@@ -0,0 +1,545 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file search_kernel.c
+ *
+ * Implementation of the internal byte search kernels.
+ *
+ * The search kernels look for the first and last bytes of the pattern at the
+ * corresponding distance in the data, and only compare the whole pattern at
+ * the positions where both match. The SSE2 and AVX2 kernels check 16 and 32
+ * positions at a time. This is very fast for short patterns, whereas the
+ * Boyer-Moore-Horspool search, which can skip over data, is better for long
+ * patterns.
+ *
+ * The kernel used by search_kernel_find() is chosen at runtime according to
+ * the features of the CPU. The reverse kernels, used by search_kernel_rfind()
+ * to find the last match, work in the same way starting from the end of the
+ * data.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "search_kernel.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SEARCH_KERNEL_X86 1
+#include <immintrin.h>
+#else
+#define SEARCH_KERNEL_X86 0
+#endif
+
+/**
+ * Checks a match candidate found by a kernel.
+ *
+ * The first and last bytes of the candidate are known to match.
+ */
+static inline int check_candidate(const unsigned char *data,
+		const unsigned char *pattern, size_t length)
+{
+	return length <= 2 || !memcmp(data + 1, pattern + 1, length - 2);
+}
+
+/**
+ * The scalar search kernel.
+ */
+static ssize_t search_kernel_scalar(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	if (len < length)
+		return -1;
+
+	const unsigned char *p = data;
+	const unsigned char *end = data + (len - length) + 1;
+	unsigned char last = pattern[length - 1];
+
+	/* Use memchr to find candidates for the first byte */
+	while (p < end) {
+		p = memchr(p, pattern[0], end - p);
+		if (p == NULL)
+			return -1;
+
+		if (p[length - 1] == last && check_candidate(p, pattern, length))
+			return p - data;
+
+		p++;
+	}
+
+	return -1;
+}
+
+/**
+ * The scalar reverse search kernel.
+ */
+static ssize_t search_rkernel_scalar(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	if (len < length)
+		return -1;
+
+	unsigned char first = pattern[0];
+	unsigned char last = pattern[length - 1];
+	size_t i = len - length + 1;
+
+	while (i-- > 0) {
+		if (data[i] == first && data[i + length - 1] == last
+				&& check_candidate(data + i, pattern, length))
+			return i;
+	}
+
+	return -1;
+}
+
+#if SEARCH_KERNEL_X86
+
+/**
+ * The SSE2 search kernel.
+ */
+__attribute__((target("sse2")))
+static ssize_t search_kernel_sse2(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	if (len < length)
+		return -1;
+
+	/* The number of positions a match can start at */
+	size_t npos = len - length + 1;
+	size_t i = 0;
+
+	if (length > 1) {
+		const __m128i first = _mm_set1_epi8(pattern[0]);
+		const __m128i last = _mm_set1_epi8(pattern[length - 1]);
+
+		for (; npos - i >= 16; i += 16) {
+			__m128i block_first =
+				_mm_loadu_si128((const __m128i *)(data + i));
+			__m128i block_last =
+				_mm_loadu_si128((const __m128i *)(data + i + length - 1));
+
+			unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+						_mm_cmpeq_epi8(first, block_first),
+						_mm_cmpeq_epi8(last, block_last)));
+
+			while (mask != 0) {
+				unsigned bit = __builtin_ctz(mask);
+
+				if (check_candidate(data + i + bit, pattern, length))
+					return i + bit;
+
+				mask &= mask - 1;
+			}
+		}
+	}
+
+	/* Handle the remaining positions (and single byte patterns) */
+	ssize_t idx = search_kernel_scalar(data + i, len - i, pattern, length);
+	if (idx >= 0)
+		return i + idx;
+
+	return -1;
+}
+
+/**
+ * The AVX2 search kernel.
+ */
+__attribute__((target("avx2")))
+static ssize_t search_kernel_avx2(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	if (len < length)
+		return -1;
+
+	/* The number of positions a match can start at */
+	size_t npos = len - length + 1;
+	size_t i = 0;
+
+	if (length > 1) {
+		const __m256i first = _mm256_set1_epi8(pattern[0]);
+		const __m256i last = _mm256_set1_epi8(pattern[length - 1]);
+
+		for (; npos - i >= 32; i += 32) {
+			__m256i block_first =
+				_mm256_loadu_si256((const __m256i *)(data + i));
+			__m256i block_last =
+				_mm256_loadu_si256((const __m256i *)(data + i + length - 1));
+
+			unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+						_mm256_cmpeq_epi8(first, block_first),
+						_mm256_cmpeq_epi8(last, block_last)));
+
+			while (mask != 0) {
+				unsigned bit = __builtin_ctz(mask);
+
+				if (check_candidate(data + i + bit, pattern, length))
+					return i + bit;
+
+				mask &= mask - 1;
+			}
+		}
+	}
+
+	/* Handle the remaining positions with the SSE2 kernel */
+	ssize_t idx = search_kernel_sse2(data + i, len - i, pattern, length);
+	if (idx >= 0)
+		return i + idx;
+
+	return -1;
+}
+
+/**
+ * The SSE2 reverse search kernel.
+ */
+__attribute__((target("sse2")))
+static ssize_t search_rkernel_sse2(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	if (len < length)
+		return -1;
+
+	/* The number of positions a match can start at */
+	size_t i = len - length + 1;
+
+	const __m128i first = _mm_set1_epi8(pattern[0]);
+	const __m128i last = _mm_set1_epi8(pattern[length - 1]);
+
+	while (i >= 16) {
+		i -= 16;
+
+		__m128i block_first =
+			_mm_loadu_si128((const __m128i *)(data + i));
+		__m128i block_last =
+			_mm_loadu_si128((const __m128i *)(data + i + length - 1));
+
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpeq_epi8(first, block_first),
+					_mm_cmpeq_epi8(last, block_last)));
+
+		while (mask != 0) {
+			unsigned bit = 31 - __builtin_clz(mask);
+
+			if (check_candidate(data + i + bit, pattern, length))
+				return i + bit;
+
+			mask &= ~(1U << bit);
+		}
+	}
+
+	/* Handle the remaining positions at the start */
+	return search_rkernel_scalar(data, i + length - 1, pattern, length);
+}
+
+/**
+ * The AVX2 reverse search kernel.
+ */
+__attribute__((target("avx2")))
+static ssize_t search_rkernel_avx2(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	if (len < length)
+		return -1;
+
+	/* The number of positions a match can start at */
+	size_t i = len - length + 1;
+
+	const __m256i first = _mm256_set1_epi8(pattern[0]);
+	const __m256i last = _mm256_set1_epi8(pattern[length - 1]);
+
+	while (i >= 32) {
+		i -= 32;
+
+		__m256i block_first =
+			_mm256_loadu_si256((const __m256i *)(data + i));
+		__m256i block_last =
+			_mm256_loadu_si256((const __m256i *)(data + i + length - 1));
+
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+					_mm256_cmpeq_epi8(first, block_first),
+					_mm256_cmpeq_epi8(last, block_last)));
+
+		while (mask != 0) {
+			unsigned bit = 31 - __builtin_clz(mask);
+
+			if (check_candidate(data + i + bit, pattern, length))
+				return i + bit;
+
+			mask &= ~(1U << bit);
+		}
+	}
+
+	/* Handle the remaining positions at the start with the SSE2 kernel */
+	return search_rkernel_sse2(data, i + length - 1, pattern, length);
+}
+
+#endif /* SEARCH_KERNEL_X86 */
+
+/**
+ * Gets a search kernel implementation.
+ *
+ * @param impl the implementation to get
+ *
+ * @return the search kernel or NULL if the implementation is not supported
+ *         by the CPU
+ */
+search_kernel_func *search_kernel_get(enum search_kernel_impl impl)
+{
+	switch (impl) {
+		case SEARCH_KERNEL_SCALAR:
+			return search_kernel_scalar;
+
+#if SEARCH_KERNEL_X86
+		case SEARCH_KERNEL_SSE2:
+			if (__builtin_cpu_supports("sse2"))
+				return search_kernel_sse2;
+			break;
+
+		case SEARCH_KERNEL_AVX2:
+			if (__builtin_cpu_supports("avx2"))
+				return search_kernel_avx2;
+			break;
+#endif
+
+		case SEARCH_KERNEL_BEST:
+			{
+				search_kernel_func *func;
+
+				func = search_kernel_get(SEARCH_KERNEL_AVX2);
+				if (func == NULL)
+					func = search_kernel_get(SEARCH_KERNEL_SSE2);
+				if (func == NULL)
+					func = search_kernel_get(SEARCH_KERNEL_SCALAR);
+
+				return func;
+			}
+
+		default:
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * Searches for a pattern in a memory area using the best search kernel.
+ *
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ * @param pattern the pattern to search for
+ * @param length the length of the pattern (> 0)
+ *
+ * @return the index of the first match in data or -1 if there is no match
+ */
+ssize_t search_kernel_find(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	static search_kernel_func *best = NULL;
+
+	/* Choose the kernel on first use (races just repeat the choice) */
+	if (best == NULL)
+		best = search_kernel_get(SEARCH_KERNEL_BEST);
+
+	return (*best)(data, len, pattern, length);
+}
+
+/**
+ * Gets a reverse search kernel implementation.
+ *
+ * Reverse kernels return the index of the last match in the data.
+ *
+ * @param impl the implementation to get
+ *
+ * @return the reverse search kernel or NULL if the implementation is not
+ *         supported by the CPU
+ */
+search_kernel_func *search_rkernel_get(enum search_kernel_impl impl)
+{
+	switch (impl) {
+		case SEARCH_KERNEL_SCALAR:
+			return search_rkernel_scalar;
+
+#if SEARCH_KERNEL_X86
+		case SEARCH_KERNEL_SSE2:
+			if (__builtin_cpu_supports("sse2"))
+				return search_rkernel_sse2;
+			break;
+
+		case SEARCH_KERNEL_AVX2:
+			if (__builtin_cpu_supports("avx2"))
+				return search_rkernel_avx2;
+			break;
+#endif
+
+		case SEARCH_KERNEL_BEST:
+			{
+				search_kernel_func *func;
+
+				func = search_rkernel_get(SEARCH_KERNEL_AVX2);
+				if (func == NULL)
+					func = search_rkernel_get(SEARCH_KERNEL_SSE2);
+				if (func == NULL)
+					func = search_rkernel_get(SEARCH_KERNEL_SCALAR);
+
+				return func;
+			}
+
+		default:
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * Searches for the last match of a pattern in a memory area using the best
+ * reverse search kernel.
+ *
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ * @param pattern the pattern to search for
+ * @param length the length of the pattern (> 0)
+ *
+ * @return the index of the last match in data or -1 if there is no match
+ */
+ssize_t search_kernel_rfind(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length)
+{
+	static search_kernel_func *best = NULL;
+
+	/* Choose the kernel on first use (races just repeat the choice) */
+	if (best == NULL)
+		best = search_rkernel_get(SEARCH_KERNEL_BEST);
+
+	return (*best)(data, len, pattern, length);
+}
+
+/**
+ * Initializes a Boyer-Moore-Horspool search.
+ *
+ * @param bmh the search_bmh to initialize
+ * @param pattern the pattern to search for (it is not copied)
+ * @param length the length of the pattern (> 0)
+ */
+void search_bmh_init(struct search_bmh *bmh, const unsigned char *pattern,
+		size_t length)
+{
+	size_t i;
+
+	bmh->pattern = pattern;
+	bmh->length = length;
+
+	for (i = 0; i < 256; i++)
+		bmh->shift[i] = length;
+
+	for (i = 0; i < length - 1; i++)
+		bmh->shift[pattern[i]] = length - 1 - i;
+}
+
+/**
+ * Searches for the pattern of a Boyer-Moore-Horspool search in a memory area.
+ *
+ * @param bmh the search_bmh
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ *
+ * @return the index of the first match in data or -1 if there is no match
+ */
+ssize_t search_bmh_find(struct search_bmh *bmh, const unsigned char *data,
+		size_t len)
+{
+	size_t m = bmh->length;
+	const unsigned char *pat = bmh->pattern;
+	unsigned char last = pat[m - 1];
+	size_t i = 0;
+
+	while (len - i >= m) {
+		unsigned char c = data[i + m - 1];
+
+		if (c == last && !memcmp(data + i, pat, m - 1))
+			return i;
+
+		i += bmh->shift[c];
+	}
+
+	return -1;
+}
+
+/**
+ * Initializes a reverse Boyer-Moore-Horspool search.
+ *
+ * The search looks for the last match of the pattern, comparing the first
+ * byte of the pattern at each position and skipping towards the start of
+ * the data.
+ *
+ * @param bmh the search_bmh to initialize
+ * @param pattern the pattern to search for (it is not copied)
+ * @param length the length of the pattern (> 0)
+ */
+void search_bmh_rinit(struct search_bmh *bmh, const unsigned char *pattern,
+		size_t length)
+{
+	size_t i;
+
+	bmh->pattern = pattern;
+	bmh->length = length;
+
+	for (i = 0; i < 256; i++)
+		bmh->shift[i] = length;
+
+	for (i = length - 1; i > 0; i--)
+		bmh->shift[pattern[i]] = i;
+}
+
+/**
+ * Searches for the last match of the pattern of a reverse Boyer-Moore-Horspool
+ * search in a memory area.
+ *
+ * @param bmh the search_bmh (initialized with search_bmh_rinit())
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ *
+ * @return the index of the last match in data or -1 if there is no match
+ */
+ssize_t search_bmh_rfind(struct search_bmh *bmh, const unsigned char *data,
+		size_t len)
+{
+	size_t m = bmh->length;
+	const unsigned char *pat = bmh->pattern;
+	unsigned char first = pat[0];
+
+	if (len < m)
+		return -1;
+
+	size_t i = len - m;
+
+	for (;;) {
+		unsigned char c = data[i];
+
+		if (c == first && !memcmp(data + i + 1, pat + 1, m - 1))
+			return i;
+
+		if (i < bmh->shift[c])
+			break;
+
+		i -= bmh->shift[c];
+	}
+
+	return -1;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file search_kernel.h
+ *
+ * Internal byte search kernels
+ */
+#ifndef _SEARCH_KERNEL_H
+#define _SEARCH_KERNEL_H
+
+#include <sys/types.h>
+
+/**
+ * A search kernel.
+ *
+ * Searches for a pattern in a memory area.
+ *
+ * @param data the memory area to search
+ * @param len the length of the memory area
+ * @param pattern the pattern to search for
+ * @param length the length of the pattern (> 0)
+ *
+ * @return the index of the first match in data (the last one for reverse
+ *         kernels) or -1 if there is no match
+ */
+typedef ssize_t (search_kernel_func)(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length);
+
+/**
+ * The available search kernel implementations.
+ */
+enum search_kernel_impl {
+	SEARCH_KERNEL_SCALAR,
+	SEARCH_KERNEL_SSE2,
+	SEARCH_KERNEL_AVX2,
+	SEARCH_KERNEL_BEST /**< The best implementation the CPU supports */
+};
+
+/**
+ * A Boyer-Moore-Horspool search.
+ */
+struct search_bmh {
+	const unsigned char *pattern;
+	size_t length;
+	size_t shift[256];
+};
+
+search_kernel_func *search_kernel_get(enum search_kernel_impl impl);
+
+ssize_t search_kernel_find(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length);
+
+void search_bmh_init(struct search_bmh *bmh, const unsigned char *pattern,
+		size_t length);
+
+ssize_t search_bmh_find(struct search_bmh *bmh, const unsigned char *data,
+		size_t len);
+
+search_kernel_func *search_rkernel_get(enum search_kernel_impl impl);
+
+ssize_t search_kernel_rfind(const unsigned char *data, size_t len,
+		const unsigned char *pattern, size_t length);
+
+void search_bmh_rinit(struct search_bmh *bmh, const unsigned char *pattern,
+		size_t length);
+
+ssize_t search_bmh_rfind(struct search_bmh *bmh, const unsigned char *data,
+		size_t len);
+
+#endif /* _SEARCH_KERNEL_H */
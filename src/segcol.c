@@ -117,7 +117,9 @@ int segcol_free(segcol_t *segcol)
  * 
  * After the invocation of this function the segcol_t is responsible
  * for the memory handling of the specified segment. The segment should
- * not be further manipulated by the user.
+ * not be further manipulated by the user. If the segment is a continuation
+ * of the last segment in the segcol_t (same data object, contiguous range),
+ * the two are merged and the specified segment is freed.
  *
  * @param segcol the segcol_t to append to
  * @param seg the segment to append
@@ -148,7 +150,9 @@ int segcol_append(segcol_t *segcol, segment_t *seg)
  * 
  * After the invocation of this function the segcol_t is responsible
  * for the memory handling of the specified segment. The segment should
- * not be further manipulated by the caller.
+ * not be further manipulated by the caller. If the segment and its new
+ * neighbours are contiguous parts of the same data object, they are merged
+ * into a single segment.
  *
  * @param segcol the segcol_t to insert into
  * @param offset the logical offset at which to insert
@@ -178,6 +182,9 @@ int segcol_insert(segcol_t *segcol, off_t offset, segment_t *seg)
 /**
  * Deletes a logical range from the segcol_t.
  *
+ * If the segments around the deleted range are contiguous parts of the same
+ * data object, they are merged into a single segment.
+ *
  * @param segcol the segcol_t to delete from
  * @param[out] deleted if it is not NULL, on return it will point to a new 
  *                     segcol_t containing the deleted segments
@@ -192,6 +199,8 @@ int segcol_delete(segcol_t *segcol, segcol_t **deleted, off_t offset, off_t leng
 
 	if (!err) {
 		segcol->size -= length;
+		if (deleted != NULL)
+			(*deleted)->size = length;
 		return err;
 	}
 	
@@ -242,6 +251,21 @@ int segcol_iter_next(segcol_iter_t *iter)
 	return (*iter->segcol->funcs->iter_next)(iter);
 }
 
+/**
+ * Moves the segcol_iter_t to the previous element.
+ *
+ * Moving before the first element invalidates the iterator. An invalid
+ * iterator is left unchanged.
+ *
+ * @param iter the segcol_iter_t to move
+ *
+ * @return the operation error code
+ */
+int segcol_iter_prev(segcol_iter_t *iter)
+{
+	return (*iter->segcol->funcs->iter_prev)(iter);
+}
+
 /**
  * Whether the iter points to a valid element.
  *
@@ -75,6 +75,8 @@ int segcol_iter_new(segcol_t *segcol, segcol_iter_t **iter);
 
 int segcol_iter_next(segcol_iter_t *iter);
 
+int segcol_iter_prev(segcol_iter_t *iter);
+
 int segcol_iter_is_valid(segcol_iter_t *iter, int *valid);
 
 int segcol_iter_get_segment(segcol_iter_t *iter, segment_t **seg);
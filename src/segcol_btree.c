@@ -0,0 +1,1234 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file segcol_btree.c
+ *
+ * B+ tree implementation of segcol_t
+ *
+ * The segments are kept only in the leaves of a B+ tree, packed in arrays of
+ * up to BTREE_MAX_ENTRIES entries. Each node (internal or leaf) stores the
+ * prefix sums of the byte counts of its entries in a contiguous array, so
+ * locating a logical offset is a binary search in each node on the path from
+ * the root. The leaves are linked in logical order, so a full scan of the
+ * segcol walks a few large arrays instead of chasing one pointer per segment.
+ * See doc/devel/segcol_data_structure.txt for more.
+ */
+#include <stdlib.h>
+#include <errno.h>
+
+#include "segcol.h"
+#include "segcol_internal.h"
+#include "segcol_btree.h"
+#include "type_limits.h"
+#include "debug.h"
+
+/** The maximum number of entries in a node */
+#define BTREE_MAX_ENTRIES 32
+
+/**
+ * The number of entries below which a node is merged with a sibling
+ * (if possible).
+ */
+#define BTREE_MIN_ENTRIES (BTREE_MAX_ENTRIES / 4)
+
+/**
+ * An entry in a node of the B+ tree.
+ */
+union segcol_btree_entry {
+	segment_t *segment; /**< the segment (leaf nodes) */
+	struct segcol_btree_node *child; /**< the child node (internal nodes) */
+};
+
+/**
+ * A node in the B+ tree.
+ */
+struct segcol_btree_node {
+	struct segcol_btree_node *parent; /**< the parent (NULL for the root) */
+	struct segcol_btree_node *prev; /**< the previous leaf (leaves only) */
+	struct segcol_btree_node *next; /**< the next leaf (leaves only) */
+	int leaf; /**< whether this node is a leaf */
+	int nentries; /**< the number of entries in the node */
+	/**
+	 * offsets[i] is the byte offset of entry i in the node and
+	 * offsets[nentries] is the total byte count of the node.
+	 */
+	off_t offsets[BTREE_MAX_ENTRIES + 1];
+	union segcol_btree_entry entries[BTREE_MAX_ENTRIES]; /**< the entries */
+};
+
+struct segcol_btree_iter_impl {
+	struct segcol_btree_node *leaf;
+	int index;
+	off_t mapping;
+};
+
+struct segcol_btree_impl {
+	struct segcol_btree_node *root;
+	struct segcol_btree_node *first;
+	struct segcol_btree_node *last;
+	int height;
+	/* Nodes reserved for an operation, linked through their parent field */
+	struct segcol_btree_node *spare;
+	int nspare;
+};
+
+/* Forward declarations */
+
+/* internal convenience functions */
+static int btree_reserve_nodes(struct segcol_btree_impl *impl, int n);
+static void btree_release_nodes(struct segcol_btree_impl *impl);
+static void btree_insert_entry(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *node, int index,
+		union segcol_btree_entry entry, off_t size);
+static void btree_insert_segment_at(struct segcol_btree_impl *impl,
+		off_t offset, segment_t *seg, off_t size);
+static void btree_remove_entry(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *node, int index);
+static struct segcol_btree_node *btree_find_leaf(
+		struct segcol_btree_impl *impl, off_t offset, int *index,
+		off_t *mapping);
+static void btree_merge_at(struct segcol_btree_impl *impl, off_t offset);
+
+/* segcol API implementation functions */
+int segcol_btree_new(segcol_t **segcol);
+static int segcol_btree_free(segcol_t *segcol);
+static int segcol_btree_append(segcol_t *segcol, segment_t *seg);
+static int segcol_btree_insert(segcol_t *segcol, off_t offset, segment_t *seg);
+static int segcol_btree_delete(segcol_t *segcol, segcol_t **deleted, off_t offset, off_t length);
+static int segcol_btree_find(segcol_t *segcol, segcol_iter_t **iter, off_t offset);
+static int segcol_btree_iter_new(segcol_t *segcol, void **iter);
+static int segcol_btree_iter_next(segcol_iter_t *iter);
+static int segcol_btree_iter_prev(segcol_iter_t *iter);
+static int segcol_btree_iter_is_valid(segcol_iter_t *iter, int *valid);
+static int segcol_btree_iter_get_segment(segcol_iter_t *iter, segment_t **seg);
+static int segcol_btree_iter_get_mapping(segcol_iter_t *iter, off_t *mapping);
+static int segcol_btree_iter_free(segcol_iter_t *iter);
+
+/* Function pointers for the B+ tree implementation of segcol_t */
+static struct segcol_funcs segcol_btree_funcs = {
+	.free = segcol_btree_free,
+	.append = segcol_btree_append,
+	.insert = segcol_btree_insert,
+	.delete = segcol_btree_delete,
+	.find = segcol_btree_find,
+	.iter_new = segcol_btree_iter_new,
+	.iter_next = segcol_btree_iter_next,
+	.iter_prev = segcol_btree_iter_prev,
+	.iter_is_valid = segcol_btree_iter_is_valid,
+	.iter_get_segment = segcol_btree_iter_get_segment,
+	.iter_get_mapping = segcol_btree_iter_get_mapping,
+	.iter_free = segcol_btree_iter_free
+};
+
+/**********************
+ * Node manipulation  *
+ **********************/
+
+/**
+ * Gets the total byte count of a node.
+ */
+static inline off_t node_size(struct segcol_btree_node *node)
+{
+	return node->offsets[node->nentries];
+}
+
+/**
+ * Gets the byte count of an entry of a node.
+ */
+static inline off_t node_entry_size(struct segcol_btree_node *node, int index)
+{
+	return node->offsets[index + 1] - node->offsets[index];
+}
+
+/**
+ * Gets the index of a node in its parent's entries.
+ */
+static int node_child_index(struct segcol_btree_node *node)
+{
+	struct segcol_btree_node *parent = node->parent;
+	int i;
+
+	for (i = 0; i < parent->nentries; i++)
+		if (parent->entries[i].child == node)
+			break;
+
+	return i;
+}
+
+/**
+ * Finds the entry of a node that contains a byte offset (relative to the
+ * start of the node).
+ *
+ * The offset must be in the range of the node.
+ */
+static int node_search(struct segcol_btree_node *node, off_t offset)
+{
+	int lo = 0;
+	int hi = node->nentries - 1;
+
+	/* Find the last entry that starts at or before offset */
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (node->offsets[mid] <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/**
+ * Inserts an entry in a node that has room for it.
+ *
+ * Only the node itself is updated, not its ancestors.
+ */
+static void node_insert_raw(struct segcol_btree_node *node, int index,
+		union segcol_btree_entry entry, off_t size)
+{
+	int i;
+
+	for (i = node->nentries; i > index; i--) {
+		node->entries[i] = node->entries[i - 1];
+		node->offsets[i + 1] = node->offsets[i] + size;
+	}
+
+	node->entries[index] = entry;
+	node->offsets[index + 1] = node->offsets[index] + size;
+	node->nentries++;
+
+	if (!node->leaf)
+		entry.child->parent = node;
+}
+
+/**
+ * Removes an entry from a node.
+ *
+ * Only the node itself is updated, not its ancestors.
+ *
+ * @return the byte count of the removed entry
+ */
+static off_t node_remove_raw(struct segcol_btree_node *node, int index)
+{
+	off_t size = node_entry_size(node, index);
+	int i;
+
+	for (i = index; i < node->nentries - 1; i++) {
+		node->entries[i] = node->entries[i + 1];
+		node->offsets[i + 1] = node->offsets[i + 2] - size;
+	}
+
+	node->nentries--;
+
+	return size;
+}
+
+/**
+ * Adds a value to the byte count of a node in all its ancestors.
+ */
+static void btree_propagate_size_change(struct segcol_btree_node *node,
+		off_t change)
+{
+	while (node->parent != NULL) {
+		struct segcol_btree_node *parent = node->parent;
+		int i;
+
+		for (i = node_child_index(node) + 1; i <= parent->nentries; i++)
+			parent->offsets[i] += change;
+
+		node = parent;
+	}
+}
+
+/**
+ * Changes the byte count of an entry of a node.
+ *
+ * This must be called whenever the size of a segment held in the tree
+ * changes, so that the byte counts of the node's ancestors remain valid.
+ */
+static void btree_set_entry_size(struct segcol_btree_node *node, int index,
+		off_t size)
+{
+	off_t change = size - node_entry_size(node, index);
+	int i;
+
+	for (i = index + 1; i <= node->nentries; i++)
+		node->offsets[i] += change;
+
+	btree_propagate_size_change(node, change);
+}
+
+/**
+ * Unlinks a leaf from the list of leaves.
+ */
+static void btree_unlink_leaf(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *node)
+{
+	if (node->prev != NULL)
+		node->prev->next = node->next;
+	else
+		impl->first = node->next;
+
+	if (node->next != NULL)
+		node->next->prev = node->prev;
+	else
+		impl->last = node->prev;
+}
+
+/**
+ * Allocates and initializes a new empty node.
+ */
+static struct segcol_btree_node *btree_node_new(int leaf)
+{
+	struct segcol_btree_node *node = malloc(sizeof *node);
+	if (node == NULL)
+		return NULL;
+
+	node->parent = NULL;
+	node->prev = NULL;
+	node->next = NULL;
+	node->leaf = leaf;
+	node->nentries = 0;
+	node->offsets[0] = 0;
+
+	return node;
+}
+
+/**
+ * Makes sure that at least n nodes are reserved for the current operation.
+ *
+ * Operations that may have to split nodes reserve the nodes they may need
+ * before altering the tree, so that they can't fail midway.
+ *
+ * @param impl the segcol_btree_impl
+ * @param n the number of nodes to reserve
+ *
+ * @return the operation error code
+ */
+static int btree_reserve_nodes(struct segcol_btree_impl *impl, int n)
+{
+	while (impl->nspare < n) {
+		struct segcol_btree_node *node = btree_node_new(1);
+		if (node == NULL)
+			return_error(ENOMEM);
+
+		node->parent = impl->spare;
+		impl->spare = node;
+		impl->nspare++;
+	}
+
+	return 0;
+}
+
+/**
+ * Frees the reserved nodes that were not used.
+ */
+static void btree_release_nodes(struct segcol_btree_impl *impl)
+{
+	while (impl->spare != NULL) {
+		struct segcol_btree_node *node = impl->spare;
+		impl->spare = node->parent;
+		free(node);
+	}
+
+	impl->nspare = 0;
+}
+
+/**
+ * Takes a node from the reserved nodes and initializes it.
+ */
+static struct segcol_btree_node *btree_take_node(
+		struct segcol_btree_impl *impl, int leaf)
+{
+	struct segcol_btree_node *node = impl->spare;
+
+	impl->spare = node->parent;
+	impl->nspare--;
+
+	node->parent = NULL;
+	node->prev = NULL;
+	node->next = NULL;
+	node->leaf = leaf;
+	node->nentries = 0;
+	node->offsets[0] = 0;
+
+	return node;
+}
+
+/**
+ * Calculates the number of nodes that must be reserved to append a number
+ * of entries to an empty tree.
+ */
+static int btree_nodes_for_entries(size_t nentries)
+{
+	size_t level = (nentries + BTREE_MAX_ENTRIES - 1) / BTREE_MAX_ENTRIES;
+	size_t total = level;
+
+	while (level > 1) {
+		level = (level + BTREE_MAX_ENTRIES - 1) / BTREE_MAX_ENTRIES;
+		total += level;
+	}
+
+	/* The empty tree already has a (leaf) node */
+	return total > 0 ? total - 1 : 0;
+}
+
+/**
+ * Splits a full node in two.
+ *
+ * The entries from index h onwards are moved to a new node that is placed
+ * right after the original node in the parent (which may be split in turn).
+ * The new nodes are taken from the reserved nodes.
+ *
+ * @param impl the segcol_btree_impl
+ * @param node the node to split
+ * @param h the index of the first entry to move to the new node
+ *
+ * @return the new node
+ */
+static struct segcol_btree_node *btree_split_node(
+		struct segcol_btree_impl *impl, struct segcol_btree_node *node, int h)
+{
+	if (node->parent == NULL) {
+		/* Grow the tree by one level */
+		union segcol_btree_entry entry = { .child = node };
+		struct segcol_btree_node *root = btree_take_node(impl, 0);
+		node_insert_raw(root, 0, entry, node_size(node));
+		impl->root = root;
+		impl->height++;
+	}
+
+	struct segcol_btree_node *right = btree_take_node(impl, node->leaf);
+	off_t base = node->offsets[h];
+	int i;
+
+	for (i = h; i < node->nentries; i++) {
+		right->entries[i - h] = node->entries[i];
+		right->offsets[i - h + 1] = node->offsets[i + 1] - base;
+		if (!node->leaf)
+			right->entries[i - h].child->parent = right;
+	}
+
+	right->nentries = node->nentries - h;
+	node->nentries = h;
+
+	if (node->leaf) {
+		right->prev = node;
+		right->next = node->next;
+		if (node->next != NULL)
+			node->next->prev = right;
+		else
+			impl->last = right;
+		node->next = right;
+	}
+
+	/*
+	 * The node shrinks and the new node, inserted right after it, takes up
+	 * the difference.
+	 */
+	struct segcol_btree_node *parent = node->parent;
+	int index = node_child_index(node);
+	off_t right_size = node_size(right);
+	union segcol_btree_entry entry = { .child = right };
+
+	btree_set_entry_size(parent, index,
+			node_entry_size(parent, index) - right_size);
+	btree_insert_entry(impl, parent, index + 1, entry, right_size);
+
+	return right;
+}
+
+/**
+ * Inserts an entry in a node, splitting the node if it is full.
+ *
+ * Enough nodes must have been reserved to handle the splits.
+ *
+ * @param impl the segcol_btree_impl
+ * @param node the node to insert the entry into
+ * @param index the index at which to insert the entry
+ * @param entry the entry to insert
+ * @param size the byte count of the entry
+ */
+static void btree_insert_entry(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *node, int index,
+		union segcol_btree_entry entry, off_t size)
+{
+	if (node->nentries == BTREE_MAX_ENTRIES) {
+		/* When appending to the node, leave it full */
+		int h = (index == BTREE_MAX_ENTRIES) ?
+			BTREE_MAX_ENTRIES : BTREE_MAX_ENTRIES / 2;
+		struct segcol_btree_node *right = btree_split_node(impl, node, h);
+
+		if (index >= h) {
+			node = right;
+			index -= h;
+		}
+	}
+
+	node_insert_raw(node, index, entry, size);
+	btree_propagate_size_change(node, size);
+}
+
+/**
+ * Inserts a segment at a logical offset that is a segment boundary.
+ *
+ * Enough nodes must have been reserved to handle the splits.
+ *
+ * @param impl the segcol_btree_impl
+ * @param offset the offset at which to insert the segment (must be the
+ *        start of a segment or the end of the segcol)
+ * @param seg the segment to insert
+ * @param size the size of the segment
+ */
+static void btree_insert_segment_at(struct segcol_btree_impl *impl,
+		off_t offset, segment_t *seg, off_t size)
+{
+	union segcol_btree_entry entry = { .segment = seg };
+	struct segcol_btree_node *leaf;
+	int index;
+
+	if (offset == node_size(impl->root)) {
+		leaf = impl->last;
+		index = leaf->nentries;
+	} else {
+		off_t mapping;
+		leaf = btree_find_leaf(impl, offset, &index, &mapping);
+	}
+
+	btree_insert_entry(impl, leaf, index, entry, size);
+}
+
+/**
+ * Merges two sibling nodes.
+ *
+ * @param impl the segcol_btree_impl
+ * @param parent the parent of the nodes
+ * @param index the index of the left node in the parent
+ */
+static void btree_merge_nodes(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *parent, int index)
+{
+	struct segcol_btree_node *left = parent->entries[index].child;
+	struct segcol_btree_node *right = parent->entries[index + 1].child;
+	off_t left_size = node_size(left);
+	int i;
+
+	for (i = 0; i < right->nentries; i++) {
+		int j = left->nentries + i;
+		left->entries[j] = right->entries[i];
+		left->offsets[j + 1] = left_size + right->offsets[i + 1];
+		if (!left->leaf)
+			left->entries[j].child->parent = left;
+	}
+
+	left->nentries += right->nentries;
+
+	if (right->leaf)
+		btree_unlink_leaf(impl, right);
+
+	/* The left node takes up the byte count of the right one */
+	off_t right_size = node_remove_raw(parent, index + 1);
+
+	for (i = index + 1; i <= parent->nentries; i++)
+		parent->offsets[i] += right_size;
+
+	free(right);
+}
+
+/**
+ * Restores the B+ tree properties after entries have been removed from a node.
+ *
+ * Empty nodes are removed and nodes with few entries are merged with
+ * a sibling, if the sibling has enough room.
+ */
+static void btree_rebalance(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *node)
+{
+	while (node->parent != NULL) {
+		struct segcol_btree_node *parent = node->parent;
+
+		if (node->nentries >= BTREE_MIN_ENTRIES)
+			return;
+
+		int index = node_child_index(node);
+
+		if (node->nentries == 0) {
+			if (node->leaf)
+				btree_unlink_leaf(impl, node);
+			node_remove_raw(parent, index);
+			free(node);
+		} else if (index + 1 < parent->nentries &&
+				node->nentries + parent->entries[index + 1].child->nentries
+				<= BTREE_MAX_ENTRIES) {
+			btree_merge_nodes(impl, parent, index);
+		} else if (index > 0 &&
+				node->nentries + parent->entries[index - 1].child->nentries
+				<= BTREE_MAX_ENTRIES) {
+			btree_merge_nodes(impl, parent, index - 1);
+		} else {
+			return;
+		}
+
+		node = parent;
+	}
+
+	/* Shrink the tree while the root has only one child */
+	while (!node->leaf && node->nentries == 1) {
+		struct segcol_btree_node *child = node->entries[0].child;
+		child->parent = NULL;
+		impl->root = child;
+		impl->height--;
+		free(node);
+		node = child;
+	}
+}
+
+/**
+ * Removes an entry from a node.
+ *
+ * Removing an entry never fails (it doesn't need any new nodes).
+ */
+static void btree_remove_entry(struct segcol_btree_impl *impl,
+		struct segcol_btree_node *node, int index)
+{
+	off_t size = node_remove_raw(node, index);
+
+	btree_propagate_size_change(node, -size);
+	btree_rebalance(impl, node);
+}
+
+/**
+ * Finds the leaf entry that contains a logical offset.
+ *
+ * @param impl the segcol_btree_impl
+ * @param offset the offset to look for
+ * @param[out] index the index of the found entry in the leaf
+ * @param[out] mapping the mapping of the found entry
+ *
+ * @return the found leaf or NULL if the offset is out of range
+ */
+static struct segcol_btree_node *btree_find_leaf(
+		struct segcol_btree_impl *impl, off_t offset, int *index,
+		off_t *mapping)
+{
+	struct segcol_btree_node *node = impl->root;
+	off_t base = 0;
+
+	if (offset < 0 || offset >= node_size(node))
+		return NULL;
+
+	while (1) {
+		int i = node_search(node, offset - base);
+
+		base += node->offsets[i];
+
+		if (node->leaf) {
+			*index = i;
+			*mapping = base;
+			return node;
+		}
+
+		node = node->entries[i].child;
+	}
+}
+
+/**
+ * Merges the segments on either side of a logical offset, if they are
+ * contiguous parts of the same data object.
+ *
+ * @param impl the segcol_btree_impl
+ * @param offset the offset (must be the start of a segment, the end of the
+ *        segcol or 0)
+ */
+static void btree_merge_at(struct segcol_btree_impl *impl, off_t offset)
+{
+	if (offset <= 0 || offset >= node_size(impl->root))
+		return;
+
+	int index;
+	off_t mapping;
+	struct segcol_btree_node *leaf =
+		btree_find_leaf(impl, offset - 1, &index, &mapping);
+
+	struct segcol_btree_node *next_leaf = leaf;
+	int next_index = index + 1;
+
+	if (next_index == leaf->nentries) {
+		next_leaf = leaf->next;
+		next_index = 0;
+	}
+
+	segment_t *seg = leaf->entries[index].segment;
+	segment_t *next_seg = next_leaf->entries[next_index].segment;
+
+	int can_merge;
+	segment_can_merge(seg, next_seg, &can_merge);
+	if (!can_merge)
+		return;
+
+	segment_merge(seg, next_seg);
+
+	/* -[E]-[N]- => -[E+N]- */
+	btree_set_entry_size(leaf, index, node_entry_size(leaf, index) +
+			node_entry_size(next_leaf, next_index));
+	btree_remove_entry(impl, next_leaf, next_index);
+
+	segment_free(next_seg);
+}
+
+/**
+ * Frees a subtree and the segments in it.
+ */
+static void btree_free_subtree(struct segcol_btree_node *node)
+{
+	int i;
+
+	for (i = 0; i < node->nentries; i++) {
+		if (node->leaf)
+			segment_free(node->entries[i].segment);
+		else
+			btree_free_subtree(node->entries[i].child);
+	}
+
+	free(node);
+}
+
+/*****************
+ * API functions *
+ *****************/
+
+/**
+ * Creates a new segcol_t using a B+ tree implementation.
+ *
+ * @param[out] segcol the created segcol_t
+ *
+ * @return the operation error code
+ */
+int segcol_btree_new(segcol_t **segcol)
+{
+	if (segcol == NULL)
+		return_error(EINVAL);
+
+	/* Allocate memory for implementation */
+	struct segcol_btree_impl *impl = malloc(sizeof(struct segcol_btree_impl));
+
+	if (impl == NULL)
+		return_error(ENOMEM);
+
+	/* The tree always has at least one (possibly empty) leaf */
+	impl->root = btree_node_new(1);
+
+	if (impl->root == NULL) {
+		free(impl);
+		return_error(ENOMEM);
+	}
+
+	impl->first = impl->root;
+	impl->last = impl->root;
+	impl->height = 1;
+	impl->spare = NULL;
+	impl->nspare = 0;
+
+	/* Create segcol_t */
+	int err = segcol_create_impl(segcol, impl, &segcol_btree_funcs);
+
+	if (err) {
+		free(impl->root);
+		free(impl);
+		return_error(err);
+	}
+
+	return 0;
+}
+
+static int segcol_btree_free(segcol_t *segcol)
+{
+	if (segcol == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_impl *impl =
+		(struct segcol_btree_impl *) segcol_get_impl(segcol);
+
+	btree_free_subtree(impl->root);
+	btree_release_nodes(impl);
+
+	free(impl);
+
+	return 0;
+}
+
+static int segcol_btree_append(segcol_t *segcol, segment_t *seg)
+{
+	if (segcol == NULL || seg == NULL)
+		return_error(EINVAL);
+
+	/*
+	 * If the segment size is 0, return successfully without adding
+	 * anything. Free the segment as we will not be using it.
+	 */
+	off_t seg_size;
+	segment_get_size(seg, &seg_size);
+	if (seg_size == 0) {
+		segment_free(seg);
+		return 0;
+	}
+
+	struct segcol_btree_impl *impl =
+		(struct segcol_btree_impl *) segcol_get_impl(segcol);
+
+	int err = btree_reserve_nodes(impl, impl->height + 1);
+	if (err) {
+		btree_release_nodes(impl);
+		return_error(err);
+	}
+
+	union segcol_btree_entry entry = { .segment = seg };
+	off_t offset = node_size(impl->root);
+	btree_insert_entry(impl, impl->last, impl->last->nentries, entry,
+			seg_size);
+	btree_merge_at(impl, offset);
+
+	btree_release_nodes(impl);
+
+	return 0;
+}
+
+static int segcol_btree_insert(segcol_t *segcol, off_t offset, segment_t *seg)
+{
+	if (segcol == NULL || seg == NULL || offset < 0)
+		return_error(EINVAL);
+
+	struct segcol_btree_impl *impl =
+		(struct segcol_btree_impl *) segcol_get_impl(segcol);
+
+	/* find the leaf entry that 'offset' is mapped to */
+	int index;
+	off_t mapping;
+	struct segcol_btree_node *leaf =
+		btree_find_leaf(impl, offset, &index, &mapping);
+	if (leaf == NULL)
+		return_error(EINVAL);
+
+	/*
+	 * If the segment size is 0, return successfully without adding
+	 * anything. Free the segment as we will not be using it.
+	 * This check is placed after the search so that the validity of offset
+	 * (if it is in range) is checked first.
+	 */
+	off_t seg_size;
+	segment_get_size(seg, &seg_size);
+	if (seg_size == 0) {
+		segment_free(seg);
+		return 0;
+	}
+
+	/* Reserve enough nodes for inserting two entries */
+	int err = btree_reserve_nodes(impl, 2 * (impl->height + 2));
+	if (err)
+		goto_error(err, on_error);
+
+	union segcol_btree_entry entry = { .segment = seg };
+
+	/* where to split the existing segment */
+	off_t split_index = offset - mapping;
+
+	/* check if a split is actually needed or we just have to prepend
+	 * the new segment */
+	if (split_index == 0) {
+		btree_insert_entry(impl, leaf, index, entry, seg_size);
+		btree_merge_at(impl, offset + seg_size);
+		btree_merge_at(impl, offset);
+		btree_release_nodes(impl);
+		return 0;
+	}
+
+	segment_t *rseg;
+	err = segment_split(leaf->entries[index].segment, &rseg, split_index);
+	if (err)
+		goto_error(err, on_error);
+
+	off_t rseg_size = node_entry_size(leaf, index) - split_index;
+	btree_set_entry_size(leaf, index, split_index);
+
+	/* -[P]-[N]- => -[P]-[Q]-[R]-[N]- */
+	btree_insert_segment_at(impl, offset, rseg, rseg_size);
+	btree_insert_segment_at(impl, offset, seg, seg_size);
+	btree_merge_at(impl, offset + seg_size);
+	btree_merge_at(impl, offset);
+
+	btree_release_nodes(impl);
+
+	return 0;
+
+on_error:
+	btree_release_nodes(impl);
+	return err;
+}
+
+/*
+ * The algorithm first splits the segments at the boundaries of the range so
+ * that the range consists of whole entries. It then moves the entries of the
+ * range, in order, to the deleted segcol (or frees them). All the nodes that
+ * may be needed are reserved before the tree is altered, so that a failure
+ * leaves the segcol intact.
+ *
+ *  -[P]-[a|F]-[]-[]-[L|b]-[N]-  => -[P]-[a]-[F]-[]-[]-[L]-[b]-[N]-
+ *          ^           ^        => -[P]-[a]-[b]-[N]-
+ *        offset  offset + length
+ */
+static int segcol_btree_delete(segcol_t *segcol, segcol_t **deleted, off_t
+		offset, off_t length)
+{
+	if (segcol == NULL || offset < 0 || length < 0)
+		return_error(EINVAL);
+
+	/* Check range for overflow */
+	if (__MAX(off_t) - offset < length - 1 * (length != 0))
+		return_error(EOVERFLOW);
+
+	struct segcol_btree_impl *impl =
+		(struct segcol_btree_impl *) segcol_get_impl(segcol);
+
+	/* Find the first and last leaf entries that contain the range */
+	int first_index;
+	off_t first_mapping;
+	struct segcol_btree_node *first_leaf =
+		btree_find_leaf(impl, offset, &first_index, &first_mapping);
+	if (first_leaf == NULL)
+		return_error(EINVAL);
+
+	int err;
+
+	/*
+	 * If the length is 0 return successfully without doing anything.
+	 * This check is placed after the first search so that the validity of
+	 * offset (if it is in range) is checked first.
+	 */
+	if (length == 0) {
+		/* Return an empty deleted segcol if the caller wants one */
+		if (deleted != NULL) {
+			err = segcol_btree_new(deleted);
+			if (err)
+				return_error(err);
+		}
+		return 0;
+	}
+
+	int last_index;
+	off_t last_mapping;
+	struct segcol_btree_node *last_leaf =
+		btree_find_leaf(impl, offset + length - 1, &last_index, &last_mapping);
+	if (last_leaf == NULL)
+		return_error(EINVAL);
+
+	/* Reserve everything we may need */
+	segcol_t *deleted_tmp = NULL;
+	struct segcol_btree_impl *deleted_impl = NULL;
+
+	err = btree_reserve_nodes(impl, 2 * (impl->height + 2));
+	if (err)
+		goto_error(err, on_error_alloc);
+
+	if (deleted != NULL) {
+		/* Count the entries that will be moved to the deleted segcol */
+		struct segcol_btree_node *leaf = first_leaf;
+		int index = first_index;
+		size_t count = 1;
+
+		while (leaf != last_leaf || index != last_index) {
+			if (++index == leaf->nentries) {
+				leaf = leaf->next;
+				index = 0;
+			}
+			count++;
+		}
+
+		err = segcol_btree_new(&deleted_tmp);
+		if (err)
+			goto_error(err, on_error_alloc);
+
+		deleted_impl = (struct segcol_btree_impl *) segcol_get_impl(deleted_tmp);
+
+		err = btree_reserve_nodes(deleted_impl, btree_nodes_for_entries(count));
+		if (err)
+			goto_error(err, on_error_alloc);
+	}
+
+	segment_t *first_seg = first_leaf->entries[first_index].segment;
+	segment_t *last_seg = last_leaf->entries[last_index].segment;
+	segment_t *aseg = NULL;
+	segment_t *bseg = NULL;
+
+	int split_first = (first_mapping < offset);
+	int split_last = (last_mapping + node_entry_size(last_leaf, last_index)
+			> offset + length);
+
+	/*
+	 * Split the segments at the range boundaries. If the range is contained
+	 * in a single segment, the second split is performed on the part of the
+	 * segment that remains after the first split.
+	 */
+	if (split_first) {
+		err = segment_split(first_seg, &aseg, offset - first_mapping);
+		if (err)
+			goto_error(err, on_error_alloc);
+	}
+
+	if (split_last) {
+		segment_t *seg = last_seg;
+		off_t seg_mapping = last_mapping;
+
+		if (split_first && first_seg == last_seg) {
+			seg = aseg;
+			seg_mapping = offset;
+		}
+
+		err = segment_split(seg, &bseg, offset + length - seg_mapping);
+		if (err)
+			goto_error(err, on_error_split);
+	}
+
+	/* Update the tree to contain the split segments */
+	off_t seg_size;
+
+	segment_get_size(first_seg, &seg_size);
+	btree_set_entry_size(first_leaf, first_index, seg_size);
+
+	segment_get_size(last_seg, &seg_size);
+	btree_set_entry_size(last_leaf, last_index, seg_size);
+
+	if (split_first) {
+		segment_get_size(aseg, &seg_size);
+		btree_insert_segment_at(impl, offset, aseg, seg_size);
+	}
+
+	if (split_last) {
+		segment_get_size(bseg, &seg_size);
+		btree_insert_segment_at(impl, offset + length, bseg, seg_size);
+	}
+
+	/* Move the entries in the range to the deleted segcol (or free them) */
+	off_t removed = 0;
+
+	while (removed < length) {
+		int index;
+		off_t mapping;
+		struct segcol_btree_node *leaf =
+			btree_find_leaf(impl, offset, &index, &mapping);
+
+		union segcol_btree_entry entry = leaf->entries[index];
+		off_t size = node_entry_size(leaf, index);
+
+		btree_remove_entry(impl, leaf, index);
+
+		if (deleted_impl != NULL) {
+			btree_insert_entry(deleted_impl, deleted_impl->last,
+					deleted_impl->last->nentries, entry, size);
+		} else {
+			segment_free(entry.segment);
+		}
+
+		removed += size;
+	}
+
+	/* The segments around the deleted range may now be contiguous */
+	btree_merge_at(impl, offset);
+
+	btree_release_nodes(impl);
+
+	if (deleted != NULL) {
+		btree_release_nodes(deleted_impl);
+		*deleted = deleted_tmp;
+	}
+
+	return 0;
+
+/*
+ * Handle failures so that the segcol is in its expected state
+ * after a failure and there are no memory leaks.
+ */
+on_error_split:
+	if (split_first) {
+		segment_merge(first_seg, aseg);
+		segment_free(aseg);
+	}
+on_error_alloc:
+	btree_release_nodes(impl);
+	if (deleted_tmp != NULL) segcol_free(deleted_tmp);
+	return err;
+}
+
+static int segcol_btree_find(segcol_t *segcol, segcol_iter_t **iter, off_t offset)
+{
+	if (segcol == NULL || iter == NULL || offset < 0)
+		return_error(EINVAL);
+
+	struct segcol_btree_impl *impl =
+		(struct segcol_btree_impl *) segcol_get_impl(segcol);
+
+	int index;
+	off_t mapping;
+	struct segcol_btree_node *leaf =
+		btree_find_leaf(impl, offset, &index, &mapping);
+
+	/* Make sure offset is in range */
+	if (leaf == NULL)
+		return_error(EINVAL);
+
+	/* Create iterator to return search results */
+	int err = segcol_iter_new(segcol, iter);
+	if (err)
+		return_error(err);
+
+	struct segcol_btree_iter_impl *iter_impl =
+		(struct segcol_btree_iter_impl *) segcol_iter_get_impl(*iter);
+
+	iter_impl->leaf = leaf;
+	iter_impl->index = index;
+	iter_impl->mapping = mapping;
+
+	return 0;
+}
+
+static int segcol_btree_iter_new(segcol_t *segcol, void **iter_impl)
+{
+	if (segcol == NULL || iter_impl == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_impl *impl =
+		(struct segcol_btree_impl *) segcol_get_impl(segcol);
+	struct segcol_btree_iter_impl **iter_impl1 =
+		(struct segcol_btree_iter_impl **)iter_impl;
+
+	*iter_impl1 = malloc(sizeof(struct segcol_btree_iter_impl));
+	if (*iter_impl1 == NULL)
+		return_error(ENOMEM);
+
+	(*iter_impl1)->leaf = impl->first;
+	(*iter_impl1)->index = 0;
+	(*iter_impl1)->mapping = 0;
+
+	return 0;
+}
+
+static int segcol_btree_iter_next(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+	struct segcol_btree_node *leaf = iter_impl->leaf;
+
+	if (iter_impl->index < leaf->nentries) {
+		iter_impl->mapping += node_entry_size(leaf, iter_impl->index);
+		iter_impl->index++;
+
+		/* Move to the next leaf, but stay past the end of the last one */
+		if (iter_impl->index == leaf->nentries && leaf->next != NULL) {
+			iter_impl->leaf = leaf->next;
+			iter_impl->index = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int segcol_btree_iter_prev(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+	struct segcol_btree_node *leaf = iter_impl->leaf;
+
+	if (iter_impl->index < leaf->nentries) {
+		if (iter_impl->index > 0) {
+			iter_impl->index--;
+		} else if (leaf->prev != NULL) {
+			iter_impl->leaf = leaf->prev;
+			iter_impl->index = iter_impl->leaf->nentries - 1;
+		} else {
+			/*
+			 * Moving before the first entry: point past the end of the
+			 * first leaf, which is an invalid position
+			 */
+			iter_impl->index = leaf->nentries;
+			return 0;
+		}
+
+		iter_impl->mapping -= node_entry_size(iter_impl->leaf,
+				iter_impl->index);
+	}
+
+	return 0;
+}
+
+static int segcol_btree_iter_get_segment(segcol_iter_t *iter, segment_t **seg)
+{
+	if (iter == NULL || seg == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	if (iter_impl->index < iter_impl->leaf->nentries)
+		*seg = iter_impl->leaf->entries[iter_impl->index].segment;
+	else
+		*seg = NULL;
+
+	return 0;
+}
+
+static int segcol_btree_iter_get_mapping(segcol_iter_t *iter, off_t *mapping)
+{
+	if (iter == NULL || mapping == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	if (iter_impl->index < iter_impl->leaf->nentries)
+		*mapping = iter_impl->mapping;
+	else
+		*mapping = -1;
+
+	return 0;
+}
+
+static int segcol_btree_iter_is_valid(segcol_iter_t *iter, int *valid)
+{
+	if (iter == NULL || valid == NULL)
+		return_error(EINVAL);
+
+	struct segcol_btree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	*valid = (iter_impl != NULL) &&
+		(iter_impl->index < iter_impl->leaf->nentries);
+
+	return 0;
+}
+
+static int segcol_btree_iter_free(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+
+	free(segcol_iter_get_impl(iter));
+
+	return 0;
+}
@@ -45,6 +45,7 @@ struct segcol_funcs {
 		int (*find)(segcol_t *segcol, segcol_iter_t **iter, off_t offset);
 		int (*iter_new)(segcol_t *segcol, void **iter);
 		int (*iter_next)(segcol_iter_t *iter);
+		int (*iter_prev)(segcol_iter_t *iter);
 		int (*iter_is_valid)(segcol_iter_t *iter, int *valid);
 		int (*iter_get_segment)(segcol_iter_t *iter, segment_t **seg);
 		int (*iter_get_mapping)(segcol_iter_t *iter, off_t *mapping);
@@ -21,8 +21,17 @@
  * @file segcol_list.c
  *
  * List implementation of segcol_t
+ *
+ * The segments are kept in a doubly linked list. To avoid walking the list
+ * when searching, the list is indexed by a skip list: each node is randomly
+ * given a height and is also linked, at every level below its height, to the
+ * next node of at least the same height. Each such link also records the
+ * number of bytes it spans, so a search can skip over many nodes at once and
+ * takes O(log n) expected time. The list itself is the lowest level of the
+ * index, so iterating over the segments is as cheap as before.
  */
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 
 #include "segcol.h"
@@ -32,9 +41,28 @@
 #include "list.h"
 #include "debug.h"
 
+/** The number of levels of the skip list index (including the list) */
+#define SEGCOL_LIST_SKIP_LEVELS 16
+
+/**
+ * A link of a node in a level of the skip list index.
+ */
+struct skip_link {
+	/** the next node in the level (NULL for the last one) */
+	struct segment_entry *next;
+	/**
+	 * the bytes from the start of this node to the start of the next node
+	 * (or to the end of the segcol, if this is the last node)
+	 */
+	off_t span;
+};
+
 struct segment_entry {
 	struct list_node ln;
 	segment_t *segment;
+	int height;
+	/* links[l - 1] is the link of the node in level l (1 <= l < height) */
+	struct skip_link links[];
 };
 
 struct segcol_list_iter_impl {
@@ -42,23 +70,64 @@ struct segcol_list_iter_impl {
 	off_t mapping;
 };
 
+/** The number of positions (cursors) kept in the search cache */
+#define SEGCOL_LIST_CACHE_SIZE 4
+
+/**
+ * The maximum number of nodes a search walks from a cached position before
+ * falling back to the skip list index.
+ */
+#define SEGCOL_LIST_CACHE_NEAR 8
+
+struct segcol_list_cache_entry {
+	struct list_node *node;
+	off_t mapping;
+	unsigned long last_used;
+};
+
 struct segcol_list_impl {
 	list_t *list;
-	struct list_node *cached_node;
-	off_t cached_mapping;
+	struct segment_entry *skip_head;
+	uint32_t skip_seed;
+	struct segcol_list_cache_entry cache[SEGCOL_LIST_CACHE_SIZE];
+	unsigned long cache_clock;
+	size_t cache_hits;
+	size_t cache_misses;
 };
 
 /* Forward declarations */
 
 /* internal convenience functions */
+static int segment_entry_new(struct segcol_list_impl *impl,
+		struct segment_entry **entry, segment_t *seg);
+static void skip_insert(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping, off_t size);
+static void skip_remove(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping, off_t size);
+static void skip_resize(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping, off_t change);
+static void skip_find(struct segcol_list_impl *impl, off_t offset,
+		struct list_node **node, off_t *mapping);
 static int find_seg_entry(segcol_t *segcol, 
 		struct segment_entry **snode, off_t *mapping, off_t offset);
+static int segcol_list_merge_next(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping);
+static void segcol_list_coalesce(struct segcol_list_impl *impl,
+		struct segment_entry **entry, off_t *mapping);
 static int segcol_list_clear_cache(struct segcol_list_impl *impl);
 static int segcol_list_set_cache(struct segcol_list_impl *impl,
 		struct list_node *node, off_t mapping);
+static int segcol_list_update_cache(struct segcol_list_impl *impl,
+		int index, struct list_node *node, off_t mapping);
+static void segcol_list_shift_cache(struct segcol_list_impl *impl,
+		off_t from, off_t change);
+static void segcol_list_invalidate_cache(struct segcol_list_impl *impl,
+		off_t start, off_t end);
 
 /* segcol API implementation functions */
 int segcol_list_new(segcol_t **segcol);
+int segcol_list_get_cache_stats(segcol_t *segcol, size_t *hits,
+		size_t *misses);
 static int segcol_list_free(segcol_t *segcol);
 static int segcol_list_append(segcol_t *segcol, segment_t *seg); 
 static int segcol_list_insert(segcol_t *segcol, off_t offset, segment_t *seg); 
@@ -66,6 +135,7 @@ static int segcol_list_delete(segcol_t *segcol, segcol_t **deleted, off_t offset
 static int segcol_list_find(segcol_t *segcol, segcol_iter_t **iter, off_t offset);
 static int segcol_list_iter_new(segcol_t *segcol, void **iter);
 static int segcol_list_iter_next(segcol_iter_t *iter);
+static int segcol_list_iter_prev(segcol_iter_t *iter);
 static int segcol_list_iter_is_valid(segcol_iter_t *iter, int *valid);
 static int segcol_list_iter_get_segment(segcol_iter_t *iter, segment_t **seg);
 static int segcol_list_iter_get_mapping(segcol_iter_t *iter, off_t *mapping);
@@ -80,12 +150,279 @@ static struct segcol_funcs segcol_list_funcs = {
 	.find = segcol_list_find,
 	.iter_new = segcol_list_iter_new,
 	.iter_next = segcol_list_iter_next,
+	.iter_prev = segcol_list_iter_prev,
 	.iter_is_valid = segcol_list_iter_is_valid,
 	.iter_get_segment = segcol_list_iter_get_segment,
 	.iter_get_mapping = segcol_list_iter_get_mapping,
 	.iter_free = segcol_list_iter_free
 };
 
+/**
+ * Creates a new segment entry with a random skip list height.
+ *
+ * @param impl the segcol_list_impl the entry will belong to
+ * @param[out] entry the created entry
+ * @param seg the segment the entry will hold
+ *
+ * @return the operation error code
+ */
+static int segment_entry_new(struct segcol_list_impl *impl,
+		struct segment_entry **entry, segment_t *seg)
+{
+	/* Each level holds 1/4 of the nodes of the level below it (xorshift32) */
+	uint32_t x = impl->skip_seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	impl->skip_seed = x;
+
+	int height = 1;
+	while (height < SEGCOL_LIST_SKIP_LEVELS && (x & 3) == 0) {
+		height++;
+		x >>= 2;
+	}
+
+	struct segment_entry *e = malloc(sizeof(struct segment_entry) +
+			(height - 1) * sizeof(struct skip_link));
+	if (e == NULL)
+		return_error(ENOMEM);
+
+	e->segment = seg;
+	e->height = height;
+
+	*entry = e;
+
+	return 0;
+}
+
+/**
+ * Finds, in every level of the skip list index, the last node that starts
+ * before a logical offset.
+ *
+ * @param impl the segcol_list_impl
+ * @param offset the offset
+ * @param[out] update the found nodes (indexed by level)
+ * @param[out] update_mapping the mappings of the found nodes
+ */
+static void skip_find_before(struct segcol_list_impl *impl, off_t offset,
+		struct segment_entry **update, off_t *update_mapping)
+{
+	struct segment_entry *x = impl->skip_head;
+	off_t mapping = 0;
+	int l;
+
+	for (l = SEGCOL_LIST_SKIP_LEVELS - 1; l >= 1; l--) {
+		struct skip_link *link = &x->links[l - 1];
+
+		while (link->next != NULL && mapping + link->span < offset) {
+			mapping += link->span;
+			x = link->next;
+			link = &x->links[l - 1];
+		}
+
+		update[l] = x;
+		update_mapping[l] = mapping;
+	}
+}
+
+/**
+ * Adds an entry to the skip list index.
+ *
+ * The entry must have already been inserted in the list.
+ *
+ * @param impl the segcol_list_impl
+ * @param entry the entry to add
+ * @param mapping the mapping of the entry
+ * @param size the size of the segment held in the entry
+ */
+static void skip_insert(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping, off_t size)
+{
+	struct segment_entry *update[SEGCOL_LIST_SKIP_LEVELS];
+	off_t update_mapping[SEGCOL_LIST_SKIP_LEVELS];
+	int l;
+
+	skip_find_before(impl, mapping, update, update_mapping);
+
+	for (l = 1; l < SEGCOL_LIST_SKIP_LEVELS; l++) {
+		struct skip_link *ulink = &update[l]->links[l - 1];
+
+		if (l < entry->height) {
+			struct skip_link *link = &entry->links[l - 1];
+			link->next = ulink->next;
+			link->span = update_mapping[l] + ulink->span - mapping + size;
+			ulink->next = entry;
+			ulink->span = mapping - update_mapping[l];
+		} else {
+			ulink->span += size;
+		}
+	}
+}
+
+/**
+ * Removes an entry from the skip list index.
+ *
+ * @param impl the segcol_list_impl
+ * @param entry the entry to remove
+ * @param mapping the mapping of the entry
+ * @param size the size of the entry, as known by the index
+ */
+static void skip_remove(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping, off_t size)
+{
+	struct segment_entry *update[SEGCOL_LIST_SKIP_LEVELS];
+	off_t update_mapping[SEGCOL_LIST_SKIP_LEVELS];
+	int l;
+
+	skip_find_before(impl, mapping, update, update_mapping);
+
+	for (l = 1; l < SEGCOL_LIST_SKIP_LEVELS; l++) {
+		struct skip_link *ulink = &update[l]->links[l - 1];
+
+		if (l < entry->height) {
+			ulink->span += entry->links[l - 1].span - size;
+			ulink->next = entry->links[l - 1].next;
+		} else {
+			ulink->span -= size;
+		}
+	}
+}
+
+/**
+ * Changes the size of an entry in the skip list index.
+ *
+ * This must be called whenever the size of a segment held in the list
+ * changes, so that the byte spans of the index remain valid.
+ *
+ * @param impl the segcol_list_impl
+ * @param entry the entry whose size changed
+ * @param mapping the mapping of the entry
+ * @param change the change in the size of the entry
+ */
+static void skip_resize(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping, off_t change)
+{
+	struct segment_entry *update[SEGCOL_LIST_SKIP_LEVELS];
+	off_t update_mapping[SEGCOL_LIST_SKIP_LEVELS];
+	int l;
+
+	skip_find_before(impl, mapping, update, update_mapping);
+
+	for (l = 1; l < SEGCOL_LIST_SKIP_LEVELS; l++) {
+		if (l < entry->height)
+			entry->links[l - 1].span += change;
+		else
+			update[l]->links[l - 1].span += change;
+	}
+}
+
+/**
+ * Walks the list from a node to the node that contains a logical offset.
+ *
+ * @param[in,out] node the node to start from and the found node
+ * @param[in,out] mapping the mapping of the start node and the found node
+ * @param offset the offset to look for (must be in range)
+ * @param max_steps the maximum number of nodes to move (-1 for no limit)
+ *
+ * @return 1 if the node was found, 0 if it wasn't found in max_steps steps
+ */
+static int segcol_list_walk(struct list_node **node, off_t *mapping,
+		off_t offset, int max_steps)
+{
+	struct list_node *cur_node = *node;
+	off_t cur_mapping = *mapping;
+	int fix_mapping = 0;
+	int steps = 0;
+
+	while (cur_node != cur_node->next && cur_node != cur_node->prev) {
+		struct segment_entry *snode =
+			list_entry(cur_node, struct segment_entry, ln);
+
+		off_t seg_size;
+		segment_get_size(snode->segment, &seg_size);
+
+		/* 
+		 * When we move backwards in the list the new mapping is the
+		 * cur_mapping - prev_seg->size. In order to avoid getting the
+		 * size twice we just set a flag to indicate that we should fix
+		 * the mapping.
+		 */
+		if (fix_mapping)
+			cur_mapping -= seg_size;
+
+		/* We have found the node! */
+		if (offset >= cur_mapping && offset < cur_mapping + seg_size) {
+			*node = cur_node;
+			*mapping = cur_mapping;
+			return 1;
+		}
+
+		if (steps++ == max_steps)
+			break;
+
+		/* 
+		 * Move forwards or backwards in the list depending on where
+		 * is the offset relative to the current node.
+		 */
+		if (offset < cur_mapping) {
+			cur_node = cur_node->prev;
+			/* 
+			 * Fix the mapping in the next iteration. Otherwise we would have
+			 * to get the size here, which is a waste since we are doing
+			 * that at the start of the loop.
+			 */
+			fix_mapping = 1;
+		}
+		else {
+			cur_node = cur_node->next;
+			fix_mapping = 0;
+			cur_mapping += seg_size;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Finds the list node that contains a logical offset using the skip list
+ * index.
+ *
+ * @param impl the segcol_list_impl
+ * @param offset the offset to look for (must be in range)
+ * @param[out] node the found node
+ * @param[out] mapping the mapping of the found node
+ */
+static void skip_find(struct segcol_list_impl *impl, off_t offset,
+		struct list_node **node, off_t *mapping)
+{
+	struct segment_entry *x = impl->skip_head;
+	off_t cur_mapping = 0;
+	int l;
+
+	/* Descend the index to the last indexed node at or before offset */
+	for (l = SEGCOL_LIST_SKIP_LEVELS - 1; l >= 1; l--) {
+		struct skip_link *link = &x->links[l - 1];
+
+		while (link->next != NULL && cur_mapping + link->span <= offset) {
+			cur_mapping += link->span;
+			x = link->next;
+			link = &x->links[l - 1];
+		}
+	}
+
+	/* Walk the rest of the way in the list */
+	if (x == impl->skip_head)
+		*node = list_head(impl->list)->next;
+	else
+		*node = &x->ln;
+
+	*mapping = cur_mapping;
+
+	segcol_list_walk(node, mapping, offset, -1);
+}
+
 /**
  * Finds the segment entry in the segcol_list that contains a logical offset.
  * 
@@ -119,6 +456,84 @@ static int find_seg_entry(segcol_t *segcol,
 	return 0;
 }
 
+/**
+ * Merges a node with the node that follows it, if their segments are
+ * contiguous parts of the same data object.
+ *
+ * @param impl the segcol_list_impl
+ * @param entry the node to merge the next node into
+ * @param mapping the mapping of the node
+ *
+ * @return 1 if the nodes were merged, 0 otherwise
+ */
+static int segcol_list_merge_next(struct segcol_list_impl *impl,
+		struct segment_entry *entry, off_t mapping)
+{
+	if (&entry->ln == list_head(impl->list)
+		|| entry->ln.next == list_tail(impl->list))
+		return 0;
+
+	struct segment_entry *next =
+		list_entry(entry->ln.next, struct segment_entry, ln);
+
+	int can_merge;
+	segment_can_merge(entry->segment, next->segment, &can_merge);
+	if (!can_merge)
+		return 0;
+
+	off_t size;
+	segment_get_size(entry->segment, &size);
+
+	off_t next_size;
+	segment_get_size(next->segment, &next_size);
+
+	segment_merge(entry->segment, next->segment);
+
+	/* -[E]-[N]- => -[E+N]- */
+	skip_remove(impl, next, mapping + size, next_size);
+	skip_resize(impl, entry, mapping, next_size);
+	list_delete_chain(&next->ln, &next->ln);
+
+	segcol_list_invalidate_cache(impl, mapping + size, mapping + size);
+
+	segment_free(next->segment);
+	free(next);
+
+	return 1;
+}
+
+/**
+ * Merges a node with its neighbours, if their segments are contiguous parts
+ * of the same data object.
+ *
+ * This keeps the number of nodes proportional to the number of edits
+ * instead of the number of (possibly contiguous) pieces of data added.
+ *
+ * @param impl the segcol_list_impl
+ * @param[in,out] entry the node to merge and the node that holds it after
+ *                      merging
+ * @param[in,out] mapping the mapping of the node before and after merging
+ */
+static void segcol_list_coalesce(struct segcol_list_impl *impl,
+		struct segment_entry **entry, off_t *mapping)
+{
+	segcol_list_merge_next(impl, *entry, *mapping);
+
+	if ((*entry)->ln.prev == list_head(impl->list))
+		return;
+
+	struct segment_entry *prev =
+		list_entry((*entry)->ln.prev, struct segment_entry, ln);
+
+	off_t prev_size;
+	segment_get_size(prev->segment, &prev_size);
+
+	if (segcol_list_merge_next(impl, prev, *mapping - prev_size)) {
+		*entry = prev;
+		*mapping -= prev_size;
+	}
+}
+
 /**
  * Clears the search cache of a segcol_list_impl.
  *
@@ -131,100 +546,172 @@ static int segcol_list_clear_cache(struct segcol_list_impl *impl)
 	if (impl == NULL)
 		return_error(EINVAL);
 
-	impl->cached_node = NULL;
-	impl->cached_mapping = 0;
+	int i;
+	for (i = 0; i < SEGCOL_LIST_CACHE_SIZE; i++) {
+		impl->cache[i].node = NULL;
+		impl->cache[i].mapping = 0;
+		impl->cache[i].last_used = 0;
+	}
+
+	impl->cache_clock = 0;
 
 	return 0;
 }
 
 /**
- * Sets the search cache of a segcol_list_impl.
+ * Updates an entry of the search cache of a segcol_list_impl.
+ *
+ * Any other entry that holds the same node is cleared, so that the
+ * entries always refer to distinct positions.
  *
  * @param impl the segcol_list_impl
+ * @param index the index of the cache entry to update
  * @param node the cached list node
  * @param mapping the logical mapping of the cached node in the segcol_list
  *
  * @return the operation error code
  */
-static int segcol_list_set_cache(struct segcol_list_impl *impl,
-		struct list_node *node, off_t mapping)
+static int segcol_list_update_cache(struct segcol_list_impl *impl,
+		int index, struct list_node *node, off_t mapping)
 {
-	if (impl == NULL || node == NULL)
+	if (impl == NULL || node == NULL || index < 0
+		|| index >= SEGCOL_LIST_CACHE_SIZE)
 		return_error(EINVAL);
 
-	impl->cached_node = node;
-	impl->cached_mapping = mapping;
+	int i;
+	for (i = 0; i < SEGCOL_LIST_CACHE_SIZE; i++) {
+		if (i != index && impl->cache[i].node == node)
+			impl->cache[i].node = NULL;
+	}
+
+	impl->cache[index].node = node;
+	impl->cache[index].mapping = mapping;
+	impl->cache[index].last_used = ++impl->cache_clock;
 
 	return 0;
 }
 
-/*
- * Gets the closest known node/mapping pair to an offset.
+/**
+ * Sets a position in the search cache of a segcol_list_impl.
+ *
+ * If the node is already cached its entry is refreshed, otherwise the
+ * least recently used entry is replaced.
  *
  * @param impl the segcol_list_impl
- * @param node the closest known list node
- * @param mapping the mapping of the closest known node in the segcol_list
- * @param offset the offset to look for
+ * @param node the cached list node
+ * @param mapping the logical mapping of the cached node in the segcol_list
  *
  * @return the operation error code
  */
-static int segcol_list_get_closest_node(segcol_t *segcol,
-		struct list_node **node, off_t *mapping, off_t offset)
+static int segcol_list_set_cache(struct segcol_list_impl *impl,
+		struct list_node *node, off_t mapping)
 {
-	off_t segcol_size;
-	segcol_get_size(segcol, &segcol_size);
+	if (impl == NULL || node == NULL)
+		return_error(EINVAL);
 
-	struct segcol_list_impl *impl =
-		(struct segcol_list_impl *) segcol_get_impl(segcol);
+	int index = 0;
+	int i;
 
-	/* 
-	 * Calculate the distance of the head, tail and cached nodes to the offset.
-	 * The distance metric is the byte distance of the offset to the
-	 * afforementioned nodes' mappings. However, our search algorithm is
-	 * O(#segments) not O(#byte_diff), so this metric may not lead to good
-	 * results in some cases.
-	 *
-	 * Eg if the distance metric from the head is 10000 with 1000 intervening
-	 * segment nodes and the metric from the tail is 100000 with 1 intervening
-	 * segment node we will incorrectly choose head as the closest node.
-	 */
-	off_t dist_from_cache = __MAX(off_t);
-	if (impl->cached_node != NULL) {
-		*node = impl->cached_node;
-		*mapping = impl->cached_mapping;
-		if (offset > *mapping)
-			dist_from_cache = offset - *mapping; 
-		else
-			dist_from_cache = *mapping - offset;
+	for (i = 0; i < SEGCOL_LIST_CACHE_SIZE; i++) {
+		struct segcol_list_cache_entry *entry = &impl->cache[i];
+
+		if (entry->node == node) {
+			index = i;
+			break;
+		}
+
+		/* Prefer empty entries, then the least recently used one */
+		struct segcol_list_cache_entry *victim = &impl->cache[index];
+		if (victim->node != NULL && (entry->node == NULL ||
+			entry->last_used < victim->last_used))
+			index = i;
 	}
 
-	off_t dist_from_head = offset;
-	off_t dist_from_tail = segcol_size - offset;
+	return segcol_list_update_cache(impl, index, node, mapping);
+}
 
-	/*
-	 * Decide which is the closest node to the offset:
-	 * head, cached or tail.
-	 */
-	off_t cur_min = dist_from_cache;
+/**
+ * Shifts the mappings of the cached positions after an edit.
+ *
+ * @param impl the segcol_list_impl
+ * @param from the mappings at or after which to shift
+ * @param change the amount to shift the mappings by
+ */
+static void segcol_list_shift_cache(struct segcol_list_impl *impl,
+		off_t from, off_t change)
+{
+	int i;
+	for (i = 0; i < SEGCOL_LIST_CACHE_SIZE; i++) {
+		struct segcol_list_cache_entry *entry = &impl->cache[i];
+		if (entry->node != NULL && entry->mapping >= from)
+			entry->mapping += change;
+	}
+}
 
-	if (dist_from_head < cur_min) {
-		*node = list_head(impl->list)->next;
-		*mapping = 0;
-		cur_min = dist_from_head;
+/**
+ * Clears the cached positions with mappings in a range.
+ *
+ * @param impl the segcol_list_impl
+ * @param start the start of the range
+ * @param end the end of the range (inclusive)
+ */
+static void segcol_list_invalidate_cache(struct segcol_list_impl *impl,
+		off_t start, off_t end)
+{
+	int i;
+	for (i = 0; i < SEGCOL_LIST_CACHE_SIZE; i++) {
+		struct segcol_list_cache_entry *entry = &impl->cache[i];
+		if (entry->node != NULL && entry->mapping >= start
+			&& entry->mapping <= end)
+			entry->node = NULL;
 	}
+}
+
+/*
+ * Gets the cached node/mapping pair closest to an offset.
+ *
+ * The distance metric is the byte distance of the offset to the cached
+ * nodes' mappings. As walking the list is O(#segments) not O(#byte_diff), the
+ * closest cached node may still be far away in terms of nodes. The caller
+ * should only walk a bounded number of nodes from it before falling back to
+ * the skip list index.
+ *
+ * @param impl the segcol_list_impl
+ * @param node the closest cached list node
+ * @param mapping the mapping of the closest cached node in the segcol_list
+ * @param offset the offset to look for
+ *
+ * @return the index of the cache entry holding the closest node or -1 if
+ *         the cache is empty
+ */
+static int segcol_list_get_closest_node(struct segcol_list_impl *impl,
+		struct list_node **node, off_t *mapping, off_t offset)
+{
+	off_t dist_from_cache = __MAX(off_t);
+	int cache_index = -1;
+	int i;
 
-	if (dist_from_tail < cur_min) {
-		*node = list_tail(impl->list)->prev;
+	for (i = 0; i < SEGCOL_LIST_CACHE_SIZE; i++) {
+		struct segcol_list_cache_entry *entry = &impl->cache[i];
 
-		struct segment_entry *snode =
-			list_entry(*node, struct segment_entry, ln);
-		off_t seg_size;
-		segment_get_size(snode->segment, &seg_size);
+		if (entry->node == NULL)
+			continue;
 
-		*mapping = segcol_size - seg_size;
+		off_t dist;
+		if (offset > entry->mapping)
+			dist = offset - entry->mapping;
+		else
+			dist = entry->mapping - offset;
+
+		if (dist < dist_from_cache) {
+			*node = entry->node;
+			*mapping = entry->mapping;
+			cache_index = i;
+			dist_from_cache = dist;
+		}
 	}
 
-	return 0;
+	return cache_index;
 }
 
 /*****************
@@ -251,15 +738,42 @@ int segcol_list_new(segcol_t **segcol)
 
 	/* Create head and tail nodes */
 	int err = list_new(&impl->list, struct segment_entry, ln);
-	if (err)
+	if (err) {
+		free(impl);
 		return_error(err);
+	}
+
+	/* Create the head of the skip list index, which is part of all levels */
+	struct segment_entry *skip_head = malloc(sizeof(struct segment_entry) +
+			(SEGCOL_LIST_SKIP_LEVELS - 1) * sizeof(struct skip_link));
+
+	if (skip_head == NULL) {
+		list_free(impl->list);
+		free(impl);
+		return_error(ENOMEM);
+	}
+
+	skip_head->segment = NULL;
+	skip_head->height = SEGCOL_LIST_SKIP_LEVELS;
+
+	int l;
+	for (l = 1; l < SEGCOL_LIST_SKIP_LEVELS; l++) {
+		skip_head->links[l - 1].next = NULL;
+		skip_head->links[l - 1].span = 0;
+	}
+
+	impl->skip_head = skip_head;
+	impl->skip_seed = 2463534242U;
 
 	segcol_list_clear_cache(impl);
+	impl->cache_hits = 0;
+	impl->cache_misses = 0;
 
 	/* Create segcol_t */
 	err = segcol_create_impl(segcol, impl, &segcol_list_funcs);
 
 	if (err) {
+		free(impl->skip_head);
 		list_free(impl->list);
 		free(impl);
 		return_error(err);
@@ -268,6 +782,34 @@ int segcol_list_new(segcol_t **segcol)
 	return 0;
 }
 
+/**
+ * Gets the search cache statistics of a segcol_t using a linked list
+ * implementation.
+ *
+ * A search is counted as a hit if it finds its node within a few nodes of a
+ * cached position, and as a miss if it has to use the skip list index.
+ *
+ * @param segcol the segcol_t (must have been created by segcol_list_new())
+ * @param[out] hits the number of searches that were cache hits
+ * @param[out] misses the number of searches that were cache misses
+ *
+ * @return the operation error code
+ */
+int segcol_list_get_cache_stats(segcol_t *segcol, size_t *hits,
+		size_t *misses)
+{
+	if (segcol == NULL || hits == NULL || misses == NULL)
+		return_error(EINVAL);
+
+	struct segcol_list_impl *impl =
+		(struct segcol_list_impl *) segcol_get_impl(segcol);
+
+	*hits = impl->cache_hits;
+	*misses = impl->cache_misses;
+
+	return 0;
+}
+
 static int segcol_list_free(segcol_t *segcol)
 {
 	if (segcol == NULL)
@@ -289,6 +831,7 @@ static int segcol_list_free(segcol_t *segcol)
 
 	list_free(impl->list);
 
+	free(impl->skip_head);
 	free(impl);
 
 	return 0;
@@ -314,19 +857,22 @@ static int segcol_list_append(segcol_t *segcol, segment_t *seg)
 		(struct segcol_list_impl *) segcol_get_impl(segcol);
 	
 	struct segment_entry *new_entry;
-	new_entry = malloc(sizeof(struct segment_entry));
-	if (new_entry == NULL)
-		return_error(ENOMEM);
-	
-	new_entry->segment = seg;
+	int err = segment_entry_new(impl, &new_entry, seg);
+	if (err)
+		return_error(err);
+
+	off_t segcol_size;
+	segcol_get_size(segcol, &segcol_size);
 
 	/* Append at the end */
 	list_insert_before(list_tail(impl->list), &new_entry->ln);
+	skip_insert(impl, new_entry, segcol_size, seg_size);
+
+	off_t mapping = segcol_size;
+	segcol_list_coalesce(impl, &new_entry, &mapping);
 	
 	/* Set the cache at the appended node */
-	off_t segcol_size;
-	segcol_get_size(segcol, &segcol_size);
-	segcol_list_set_cache(impl, &new_entry->ln, segcol_size);
+	segcol_list_set_cache(impl, &new_entry->ln, mapping);
 
 	return 0;
 }
@@ -359,8 +905,6 @@ static int segcol_list_insert(segcol_t *segcol, off_t offset, segment_t *seg)
 		return 0;
 	}
 
-	segcol_list_clear_cache(impl);
-
 	segment_t *pseg;
 	segcol_list_iter_get_segment(iter, &pseg);
 
@@ -377,11 +921,9 @@ static int segcol_list_insert(segcol_t *segcol, off_t offset, segment_t *seg)
 	
 	/* create a list node containing the new segment */
 	struct segment_entry *qentry;
-	qentry = malloc(sizeof(struct segment_entry));
-	if (qentry == NULL)
-		return_error(ENOMEM);
-
-	qentry->segment = seg;
+	err = segment_entry_new(impl, &qentry, seg);
+	if (err)
+		return_error(err);
 
 	/* 
 	 * split the existing segment and insert the new segment
@@ -392,29 +934,49 @@ static int segcol_list_insert(segcol_t *segcol, off_t offset, segment_t *seg)
 
 	/* check if a split is actually needed or we just have to prepend 
 	 * the new segment */
-	if (split_index == 0)
+	if (split_index == 0) {
 		list_insert_before(&pentry->ln, &qentry->ln);
+		skip_insert(impl, qentry, offset, seg_size);
+	}
 	else {
+		off_t pseg_size;
+		segment_get_size(pseg, &pseg_size);
+
 		segment_t *rseg;
 		err = segment_split(pseg, &rseg, split_index);
-		if (err)
+		if (err) {
+			free(qentry);
 			return_error(err);
+		}
 		
 		struct segment_entry *rentry;
-		rentry = malloc(sizeof(struct segment_entry));
-		if (rentry == NULL) {
+		err = segment_entry_new(impl, &rentry, rseg);
+		if (err) {
 			segment_merge(pseg, rseg);
 			segment_free(rseg);
-			return_error(ENOMEM);
+			free(qentry);
+			return_error(err);
 		}
-		rentry->segment = rseg;
 
 		list_insert_after(&pentry->ln, &qentry->ln);
 		list_insert_after(&qentry->ln, &rentry->ln);
+
+		/* -[P]-[N]- => -[P]-[Q]-[R]-[N]- */
+		skip_resize(impl, pentry, mapping, split_index - pseg_size);
+		skip_insert(impl, qentry, offset, seg_size);
+		skip_insert(impl, rentry, offset + seg_size, pseg_size - split_index);
 	}
 
-	/* Set the cache at the inserted node */
-	segcol_list_set_cache(impl, &qentry->ln, offset);
+	/*
+	 * Move the cached positions after the inserted segment and set the
+	 * cache at the inserted node. A split node keeps its mapping.
+	 */
+	segcol_list_shift_cache(impl, offset, seg_size);
+
+	off_t qmapping = offset;
+	segcol_list_coalesce(impl, &qentry, &qmapping);
+
+	segcol_list_set_cache(impl, &qentry->ln, qmapping);
 
 	return 0;
 }
@@ -482,8 +1044,6 @@ static int segcol_list_delete(segcol_t *segcol, segcol_t **deleted, off_t
 		|| first_entry->segment == NULL || last_entry->segment == NULL)
 		return_error(EINVAL);
 
-	segcol_list_clear_cache(impl);
-
 	/* 
 	 * entry_a will hold the part of the first segment that we must
 	 * put back into the segcol.
@@ -493,16 +1053,13 @@ static int segcol_list_delete(segcol_t *segcol, segcol_t **deleted, off_t
 	struct segment_entry *entry_a;
 	struct segment_entry *entry_b;
 
-	entry_a = malloc(sizeof(struct segment_entry));
-	if (entry_a == NULL) {
-		err = ENOMEM;
+	err = segment_entry_new(impl, &entry_a, NULL);
+	if (err)
 		goto_error(err, on_error_mem_entry_a);
-	}
-	entry_b = malloc(sizeof(struct segment_entry));
-	if (entry_b == NULL) {
-		err = ENOMEM;
+
+	err = segment_entry_new(impl, &entry_b, NULL);
+	if (err)
 		goto_error(err, on_error_mem_entry_b);
-	}
 
 	/* 
 	 * The nodes that should go before and after entry_a and entry_b, respectively 
@@ -521,6 +1078,9 @@ static int segcol_list_delete(segcol_t *segcol, segcol_t **deleted, off_t
 	off_t new_size;
 	segcol_get_size(segcol, &new_size);
 
+	off_t first_seg_size;
+	segment_get_size(first_entry->segment, &first_seg_size);
+
 	off_t last_seg_size;
 	segment_get_size(last_entry->segment, &last_seg_size);
 
@@ -599,14 +1159,85 @@ static int segcol_list_delete(segcol_t *segcol, segcol_t **deleted, off_t
 	list_insert_chain_after(list_head(deleted_impl->list), &first_entry->ln,
 			&last_entry->ln);
 
+	/*
+	 * Update the skip list indexes. Move the entries of the deleted chain
+	 * from the index of this segcol to the index of the deleted segcol (the
+	 * index still knows the first and last entries by their size before the
+	 * splits) and add the parts of the split segments that were put back.
+	 */
+	struct list_node *node = &first_entry->ln;
+	off_t deleted_mapping = 0;
+
+	while (1) {
+		struct segment_entry *entry =
+			list_entry(node, struct segment_entry, ln);
+
+		off_t index_size;
+		if (entry == first_entry)
+			index_size = first_seg_size;
+		else if (entry == last_entry)
+			index_size = last_seg_size;
+		else
+			segment_get_size(entry->segment, &index_size);
+
+		skip_remove(impl, entry, first_mapping, index_size);
+
+		off_t seg_size;
+		segment_get_size(entry->segment, &seg_size);
+		skip_insert(deleted_impl, entry, deleted_mapping, seg_size);
+		deleted_mapping += seg_size;
+
+		if (entry == last_entry)
+			break;
+
+		node = node->next;
+	}
+
+	if (entry_a != NULL) {
+		off_t seg_size;
+		segment_get_size(entry_a->segment, &seg_size);
+		skip_insert(impl, entry_a, first_mapping, seg_size);
+	}
+
+	if (entry_b != NULL) {
+		off_t seg_size;
+		segment_get_size(entry_b->segment, &seg_size);
+		skip_insert(impl, entry_b, offset, seg_size);
+	}
+
 	/* Either return the deleted segments or free them */
 	if (deleted != NULL) 
 		*deleted = deleted_tmp;
 	else
 		segcol_free(deleted_tmp);
 
+	/*
+	 * The nodes from first_entry to last_entry have been moved out of the
+	 * segcol, so forget any cached positions at them. The positions after
+	 * them move back by the deleted length.
+	 */
+	segcol_list_invalidate_cache(impl, first_mapping, last_mapping);
+	segcol_list_shift_cache(impl, last_mapping + 1, -length);
+
+	/* The nodes around the deleted range may now hold contiguous data */
+	struct segment_entry *left_entry = entry_a;
+	off_t left_mapping = first_mapping;
+
+	if (left_entry == NULL && &entry_a_prev->ln != list_head(impl->list)) {
+		off_t prev_size;
+		segment_get_size(entry_a_prev->segment, &prev_size);
+		left_entry = entry_a_prev;
+		left_mapping = first_mapping - prev_size;
+	}
+
+	int merged = 0;
+	if (left_entry != NULL)
+		merged = segcol_list_merge_next(impl, left_entry, left_mapping);
+
 	/* Set the cache at the node after the deleted range */
-	if (entry_b != NULL)
+	if (merged)
+		segcol_list_set_cache(impl, &left_entry->ln, left_mapping);
+	else if (entry_b != NULL)
 		segcol_list_set_cache(impl, &entry_b->ln, offset);
 	else if (entry_b_next->ln.next != &entry_b_next->ln)
 		segcol_list_set_cache(impl, &entry_b_next->ln, offset);
@@ -661,58 +1292,31 @@ static int segcol_list_find(segcol_t *segcol, segcol_iter_t **iter, off_t offset
 		(struct segcol_list_impl *) segcol_get_impl(segcol);
 
 	/* 
-	 * Find the closest known node/mapping pair to the offset
-	 * and start the search from there.
+	 * Try to find the node by walking a few nodes from the closest cached
+	 * position. If that fails, search using the skip list index.
 	 */
 	struct list_node *cur_node = NULL;
 	off_t cur_mapping = -1;
 
-	segcol_list_get_closest_node(segcol, &cur_node, &cur_mapping, offset);
-	
-	int fix_mapping = 0;
-
-	/* linear search of list nodes */
-	while (cur_node != cur_node->next && cur_node != cur_node->prev) {
-		struct segment_entry *snode =
-			list_entry(cur_node, struct segment_entry, ln);
-
-		segment_t *seg = snode->segment;
-		off_t seg_size;
-		err = segment_get_size(seg, &seg_size);
+	int cache_index = segcol_list_get_closest_node(impl, &cur_node,
+			&cur_mapping, offset);
 
-		/* 
-		 * When we move backwards in the list the new mapping is the
-		 * cur_mapping - prev_seg->size. In order to avoid getting the
-		 * size twice we just set a flag to indicate that we should fix
-		 * the mapping.
+	if (cache_index >= 0 && segcol_list_walk(&cur_node, &cur_mapping, offset,
+				SEGCOL_LIST_CACHE_NEAR)) {
+		/*
+		 * Move the cached position here, so that a user accessing the
+		 * segcol sequentially keeps reusing the same entry.
 		 */
-		if (fix_mapping)
-			cur_mapping -= seg_size;
-
-		/* We have found the node! */
-		if (offset >= cur_mapping && offset < cur_mapping + seg_size) {
-			segcol_list_set_cache(impl, cur_node, cur_mapping);
-			break;
-		}
-		
-		/* 
-		 * Move forwards or backwards in the list depending on where
-		 * is the offset relative to the current node.
+		impl->cache_hits++;
+		segcol_list_update_cache(impl, cache_index, cur_node, cur_mapping);
+	} else {
+		/*
+		 * Cache the node in a new entry, so that users accessing different
+		 * regions of the segcol don't evict each other's positions.
 		 */
-		if (offset < cur_mapping) {
-			cur_node = cur_node->prev;
-			/* 
-			 * Fix the mapping in the next iteration. Otherwise we would have
-			 * to get the size here, which is a waste since we are doing
-			 * that at the start of the loop.
-			 */
-			fix_mapping = 1;
-		}
-		else if (offset >= cur_mapping + seg_size) {
-			cur_node = cur_node->next;
-			fix_mapping = 0;
-			cur_mapping += seg_size;
-		}
+		impl->cache_misses++;
+		skip_find(impl, offset, &cur_node, &cur_mapping);
+		segcol_list_set_cache(impl, cur_node, cur_mapping);
 	}
 
 	/* Create iterator to return search results */
@@ -769,6 +1373,34 @@ static int segcol_list_iter_next(segcol_iter_t *iter)
 	return 0;
 }
 
+static int segcol_list_iter_prev(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+	
+	struct segcol_list_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+	struct list_node *node = iter_impl->node;
+
+	/* Leave invalid iterators (head or tail) unchanged */
+	if (node == node->next || node == node->prev)
+		return 0;
+
+	iter_impl->node = node->prev;
+
+	/* Moving to the head invalidates the iterator */
+	if (iter_impl->node != iter_impl->node->prev) {
+		off_t node_size;
+		
+		struct segment_entry *snode =
+			list_entry(iter_impl->node, struct segment_entry, ln);
+
+		segment_get_size(snode->segment, &node_size);
+		iter_impl->mapping = iter_impl->mapping - node_size;
+	}
+
+	return 0;
+}
+
 static int segcol_list_iter_get_segment(segcol_iter_t *iter, segment_t **seg)
 {
 	if (iter == NULL || seg == NULL)
@@ -20,7 +20,8 @@
 /**
  * @file segcol_list.h
  *
- * Definition of constructor function for the list implementation of segcol_t.
+ * Definition of constructor and statistics functions for the list
+ * implementation of segcol_t.
  */
 #ifndef _SEGCOL_LIST_H
 #define _SEGCOL_LIST_H
@@ -39,6 +40,16 @@
 
 int segcol_list_new(segcol_t **segcol);
 
+/** @} */
+
+/**
+ * @name Statistics
+ * @{
+ */
+
+int segcol_list_get_cache_stats(segcol_t *segcol, size_t *hits,
+		size_t *misses);
+
 /** @} */
 /** @} */
 
@@ -0,0 +1,930 @@
+/*
+ * Copyright 2008, 2009 Alexandros Frantzis, Michael Iatrou
+ *
+ * This file is part of libbls.
+ *
+ * libbls is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * libbls is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * libbls.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file segcol_tree.c
+ *
+ * Counted tree implementation of segcol_t
+ *
+ * The segments are kept in a treap (a randomized binary search tree) ordered
+ * by their logical position. Every node holds the byte count of its subtree,
+ * so a logical offset can be located in O(log n) expected time by descending
+ * from the root. The nodes are also threaded (each node links directly to its
+ * logical predecessor and successor), so iterating over the segments costs
+ * O(1) per step. See doc/devel/segcol_data_structure.txt for more.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "segcol.h"
+#include "segcol_internal.h"
+#include "segcol_tree.h"
+#include "type_limits.h"
+#include "debug.h"
+
+/**
+ * A node in the counted tree.
+ */
+struct segcol_tree_node {
+	struct segcol_tree_node *left; /**< the left child */
+	struct segcol_tree_node *right; /**< the right child */
+	struct segcol_tree_node *parent; /**< the parent (NULL for the root) */
+	struct segcol_tree_node *prev; /**< the logical predecessor */
+	struct segcol_tree_node *next; /**< the logical successor */
+	segment_t *segment; /**< the segment held in this node */
+	off_t size; /**< the size of the segment held in this node */
+	off_t subtree_size; /**< the total size of the segments in the subtree */
+	uint32_t priority; /**< the (random) heap priority of the node */
+};
+
+struct segcol_tree_iter_impl {
+	struct segcol_tree_node *node;
+	off_t mapping;
+};
+
+struct segcol_tree_impl {
+	struct segcol_tree_node *root;
+	struct segcol_tree_node *first;
+	struct segcol_tree_node *last;
+	uint32_t seed;
+};
+
+/* Forward declarations */
+
+/* internal convenience functions */
+static int tree_node_new(struct segcol_tree_impl *impl,
+		struct segcol_tree_node **node, segment_t *seg);
+static void tree_insert_node_before(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *pos, struct segcol_tree_node *node);
+static void tree_remove_node(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *node);
+static struct segcol_tree_node *tree_find_node(struct segcol_tree_impl *impl,
+		off_t offset, off_t *mapping);
+static int tree_merge_next(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *node);
+static void tree_coalesce(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *node);
+
+/* segcol API implementation functions */
+int segcol_tree_new(segcol_t **segcol);
+static int segcol_tree_free(segcol_t *segcol);
+static int segcol_tree_append(segcol_t *segcol, segment_t *seg);
+static int segcol_tree_insert(segcol_t *segcol, off_t offset, segment_t *seg);
+static int segcol_tree_delete(segcol_t *segcol, segcol_t **deleted, off_t offset, off_t length);
+static int segcol_tree_find(segcol_t *segcol, segcol_iter_t **iter, off_t offset);
+static int segcol_tree_iter_new(segcol_t *segcol, void **iter);
+static int segcol_tree_iter_next(segcol_iter_t *iter);
+static int segcol_tree_iter_prev(segcol_iter_t *iter);
+static int segcol_tree_iter_is_valid(segcol_iter_t *iter, int *valid);
+static int segcol_tree_iter_get_segment(segcol_iter_t *iter, segment_t **seg);
+static int segcol_tree_iter_get_mapping(segcol_iter_t *iter, off_t *mapping);
+static int segcol_tree_iter_free(segcol_iter_t *iter);
+
+/* Function pointers for the tree implementation of segcol_t */
+static struct segcol_funcs segcol_tree_funcs = {
+	.free = segcol_tree_free,
+	.append = segcol_tree_append,
+	.insert = segcol_tree_insert,
+	.delete = segcol_tree_delete,
+	.find = segcol_tree_find,
+	.iter_new = segcol_tree_iter_new,
+	.iter_next = segcol_tree_iter_next,
+	.iter_prev = segcol_tree_iter_prev,
+	.iter_is_valid = segcol_tree_iter_is_valid,
+	.iter_get_segment = segcol_tree_iter_get_segment,
+	.iter_get_mapping = segcol_tree_iter_get_mapping,
+	.iter_free = segcol_tree_iter_free
+};
+
+/**********************
+ * Tree manipulation  *
+ **********************/
+
+/**
+ * Gets the byte count of a subtree (0 for an empty subtree).
+ */
+static inline off_t subtree_size(struct segcol_tree_node *node)
+{
+	return node != NULL ? node->subtree_size : 0;
+}
+
+/**
+ * Recalculates the byte count of a node from its children.
+ */
+static inline void update_subtree_size(struct segcol_tree_node *node)
+{
+	node->subtree_size = node->size + subtree_size(node->left) +
+		subtree_size(node->right);
+}
+
+/**
+ * Adds a value to the byte count of a node and all its ancestors.
+ */
+static void propagate_size_change(struct segcol_tree_node *node, off_t change)
+{
+	while (node != NULL) {
+		node->subtree_size += change;
+		node = node->parent;
+	}
+}
+
+/**
+ * Gets a new pseudo-random node priority (xorshift32).
+ */
+static uint32_t tree_next_priority(struct segcol_tree_impl *impl)
+{
+	uint32_t x = impl->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	impl->seed = x;
+
+	return x;
+}
+
+/**
+ * Replaces a child of a node (or the root) with another node.
+ */
+static void replace_child(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *parent, struct segcol_tree_node *old,
+		struct segcol_tree_node *new)
+{
+	if (parent == NULL)
+		impl->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+
+	if (new != NULL)
+		new->parent = parent;
+}
+
+/**
+ * Rotates a node to the left (its right child takes its place).
+ *
+ *     x              y
+ *    / \            / \
+ *   a   y    =>    x   c
+ *      / \        / \
+ *     b   c      a   b
+ */
+static void rotate_left(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *x)
+{
+	struct segcol_tree_node *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+
+	replace_child(impl, x->parent, x, y);
+
+	y->left = x;
+	x->parent = y;
+
+	update_subtree_size(x);
+	update_subtree_size(y);
+}
+
+/**
+ * Rotates a node to the right (its left child takes its place).
+ *
+ *       x          y
+ *      / \        / \
+ *     y   c  =>  a   x
+ *    / \            / \
+ *   a   b          b   c
+ */
+static void rotate_right(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *x)
+{
+	struct segcol_tree_node *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+
+	replace_child(impl, x->parent, x, y);
+
+	y->right = x;
+	x->parent = y;
+
+	update_subtree_size(x);
+	update_subtree_size(y);
+}
+
+/**
+ * Creates a new detached tree node holding a segment.
+ *
+ * @param impl the segcol_tree_impl the node will belong to
+ * @param[out] node the created node
+ * @param seg the segment the node will hold
+ *
+ * @return the operation error code
+ */
+static int tree_node_new(struct segcol_tree_impl *impl,
+		struct segcol_tree_node **node, segment_t *seg)
+{
+	struct segcol_tree_node *n = malloc(sizeof *n);
+	if (n == NULL)
+		return_error(ENOMEM);
+
+	n->left = n->right = n->parent = NULL;
+	n->prev = n->next = NULL;
+	n->segment = seg;
+	n->size = 0;
+	if (seg != NULL)
+		segment_get_size(seg, &n->size);
+	n->subtree_size = n->size;
+	n->priority = tree_next_priority(impl);
+
+	*node = n;
+
+	return 0;
+}
+
+/**
+ * Changes the cached size of the segment held in a node.
+ *
+ * This must be called whenever the size of a segment held in the tree
+ * changes, so that the byte counts of the node's ancestors remain valid.
+ */
+static void tree_node_set_size(struct segcol_tree_node *node, off_t size)
+{
+	off_t change = size - node->size;
+
+	node->size = size;
+	propagate_size_change(node, change);
+}
+
+/**
+ * Inserts a node in the tree before another node.
+ *
+ * @param impl the segcol_tree_impl
+ * @param pos the node before which to insert or NULL to append at the end
+ * @param node the (detached) node to insert
+ */
+static void tree_insert_node_before(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *pos, struct segcol_tree_node *node)
+{
+	node->left = node->right = NULL;
+	node->subtree_size = node->size;
+
+	if (impl->root == NULL) {
+		node->parent = NULL;
+		node->prev = node->next = NULL;
+		impl->root = impl->first = impl->last = node;
+		return;
+	}
+
+	/*
+	 * Attach the node as a leaf at the correct in-order position. The new
+	 * node becomes either the left child of pos or the right child of the
+	 * in-order predecessor of pos (which can't have a right child).
+	 */
+	if (pos == NULL) {
+		impl->last->right = node;
+		node->parent = impl->last;
+	} else if (pos->left == NULL) {
+		pos->left = node;
+		node->parent = pos;
+	} else {
+		pos->prev->right = node;
+		node->parent = pos->prev;
+	}
+
+	/* Thread the node */
+	node->next = pos;
+	node->prev = (pos == NULL) ? impl->last : pos->prev;
+
+	if (node->prev != NULL)
+		node->prev->next = node;
+	else
+		impl->first = node;
+
+	if (pos != NULL)
+		pos->prev = node;
+	else
+		impl->last = node;
+
+	propagate_size_change(node->parent, node->size);
+
+	/* Restore the heap property by rotating the node upwards */
+	while (node->parent != NULL && node->priority > node->parent->priority) {
+		if (node->parent->left == node)
+			rotate_right(impl, node->parent);
+		else
+			rotate_left(impl, node->parent);
+	}
+}
+
+/**
+ * Removes a node from the tree.
+ *
+ * The node itself (and its segment) are not freed.
+ *
+ * @param impl the segcol_tree_impl
+ * @param node the node to remove
+ */
+static void tree_remove_node(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *node)
+{
+	/* Rotate the node downwards until it has at most one child */
+	while (node->left != NULL && node->right != NULL) {
+		if (node->left->priority > node->right->priority)
+			rotate_right(impl, node);
+		else
+			rotate_left(impl, node);
+	}
+
+	struct segcol_tree_node *child =
+		(node->left != NULL) ? node->left : node->right;
+	struct segcol_tree_node *parent = node->parent;
+
+	replace_child(impl, parent, node, child);
+	propagate_size_change(parent, -node->size);
+
+	/* Unthread the node */
+	if (node->prev != NULL)
+		node->prev->next = node->next;
+	else
+		impl->first = node->next;
+
+	if (node->next != NULL)
+		node->next->prev = node->prev;
+	else
+		impl->last = node->prev;
+
+	node->left = node->right = node->parent = NULL;
+	node->prev = node->next = NULL;
+	node->subtree_size = node->size;
+}
+
+/**
+ * Finds the node that contains a logical offset.
+ *
+ * @param impl the segcol_tree_impl
+ * @param offset the offset to look for
+ * @param[out] mapping the mapping of the found node
+ *
+ * @return the found node or NULL if the offset is out of range
+ */
+static struct segcol_tree_node *tree_find_node(struct segcol_tree_impl *impl,
+		off_t offset, off_t *mapping)
+{
+	struct segcol_tree_node *node = impl->root;
+	off_t base = 0;
+
+	if (offset < 0 || offset >= subtree_size(node))
+		return NULL;
+
+	while (node != NULL) {
+		off_t left_size = subtree_size(node->left);
+
+		if (offset < base + left_size) {
+			node = node->left;
+		} else if (offset < base + left_size + node->size) {
+			*mapping = base + left_size;
+			return node;
+		} else {
+			base += left_size + node->size;
+			node = node->right;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Merges a node with the node that follows it, if their segments are
+ * contiguous parts of the same data object.
+ *
+ * @param impl the segcol_tree_impl
+ * @param node the node to merge the next node into
+ *
+ * @return 1 if the nodes were merged, 0 otherwise
+ */
+static int tree_merge_next(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *node)
+{
+	struct segcol_tree_node *next = node->next;
+
+	if (next == NULL)
+		return 0;
+
+	int can_merge;
+	segment_can_merge(node->segment, next->segment, &can_merge);
+	if (!can_merge)
+		return 0;
+
+	segment_merge(node->segment, next->segment);
+
+	/* -[E]-[N]- => -[E+N]- */
+	tree_remove_node(impl, next);
+	tree_node_set_size(node, node->size + next->size);
+
+	segment_free(next->segment);
+	free(next);
+
+	return 1;
+}
+
+/**
+ * Merges a node with its neighbours, if their segments are contiguous parts
+ * of the same data object.
+ *
+ * @param impl the segcol_tree_impl
+ * @param node the node to merge
+ */
+static void tree_coalesce(struct segcol_tree_impl *impl,
+		struct segcol_tree_node *node)
+{
+	tree_merge_next(impl, node);
+
+	if (node->prev != NULL)
+		tree_merge_next(impl, node->prev);
+}
+
+/*****************
+ * API functions *
+ *****************/
+
+/**
+ * Creates a new segcol_t using a counted tree implementation.
+ *
+ * @param[out] segcol the created segcol_t
+ *
+ * @return the operation error code
+ */
+int segcol_tree_new(segcol_t **segcol)
+{
+	if (segcol == NULL)
+		return_error(EINVAL);
+
+	/* Allocate memory for implementation */
+	struct segcol_tree_impl *impl = malloc(sizeof(struct segcol_tree_impl));
+
+	if (impl == NULL)
+		return_error(ENOMEM);
+
+	impl->root = NULL;
+	impl->first = NULL;
+	impl->last = NULL;
+	impl->seed = 2463534242U;
+
+	/* Create segcol_t */
+	int err = segcol_create_impl(segcol, impl, &segcol_tree_funcs);
+
+	if (err) {
+		free(impl);
+		return_error(err);
+	}
+
+	return 0;
+}
+
+static int segcol_tree_free(segcol_t *segcol)
+{
+	if (segcol == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_impl *impl =
+		(struct segcol_tree_impl *) segcol_get_impl(segcol);
+
+	/* Free segments and nodes using the threading */
+	struct segcol_tree_node *node = impl->first;
+
+	while (node != NULL) {
+		struct segcol_tree_node *next = node->next;
+		if (node->segment != NULL)
+			segment_free(node->segment);
+		free(node);
+		node = next;
+	}
+
+	free(impl);
+
+	return 0;
+}
+
+static int segcol_tree_append(segcol_t *segcol, segment_t *seg)
+{
+	if (segcol == NULL || seg == NULL)
+		return_error(EINVAL);
+
+	/*
+	 * If the segment size is 0, return successfully without adding
+	 * anything. Free the segment as we will not be using it.
+	 */
+	off_t seg_size;
+	segment_get_size(seg, &seg_size);
+	if (seg_size == 0) {
+		segment_free(seg);
+		return 0;
+	}
+
+	struct segcol_tree_impl *impl =
+		(struct segcol_tree_impl *) segcol_get_impl(segcol);
+
+	struct segcol_tree_node *node;
+	int err = tree_node_new(impl, &node, seg);
+	if (err)
+		return_error(err);
+
+	tree_insert_node_before(impl, NULL, node);
+	tree_coalesce(impl, node);
+
+	return 0;
+}
+
+static int segcol_tree_insert(segcol_t *segcol, off_t offset, segment_t *seg)
+{
+	if (segcol == NULL || seg == NULL || offset < 0)
+		return_error(EINVAL);
+
+	struct segcol_tree_impl *impl =
+		(struct segcol_tree_impl *) segcol_get_impl(segcol);
+
+	/* find the node that 'offset' is mapped to */
+	off_t mapping;
+	struct segcol_tree_node *pnode = tree_find_node(impl, offset, &mapping);
+	if (pnode == NULL)
+		return_error(EINVAL);
+
+	/*
+	 * If the segment size is 0, return successfully without adding
+	 * anything. Free the segment as we will not be using it.
+	 * This check is placed after the search so that the validity of offset
+	 * (if it is in range) is checked first.
+	 */
+	off_t seg_size;
+	segment_get_size(seg, &seg_size);
+	if (seg_size == 0) {
+		segment_free(seg);
+		return 0;
+	}
+
+	/* create a node containing the new segment */
+	struct segcol_tree_node *qnode;
+	int err = tree_node_new(impl, &qnode, seg);
+	if (err)
+		return_error(err);
+
+	/* where to split the existing segment */
+	off_t split_index = offset - mapping;
+
+	/* check if a split is actually needed or we just have to prepend
+	 * the new segment */
+	if (split_index == 0) {
+		tree_insert_node_before(impl, pnode, qnode);
+		tree_coalesce(impl, qnode);
+		return 0;
+	}
+
+	struct segcol_tree_node *rnode;
+	err = tree_node_new(impl, &rnode, NULL);
+	if (err) {
+		free(qnode);
+		return_error(err);
+	}
+
+	err = segment_split(pnode->segment, &rnode->segment, split_index);
+	if (err) {
+		free(rnode);
+		free(qnode);
+		return_error(err);
+	}
+
+	rnode->size = pnode->size - split_index;
+	tree_node_set_size(pnode, split_index);
+
+	/* -[P]-[N]- => -[P]-[Q]-[R]-[N]- */
+	tree_insert_node_before(impl, pnode->next, rnode);
+	tree_insert_node_before(impl, rnode, qnode);
+	tree_coalesce(impl, qnode);
+
+	return 0;
+}
+
+/*
+ * The algorithm first splits the segments at the boundaries of the range so
+ * that the range consists of whole nodes. It then moves the nodes of the
+ * range, in order, to the deleted segcol (or frees them). All memory
+ * allocations are made before the tree is altered, so that a failure leaves
+ * the segcol intact.
+ *
+ *  -[P]-[a|F]-[]-[]-[L|b]-[N]-  => -[P]-[a]-[F]-[]-[]-[L]-[b]-[N]-
+ *          ^           ^        => -[P]-[a]-[b]-[N]-
+ *        offset  offset + length
+ */
+static int segcol_tree_delete(segcol_t *segcol, segcol_t **deleted, off_t
+		offset, off_t length)
+{
+	if (segcol == NULL || offset < 0 || length < 0)
+		return_error(EINVAL);
+
+	/* Check range for overflow */
+	if (__MAX(off_t) - offset < length - 1 * (length != 0))
+		return_error(EOVERFLOW);
+
+	struct segcol_tree_impl *impl =
+		(struct segcol_tree_impl *) segcol_get_impl(segcol);
+
+	/* Find the first and last nodes that contain the range */
+	off_t first_mapping;
+	struct segcol_tree_node *first_node =
+		tree_find_node(impl, offset, &first_mapping);
+	if (first_node == NULL)
+		return_error(EINVAL);
+
+	int err;
+
+	/*
+	 * If the length is 0 return successfully without doing anything.
+	 * This check is placed after the first search so that the validity of
+	 * offset (if it is in range) is checked first.
+	 */
+	if (length == 0) {
+		/* Return an empty deleted segcol if the caller wants one */
+		if (deleted != NULL) {
+			err = segcol_tree_new(deleted);
+			if (err)
+				return_error(err);
+		}
+		return 0;
+	}
+
+	off_t last_mapping;
+	struct segcol_tree_node *last_node =
+		tree_find_node(impl, offset + length - 1, &last_mapping);
+	if (last_node == NULL)
+		return_error(EINVAL);
+
+	/* Allocate everything we may need */
+	segcol_t *deleted_tmp = NULL;
+	struct segcol_tree_node *anode = NULL;
+	struct segcol_tree_node *bnode = NULL;
+
+	if (deleted != NULL) {
+		err = segcol_tree_new(&deleted_tmp);
+		if (err)
+			return_error(err);
+	}
+
+	int split_first = (first_mapping < offset);
+	int split_last = (last_mapping + last_node->size > offset + length);
+
+	if (split_first) {
+		err = tree_node_new(impl, &anode, NULL);
+		if (err)
+			goto_error(err, on_error_alloc);
+	}
+
+	if (split_last) {
+		err = tree_node_new(impl, &bnode, NULL);
+		if (err)
+			goto_error(err, on_error_alloc);
+	}
+
+	/*
+	 * Split the segments at the range boundaries. If the range is contained
+	 * in a single segment, the second split is performed on the part of the
+	 * segment that remains after the first split.
+	 */
+	if (split_first) {
+		err = segment_split(first_node->segment, &anode->segment,
+				offset - first_mapping);
+		if (err)
+			goto_error(err, on_error_alloc);
+		anode->size = first_node->size - (offset - first_mapping);
+	}
+
+	if (split_last) {
+		segment_t *seg = last_node->segment;
+		off_t seg_mapping = last_mapping;
+
+		if (split_first && first_node == last_node) {
+			seg = anode->segment;
+			seg_mapping = offset;
+		}
+
+		err = segment_split(seg, &bnode->segment,
+				offset + length - seg_mapping);
+		if (err)
+			goto_error(err, on_error_split);
+		bnode->size = last_mapping + last_node->size - (offset + length);
+	}
+
+	/* Put the new nodes in the tree */
+	if (split_first) {
+		tree_node_set_size(first_node, offset - first_mapping);
+		tree_insert_node_before(impl, first_node->next, anode);
+		if (first_node == last_node)
+			last_node = anode;
+		first_node = anode;
+	}
+
+	if (split_last) {
+		tree_node_set_size(last_node, last_node->size - bnode->size);
+		tree_insert_node_before(impl, last_node->next, bnode);
+	}
+
+	/* Move the nodes in the range to the deleted segcol (or free them) */
+	struct segcol_tree_impl *deleted_impl = NULL;
+	if (deleted_tmp != NULL)
+		deleted_impl = (struct segcol_tree_impl *) segcol_get_impl(deleted_tmp);
+
+	struct segcol_tree_node *node = first_node;
+	struct segcol_tree_node *end = last_node->next;
+
+	while (node != end) {
+		struct segcol_tree_node *next = node->next;
+
+		tree_remove_node(impl, node);
+
+		if (deleted_impl != NULL) {
+			tree_insert_node_before(deleted_impl, NULL, node);
+		} else {
+			segment_free(node->segment);
+			free(node);
+		}
+
+		node = next;
+	}
+
+	/* The nodes around the deleted range may now hold contiguous data */
+	if (end != NULL && end->prev != NULL)
+		tree_merge_next(impl, end->prev);
+
+	if (deleted != NULL)
+		*deleted = deleted_tmp;
+
+	return 0;
+
+/*
+ * Handle failures so that the segcol is in its expected state
+ * after a failure and there are no memory leaks.
+ */
+on_error_split:
+	if (split_first) {
+		segment_merge(first_node->segment, anode->segment);
+		segment_free(anode->segment);
+	}
+on_error_alloc:
+	if (bnode != NULL) free(bnode);
+	if (anode != NULL) free(anode);
+	if (deleted_tmp != NULL) segcol_free(deleted_tmp);
+	return err;
+}
+
+static int segcol_tree_find(segcol_t *segcol, segcol_iter_t **iter, off_t offset)
+{
+	if (segcol == NULL || iter == NULL || offset < 0)
+		return_error(EINVAL);
+
+	struct segcol_tree_impl *impl =
+		(struct segcol_tree_impl *) segcol_get_impl(segcol);
+
+	off_t mapping;
+	struct segcol_tree_node *node = tree_find_node(impl, offset, &mapping);
+
+	/* Make sure offset is in range */
+	if (node == NULL)
+		return_error(EINVAL);
+
+	/* Create iterator to return search results */
+	int err = segcol_iter_new(segcol, iter);
+	if (err)
+		return_error(err);
+
+	struct segcol_tree_iter_impl *iter_impl =
+		(struct segcol_tree_iter_impl *) segcol_iter_get_impl(*iter);
+
+	iter_impl->node = node;
+	iter_impl->mapping = mapping;
+
+	return 0;
+}
+
+static int segcol_tree_iter_new(segcol_t *segcol, void **iter_impl)
+{
+	if (segcol == NULL || iter_impl == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_impl *impl =
+		(struct segcol_tree_impl *) segcol_get_impl(segcol);
+	struct segcol_tree_iter_impl **iter_impl1 =
+		(struct segcol_tree_iter_impl **)iter_impl;
+
+	*iter_impl1 = malloc(sizeof(struct segcol_tree_iter_impl));
+	if (*iter_impl1 == NULL)
+		return_error(ENOMEM);
+
+	(*iter_impl1)->node = impl->first;
+	(*iter_impl1)->mapping = 0;
+
+	return 0;
+}
+
+static int segcol_tree_iter_next(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	if (iter_impl->node != NULL) {
+		iter_impl->mapping += iter_impl->node->size;
+		iter_impl->node = iter_impl->node->next;
+	}
+
+	return 0;
+}
+
+static int segcol_tree_iter_prev(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	if (iter_impl->node != NULL) {
+		iter_impl->node = iter_impl->node->prev;
+		if (iter_impl->node != NULL)
+			iter_impl->mapping -= iter_impl->node->size;
+	}
+
+	return 0;
+}
+
+static int segcol_tree_iter_get_segment(segcol_iter_t *iter, segment_t **seg)
+{
+	if (iter == NULL || seg == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	if (iter_impl->node != NULL)
+		*seg = iter_impl->node->segment;
+	else
+		*seg = NULL;
+
+	return 0;
+}
+
+static int segcol_tree_iter_get_mapping(segcol_iter_t *iter, off_t *mapping)
+{
+	if (iter == NULL || mapping == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	if (iter_impl->node != NULL)
+		*mapping = iter_impl->mapping;
+	else
+		*mapping = -1;
+
+	return 0;
+}
+
+static int segcol_tree_iter_is_valid(segcol_iter_t *iter, int *valid)
+{
+	if (iter == NULL || valid == NULL)
+		return_error(EINVAL);
+
+	struct segcol_tree_iter_impl *iter_impl = segcol_iter_get_impl(iter);
+
+	*valid = (iter_impl != NULL) && (iter_impl->node != NULL);
+
+	return 0;
+}
+
+static int segcol_tree_iter_free(segcol_iter_t *iter)
+{
+	if (iter == NULL)
+		return_error(EINVAL);
+
+	free(segcol_iter_get_impl(iter));
+
+	return 0;
+}
@@ -226,6 +226,44 @@ int segment_merge(segment_t *seg, segment_t *seg1)
 	return 0;
 }
 
+/**
+ * Checks whether two segments can be merged.
+ *
+ * Two segments can be merged if they point to the same data object, seg1
+ * is a continuation of seg and the merged range doesn't overflow.
+ *
+ * @param seg the first segment
+ * @param seg1 the segment to merge with the first segment
+ * @param[out] can_merge 1 if the segments can be merged, 0 otherwise
+ *
+ * @return the operation error code
+ */
+int segment_can_merge(segment_t *seg, segment_t *seg1, int *can_merge)
+{
+	if (seg == NULL || seg1 == NULL || can_merge == NULL)
+		return_error(EINVAL);
+
+	*can_merge = 0;
+
+	if (seg->data != seg1->data)
+		return 0;
+
+	if (__MAX(off_t) - seg->size < seg1->size)
+		return 0;
+
+	off_t new_size = seg->size + seg1->size;
+
+	if (__MAX(off_t) - seg->start < new_size - 1 * (new_size != 0))
+		return 0;
+
+	if (seg->start + seg->size != seg1->start)
+		return 0;
+
+	*can_merge = 1;
+
+	return 0;
+}
+
 /**
  * Gets data object a segment_t is related to.
  *
@@ -70,6 +70,8 @@ int segment_split(segment_t *seg, segment_t **seg1, off_t split_index);
 
 int segment_merge(segment_t *seg, segment_t *seg1);
 
+int segment_can_merge(segment_t *seg, segment_t *seg1, int *can_merge);
+
 int segment_get_data(segment_t *seg, void **data);
 
 int segment_get_start(segment_t *seg, off_t *start);
@@ -460,6 +460,756 @@ class BufferTests(unittest.TestCase):
 		err = bless_buffer_source_unref(data_src)
 		self.assertEqual(err, 0)
 
+	def testAppendFromFilePread(self):
+		"Append data to the buffer from a file read with pread"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+
+		(err, data_src) = bless_buffer_source_file_pread(fd, None)
+		self.assertEqual(err, 0)
+
+		(err, backend) = data_object_file_get_backend(data_src)
+		self.assertEqual(err, 0)
+		self.assertEqual(backend, DATA_OBJECT_FILE_PREAD)
+
+		err = bless_buffer_append(self.buf, data_src, 0, 10)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_insert(self.buf, 2, data_src, 3, 7)
+		self.assertEqual(err, 0)
+
+		read_data = create_string_buffer(17)
+		err = bless_buffer_read(self.buf, 0, read_data, 0, 17)
+		self.assertEqual(err, 0)
+		self.assertEqual(read_data.raw, "12456789034567890")
+
+		err = bless_buffer_source_unref(data_src)
+		self.assertEqual(err, 0)
+
+	def testReadExtents(self):
+		"Get the extents of a range of the buffer"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+
+		(err, data_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, data_src, 0, 10)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_source_unref(data_src)
+		self.assertEqual(err, 0)
+
+		(err, extents) = bless_buffer_read_extents(self.buf, 0, 11)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, extents) = bless_buffer_read_extents(self.buf, -1, 3)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, extents) = bless_buffer_read_extents(self.buf, 2, 5)
+		self.assertEqual(err, 0)
+
+		(err, iov, count) = bless_buffer_extents_get_iovec(extents)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 1)
+
+		# The extents remain valid after the buffer has changed
+		err = bless_buffer_delete(self.buf, 0, 10)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_extents_free(extents)
+		self.assertEqual(err, 0)
+
+	def testReadExtentsSave(self):
+		"Save the buffer to a file its extents point to"
+
+		# Use data large enough not to be copied to the buffer on append
+		data = "0123456789abcdef" * 256
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, data_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_whole_mapping(data_src, 1)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, data_src, 0, len(data))
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_source_unref(data_src)
+		self.assertEqual(err, 0)
+
+		# The extents pin the mapped data of the file
+		(err, extents) = bless_buffer_read_extents(self.buf, 0, len(data))
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_delete(self.buf, 0, 100)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_save(self.buf, fd, None)
+		self.assertEqual(err, errno.EBUSY)
+
+		os.lseek(fd, 0, os.SEEK_SET)
+		self.assertEqual(os.read(fd, len(data) + 1), data)
+
+		# Saving to another file is not affected
+		(fd2, path2) = tempfile.mkstemp()
+
+		err = bless_buffer_save(self.buf, fd2, None)
+		self.assertEqual(err, 0)
+
+		os.lseek(fd2, 0, os.SEEK_SET)
+		self.assertEqual(os.read(fd2, len(data) + 1), data[100:])
+
+		err = bless_buffer_extents_free(extents)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_save(self.buf, fd, None)
+		self.assertEqual(err, 0)
+
+		os.lseek(fd, 0, os.SEEK_SET)
+		self.assertEqual(os.read(fd, len(data) + 1), data[100:])
+
+		# Remove temporary files
+		os.close(fd2)
+		os.remove(path2)
+		os.close(fd)
+		os.remove(path)
+
+	def testFind(self):
+		"Search for data in the buffer"
+
+		# Create a buffer with many segments from memory and a file
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		data = "abcdefghij" * 300
+		(err, mem_src) = bless_buffer_source_memory(data, len(data), None)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, mem_src, 0, 2000)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 3, 2000)
+		self.assertEqual(err, 0)
+		err = bless_buffer_insert(self.buf, 1500, file_src, 4, 3)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		# Contents: data[0:1500] + "567" + data[1500:2000] + "1234567890" +
+		# data[3:2003]
+		(err, match) = bless_buffer_find(self.buf, 0, "cde", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2)
+
+		# Matches straddling segment boundaries
+		(err, match) = bless_buffer_find(self.buf, 0, "ij567ab", 7, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 1498)
+
+		(err, match) = bless_buffer_find(self.buf, 0, "ij123", 5, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2001)
+
+		(err, match) = bless_buffer_find(self.buf, 0, "890def", 6, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2010)
+
+		# Start offset
+		(err, match) = bless_buffer_find(self.buf, 3, "cde", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 12)
+
+		(err, match) = bless_buffer_find(self.buf, 2010, "cde", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2022)
+
+		# No match
+		(err, match) = bless_buffer_find(self.buf, 0, "jb", 2, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, -1)
+
+		(err, match) = bless_buffer_find(self.buf, 5000, "a", 1, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, -1)
+
+		# Invalid arguments
+		(err, match) = bless_buffer_find(self.buf, -1, "a", 1, None)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, match) = bless_buffer_find(self.buf, 0, "a", 0, None)
+		self.assertEqual(err, errno.EINVAL)
+
+	def testFindParallel(self):
+		"Search for data in the buffer using many threads"
+
+		data = "a" * (1024 * 1024)
+		(err, mem_src) = bless_buffer_source_memory(data, len(data), None)
+		self.assertEqual(err, 0)
+
+		for i in range(130):
+			err = bless_buffer_append(self.buf, mem_src, 0, len(data))
+			self.assertEqual(err, 0)
+
+		(err, needle_src) = bless_buffer_source_memory("needle", 6, None)
+		self.assertEqual(err, 0)
+
+		# Place matches so that they straddle the search blocks (64 MiB)
+		block = 64 * 1024 * 1024
+
+		err = bless_buffer_insert(self.buf, 2 * block - 3, needle_src, 0, 6)
+		self.assertEqual(err, 0)
+		err = bless_buffer_insert(self.buf, block - 2, needle_src, 0, 6)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(mem_src)
+		bless_buffer_source_unref(needle_src)
+
+		# The results must be the same regardless of the number of threads
+		for threads in ['1', '4']:
+			err = bless_buffer_set_option(self.buf, BLESS_BUF_FIND_THREADS,
+					threads)
+			self.assertEqual(err, 0)
+
+			(err, match) = bless_buffer_find(self.buf, 0, "needle", 6, None)
+			self.assertEqual(err, 0)
+			self.assertEqual(match, block - 2)
+
+			(err, match) = bless_buffer_find(self.buf, block - 1, "needle", 6,
+					None)
+			self.assertEqual(err, 0)
+			self.assertEqual(match, 2 * block + 3)
+
+			(err, match) = bless_buffer_find(self.buf, 0, "aan", 3, None)
+			self.assertEqual(err, 0)
+			self.assertEqual(match, block - 4)
+
+			(err, match) = bless_buffer_find(self.buf, 0, "needlf", 6, None)
+			self.assertEqual(err, 0)
+			self.assertEqual(match, -1)
+
+	def testFindReverse(self):
+		"Search backwards for data in the buffer"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		data = "abcdefghij" * 300
+		(err, mem_src) = bless_buffer_source_memory(data, len(data), None)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, mem_src, 0, 2000)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 3, 2000)
+		self.assertEqual(err, 0)
+		err = bless_buffer_insert(self.buf, 1500, file_src, 4, 3)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		# Contents: data[0:1500] + "567" + data[1500:2000] + "1234567890" +
+		# data[3:2003]
+		(err, size) = bless_buffer_get_size(self.buf)
+		self.assertEqual(err, 0)
+
+		(err, match) = bless_buffer_rfind(self.buf, size, "cde", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 4002)
+
+		# Matches straddling segment boundaries
+		(err, match) = bless_buffer_rfind(self.buf, size, "ij567ab", 7, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 1498)
+
+		(err, match) = bless_buffer_rfind(self.buf, size, "ij123", 5, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2001)
+
+		(err, match) = bless_buffer_rfind(self.buf, size, "890def", 6, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2010)
+
+		# Start offset (matches may start at it)
+		(err, match) = bless_buffer_rfind(self.buf, 2021, "cde", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 1995)
+
+		(err, match) = bless_buffer_rfind(self.buf, 2022, "cde", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 2022)
+
+		(err, match) = bless_buffer_rfind(self.buf, 0, "ab", 2, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 0)
+
+		# No match
+		(err, match) = bless_buffer_rfind(self.buf, 1497, "ij567ab", 7, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, -1)
+
+		(err, match) = bless_buffer_rfind(self.buf, size, "jb", 2, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, -1)
+
+		# Invalid arguments
+		(err, match) = bless_buffer_rfind(self.buf, -1, "a", 1, None)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, match) = bless_buffer_rfind(self.buf, 0, "a", 0, None)
+		self.assertEqual(err, errno.EINVAL)
+
+	def testFindMasked(self):
+		"Search for data with masked bits in the buffer"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		data = "\xe8\x01\x02\x03\x04\x48\x8b\xe8\x10\x48\x8b"
+		(err, mem_src) = bless_buffer_source_memory(data, len(data), None)
+		self.assertEqual(err, 0)
+
+		# Contents: data[0:6] + "1234567890" + data[6:11] + data
+		err = bless_buffer_append(self.buf, mem_src, 0, 6)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 6, 5)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 0, 11)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		# "E8 ?? ?? ?? ?? 48 8B"
+		pattern = "\xe8\x00\x00\x00\x00\x48\x8b"
+		mask = "\xff\x00\x00\x00\x00\xff\xff"
+
+		(err, match) = bless_buffer_find_masked(self.buf, 0, pattern, mask, 7,
+				None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 21)
+
+		# "E8 ?? 48 8B" straddling a segment boundary
+		(err, match) = bless_buffer_find_masked(self.buf, 0,
+				"\xe8\x00\x48\x8b", "\xff\x00\xff\xff", 4, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 17)
+
+		# Bit masks: two digits (0x3?) followed by "0"
+		(err, match) = bless_buffer_find_masked(self.buf, 0, "\x30\x30\x30",
+				"\xf0\xf0\xff", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 13)
+
+		# Only wildcards
+		(err, match) = bless_buffer_find_masked(self.buf, 5, "\x00\x00",
+				"\x00\x00", 2, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 5)
+
+		# No match
+		(err, match) = bless_buffer_find_masked(self.buf, 0, "\xe8\x00\x49",
+				"\xff\x00\xff", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, -1)
+
+	def find_multi(self, buf, pattern_set, start_offset):
+		"""Search for the patterns of a set and return the matches as a
+		list of (offset, length, id) tuples."""
+
+		(rfd, wfd) = os.pipe()
+		err = print_find_multi_matches(buf, pattern_set, start_offset, wfd)
+		self.assertEqual(err, 0)
+		match_str = os.read(rfd, 10000)
+		os.close(rfd)
+
+		return [tuple([int(x) for x in l.split()]) for l in match_str.splitlines()]
+
+	def testFindMulti(self):
+		"Search for many patterns at once"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		data = "abcab12"
+		(err, mem_src) = bless_buffer_source_memory(data, len(data), None)
+		self.assertEqual(err, 0)
+
+		# Contents: "abcab" + "1234567890" + "cab12"
+		err = bless_buffer_append(self.buf, mem_src, 0, 5)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 2, 5)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		(err, pattern_set) = bless_pattern_set_new()
+		self.assertEqual(err, 0)
+
+		for (i, p) in enumerate(["ab", "cab", "b1", "ab", "90c"]):
+			(err, id) = bless_pattern_set_add(pattern_set, p, len(p))
+			self.assertEqual(err, 0)
+			self.assertEqual(id, i)
+
+		(err, count) = bless_pattern_set_get_count(pattern_set)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 5)
+
+		# Matches are ordered by end offset, then from longest to shortest
+		matches = self.find_multi(self.buf, pattern_set, 0)
+		self.assertEqual(matches, [(0, 2, 0), (0, 2, 3), (2, 3, 1), (3, 2, 0),
+			(3, 2, 3), (4, 2, 2), (13, 3, 4), (15, 3, 1), (16, 2, 0),
+			(16, 2, 3), (17, 2, 2)])
+
+		matches = self.find_multi(self.buf, pattern_set, 3)
+		self.assertEqual(matches, [(3, 2, 0), (3, 2, 3), (4, 2, 2), (13, 3, 4),
+			(15, 3, 1), (16, 2, 0), (16, 2, 3), (17, 2, 2)])
+
+		# The set can be used with other buffers and changed
+		(err, buf2) = bless_buffer_new()
+		self.assertEqual(err, 0)
+
+		(err, mem_src) = bless_buffer_source_memory("xb1cab", 6, None)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(buf2, mem_src, 0, 6)
+		self.assertEqual(err, 0)
+		bless_buffer_source_unref(mem_src)
+
+		(err, id) = bless_pattern_set_add(pattern_set, "x", 1)
+		self.assertEqual(err, 0)
+
+		matches = self.find_multi(buf2, pattern_set, 0)
+		self.assertEqual(matches, [(0, 1, 5), (1, 2, 2), (3, 3, 1), (4, 2, 0),
+			(4, 2, 3)])
+
+		bless_buffer_free(buf2)
+
+		# Invalid arguments
+		(err, id) = bless_pattern_set_add(pattern_set, "a", 0)
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_pattern_set_free(pattern_set)
+		self.assertEqual(err, 0)
+
+	def find_all(self, buf, start_offset, end_offset, data, flags,
+			max_matches=0):
+		"""Search for all the occurrences of data and return the matches as a
+		list of (offset, length, id) tuples."""
+
+		(rfd, wfd) = os.pipe()
+		err = print_find_all_matches(buf, start_offset, end_offset, data,
+				len(data), flags, max_matches, wfd)
+		self.assertEqual(err, 0)
+		match_str = os.read(rfd, 10000)
+		os.close(rfd)
+
+		return [tuple([int(x) for x in l.split()]) for l in match_str.splitlines()]
+
+	def testFindAll(self):
+		"Search for all the occurrences of data in the buffer"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		(err, mem_src) = bless_buffer_source_memory("aaaab", 5, None)
+		self.assertEqual(err, 0)
+
+		# Contents: "aaaab" + "1234567890" + "aaaa"
+		err = bless_buffer_append(self.buf, mem_src, 0, 5)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 0, 4)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		matches = self.find_all(self.buf, 0, 19, "aa", 0)
+		self.assertEqual(matches, [(0, 2, 0), (2, 2, 0), (15, 2, 0),
+			(17, 2, 0)])
+
+		matches = self.find_all(self.buf, 0, 19, "aa",
+				BLESS_BUFFER_FIND_OVERLAPPING)
+		self.assertEqual(matches, [(0, 2, 0), (1, 2, 0), (2, 2, 0),
+			(15, 2, 0), (16, 2, 0), (17, 2, 0)])
+
+		# Matches must lie completely in the range
+		matches = self.find_all(self.buf, 1, 17, "aa", 0)
+		self.assertEqual(matches, [(1, 2, 0), (15, 2, 0)])
+
+		matches = self.find_all(self.buf, 1, 17, "aa",
+				BLESS_BUFFER_FIND_OVERLAPPING)
+		self.assertEqual(matches, [(1, 2, 0), (2, 2, 0), (15, 2, 0)])
+
+		# Matches straddling segment boundaries, range end past the buffer end
+		matches = self.find_all(self.buf, 0, 100, "b12", 0)
+		self.assertEqual(matches, [(4, 3, 0)])
+
+		matches = self.find_all(self.buf, 0, 19, "0aa", 0)
+		self.assertEqual(matches, [(14, 3, 0)])
+
+		# Stop the search from the match function
+		matches = self.find_all(self.buf, 0, 19, "aa",
+				BLESS_BUFFER_FIND_OVERLAPPING, 2)
+		self.assertEqual(matches, [(0, 2, 0), (1, 2, 0)])
+
+		# No match
+		matches = self.find_all(self.buf, 0, 19, "x", 0)
+		self.assertEqual(matches, [])
+
+		matches = self.find_all(self.buf, 19, 19, "a", 0)
+		self.assertEqual(matches, [])
+
+		# Invalid arguments
+		(rfd, wfd) = os.pipe()
+		err = print_find_all_matches(self.buf, 5, 4, "a", 1, 0, 0, wfd)
+		self.assertEqual(err, errno.EINVAL)
+		os.close(rfd)
+
+	def find_regex(self, buf, regex, start_offset, end_offset):
+		"""Search for the matches of a regex and return them as a list of
+		(offset, length, id) tuples."""
+
+		(rfd, wfd) = os.pipe()
+		err = print_find_regex_matches(buf, regex, start_offset, end_offset,
+				wfd)
+		self.assertEqual(err, 0)
+		match_str = os.read(rfd, 10000)
+		os.close(rfd)
+
+		return [tuple([int(x) for x in l.split()]) for l in match_str.splitlines()]
+
+	def testFindRegex(self):
+		"Search for the matches of a regular expression"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		data = "xx\x05hello\x0512345zz"
+		(err, mem_src) = bless_buffer_source_memory(data, len(data), None)
+		self.assertEqual(err, 0)
+
+		# Contents: "xx\x05hello" + "1234567890" + "\x0512345zz"
+		err = bless_buffer_append(self.buf, mem_src, 0, 8)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 8, 8)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		def find(pattern, start_offset=0, end_offset=100):
+			(err, regex) = bless_regex_new(pattern, len(pattern))
+			self.assertEqual(err, 0)
+			matches = self.find_regex(self.buf, regex, start_offset,
+					end_offset)
+			err = bless_regex_free(regex)
+			self.assertEqual(err, 0)
+			return matches
+
+		# Length-prefixed strings
+		self.assertEqual(find("\\x05[a-z0-9]{5}"), [(2, 6, 0), (18, 6, 0)])
+
+		# Matches are as long as possible and don't overlap
+		self.assertEqual(find("[0-9]+"), [(8, 10, 0), (19, 5, 0)])
+		self.assertEqual(find("\\d{3}", 9, 17), [(9, 3, 0), (12, 3, 0)])
+		self.assertEqual(find("z|x"), [(0, 1, 0), (1, 1, 0), (24, 1, 0),
+			(25, 1, 0)])
+
+		# Matches across segment boundaries
+		self.assertEqual(find("l+o1"), [(5, 4, 0)])
+		self.assertEqual(find("90\\x05"), [(16, 3, 0)])
+
+		self.assertEqual(find("[^\\x00-\\x7f]"), [])
+		self.assertEqual(find("x", 26), [])
+
+		# Invalid regexes (and regexes that match the empty data)
+		for pattern in ["a(", "a)", "[a", "a{2,1}", "^a", "\\q", "a*", "a|"]:
+			(err, regex) = bless_regex_new(pattern, len(pattern))
+			self.assertEqual(err, errno.EINVAL)
+
+	def testSourceIndex(self):
+		"Search using the index of a file source"
+
+		# A file with a different byte in each 64KiB block
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, "a" * 65536 + "b" * 65536 + "c" * 65536)
+		os.lseek(fd, 100000, os.SEEK_SET)
+		os.write(fd, "needle")
+
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		(err, mem_src) = bless_buffer_source_memory("needle", 6, None)
+		self.assertEqual(err, 0)
+
+		# Memory sources can't be indexed
+		err = bless_buffer_source_index_build(mem_src, None)
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_source_index_save(file_src, fd)
+		self.assertEqual(err, errno.ENOENT)
+
+		err = bless_buffer_source_index_build(file_src, None)
+		self.assertEqual(err, 0)
+
+		# Contents: file[0:150000] + "needle" + file[150000:196608]
+		err = bless_buffer_append(self.buf, file_src, 0, 196608)
+		self.assertEqual(err, 0)
+		err = bless_buffer_insert(self.buf, 150000, mem_src, 0, 6)
+		self.assertEqual(err, 0)
+
+		(err, match) = bless_buffer_find(self.buf, 0, "needle", 6, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 100000)
+
+		(err, match) = bless_buffer_find(self.buf, 100001, "needle", 6, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 150000)
+
+		# Matches straddling block boundaries
+		(err, match) = bless_buffer_find(self.buf, 0, "abbb", 4, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 65535)
+
+		(err, match) = bless_buffer_find(self.buf, 0, "cneedlec", 8, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, 149999)
+
+		(err, match) = bless_buffer_find(self.buf, 0, "abc", 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(match, -1)
+
+		matches = self.find_all(self.buf, 0, 196614, "needle", 0)
+		self.assertEqual(matches, [(100000, 6, 0), (150000, 6, 0)])
+
+		# Save the index and load it into another source of the same file
+		(index_fd, index_path) = tempfile.mkstemp()
+
+		err = bless_buffer_source_index_save(file_src, index_fd)
+		self.assertEqual(err, 0)
+
+		(err, file_src2) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		os.lseek(index_fd, 0, os.SEEK_SET)
+		err = bless_buffer_source_index_load(file_src2, index_fd)
+		self.assertEqual(err, 0)
+
+		# Invalid index
+		os.lseek(fd, 0, os.SEEK_SET)
+		err = bless_buffer_source_index_load(file_src2, fd)
+		self.assertEqual(err, errno.EINVAL)
+
+		# The index doesn't match the file any more
+		os.lseek(fd, 0, os.SEEK_END)
+		os.write(fd, "d")
+		(err, file_src3) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		os.lseek(index_fd, 0, os.SEEK_SET)
+		err = bless_buffer_source_index_load(file_src3, index_fd)
+		self.assertEqual(err, errno.ESTALE)
+
+		bless_buffer_source_unref(file_src3)
+		bless_buffer_source_unref(file_src2)
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		os.close(index_fd)
+		os.remove(index_path)
+		os.close(fd)
+		os.remove(path)
+
+	def testReplaceAll(self):
+		"Replace all the occurrences of data in the buffer"
+
+		fd = get_file_fd("buffer_test_file1.bin")
+		(err, file_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		(err, mem_src) = bless_buffer_source_memory("aaaab", 5, None)
+		self.assertEqual(err, 0)
+
+		(err, repl_src) = bless_buffer_source_memory("XYZ", 3, None)
+		self.assertEqual(err, 0)
+
+		# Contents: "aaaab" + "1234567890" + "aaaa"
+		err = bless_buffer_append(self.buf, mem_src, 0, 5)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, file_src, 0, 10)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, mem_src, 0, 4)
+		self.assertEqual(err, 0)
+
+		bless_buffer_source_unref(file_src)
+		bless_buffer_source_unref(mem_src)
+
+		(err, count) = bless_buffer_replace_all(self.buf, 0, 19, "aa", 2,
+				repl_src, 0, 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 4)
+		self.check_buffer(self.buf, "XYZXYZb1234567890XYZXYZ")
+		self.check_rev_id(self.buf, 4)
+
+		# Replace with nothing, only in part of the buffer
+		(err, count) = bless_buffer_replace_all(self.buf, 3, 100, "XYZ", 3,
+				None, 0, 0, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 3)
+		self.check_buffer(self.buf, "XYZb1234567890")
+		self.check_rev_id(self.buf, 5)
+
+		# No match, nothing changes
+		(err, count) = bless_buffer_replace_all(self.buf, 0, 100, "aa", 2,
+				repl_src, 0, 3, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 0)
+		self.check_rev_id(self.buf, 5)
+
+		# Each replace is undone and redone as a single action
+		undo_expected = [
+				("undo", "XYZXYZb1234567890XYZXYZ", 4),
+				("undo", "aaaab1234567890aaaa", 3),
+				("redo", "XYZXYZb1234567890XYZXYZ", 4),
+				("redo", "XYZb1234567890", 5)
+				]
+
+		self.check_undo_redo(undo_expected)
+
+		# Invalid arguments
+		(err, count) = bless_buffer_replace_all(self.buf, 0, 100, "a", 1,
+				None, 0, 1, None)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, count) = bless_buffer_replace_all(self.buf, 0, 100, "X", 1,
+				repl_src, 1, 3, None)
+		self.assertEqual(err, errno.EINVAL)
+		self.check_buffer(self.buf, "XYZb1234567890")
+
+		bless_buffer_source_unref(repl_src)
+
 	def testAppendFromFileBoundaryCases(self):
 		"Try boundary cases for appending to buffer from a file"
 		
@@ -662,31 +1412,129 @@ class BufferTests(unittest.TestCase):
 			err = bless_buffer_append(self.buf, data_obj, offset, length)
 			self.assertEqual(err, 0)
 
-		# Check file contents before save
-		data_len = len(expected_data)
-		self.assertEqual(data_len, bless_buffer_get_size(self.buf)[1])
-		if data_len > 0:
-			read_data = create_string_buffer(data_len)
-			err = bless_buffer_read(self.buf, 0, read_data, 0, data_len)
-			self.assertEqual(err, 0)
+		# Check file contents before save
+		data_len = len(expected_data)
+		self.assertEqual(data_len, bless_buffer_get_size(self.buf)[1])
+		if data_len > 0:
+			read_data = create_string_buffer(data_len)
+			err = bless_buffer_read(self.buf, 0, read_data, 0, data_len)
+			self.assertEqual(err, 0)
+
+			for i in range(len(read_data)):
+				self.assertEqual(read_data[i], expected_data[i])
+
+		# Save file
+		err = bless_buffer_save(self.buf, save_fd, None)
+		self.assertEqual(err, 0)
+
+		# Check file contents after save
+		self.assertEqual(data_len, bless_buffer_get_size(self.buf)[1])
+		if data_len > 0:
+			read_data = create_string_buffer(data_len)
+			err = bless_buffer_read(self.buf, 0, read_data, 0, data_len)
+			self.assertEqual(err, 0)
+			
+			for i in range(len(read_data)):
+				self.assertEqual(read_data[i], expected_data[i])
+		
+	def testManySmallEdits(self):
+		"Insert many small pieces of data whose sources are freed immediately"
+
+		data = "abcdefghijklmnopqrstuvwxyz" * 200
+
+		(err, src) = bless_buffer_source_memory("|", 1, None)
+		self.assertEqual(err, 0)
+		err = bless_buffer_append(self.buf, src, 0, 1)
+		self.assertEqual(err, 0)
+		bless_buffer_source_unref(src)
+
+		# Type the data in front of the "|"
+		for i in range(len(data)):
+			(err, src) = bless_buffer_source_memory(data[i] * 2, 2, None)
+			self.assertEqual(err, 0)
+			err = bless_buffer_insert(self.buf, i, src, 1, 1)
+			self.assertEqual(err, 0)
+			err = bless_buffer_source_unref(src)
+			self.assertEqual(err, 0)
+
+		expected_data = data + "|"
+
+		read_data = create_string_buffer(len(expected_data))
+		err = bless_buffer_read(self.buf, 0, read_data, 0, len(read_data))
+		self.assertEqual(err, 0)
+		self.assertEqual(read_data.raw, expected_data)
+
+		# Undo and redo some of the edits
+		for i in range(100):
+			err = bless_buffer_undo(self.buf)
+			self.assertEqual(err, 0)
+
+		self.assertEqual(bless_buffer_get_size(self.buf)[1],
+				len(expected_data) - 100)
+
+		for i in range(100):
+			err = bless_buffer_redo(self.buf)
+			self.assertEqual(err, 0)
+
+		err = bless_buffer_read(self.buf, 0, read_data, 0, len(read_data))
+		self.assertEqual(err, 0)
+		self.assertEqual(read_data.raw, expected_data)
+
+	def testInvalidSmallEdits(self):
+		"Check that invalid small edits don't use the add buffer"
+
+		(err, src) = bless_buffer_source_memory("abcdXY", 6, None)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, src, 0, 2)
+		self.assertEqual(err, 0)
+
+		# Invalid offsets in the buffer and in the source
+		err = bless_buffer_insert(self.buf, 2, src, 4, 2)
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_insert(self.buf, -1, src, 4, 2)
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_insert(self.buf, 0, src, 5, 2)
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_append(self.buf, src, 4, 3)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, count) = bless_buffer_replace_all(self.buf, 0, 2, "a", 1,
+				src, 6, 1, None)
+		self.assertEqual(err, errno.EINVAL)
+
+		# An invalid search range and a search without matches
+		(err, count) = bless_buffer_replace_all(self.buf, -1, 2, "a", 1,
+				src, 4, 1, None)
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, count) = bless_buffer_replace_all(self.buf, 0, 2, "z", 1,
+				src, 4, 1, None)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 0)
+
+		err = bless_buffer_append(self.buf, src, 2, 2)
+		self.assertEqual(err, 0)
+
+		# The data of the valid edits are contiguous in the add buffer
+		(err, extents) = bless_buffer_read_extents(self.buf, 0, 4)
+		self.assertEqual(err, 0)
+
+		(err, iov, count) = bless_buffer_extents_get_iovec(extents)
+		self.assertEqual(err, 0)
+		self.assertEqual(count, 1)
+
+		err = bless_buffer_extents_free(extents)
+		self.assertEqual(err, 0)
 
-			for i in range(len(read_data)):
-				self.assertEqual(read_data[i], expected_data[i])
+		self.check_buffer(self.buf, "abcd")
 
-		# Save file
-		err = bless_buffer_save(self.buf, save_fd, None)
+		err = bless_buffer_source_unref(src)
 		self.assertEqual(err, 0)
 
-		# Check file contents after save
-		self.assertEqual(data_len, bless_buffer_get_size(self.buf)[1])
-		if data_len > 0:
-			read_data = create_string_buffer(data_len)
-			err = bless_buffer_read(self.buf, 0, read_data, 0, data_len)
-			self.assertEqual(err, 0)
-			
-			for i in range(len(read_data)):
-				self.assertEqual(read_data[i], expected_data[i])
-		
 	def testSaveEmpty(self):
 		"""Save a empty buffer"""
 		(fd1, fd1_path) = get_tmp_copy_file_fd("/dev/null", os.O_RDWR)
@@ -755,6 +1603,40 @@ class BufferTests(unittest.TestCase):
 		os.close(fd1)
 		os.remove(fd1_path)
 
+	def testSaveSelfOverlapLowerLarge(self):
+		"""Save a buffer that contains a large self overlap moved to lower
+		offsets by a few bytes"""
+
+		data = "".join([chr(i % 251) for i in range(100000)])
+
+		# (offset, length) of the data to delete from the file
+		for (offset, length) in ((0, 1), (0, 9), (344, 9), (50000, 1)):
+			(fd1, fd1_path) = tempfile.mkstemp()
+			os.write(fd1, data)
+
+			(err, fd1_src) = bless_buffer_source_file(fd1, None)
+			self.assertEqual(err, 0)
+
+			expected = data[:offset] + data[offset + length:]
+
+			segments = [(fd1_src, offset + length, len(expected) - offset)]
+			if offset > 0:
+				segments.insert(0, (fd1_src, 0, offset))
+
+			self.check_save(fd1, segments, expected)
+
+			os.lseek(fd1, 0, os.SEEK_SET)
+			self.assertEqual(os.read(fd1, len(data)), expected)
+
+			bless_buffer_delete(self.buf, 0, bless_buffer_get_size(self.buf)[1])
+
+			err = bless_buffer_source_unref(fd1_src)
+			self.assertEqual(err, 0)
+
+			# Remove temporary file
+			os.close(fd1)
+			os.remove(fd1_path)
+
 	def testSaveRemoveLeftOverlap(self):
 		"""Save a buffer that contains two circular overlaps so that the
 		removed overlap is the one where the buffer segment is left of the
@@ -904,6 +1786,145 @@ class BufferTests(unittest.TestCase):
 		os.close(fd1)
 		os.remove(fd1_path)
 
+	def testSaveSpill(self):
+		"""Get the number of bytes a save must copy out of the file with each
+		cycle breaking strategy and save with each of them"""
+
+		# Use segments large enough not to be copied to the buffer on append
+		data = "".join([c * 1024 for c in "0123456789abcdef"])
+		expected = "".join([c * 1024 for c in "56789789abcd23456789acdef"])
+
+		for (strategy, spill) in (("greedy", 2048), ("spanning_tree", 5120)):
+			(fd1, fd1_path) = tempfile.mkstemp()
+			os.write(fd1, data)
+
+			(err, fd1_src) = bless_buffer_source_file(fd1, None)
+			self.assertEqual(err, 0)
+
+			err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_CYCLES,
+					strategy)
+			self.assertEqual(err, 0)
+
+			# Segments that overlap each other in cycles
+			for (offset, length) in ((5120, 5120), (7168, 7168), (2048, 9216),
+					(12288, 4096)):
+				err = bless_buffer_append(self.buf, fd1_src, offset, length)
+				self.assertEqual(err, 0)
+
+			(err, nbytes) = bless_buffer_get_save_spill(self.buf, fd1)
+			self.assertEqual(err, 0)
+			self.assertEqual(nbytes, spill)
+
+			err = bless_buffer_save(self.buf, fd1, None)
+			self.assertEqual(err, 0)
+
+			os.lseek(fd1, 0, os.SEEK_SET)
+			self.assertEqual(os.read(fd1, 2 * len(expected)), expected)
+			self.check_buffer(self.buf, expected)
+
+			# Nothing needs to be copied after the save
+			(err, nbytes) = bless_buffer_get_save_spill(self.buf, fd1)
+			self.assertEqual(err, 0)
+			self.assertEqual(nbytes, 0)
+
+			bless_buffer_delete(self.buf, 0, bless_buffer_get_size(self.buf)[1])
+
+			err = bless_buffer_source_unref(fd1_src)
+			self.assertEqual(err, 0)
+
+			# Remove temporary file
+			os.close(fd1)
+			os.remove(fd1_path)
+
+	def testSaveBatchSize(self):
+		"Save a buffer writing less data at once than each segment contains"
+
+		data = "".join([c * 1024 for c in "0123456789abcdef"])
+
+		(fd1, fd1_path) = tempfile.mkstemp()
+		os.write(fd1, data)
+
+		(err, fd1_src) = bless_buffer_source_file(fd1, None)
+		self.assertEqual(err, 0)
+
+		data1 = "X" * 1500
+		(err, data1_src) = bless_buffer_source_memory(data1, len(data1), None)
+		self.assertEqual(err, 0)
+
+		data2 = "Y" * 10
+		(err, data2_src) = bless_buffer_source_memory(data2, len(data2), None)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_BATCH_SIZE,
+				'1000')
+		self.assertEqual(err, 0)
+
+		self.check_save(fd1, [(data1_src, 0, len(data1)), (fd1_src, 0, 8192),
+			(data2_src, 0, len(data2)), (fd1_src, 4096, 12288),
+			(fd1_src, 12288, 2048)],
+			data1 + data[:8192] + data2 + data[4096:] + data[12288:14336])
+
+		os.lseek(fd1, 0, os.SEEK_SET)
+		self.assertEqual(os.read(fd1, 2 * len(data)),
+			data1 + data[:8192] + data2 + data[4096:] + data[12288:14336])
+
+		bless_buffer_source_unref(data1_src)
+		bless_buffer_source_unref(data2_src)
+
+		err = bless_buffer_source_unref(fd1_src)
+		self.assertEqual(err, 0)
+
+		# Remove temporary file
+		os.close(fd1)
+		os.remove(fd1_path)
+
+	def testSaveLargeFileSegments(self):
+		"Save a buffer that contains large segments from two files"
+
+		data1 = "".join([c * 20480 for c in "0123456789"])
+		data2 = "".join([c * 32768 for c in "abcdefgh"])
+
+		(fd1, fd1_path) = tempfile.mkstemp()
+		os.write(fd1, data1)
+
+		(fd2, fd2_path) = tempfile.mkstemp()
+		os.write(fd2, data2)
+
+		(err, fd1_src) = bless_buffer_source_file(fd1, None)
+		self.assertEqual(err, 0)
+
+		(err, fd2_src) = bless_buffer_source_file(fd2, None)
+		self.assertEqual(err, 0)
+
+		data3 = "#!LBBLSS!#"
+		(err, data3_src) = bless_buffer_source_memory(data3, len(data3), None)
+		self.assertEqual(err, 0)
+
+		# The segments are large enough to be copied by the kernel
+		expected = (data1[102400:] + data2[:131072] + data3 +
+				data2[65536:196608])
+
+		self.check_save(fd1, [(fd1_src, 102400, 102400),
+			(fd2_src, 0, 131072), (data3_src, 0, len(data3)),
+			(fd2_src, 65536, 131072)], expected)
+
+		os.lseek(fd1, 0, os.SEEK_SET)
+		self.assertEqual(os.read(fd1, 2 * len(expected)), expected)
+
+		bless_buffer_source_unref(data3_src)
+
+		err = bless_buffer_source_unref(fd1_src)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_source_unref(fd2_src)
+		self.assertEqual(err, 0)
+
+		# Remove temporary files
+		os.close(fd1)
+		os.remove(fd1_path)
+		os.close(fd2)
+		os.remove(fd2_path)
+
 	def testBufferOptions(self):
 		"Set and get buffer options"
 
@@ -941,6 +1962,257 @@ class BufferTests(unittest.TestCase):
 		self.assertEqual(err, 0)
 		self.assertEqual(val, '1024')
 
+		# BLESS_BUF_SEGCOL_IMPL
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SEGCOL_IMPL)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'list')
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SEGCOL_IMPL, 'heap')
+		self.assertEqual(err, errno.EINVAL)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SEGCOL_IMPL)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'list')
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SEGCOL_IMPL, 'tree')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SEGCOL_IMPL)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'tree')
+
+		# BLESS_BUF_FILE_WINDOW_SIZE
+		(err, val) = bless_buffer_get_option(self.buf,
+				BLESS_BUF_FILE_WINDOW_SIZE)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, str(DATA_OBJECT_FILE_WINDOW_SIZE))
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOW_SIZE, '0')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOW_SIZE,
+				'1M')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOW_SIZE,
+				'16777216')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf,
+				BLESS_BUF_FILE_WINDOW_SIZE)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '16777216')
+
+		# BLESS_BUF_FILE_WINDOWS
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FILE_WINDOWS)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, str(DATA_OBJECT_FILE_WINDOWS))
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOWS, '-2')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOWS, '8')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FILE_WINDOWS)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '8')
+
+		# BLESS_BUF_FILE_BACKEND
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FILE_BACKEND)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'default')
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_BACKEND, 'read')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_BACKEND, 'pread')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FILE_BACKEND)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'pread')
+
+		# BLESS_BUF_FIND_THREADS
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FIND_THREADS)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '1')
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FIND_THREADS, '0')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FIND_THREADS, '4')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FIND_THREADS)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '4')
+
+		# BLESS_BUF_SAVE_CYCLES
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SAVE_CYCLES)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'spanning_tree')
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_CYCLES, 'none')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_CYCLES,
+				'greedy')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SAVE_CYCLES)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'greedy')
+
+		# BLESS_BUF_SAVE_BATCH_SIZE
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SAVE_BATCH_SIZE)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '4194304')
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_BATCH_SIZE, '0')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_BATCH_SIZE,
+				'-4096')
+		self.assertEqual(err, errno.EINVAL)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SAVE_BATCH_SIZE,
+				'65536')
+		self.assertEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_SAVE_BATCH_SIZE)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '65536')
+
+	def testFileWindowOptionsFailure(self):
+		"Check that a window option that can't be applied is not changed"
+
+		# Use data large enough not to be copied to the buffer on append
+		data = "0123456789abcdef" * 256
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, data_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, data_src, 0, len(data))
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_source_unref(data_src)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOW_SIZE,
+				'16777216')
+		self.assertEqual(err, 0)
+
+		# The size overflows when it is rounded up to the page size
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_WINDOW_SIZE,
+				str(get_max_size_t()))
+		self.assertNotEqual(err, 0)
+
+		(err, val) = bless_buffer_get_option(self.buf,
+				BLESS_BUF_FILE_WINDOW_SIZE)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, '16777216')
+
+		self.check_buffer(self.buf, data)
+
+		bless_buffer_delete(self.buf, 0, len(data))
+
+		# Remove temporary file
+		os.close(fd)
+		os.remove(path)
+
+	def testFileBackendFailure(self):
+		"Check that a backend that can't be applied is not changed"
+
+		# Use data large enough not to be copied to the buffer on append
+		data = "0123456789abcdef" * 256
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, data_src) = bless_buffer_source_file(fd, None)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_whole_mapping(data_src, 1)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_append(self.buf, data_src, 0, len(data))
+		self.assertEqual(err, 0)
+
+		# The extents pin the mapped data of the file
+		(err, extents) = bless_buffer_read_extents(self.buf, 0, len(data))
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_BACKEND,
+				'pread')
+		self.assertEqual(err, errno.EBUSY)
+
+		(err, val) = bless_buffer_get_option(self.buf, BLESS_BUF_FILE_BACKEND)
+		self.assertEqual(err, 0)
+		self.assertEqual(val, 'default')
+
+		(err, backend) = data_object_file_get_backend(data_src)
+		self.assertEqual(err, 0)
+		self.assertEqual(backend, DATA_OBJECT_FILE_MMAP)
+
+		err = bless_buffer_extents_free(extents)
+		self.assertEqual(err, 0)
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_FILE_BACKEND,
+				'pread')
+		self.assertEqual(err, 0)
+
+		(err, backend) = data_object_file_get_backend(data_src)
+		self.assertEqual(err, 0)
+		self.assertEqual(backend, DATA_OBJECT_FILE_PREAD)
+
+		self.check_buffer(self.buf, data)
+
+		err = bless_buffer_source_unref(data_src)
+		self.assertEqual(err, 0)
+
+		bless_buffer_delete(self.buf, 0, len(data))
+
+		# Remove temporary file
+		os.close(fd)
+		os.remove(path)
+
+	def testSegcolImplChange(self):
+		"Change the segcol implementation of a buffer with contents"
+
+		self.fill_buffer_for_undo()
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SEGCOL_IMPL, 'tree')
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "dehij")
+
+		err = bless_buffer_undo(self.buf)
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "de")
+
+		err = bless_buffer_undo(self.buf)
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "defg234abc56789")
+
+		err = bless_buffer_redo(self.buf)
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "de")
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SEGCOL_IMPL, 'btree')
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "de")
+
+		err = bless_buffer_redo(self.buf)
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "dehij")
+
+		err = bless_buffer_set_option(self.buf, BLESS_BUF_SEGCOL_IMPL, 'list')
+		self.assertEqual(err, 0)
+		self.check_buffer(self.buf, "dehij")
+
 	def fill_buffer_for_undo(self):
 		data = "0123456789abcdefghij" 
 		(err, src) = bless_buffer_source_memory(data, 20, None)
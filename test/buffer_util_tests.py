@@ -139,6 +139,100 @@ class BufferUtilTests(unittest.TestCase):
 		os.remove(tmp_path)
 		data_object_free(data_obj)
 
+	def testWriteBatch(self):
+		"Write data from file and memory data objects with a write batch"
+
+		(tmp_fd, tmp_path) = tempfile.mkstemp();
+
+		fd = get_file_fd("buffer_tests.py")
+
+		# Read data using python functions
+		f = os.fdopen(fd)
+
+		from_python = f.read()
+
+		(err, data_obj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		# Create and fill memory data object
+		(err, data_obj1) = data_object_memory_new_ptr(bless_malloc(10), 10)
+		self.assertEqual(err, 0)
+
+		data = "#!LBBLSS!#"
+		(err, buf) = data_object_get_data(data_obj1, 0, 10, DATA_OBJECT_WRITE)
+		self.assertEqual(err, 0)
+		buf[:] = data
+
+		# Use a small batch so that the data are written in many parts
+		(err, batch) = write_batch_new(tmp_fd, 1000)
+		self.assertEqual(err, 0)
+
+		length = len(from_python) - 4
+
+		err = write_batch_add(batch, data_obj, 2, length, 0)
+		self.assertEqual(err, 0)
+
+		err = write_batch_add(batch, data_obj1, 0, 10, length)
+		self.assertEqual(err, 0)
+
+		# Data that don't follow the previous data
+		err = write_batch_add(batch, data_obj1, 2, 4, length + 20)
+		self.assertEqual(err, 0)
+
+		err = write_batch_flush(batch)
+		self.assertEqual(err, 0)
+
+		err = write_batch_free(batch)
+		self.assertEqual(err, 0)
+
+		os.close(tmp_fd)
+
+		tmp_f = open(tmp_path)
+		self.assert_(tmp_f is not None)
+		from_python_tmp = tmp_f.read()
+
+		self.assertEqual(from_python_tmp, from_python[2:-2] + data +
+				"\0" * 10 + data[2:6])
+
+		os.remove(tmp_path)
+		data_object_free(data_obj)
+		data_object_free(data_obj1)
+
+	def testWriteBatchSafe(self):
+		"Write overlapping data in a safe way with a write batch"
+
+		(tmp_fd, tmp_path) = tempfile.mkstemp();
+
+		data = "".join([chr(ord('a') + i % 26) for i in xrange(100)])
+		os.write(tmp_fd, data)
+
+		(err, data_obj) = data_object_file_new(tmp_fd)
+		self.assertEqual(err, 0)
+
+		(err, batch) = write_batch_new(tmp_fd, 7)
+		self.assertEqual(err, 0)
+
+		# Move most of the data to a higher and then to a lower offset
+		err = write_batch_write_safe(batch, data_obj, 0, 90, 5)
+		self.assertEqual(err, 0)
+
+		os.lseek(tmp_fd, 0, os.SEEK_SET)
+		self.assertEqual(os.read(tmp_fd, 200), data[:5] + data[:90] + data[95:])
+
+		err = write_batch_write_safe(batch, data_obj, 5, 90, 0)
+		self.assertEqual(err, 0)
+
+		os.lseek(tmp_fd, 0, os.SEEK_SET)
+		self.assertEqual(os.read(tmp_fd, 200), data[:90] + data[85:90] +
+				data[95:])
+
+		err = write_batch_free(batch)
+		self.assertEqual(err, 0)
+
+		data_object_free(data_obj)
+		os.close(tmp_fd)
+		os.remove(tmp_path)
+
 	def create_buffer(self):
 		"Create a buffer used in testSegcolStore*"
 
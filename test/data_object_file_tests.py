@@ -58,6 +58,16 @@ class DataObjectFileTests(unittest.TestCase):
 
 		self.assertEqual(data_object_get_size(self.obj)[1], 10)
 
+	def testNewClosedFd(self):
+		"Try to create a file data object from a closed file descriptor"
+
+		(fd, path) = tempfile.mkstemp()
+		os.close(fd)
+		os.remove(path)
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, errno.EBADF)
+
 	def testGetData(self):
 		"Get data from a file data object"
 
@@ -141,6 +151,278 @@ class DataObjectFileTests(unittest.TestCase):
 
 		data_object_free(dobj)
 
+	def testWindowCache(self):
+		"Set and get the window cache parameters of a file data object"
+
+		(err, window_size, nwindows) = data_object_file_get_window_cache(self.obj)
+		self.assertEqual(err, 0)
+		self.assertEqual(window_size, DATA_OBJECT_FILE_WINDOW_SIZE)
+		self.assertEqual(nwindows, DATA_OBJECT_FILE_WINDOWS)
+
+		err = data_object_file_set_window_cache(self.obj, 0, 2)
+		self.assertEqual(err, errno.EINVAL)
+
+		err = data_object_file_set_window_cache(self.obj, 1024, 0)
+		self.assertEqual(err, errno.EINVAL)
+
+		# The window size is rounded up to a multiple of the page size
+		err = data_object_file_set_window_cache(self.obj, 1, 2)
+		self.assertEqual(err, 0)
+
+		(err, window_size, nwindows) = data_object_file_get_window_cache(self.obj)
+		self.assertEqual(err, 0)
+		self.assertEqual(window_size, os.sysconf("SC_PAGESIZE"))
+		self.assertEqual(nwindows, 2)
+
+		(err, buf) = data_object_get_data(self.obj, 3, 5, DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(str(buf), "34567")
+
+		(err, is_file) = data_object_is_file(self.obj)
+		self.assertEqual(err, 0)
+		self.assertEqual(is_file, 1)
+
+		(err, mem_obj) = data_object_memory_new_ptr(0, 10)
+		(err, is_file) = data_object_is_file(mem_obj)
+		self.assertEqual(err, 0)
+		self.assertEqual(is_file, 0)
+		data_object_free(mem_obj)
+
+	def testGetDataWindows(self):
+		"Get data from a file data object through several small windows"
+
+		page_size = os.sysconf("SC_PAGESIZE")
+		data = "".join([chr(i % 251) for i in xrange(8 * page_size + 100)])
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_whole_mapping(dobj, 0)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_window_cache(dobj, page_size, 3)
+		self.assertEqual(err, 0)
+
+		# Interleave reads from distant parts of the file
+		offsets = [0, 7 * page_size, page_size - 3, 5 * page_size + 10,
+				8 * page_size + 50, 10, 7 * page_size + 1, 3 * page_size]
+
+		for off in offsets:
+			(err, buf) = data_object_get_data(dobj, off, 50, DATA_OBJECT_READ)
+			self.assertEqual(err, 0)
+			self.assert_(len(buf) > 0)
+			self.assertEqual(str(buf), data[off:off + len(buf)])
+
+		# A read can't cross a window boundary
+		(err, buf) = data_object_get_data(dobj, page_size - 3, 50,
+				DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(len(buf), 3)
+
+		data_object_free(dobj)
+		os.close(fd)
+		os.remove(path)
+
+	def testWholeMapping(self):
+		"Map the whole file of a file data object"
+
+		page_size = os.sysconf("SC_PAGESIZE")
+		data = "".join([chr(i % 251) for i in xrange(8 * page_size + 100)])
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_whole_mapping(dobj, 1)
+		self.assertEqual(err, 0)
+
+		(err, enabled) = data_object_file_get_whole_mapping(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(enabled, 1)
+
+		# The whole range is returned at once
+		(err, buf) = data_object_get_data(dobj, 10, len(data) - 10,
+				DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(str(buf), data[10:])
+
+		err = data_object_file_set_whole_mapping(dobj, 0)
+		self.assertEqual(err, 0)
+
+		(err, enabled) = data_object_file_get_whole_mapping(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(enabled, 0)
+
+		(err, buf) = data_object_get_data(dobj, 10, len(data) - 10,
+				DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(str(buf), data[10:10 + len(buf)])
+
+		data_object_free(dobj)
+		os.close(fd)
+		os.remove(path)
+
+	def testCanPin(self):
+		"Check whether the data of a file data object can be pinned"
+
+		data = "".join([chr(i % 251) for i in xrange(3 * 4096 + 100)])
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		# Only the data of a whole mapped file can be pinned
+		err = data_object_file_set_whole_mapping(dobj, 1)
+		self.assertEqual(err, 0)
+
+		(err, can_pin) = data_object_can_pin(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_pin, 1)
+
+		err = data_object_file_set_whole_mapping(dobj, 0)
+		self.assertEqual(err, 0)
+
+		(err, can_pin) = data_object_can_pin(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_pin, 0)
+
+		err = data_object_file_set_backend(dobj, DATA_OBJECT_FILE_PREAD)
+		self.assertEqual(err, 0)
+
+		(err, can_pin) = data_object_can_pin(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_pin, 0)
+
+		data_object_free(dobj)
+		os.close(fd)
+		os.remove(path)
+
+	def testPreadBackend(self):
+		"Get data from a file data object using the pread backend"
+
+		data = "".join([chr(i % 251) for i in xrange(300 * 1024 + 17)])
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_backend(dobj, DATA_OBJECT_FILE_PREAD)
+		self.assertEqual(err, 0)
+
+		(err, backend) = data_object_file_get_backend(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(backend, DATA_OBJECT_FILE_PREAD)
+
+		# Whole mapping is not supported by the pread backend
+		err = data_object_file_set_whole_mapping(dobj, 1)
+		self.assertEqual(err, errno.EINVAL)
+
+		# Read sequentially and at random offsets
+		offsets = range(0, len(data), 10000) + [len(data) - 1, 5, 200000, 17]
+
+		for off in offsets:
+			(err, buf) = data_object_get_data(dobj, off,
+					min(20000, len(data) - off), DATA_OBJECT_READ)
+			self.assertEqual(err, 0)
+			self.assert_(len(buf) > 0)
+			self.assertEqual(str(buf), data[off:off + len(buf)])
+
+		# A pread object is equal to an mmap object of the same file
+		(err, dobj1) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		(err, res) = data_object_compare(dobj, dobj1)
+		self.assertEqual(err, 0)
+		self.assertEqual(res, 0)
+
+		err = data_object_file_set_backend(dobj, DATA_OBJECT_FILE_MMAP)
+		self.assertEqual(err, 0)
+
+		(err, buf) = data_object_get_data(dobj, 17, 100, DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(str(buf), data[17:117])
+
+		data_object_free(dobj1)
+		data_object_free(dobj)
+		os.close(fd)
+		os.remove(path)
+
+	def testNewView(self):
+		"Create views of a file data object"
+
+		data = "".join([chr(i % 251) for i in xrange(300 * 1024 + 17)])
+
+		(fd, path) = tempfile.mkstemp()
+		os.write(fd, data)
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_whole_mapping(dobj, 0)
+		self.assertEqual(err, 0)
+
+		err = data_object_file_set_window_cache(dobj, 64 * 1024, 2)
+		self.assertEqual(err, 0)
+
+		# The view has the same parameters and data as the original
+		(err, view) = data_object_file_new_view(dobj)
+		self.assertEqual(err, 0)
+
+		(err, window_size, nwindows) = data_object_file_get_window_cache(view)
+		self.assertEqual(err, 0)
+		self.assertEqual(window_size, 64 * 1024)
+		self.assertEqual(nwindows, 2)
+
+		(err, enabled) = data_object_file_get_whole_mapping(view)
+		self.assertEqual(err, 0)
+		self.assertEqual(enabled, 0)
+
+		(err, res) = data_object_compare(dobj, view)
+		self.assertEqual(err, 0)
+		self.assertEqual(res, 0)
+
+		for off in [0, 70000, 250000, 17]:
+			(err, buf) = data_object_get_data(view, off, 100, DATA_OBJECT_READ)
+			self.assertEqual(err, 0)
+			self.assertEqual(str(buf), data[off:off + 100])
+
+		data_object_free(view)
+
+		# Views of objects using the pread backend use it too
+		err = data_object_file_set_backend(dobj, DATA_OBJECT_FILE_PREAD)
+		self.assertEqual(err, 0)
+
+		(err, view) = data_object_file_new_view(dobj)
+		self.assertEqual(err, 0)
+
+		(err, backend) = data_object_file_get_backend(view)
+		self.assertEqual(err, 0)
+		self.assertEqual(backend, DATA_OBJECT_FILE_PREAD)
+
+		(err, buf) = data_object_get_data(view, 1000, 100, DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(str(buf), data[1000:1100])
+
+		# Freeing the view doesn't close the file
+		data_object_free(view)
+
+		(err, buf) = data_object_get_data(dobj, 1000, 100, DATA_OBJECT_READ)
+		self.assertEqual(err, 0)
+		self.assertEqual(str(buf), data[1000:1100])
+
+		data_object_free(dobj)
+		os.close(fd)
+		os.remove(path)
+
 	def testGetDataOverflow(self):
 		"Test boundary cases for get_data overflow"
 
@@ -188,6 +470,27 @@ class DataObjectFileTests(unittest.TestCase):
 		data_object_free(obj1)
 		data_object_free(obj2)
 
+	def testGetFd(self):
+		"Get the file descriptor of a file data object"
+
+		(fd, path) = tempfile.mkstemp()
+
+		(err, dobj) = data_object_file_new(fd)
+		self.assertEqual(err, 0)
+
+		(err, obj_fd) = data_object_file_get_fd(dobj)
+		self.assertEqual(err, 0)
+		self.assertEqual(obj_fd, fd)
+
+		(err, mem_obj) = data_object_memory_new_ptr(0, 10)
+		(err, obj_fd) = data_object_file_get_fd(mem_obj)
+		self.assertEqual(err, errno.EINVAL)
+		data_object_free(mem_obj)
+
+		data_object_free(dobj)
+		os.close(fd)
+		os.remove(path)
+
 	def testTempFile(self):
 		"Create a tempfile data object"
 
@@ -118,6 +118,13 @@ class DataObjectMemoryTests(unittest.TestCase):
 
 		self.assertEqual(size, 10)
 
+	def testCanPin(self):
+		"Check that the data of a memory data object can be pinned"
+
+		(err, can_pin) = data_object_can_pin(self.obj)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_pin, 1)
+
 	def testReadInvalid(self):
 		"Try to read from invalid ranges in a data object"
 
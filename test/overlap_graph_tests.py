@@ -117,6 +117,44 @@ class OverlapGraphTests(unittest.TestCase):
 		segment_free(seg2)
 		segment_free(seg3)
 
+	def testAddSegmentsDeferred(self):
+		"Add segments to the overlap graph and find their overlaps at once"
+
+		(err, seg1) = segment_new("", 5, 10, None)
+		self.assertEqual(err, 0)
+		(err, seg2) = segment_new("", 20, 5, None)
+		self.assertEqual(err, 0)
+		(err, seg3) = segment_new("", 30, 5, None)
+		self.assertEqual(err, 0)
+		(err, seg4) = segment_new("", 40, 0, None)
+		self.assertEqual(err, 0)
+
+		# Mix deferred and immediate additions
+		err = overlap_graph_add_segment_deferred(self.g, seg1, 12)
+		self.assertEqual(err, 0)
+		err = overlap_graph_add_segment(self.g, seg2, 28)
+		self.assertEqual(err, 0)
+		err = overlap_graph_add_segment_deferred(self.g, seg3, 3)
+		self.assertEqual(err, 0)
+		err = overlap_graph_add_segment_deferred(self.g, seg4, 30)
+		self.assertEqual(err, 0)
+
+		err = overlap_graph_update_edges(self.g)
+		self.assertEqual(err, 0)
+
+		# Same graph as testAddSegments2 (empty segments overlap nothing)
+		expected_lines =("0 [label = \"0-1/1\"]\n", "1 [label = \"1-1/1\"]\n",
+				"2 [label = \"2-1/1\"]\n", "3 [label = \"3-0/0\"]\n",
+				"0 -> 0 [label = 3]\n", "0 -> 2 [label = 3]\n",
+				"1 -> 0 [label = 2]\n", "2 -> 1 [label = 3]\n")
+
+		self.check_dot(self.g, expected_lines)
+
+		segment_free(seg1)
+		segment_free(seg2)
+		segment_free(seg3)
+		segment_free(seg4)
+
 	def testSpanningTree(self):
 		"Find the spanning tree of an overlap graph"
 
@@ -171,6 +209,93 @@ class OverlapGraphTests(unittest.TestCase):
 		segment_free(seg2)
 		segment_free(seg3)
 
+	def testRemoveCyclesGreedy(self):
+		"Remove cycles with the greedy heuristic"
+
+		(err, seg1) = segment_new("A1", 9, 3, None)
+		self.assertEqual(err, 0)
+		(err, seg2) = segment_new("B2", 0, 4, None)
+		self.assertEqual(err, 0)
+		(err, seg3) = segment_new("C3", 0, 7, None)
+		self.assertEqual(err, 0)
+
+		err = overlap_graph_add_segment(self.g, seg1, 0)
+		self.assertEqual(err, 0)
+		err = overlap_graph_add_segment(self.g, seg2, 3)
+		self.assertEqual(err, 0)
+		err = overlap_graph_add_segment(self.g, seg3, 7)
+		self.assertEqual(err, 0)
+
+		# No removed edges so far
+		(err, weight) = overlap_graph_get_removed_weight(self.g)
+		self.assertEqual(err, 0)
+		self.assertEqual(weight, 0)
+
+		err = overlap_graph_remove_cycles_greedy(self.g)
+		self.assertEqual(err, 0)
+
+		expected_lines = ("0 [label = \"0-2/0\"]\n", "1 [label = \"1-1/1\"]\n",
+				"2 [label = \"2-0/2\"]\n", "1 -> 1 [label = 1]\n",
+				"0 -> 2 [label = 3 style = dotted]\n",
+				"1 -> 0 [label = 3]\n", "2 -> 0 [label = 3]\n",
+				"2 -> 1 [label = 4]\n")
+
+		self.check_dot(self.g, expected_lines)
+
+		self.check_removed_edges(self.g, ["A1 -> C3\n"])
+
+		(err, weight) = overlap_graph_get_removed_weight(self.g)
+		self.assertEqual(err, 0)
+		self.assertEqual(weight, 3)
+
+		segment_free(seg1)
+		segment_free(seg2)
+		segment_free(seg3)
+
+	def testRemoveCyclesGreedyCompare(self):
+		"Compare the greedy and spanning tree heuristics"
+
+		segs = []
+		for (name, start, size, mapping) in (("A1", 5, 5, 0), ("B2", 7, 7, 5),
+				("C3", 2, 9, 12), ("D4", 12, 4, 21)):
+			(err, seg) = segment_new(name, start, size, None)
+			self.assertEqual(err, 0)
+			err = overlap_graph_add_segment(self.g, seg, mapping)
+			self.assertEqual(err, 0)
+			segs.append(seg)
+
+		# The spanning tree heuristic removes two edges
+		err = overlap_graph_remove_cycles(self.g)
+		self.assertEqual(err, 0)
+
+		self.check_removed_edges(self.g, ["B2 -> C3\n", "C3 -> A1\n"])
+
+		(err, weight) = overlap_graph_get_removed_weight(self.g)
+		self.assertEqual(err, 0)
+		self.assertEqual(weight, 5)
+
+		# The greedy heuristic removes only the lightest edge of the cycles
+		err = overlap_graph_remove_cycles_greedy(self.g)
+		self.assertEqual(err, 0)
+
+		expected_lines = ("0 [label = \"0-1/1\"]\n", "1 [label = \"1-2/0\"]\n",
+				"2 [label = \"2-1/2\"]\n", "3 [label = \"3-0/1\"]\n",
+				"0 -> 1 [label = 5]\n", "1 -> 1 [label = 5]\n",
+				"1 -> 2 [label = 2 style = dotted]\n",
+				"2 -> 0 [label = 3]\n", "2 -> 1 [label = 6]\n",
+				"3 -> 2 [label = 4]\n")
+
+		self.check_dot(self.g, expected_lines)
+
+		self.check_removed_edges(self.g, ["B2 -> C3\n"])
+
+		(err, weight) = overlap_graph_get_removed_weight(self.g)
+		self.assertEqual(err, 0)
+		self.assertEqual(weight, 2)
+
+		for seg in segs:
+			segment_free(seg)
+
 	def testGetRemovedEdges(self):
 		"Get the removed edges of the graph"
 
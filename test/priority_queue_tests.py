@@ -74,6 +74,87 @@ class PriorityQueueTests(unittest.TestCase):
 
 		self.assertEqual(result, "ABCDEFGHIJKLMN")
 
+	def testAddRemoveLarge(self):
+		"""Add objects to the priority queue with priorities that don't fit
+		in 32 bits"""
+
+		data = "NDJBCLAEFIKMHG"
+
+		for c in data:
+			priority_queue_add(self.pq, c, ord(c) << 33, None)
+
+		result_list = []
+
+		while priority_queue_get_size(self.pq)[1] != 0:
+			(err, c) = priority_queue_remove_max(self.pq)
+			result_list.append(c)
+
+		result = ''.join(result_list)
+
+		self.assertEqual(result, "NMLKJIHGFEDCBA")
+
+	def testAddDeferred(self):
+		"Add objects to the priority queue and build the heap at once"
+
+		data = "NDJBCLAEFIKMHGRPOQ"
+
+		for c in data:
+			err = priority_queue_add_deferred(self.pq, c, ord(c), None)
+			self.assertEqual(err, 0)
+
+		(err, size) = priority_queue_get_size(self.pq)
+		self.assertEqual(err, 0)
+		self.assertEqual(size, len(data))
+
+		err = priority_queue_heapify(self.pq)
+		self.assertEqual(err, 0)
+
+		result_list = []
+
+		# Add some more objects normally after the first removal
+		(err, c) = priority_queue_remove_max(self.pq)
+		result_list.append(c)
+
+		for c in "ZST":
+			err = priority_queue_add(self.pq, c, ord(c), None)
+			self.assertEqual(err, 0)
+
+		while priority_queue_get_size(self.pq)[1] != 0:
+			(err, c) = priority_queue_remove_max(self.pq)
+			result_list.append(c)
+
+		result = ''.join(result_list)
+
+		self.assertEqual(result, "RZTSQPONMLKJIHGFEDCBA")
+
+	def testAddDeferredChangeKey(self):
+		"""Change the priorities of objects added without building the heap
+		(the heap is built implicitly on removal)"""
+
+		data = "NDJBCLAEFIKMHG"
+
+		elem_pos = []
+
+		for c in data:
+			x = size_tp();
+			elem_pos.append(x)
+			priority_queue_add_deferred(self.pq, c, ord(c), x)
+
+		# Reverse the priorities of the elements
+		for i in range(len(data)):
+			priority_queue_change_key(self.pq, elem_pos[i].value(),
+					-ord(data[i]))
+
+		result_list = []
+
+		while priority_queue_get_size(self.pq)[1] != 0:
+			(err, c) = priority_queue_remove_max(self.pq)
+			result_list.append(c)
+
+		result = ''.join(result_list)
+
+		self.assertEqual(result, "ABCDEFGHIJKLMN")
+
 	def testChangeKeyDown(self):
 		"Decrease the priority of an element in the priority queue"
 
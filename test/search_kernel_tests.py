@@ -0,0 +1,168 @@
+import unittest
+import random
+import errno
+from libbls import *
+
+# The search kernel implementations to check
+KERNELS = [SEARCH_KERNEL_SCALAR, SEARCH_KERNEL_SSE2, SEARCH_KERNEL_AVX2,
+		SEARCH_KERNEL_BEST]
+
+# The patterns to search for: a single byte, a short pattern whose first
+# and last bytes often match without the middle ones, and a pattern longer
+# than a vector
+PATTERNS = ["b", "abaab",
+		''.join(random.Random(40).choice("ab") for i in range(40))]
+
+def naive_find(data, pattern):
+	"Find the first occurrence of pattern in data, -1 if there is none"
+
+	for i in range(len(data) - len(pattern) + 1):
+		if data[i:i + len(pattern)] == pattern:
+			return i
+
+	return -1
+
+def naive_rfind(data, pattern):
+	"Find the last occurrence of pattern in data, -1 if there is none"
+
+	for i in reversed(range(len(data) - len(pattern) + 1)):
+		if data[i:i + len(pattern)] == pattern:
+			return i
+
+	return -1
+
+def get_searches(kernel_find_aligned):
+	"""
+	Get the searches of the kernels the CPU supports as (name, func) pairs,
+	where func(align, data, pattern) returns (err, index)
+	"""
+
+	searches = []
+
+	for kernel in KERNELS:
+		(err, index) = kernel_find_aligned(kernel, 0, "a", 1, "a", 1)
+		if err == errno.ENOTSUP:
+			continue
+
+		def search(align, data, pattern, kernel=kernel):
+			return kernel_find_aligned(kernel, align, data, len(data),
+					pattern, len(pattern))
+
+		searches.append(("kernel %d" % kernel, search))
+
+	return searches
+
+def bmh_rsearch(align, data, pattern):
+	return search_bmh_rfind_aligned(align, data, len(data), pattern,
+			len(pattern))
+
+class SearchKernelTests(unittest.TestCase):
+
+	def setUp(self):
+		self.rand = random.Random(0)
+		self.searches = get_searches(search_kernel_find_aligned)
+		self.rsearches = get_searches(search_rkernel_find_aligned)
+		self.rsearches.append(("reverse bmh", bmh_rsearch))
+
+	def tearDown(self):
+		pass
+
+	def random_data(self, n):
+		return ''.join(self.rand.choice("ab") for i in range(n))
+
+	def get_cases(self, n, pattern):
+		"Get haystacks of n bytes to search pattern in"
+
+		cases = [self.random_data(n), "c" * n]
+
+		m = len(pattern)
+		if n >= m:
+			# A match at the very first byte
+			cases.append(pattern + self.random_data(n - m))
+			# The only match starting at the very first byte
+			cases.append(pattern + "c" * (n - m))
+			# A match ending at the very last byte
+			cases.append(self.random_data(n - m) + pattern)
+			# The only match ending at the very last byte
+			cases.append("c" * (n - m) + pattern)
+
+		return cases
+
+	def check_searches(self, searches, naive):
+		"Check searches against a naive search"
+
+		for pattern in PATTERNS:
+			# Haystacks shorter than a vector and ones with a full vector
+			# loop, followed by tails of every length
+			for tail in range(64):
+				for n in (tail, 64 + tail):
+					for data in self.get_cases(n, pattern):
+						expected = naive(data, pattern)
+
+						for align in range(32):
+							for (name, search) in searches:
+								(err, index) = search(align, data, pattern)
+								self.assertEqual(err, 0)
+								self.assertEqual(index, expected,
+									"%s, align %d, data %r, pattern %r" %
+									(name, align, data, pattern))
+
+	def check_search(self, searches, data, pattern, expected):
+		for align in range(32):
+			for (name, search) in searches:
+				(err, index) = search(align, data, pattern)
+				self.assertEqual(err, 0)
+				self.assertEqual(index, expected, "%s, align %d" %
+						(name, align))
+
+	def testKernelsFind(self):
+		"Check the search kernels against a naive search"
+
+		self.check_searches(self.searches, naive_find)
+
+	def testKernelsFindEdges(self):
+		"Find matches at the edges of the data"
+
+		data = "abaab" + "c" * 90 + "abaab"
+
+		self.check_search(self.searches, data, "abaab", 0)
+		self.check_search(self.searches, data[1:], "abaab", len(data) - 6)
+
+		# A pattern longer than the data never matches
+		self.check_search(self.searches, data[:4], "abaab", -1)
+		self.check_search(self.searches, "", "a", -1)
+
+	def testReverseFind(self):
+		"Check the reverse searches against a naive search"
+
+		self.check_searches(self.rsearches, naive_rfind)
+
+	def testReverseFindEdges(self):
+		"Find the last matches at the edges of the data"
+
+		data = "abaab" + "c" * 90 + "abaab"
+
+		self.check_search(self.rsearches, data, "abaab", len(data) - 5)
+		self.check_search(self.rsearches, data[:-1], "abaab", 0)
+
+		# A pattern longer than the data never matches
+		self.check_search(self.rsearches, data[:4], "abaab", -1)
+		self.check_search(self.rsearches, "", "a", -1)
+
+	def testReverseFindOverlapping(self):
+		"Find the last of overlapping matches"
+
+		for n in range(2, 100):
+			self.check_search(self.rsearches, "a" * n, "aa", n - 2)
+
+		for n in range(1, 50):
+			data = "ab" * n + "a"
+			self.check_search(self.rsearches, data, "aba", len(data) - 3)
+			self.check_search(self.rsearches, data + "c", "aba",
+					len(data) - 3)
+
+		data = "abaabaabaab" * 5
+		self.check_search(self.rsearches, data, "abaab", len(data) - 5)
+
+if __name__ == '__main__':
+	unittest.main()
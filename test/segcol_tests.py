@@ -91,6 +91,35 @@ class SegcolTestsList(unittest.TestCase):
 			segcol_append(self.segcol, seg_tmp)
 
 		self.check_iter_segments(self.segcol, seg)
+
+	def testIteratorReverse(self):
+		"Traverse an iterator backwards"
+
+		nseg = 100
+
+		for i in xrange(nseg):
+			(err, seg_tmp) = segment_new("%02d" % i, 0, 2, None)
+			segcol_append(self.segcol, seg_tmp)
+
+		iter = segcol_find(self.segcol, 2 * nseg - 1)[1]
+
+		for i in reversed(xrange(nseg)):
+			self.assertEqual(segcol_iter_is_valid(iter)[1], 1)
+			seg_tmp = segcol_iter_get_segment(iter)[1]
+			self.assertEqual(segment_get_data(seg_tmp)[1], "%02d" % i)
+			self.assertEqual(segcol_iter_get_mapping(iter)[1], 2 * i)
+
+			err = segcol_iter_prev(iter)
+			self.assertEqual(err, 0)
+
+		# Moving before the first segment invalidates the iterator
+		self.assertEqual(segcol_iter_is_valid(iter)[1], 0)
+
+		err = segcol_iter_prev(iter)
+		self.assertEqual(err, 0)
+		self.assertEqual(segcol_iter_is_valid(iter)[1], 0)
+
+		segcol_iter_free(iter)
 		
 	def testInsertBeginning(self):
 		"Insert a segment at the beginning of another segment"
@@ -333,6 +362,66 @@ class SegcolTestsList(unittest.TestCase):
 
 		segcol_free(del_segcol)
 
+	def testAppendContiguous(self):
+		"Append contiguous parts of the same data"
+
+		data = "0123456789"
+
+		for i in xrange(5):
+			(err, seg1) = segment_new(data, i * 2, 2, None)
+			self.assertEqual(err, 0)
+			err = segcol_append(self.segcol, seg1)
+			self.assertEqual(err, 0)
+
+		# Segcol should be ["0123456789"]
+		self.check_iter_segments(self.segcol, [(data, 0, 0, 10)])
+
+	def testInsertContiguous(self):
+		"Insert a part of some data between the parts it continues"
+
+		data = "0123456789"
+
+		(err, seg1) = segment_new(data, 0, 3, None)
+		(err, seg2) = segment_new(data, 7, 3, None)
+		(err, seg3) = segment_new(data, 3, 4, None)
+
+		segcol_append(self.segcol, seg1)
+		segcol_append(self.segcol, seg2)
+
+		# Segcol should be ["012"]-["789"]
+		segs = [(data, 0, 0, 3), (data, 3, 7, 3)]
+		self.check_iter_segments(self.segcol, segs)
+
+		err = segcol_insert(self.segcol, 3, seg3)
+		self.assertEqual(err, 0)
+
+		# Segcol should be ["0123456789"]
+		self.check_iter_segments(self.segcol, [(data, 0, 0, 10)])
+
+	def testDeleteContiguous(self):
+		"Delete a range so that contiguous parts of some data become adjacent"
+
+		data = "0123456789"
+
+		(err, seg1) = segment_new(data, 0, 10, None)
+		(err, seg2) = segment_new("abc", 0, 3, None)
+
+		segcol_append(self.segcol, seg1)
+		segcol_insert(self.segcol, 5, seg2)
+
+		# Segcol should be ["01234"]-["abc"]-["56789"]
+		segs = [(data, 0, 0, 5), ("abc", 5, 0, 3), (data, 8, 5, 5)]
+		self.check_iter_segments(self.segcol, segs)
+
+		(err, del_segcol) = segcol_delete(self.segcol, 5, 3)
+		self.assertEqual(err, 0)
+
+		# Segcol should be ["0123456789"]
+		self.check_iter_segments(self.segcol, [(data, 0, 0, 10)])
+		self.check_iter_segments(del_segcol, [("abc", 0, 0, 3)])
+
+		segcol_free(del_segcol)
+
 	def testFindStressTest(self):
 		"Find a segment stress test"
 		
@@ -355,6 +444,40 @@ class SegcolTestsList(unittest.TestCase):
 
 			segcol_iter_free(iter)
 
+	def testFindSkewedStressTest(self):
+		"Find segments of very different sizes in random order"
+
+		data = "a" * 1000
+		segs = []
+		mappings = []
+		mapping = 0
+
+		# Insert segments of 1 and 1000 bytes, in front of each other
+		for i in xrange(500):
+			size = (1, 1000)[i % 2]
+			(err, seg1) = segment_new(data, 0, size, None)
+			segs.insert(0, seg1)
+
+			if i == 0:
+				err = segcol_append(self.segcol, seg1)
+			else:
+				err = segcol_insert(self.segcol, 0, seg1)
+			self.assertEqual(err, 0)
+
+		for seg in segs:
+			mappings.append(mapping)
+			mapping += segment_get_size(seg)[1]
+
+		# Look up the segments out of order
+		for i in range(0, 500, 7) + range(499, 0, -11):
+			offsets = [mappings[i], mappings[i] + segment_get_size(segs[i])[1] - 1]
+			for off in offsets:
+				(err, iter) = segcol_find(self.segcol, off)
+				self.assertEqual(err, 0)
+				self.assertEqual(segcol_iter_get_segment(iter)[1], segs[i])
+				self.assertEqual(segcol_iter_get_mapping(iter)[1], mappings[i])
+				segcol_iter_free(iter)
+
 	def testTryFindInvalidOffset(self):
 		"Try to search for invalid offsets"
 
@@ -480,5 +603,97 @@ class SegcolTestsList(unittest.TestCase):
 		(err, deleted) = segcol_delete(self.segcol, get_max_off_t(), 2)
 		self.assertNotEqual(err, 0)
 
+class SegcolTestsTree(SegcolTestsList):
+
+	def setUp(self):
+		(err, self.segcol) = segcol_tree_new()
+		self.assertEqual(err, 0)
+
+class SegcolTestsBtree(SegcolTestsList):
+
+	def setUp(self):
+		(err, self.segcol) = segcol_btree_new()
+		self.assertEqual(err, 0)
+
+class SegcolListCacheTests(unittest.TestCase):
+
+	def setUp(self):
+		(err, self.segcol) = segcol_list_new()
+		self.assertEqual(err, 0)
+
+		# 100 segments of 10 bytes each (of different data, so that they
+		# are not merged)
+		self.data = ["%010d" % i for i in range(100)]
+		for i in range(100):
+			(err, seg) = segment_new(self.data[i], 0, 10, None)
+			self.assertEqual(err, 0)
+			err = segcol_append(self.segcol, seg)
+			self.assertEqual(err, 0)
+
+	def tearDown(self):
+		segcol_free(self.segcol)
+
+	def find_mapping(self, offset):
+		(err, iter) = segcol_find(self.segcol, offset)
+		self.assertEqual(err, 0)
+		(err, mapping) = segcol_iter_get_mapping(iter)
+		self.assertEqual(err, 0)
+		segcol_iter_free(iter)
+		return mapping
+
+	def testCacheMultipleRegions(self):
+		"Search alternately in different regions of the segcol"
+
+		(err, hits, misses) = segcol_list_get_cache_stats(self.segcol)
+		self.assertEqual(err, 0)
+		self.assertEqual((hits, misses), (0, 0))
+
+		# The first search in each region starts from the head or tail
+		self.assertEqual(self.find_mapping(300), 300)
+		self.assertEqual(self.find_mapping(505), 500)
+		self.assertEqual(self.find_mapping(700), 700)
+
+		(err, hits, misses) = segcol_list_get_cache_stats(self.segcol)
+		self.assertEqual(err, 0)
+		self.assertEqual(hits + misses, 3)
+
+		# Further searches in the regions should all be hits
+		for i in range(10):
+			self.assertEqual(self.find_mapping(310 + i * 10), 310 + i * 10)
+			self.assertEqual(self.find_mapping(510 + i * 10), 510 + i * 10)
+			self.assertEqual(self.find_mapping(710 + i * 10), 710 + i * 10)
+
+		(err, hits1, misses1) = segcol_list_get_cache_stats(self.segcol)
+		self.assertEqual(err, 0)
+		self.assertEqual(hits1, hits + 30)
+		self.assertEqual(misses1, misses)
+
+	def testCacheAfterEdits(self):
+		"Search cached regions after inserting and deleting"
+
+		self.assertEqual(self.find_mapping(300), 300)
+		self.assertEqual(self.find_mapping(700), 700)
+
+		# Insert before the cached positions
+		(err, seg) = segment_new("abcde", 0, 5, None)
+		self.assertEqual(err, 0)
+		err = segcol_insert(self.segcol, 102, seg)
+		self.assertEqual(err, 0)
+
+		self.assertEqual(self.find_mapping(305), 305)
+		self.assertEqual(self.find_mapping(705), 705)
+
+		# Delete a range containing one of the cached positions
+		(err, deleted) = segcol_delete(self.segcol, 290, 30)
+		self.assertEqual(err, 0)
+		segcol_free(deleted)
+
+		self.assertEqual(self.find_mapping(289), 285)
+		self.assertEqual(self.find_mapping(290), 290)
+		self.assertEqual(self.find_mapping(295), 295)
+		self.assertEqual(self.find_mapping(675), 675)
+		self.assertEqual(self.find_mapping(0), 0)
+		self.assertEqual(self.find_mapping(1000 + 5 - 30 - 1), 965)
+
 if __name__ == '__main__':
 	unittest.main()
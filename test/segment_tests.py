@@ -156,6 +156,10 @@ class SegmentTests(unittest.TestCase):
 		err = segment_merge(self.seg, seg1)
 		self.assertEqual(err, errno.EOVERFLOW)
 
+		(err, can_merge) = segment_can_merge(self.seg, seg1)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_merge, 0)
+
 		# This should succeed
 		err = segment_set_range(seg1, 1, get_max_off_t() - 1)
 		self.assertEqual(err, 0)
@@ -165,6 +169,37 @@ class SegmentTests(unittest.TestCase):
 
 		segment_free(seg1)
 
+	def testCanMerge(self):
+		"Check whether segments can be merged"
+
+		err = segment_set_range(self.seg, 0, 10)
+		self.assertEqual(err, 0)
+
+		(err, seg1) = segment_copy(self.seg)
+		self.assertEqual(err, 0)
+
+		# Not a continuation
+		(err, can_merge) = segment_can_merge(self.seg, seg1)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_merge, 0)
+
+		err = segment_set_range(seg1, 10, 5)
+		self.assertEqual(err, 0)
+
+		(err, can_merge) = segment_can_merge(self.seg, seg1)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_merge, 1)
+
+		# Different data
+		err = segment_set_data(seg1, "def", None)
+		self.assertEqual(err, 0)
+
+		(err, can_merge) = segment_can_merge(self.seg, seg1)
+		self.assertEqual(err, 0)
+		self.assertEqual(can_merge, 0)
+
+		segment_free(seg1)
+
 	def testRangeOverflow(self):
 		"Try boundary conditions for overflow"
 